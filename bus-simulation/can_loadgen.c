@@ -0,0 +1,410 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#define MAX_INTERFACES 16
+#define MAX_MATRIX_ENTRIES 4096
+
+// Pacing lateness histogram: 1us buckets, last bucket collects everything above
+#define JITTER_BUCKETS 1000
+
+// Flag for stopping all generator threads
+static volatile int running = 1;
+
+// One line of the communication matrix
+typedef struct {
+    canid_t can_id;
+    uint8_t dlc;
+    uint32_t weight;
+} matrix_entry_t;
+
+// Generator settings shared by all interfaces
+typedef struct {
+    double rate;            // Frames per second per interface within a burst
+    uint32_t bitrate;       // Bus bitrate used to derive the saturation rate
+    uint32_t burst;         // Frames per burst
+    uint64_t burst_gap_ns;  // Idle time after each burst
+    uint64_t duration_ns;   // Run time, 0 = until interrupted
+    uint64_t count;         // Frames per interface, 0 = unlimited
+    uint64_t spin_ns;       // Busy-wait window before each deadline
+    uint64_t seed;
+    matrix_entry_t matrix[MAX_MATRIX_ENTRIES];
+    uint64_t cumulative[MAX_MATRIX_ENTRIES];  // Running sum of weights
+    size_t matrix_size;
+} loadgen_config_t;
+
+// Per-interface generator state and results
+typedef struct {
+    const loadgen_config_t *config;
+    char ifname[IFNAMSIZ];
+    int socket;             // -1 for the "null" interface (frames are discarded)
+    uint64_t rng;
+    pthread_t thread;
+
+    uint64_t sent;
+    uint64_t tx_errors;     // Frames rejected by the socket (e.g. TX queue full)
+    uint64_t elapsed_ns;
+    uint64_t late_sum_ns;
+    uint64_t late_max_ns;
+    uint64_t histogram[JITTER_BUCKETS];
+} loadgen_thread_t;
+
+static loadgen_config_t config;
+static loadgen_thread_t threads[MAX_INTERFACES];
+
+static void signal_handler(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// xorshift64* generator, reproducible per interface for a given seed
+static inline uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+// Worst-case bits on the wire for a frame, including stuff bits
+static double frame_bits(uint8_t dlc, int extended) {
+    double bits = (extended ? 67.0 : 47.0) + 8.0 * dlc;
+    return bits + (bits - 13.0) / 4.0;
+}
+
+// Sleep until shortly before the deadline, then spin to hit it precisely
+static void wait_until(uint64_t deadline, uint64_t spin_ns) {
+    if (deadline > spin_ns) {
+        uint64_t sleep_until = deadline - spin_ns;
+        if (now_ns() < sleep_until) {
+            struct timespec ts;
+            ts.tv_sec = (time_t)(sleep_until / 1000000000ull);
+            ts.tv_nsec = (long)(sleep_until % 1000000000ull);
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && running) {
+            }
+        }
+    }
+
+    while (now_ns() < deadline) {
+    }
+}
+
+// Pick an ID/DLC pair according to the matrix weights
+static const matrix_entry_t *pick_entry(loadgen_thread_t *t) {
+    const loadgen_config_t *cfg = t->config;
+    uint64_t total = cfg->cumulative[cfg->matrix_size - 1];
+    uint64_t r = next_random(&t->rng) % total;
+
+    size_t low = 0;
+    size_t high = cfg->matrix_size - 1;
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        if (cfg->cumulative[mid] > r) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return &cfg->matrix[low];
+}
+
+static void *generator_thread(void *arg) {
+    loadgen_thread_t *t = (loadgen_thread_t *)arg;
+    const loadgen_config_t *cfg = t->config;
+    uint64_t period_ns = (uint64_t)(1e9 / cfg->rate);
+    struct can_frame frame;
+
+    uint64_t start = now_ns();
+    uint64_t deadline = start;
+    uint64_t end = cfg->duration_ns ? start + cfg->duration_ns : UINT64_MAX;
+
+    while (running && deadline < end && (cfg->count == 0 || t->sent + t->tx_errors < cfg->count)) {
+        wait_until(deadline, cfg->spin_ns);
+
+        uint64_t late = now_ns() - deadline;
+        t->late_sum_ns += late;
+        if (late > t->late_max_ns) {
+            t->late_max_ns = late;
+        }
+        uint64_t bucket = late / 1000;
+        t->histogram[bucket < JITTER_BUCKETS ? bucket : JITTER_BUCKETS - 1]++;
+
+        const matrix_entry_t *entry = pick_entry(t);
+        memset(&frame, 0, sizeof(frame));
+        frame.can_id = entry->can_id;
+        frame.can_dlc = entry->dlc;
+        uint64_t payload = next_random(&t->rng);
+        memcpy(frame.data, &payload, sizeof(frame.data));
+        if (frame.can_dlc > 0) {
+            frame.data[0] = (uint8_t)(t->sent + t->tx_errors);
+        }
+
+        if (t->socket < 0 || write(t->socket, &frame, sizeof(frame)) == (ssize_t)sizeof(frame)) {
+            t->sent++;
+        } else {
+            t->tx_errors++;
+        }
+
+        // Next deadline is absolute so pacing errors do not accumulate
+        uint64_t n = t->sent + t->tx_errors;
+        deadline += period_ns;
+        if (n % cfg->burst == 0) {
+            deadline += cfg->burst_gap_ns;
+        }
+    }
+
+    t->elapsed_ns = now_ns() - start;
+    return NULL;
+}
+
+static int open_interface(loadgen_thread_t *t) {
+    struct sockaddr_can addr;
+    struct ifreq ifr;
+
+    if (strcmp(t->ifname, "null") == 0) {
+        t->socket = -1;
+        return 0;
+    }
+
+    if ((t->socket = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+        perror("Error while opening socket");
+        return -1;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", t->ifname);
+    if (ioctl(t->socket, SIOCGIFINDEX, &ifr) < 0) {
+        fprintf(stderr, "Error in ioctl for %s: %s\n", t->ifname, strerror(errno));
+        close(t->socket);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(t->socket, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "Error in socket bind for %s: %s\n", t->ifname, strerror(errno));
+        close(t->socket);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Matrix file: one "<id> <dlc> <weight>" per line, '#' starts a comment.
+// IDs above 0x7FF or with an 'x' suffix are sent as extended frames.
+static int load_matrix(loadgen_config_t *cfg, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror("Error opening matrix file");
+        return -1;
+    }
+
+    char line[256];
+    int lineno = 0;
+    cfg->matrix_size = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        lineno++;
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        char id_text[32];
+        unsigned dlc;
+        unsigned weight = 1;
+        int fields = sscanf(line, "%31s %u %u", id_text, &dlc, &weight);
+        if (fields <= 0) {
+            continue;
+        }
+        if (fields < 2 || dlc > 8 || weight == 0 || cfg->matrix_size == MAX_MATRIX_ENTRIES) {
+            fprintf(stderr, "%s:%d: invalid matrix entry\n", path, lineno);
+            fclose(file);
+            return -1;
+        }
+
+        char *end;
+        unsigned long id = strtoul(id_text, &end, 0);
+        int extended = (*end == 'x' || *end == 'X' || id > CAN_SFF_MASK);
+
+        matrix_entry_t *entry = &cfg->matrix[cfg->matrix_size++];
+        entry->can_id = extended ? ((canid_t)(id & CAN_EFF_MASK) | CAN_EFF_FLAG) : (canid_t)id;
+        entry->dlc = (uint8_t)dlc;
+        entry->weight = weight;
+    }
+
+    fclose(file);
+    if (cfg->matrix_size == 0) {
+        fprintf(stderr, "%s: matrix is empty\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static uint64_t percentile_us(const loadgen_thread_t *t, double fraction) {
+    uint64_t total = 0;
+    for (int i = 0; i < JITTER_BUCKETS; i++) {
+        total += t->histogram[i];
+    }
+
+    uint64_t target = (uint64_t)(total * fraction);
+    uint64_t seen = 0;
+    for (int i = 0; i < JITTER_BUCKETS; i++) {
+        seen += t->histogram[i];
+        if (seen > target) {
+            return (uint64_t)i;
+        }
+    }
+    return JITTER_BUCKETS;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -i IFACES   comma-separated CAN interfaces, one thread each (default can0,\n"
+            "              \"null\" discards frames to measure pacing only)\n"
+            "  -r RATE     frames per second per interface, 0 = bus saturation (default 100)\n"
+            "  -b BITRATE  bus bitrate for the saturation rate (default 500000)\n"
+            "  -m FILE     ID/DLC matrix file (default 0x123 with DLC 8)\n"
+            "  -n BURST    frames per burst (default 1)\n"
+            "  -g GAP_US   idle time after each burst in microseconds (default 0)\n"
+            "  -t SECONDS  run time, 0 = until interrupted (default 10)\n"
+            "  -c COUNT    frames per interface, 0 = unlimited (default 0)\n"
+            "  -S SPIN_US  busy-wait window before each deadline (default 50)\n"
+            "  -s SEED     random seed (default 1)\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    char interfaces[512] = "can0";
+    const char *matrix_path = NULL;
+    int opt;
+
+    config.rate = 100.0;
+    config.bitrate = 500000;
+    config.burst = 1;
+    config.duration_ns = 10000000000ull;
+    config.spin_ns = 50000;
+    config.seed = 1;
+
+    while ((opt = getopt(argc, argv, "i:r:b:m:n:g:t:c:S:s:h")) != -1) {
+        switch (opt) {
+            case 'i': snprintf(interfaces, sizeof(interfaces), "%s", optarg); break;
+            case 'r': config.rate = strtod(optarg, NULL); break;
+            case 'b': config.bitrate = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'm': matrix_path = optarg; break;
+            case 'n': config.burst = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'g': config.burst_gap_ns = strtoull(optarg, NULL, 10) * 1000ull; break;
+            case 't': config.duration_ns = (uint64_t)(strtod(optarg, NULL) * 1e9); break;
+            case 'c': config.count = strtoull(optarg, NULL, 10); break;
+            case 'S': config.spin_ns = strtoull(optarg, NULL, 10) * 1000ull; break;
+            case 's': config.seed = strtoull(optarg, NULL, 10); break;
+            default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+
+    if (config.burst == 0 || config.rate < 0.0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (matrix_path) {
+        if (load_matrix(&config, matrix_path) != 0) {
+            return EXIT_FAILURE;
+        }
+    } else {
+        config.matrix[0].can_id = 0x123;
+        config.matrix[0].dlc = 8;
+        config.matrix[0].weight = 1;
+        config.matrix_size = 1;
+    }
+
+    // Weighted average frame length determines how fast the bus can go
+    uint64_t total_weight = 0;
+    double weighted_bits = 0.0;
+    for (size_t i = 0; i < config.matrix_size; i++) {
+        total_weight += config.matrix[i].weight;
+        config.cumulative[i] = total_weight;
+        weighted_bits += config.matrix[i].weight *
+                         frame_bits(config.matrix[i].dlc, (config.matrix[i].can_id & CAN_EFF_FLAG) != 0);
+    }
+    double saturation = config.bitrate / (weighted_bits / total_weight);
+    if (config.rate == 0.0 || config.rate > saturation) {
+        config.rate = saturation;
+    }
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    // Open every interface before starting, so all threads start together
+    int count = 0;
+    for (char *name = strtok(interfaces, ","); name && count < MAX_INTERFACES; name = strtok(NULL, ",")) {
+        loadgen_thread_t *t = &threads[count];
+        t->config = &config;
+        snprintf(t->ifname, sizeof(t->ifname), "%s", name);
+        t->rng = (config.seed + 1) * 0x9E3779B97F4A7C15ull + (uint64_t)count;
+        if (open_interface(t) != 0) {
+            for (int i = 0; i < count; i++) {
+                if (threads[i].socket >= 0) {
+                    close(threads[i].socket);
+                }
+            }
+            return EXIT_FAILURE;
+        }
+        count++;
+    }
+
+    printf("Generating %.1f frames/s (saturation %.1f at %u bit/s) on %d interface(s), burst %u, gap %llu us\n",
+           config.rate, saturation, config.bitrate, count, config.burst,
+           (unsigned long long)(config.burst_gap_ns / 1000));
+
+    for (int i = 0; i < count; i++) {
+        if (pthread_create(&threads[i].thread, NULL, generator_thread, &threads[i]) != 0) {
+            perror("Error starting generator thread");
+            running = 0;
+            count = i;
+            break;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        loadgen_thread_t *t = &threads[i];
+        pthread_join(t->thread, NULL);
+
+        uint64_t frames = t->sent + t->tx_errors;
+        double seconds = t->elapsed_ns / 1e9;
+        printf("%s: sent %llu, tx errors %llu, achieved %.1f frames/s, "
+               "lateness mean %.1f us, p99 %llu us, max %.1f us\n",
+               t->ifname, (unsigned long long)t->sent, (unsigned long long)t->tx_errors,
+               seconds > 0.0 ? t->sent / seconds : 0.0,
+               frames ? (t->late_sum_ns / 1e3) / frames : 0.0,
+               (unsigned long long)percentile_us(t, 0.99), t->late_max_ns / 1e3);
+
+        if (t->socket >= 0) {
+            close(t->socket);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,15 +1,28 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "pcie_common.h"
 #include "pcie_client.h"
+#include "pcie_crc32c.h"
+
+// Default location of the PCI device resources
+#define PCIE_SYSFS_DEVICES "/sys/bus/pci/devices"
+
+// Interval between peer checks during the start-up handshake
+#define HANDSHAKE_POLL_NS 1000000
 
 // Global configuration for the PCIe client
-static pcie_config_t g_config = {NULL, NULL, NULL};
+static pcie_config_t g_config = {NULL, NULL, NULL, NULL};
 
 // Track initialization state
 static int g_initialized = 0;
 
+// Report of the last eager start-up
+static pcie_client_startup_t g_startup;
+
 // Internal helper function to load environment variables
 static int load_env_variables() {
     const char *device_id = getenv("PCIE_DEVICE_ID");
@@ -25,6 +38,7 @@ static int load_env_variables() {
     g_config.device_id = device_id;
     g_config.vendor_id = vendor_id;
     g_config.subsystem_id = subsystem_id;
+    g_config.sysfs_root = getenv("PCIE_SYSFS_ROOT") ? getenv("PCIE_SYSFS_ROOT") : PCIE_SYSFS_DEVICES;
 
     pcie_log("Client", "Environment variables loaded successfully.");
     return 0;
@@ -44,11 +58,137 @@ int pcie_client_init() {
     // Set initialization flag
     g_initialized = 1;
     
-    // Placeholder for actual initialization logic
+    // Optionally pay the device set-up cost now instead of on the first message
+    const char *eager = getenv("PCIE_EAGER_INIT");
+    if (eager != NULL && strcmp(eager, "0") != 0) {
+        const char *timeout = getenv("PCIE_HANDSHAKE_TIMEOUT_MS");
+        uint32_t handshake_ms = timeout ? (uint32_t)strtoul(timeout, NULL, 10) : 0;
+        if (pcie_client_start(handshake_ms, NULL) < 0) {
+            pcie_client_cleanup();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// Check a hexadecimal ID such as 0x1234
+static int valid_hex_id(const char *value) {
+    char *end = NULL;
+    strtoul(value, &end, 16);
+    return end != value && *end == '\0';
+}
+
+// Check the configuration before touching any device
+static int validate_config() {
+    unsigned int domain, bus, device, function;
+    char extra;
+    
+    // Domain:bus:device.function, e.g. 0000:01:00.0
+    if (sscanf(g_config.device_id, "%x:%x:%x.%x%c", &domain, &bus, &device, &function, &extra) != 4 ||
+        bus > 0xFF || device > 0x1F || function > 7) {
+        pcie_log("Client", "Error: PCIE_DEVICE_ID is not a PCI address (DDDD:BB:DD.F).");
+        return -1;
+    }
+    if (!valid_hex_id(g_config.vendor_id) || !valid_hex_id(g_config.subsystem_id)) {
+        pcie_log("Client", "Error: PCIE_VENDOR_ID and PCIE_SUBSYSTEM_ID must be hexadecimal.");
+        return -1;
+    }
+    return 0;
+}
 
+// Start-up phases, filling g_startup as they complete
+static int run_startup(uint32_t handshake_timeout_ms) {
+    uint64_t phase = pcie_time_ns();
+    if (validate_config() != 0) {
+        return -1;
+    }
+    g_startup.validate_ns = pcie_time_ns() - phase;
+    
+    phase = pcie_time_ns();
+    if (pcie_sender_open() != 0) {
+        return -1;
+    }
+    g_startup.tx_open_ns = pcie_time_ns() - phase;
+    
+    phase = pcie_time_ns();
+    if (pcie_receiver_open() != 0) {
+        // Do not leave the transmit BAR mapped behind a failed start-up
+        pcie_sender_cleanup();
+        return -1;
+    }
+    g_startup.rx_open_ns = pcie_time_ns() - phase;
+    
+    // Select the CRC implementation (and build its tables) and take the
+    // first clock and ring reads off the data path
+    phase = pcie_time_ns();
+    uint8_t probe[64] = {0};
+    (void)pcie_crc32c(probe, sizeof(probe));
+    g_startup.peer_ready = pcie_receiver_peer_ready();
+    g_startup.warmup_ns = pcie_time_ns() - phase;
+    
+    if (handshake_timeout_ms == 0) {
+        return 0;
+    }
+    
+    // The peer is up once it has formatted the ring we receive from and
+    // echoed the generation of the ring we just formatted
+    phase = pcie_time_ns();
+    uint64_t deadline = phase + (uint64_t)handshake_timeout_ms * 1000000ull;
+    struct timespec pause = {0, HANDSHAKE_POLL_NS};
+    while (!(g_startup.peer_ready = pcie_receiver_peer_ready()) && pcie_time_ns() < deadline) {
+        nanosleep(&pause, NULL);
+    }
+    g_startup.handshake_ns = pcie_time_ns() - phase;
+    
+    if (!g_startup.peer_ready) {
+        pcie_log("Client", "Peer did not format its ring before the handshake timeout.");
+        return PCIE_CLIENT_NO_PEER;
+    }
     return 0;
 }
 
+// Eager start-up: validate, open and warm up everything before the first message
+int pcie_client_start(uint32_t handshake_timeout_ms, pcie_client_startup_t *report) {
+    if (!g_initialized) {
+        pcie_log("Client", "Error: PCIe client not initialized.");
+        return -1;
+    }
+    
+    memset(&g_startup, 0, sizeof(g_startup));
+    uint64_t start = pcie_time_ns();
+    int ret = run_startup(handshake_timeout_ms);
+    g_startup.total_ns = pcie_time_ns() - start;
+    
+    if (report) {
+        *report = g_startup;
+    }
+    if (ret < 0) {
+        pcie_log("Client", "Error: Eager start-up failed.");
+        return ret;
+    }
+    
+    pcie_log("Client", "Start-up complete:");
+    printf("Validate: %.1f us, TX open: %.1f us, RX open: %.1f us, warm-up: %.1f us, handshake: %.1f us\n",
+           g_startup.validate_ns / 1e3, g_startup.tx_open_ns / 1e3, g_startup.rx_open_ns / 1e3,
+           g_startup.warmup_ns / 1e3, g_startup.handshake_ns / 1e3);
+    printf("Total: %.3f ms, peer %s\n", g_startup.total_ns / 1e6, g_startup.peer_ready ? "ready" : "not ready");
+    
+    // Warn when the gateway missed its start-up budget
+    const char *budget = getenv("PCIE_STARTUP_BUDGET_MS");
+    if (budget != NULL && g_startup.total_ns > strtoull(budget, NULL, 10) * 1000000ull) {
+        pcie_log("Client", "Warning: Start-up exceeded PCIE_STARTUP_BUDGET_MS.");
+    }
+    return ret;
+}
+
+// Report of the last eager start-up
+void pcie_client_get_startup(pcie_client_startup_t *report) {
+    if (report) {
+        *report = g_startup;
+    }
+}
+
 // Get PCIe client configuration
 const pcie_config_t* pcie_client_get_config() {
     if (!g_initialized) {
@@ -62,6 +202,16 @@ int pcie_client_is_initialized() {
     return g_initialized;
 }
 
+// Get flow control counters of both link directions
+void pcie_client_get_flow_stats(pcie_flow_stats_t *tx_stats, pcie_flow_stats_t *rx_stats) {
+    if (tx_stats) {
+        pcie_sender_get_stats(tx_stats);
+    }
+    if (rx_stats) {
+        pcie_receiver_get_stats(rx_stats);
+    }
+}
+
 // Cleanup the PCIe client
 void pcie_client_cleanup() {
     pcie_log("Client", "Cleaning up PCIe client.");
@@ -74,4 +224,5 @@ void pcie_client_cleanup() {
     
     // Reset initialization flag
     g_initialized = 0;
+    memset(&g_startup, 0, sizeof(g_startup));
 }
\ No newline at end of file
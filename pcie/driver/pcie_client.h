@@ -2,6 +2,12 @@
 #define PCIE_CLIENT_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include "pcie_flow.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 // Client initialization and cleanup
 int pcie_client_init();
@@ -14,18 +20,97 @@ int pcie_client_is_initialized();
 int pcie_client_send(const char *message);
 int pcie_client_receive(char *buffer, size_t buffer_size);
 
-// Internal cleanup functions
+// Default time a receive waits for the peer
+#define PCIE_CLIENT_RECEIVE_TIMEOUT_US 100000
+
+// Binary transfer with credit-based flow control.
+// Send returns PCIE_FLOW_DROPPED if the overflow policy discarded the message,
+// receive returns PCIE_FLOW_EMPTY if no new message arrived within the
+// receive timeout. Messages larger than the receive buffer are discarded and
+// counted in the oversized flow statistic.
+int pcie_client_send_buffer(const void *data, size_t length, uint32_t priority);
+int pcie_client_receive_buffer(void *buffer, size_t buffer_size, size_t *received);
+
+// Receive up to max_count messages into buffers spaced stride bytes apart,
+// waiting up to the receive timeout for the first one. Returns the number of
+// messages stored (lengths in lengths), 0 on timeout or -1. Messages larger
+// than stride are discarded and counted as oversized.
+int pcie_client_receive_batch(void *buffers, size_t stride, size_t max_count, size_t *lengths);
+
+// View of the next received message without copying it, waiting up to the
+// receive timeout like pcie_client_receive_buffer(). The data stays valid and
+// the message stays pending until pcie_client_consume_buffer() or the next
+// receive call. Returns 0, PCIE_FLOW_EMPTY or -1.
+int pcie_client_peek_buffer(const void **data, size_t *length);
+void pcie_client_consume_buffer(void);
+
+// Set the receive timeout (0 checks once without waiting); loops with other
+// deadlines bound the wait by the next one
+int pcie_client_set_receive_timeout(uint32_t timeout_us);
+
+// Flow control configuration and loss counters
+int pcie_client_set_flow_policy(uint32_t priority_class, pcie_flow_policy_t policy, uint32_t timeout_us);
+int pcie_client_set_flow_crc(int enabled);
+void pcie_client_get_flow_stats(pcie_flow_stats_t *tx_stats, pcie_flow_stats_t *rx_stats);
+
+// Rings of the client link for callers that drive them directly, such as an
+// event loop; opens the BAR on first use and returns NULL on error. Do not
+// mix direct receives with pcie_client_receive_buffer(), which may hold
+// messages it already took off the ring.
+pcie_flow_t *pcie_client_tx_flow(void);
+pcie_flow_t *pcie_client_rx_flow(void);
+
+// Internal open, readiness and cleanup functions
+int pcie_sender_open();
+int pcie_receiver_open();
+int pcie_receiver_peer_ready();
+pcie_flow_t *pcie_sender_flow(void);
 void pcie_sender_cleanup();
 void pcie_receiver_cleanup();
+void pcie_sender_get_stats(pcie_flow_stats_t *stats);
+void pcie_receiver_get_stats(pcie_flow_stats_t *stats);
 
 // Configuration
 typedef struct {
     const char* device_id;
     const char* vendor_id;
     const char* subsystem_id;
+    const char* sysfs_root;       // PCIE_SYSFS_ROOT, defaults to /sys/bus/pci/devices
 } pcie_config_t;
 
 // Get current PCIe configuration
 const pcie_config_t* pcie_client_get_config();
 
+// Return code of pcie_client_start() when the peer did not show up in time
+#define PCIE_CLIENT_NO_PEER 1
+
+// Duration of each start-up phase in nanoseconds
+typedef struct {
+    uint64_t validate_ns;     // Configuration checks
+    uint64_t tx_open_ns;      // Open, map and pre-fault the transmit BAR, format the ring
+    uint64_t rx_open_ns;      // Open, map and pre-fault the receive BAR, attach to the ring
+    uint64_t warmup_ns;       // First calls into the CRC and clock code paths
+    uint64_t handshake_ns;    // Waiting for the peer (0 if not requested)
+    uint64_t total_ns;
+    int peer_ready;           // The peer has formatted its transmit ring and acknowledged ours
+} pcie_client_startup_t;
+
+// Eager start-up after pcie_client_init(): validate the configuration, open
+// and map both BARs with the pages faulted in, and warm up the data path so
+// the first message is not an outlier. With a handshake timeout > 0 it also
+// waits for the peer. Returns 0, PCIE_CLIENT_NO_PEER if the handshake timed
+// out, or -1 on error. The report may be NULL.
+//
+// pcie_client_init() runs this itself when PCIE_EAGER_INIT=1, with the
+// handshake timeout taken from PCIE_HANDSHAKE_TIMEOUT_MS. Without it the
+// BARs are still opened on the first send or receive.
+int pcie_client_start(uint32_t handshake_timeout_ms, pcie_client_startup_t *report);
+
+// Report of the last pcie_client_start(), all zero if it never ran
+void pcie_client_get_startup(pcie_client_startup_t *report);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif // PCIE_CLIENT_H
\ No newline at end of file
@@ -2,9 +2,61 @@
 #define PCIE_COMMON_H
 
 #include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 #define BUFFER_SIZE 256
 
+// Monotonic timestamp in nanoseconds
+static inline uint64_t pcie_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Read one byte per page so a fresh mapping is faulted in before the data path
+// touches it. Reads only: device registers must not see stray writes.
+static inline void pcie_prefault(const void *region, size_t size) {
+    const volatile uint8_t *bytes = (const volatile uint8_t *)region;
+    for (size_t offset = 0; offset < size; offset += 4096) {
+        (void)bytes[offset];
+    }
+}
+
+// Ordered access to 64-bit counters shared with another thread or the peer.
+//
+// Shared records without locks (flow ring slots, broadcast slots, signal
+// store entries) carry a sequence counter: the writer makes it odd, updates
+// the record and makes it even again with a release store. A reader copies
+// the record between two acquire loads of the counter and discards the copy
+// if the counter was odd or changed.
+static inline uint64_t pcie_load_acquire(const uint64_t *ptr) {
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void pcie_store_release(uint64_t *ptr, uint64_t value) {
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+// Tell the CPU the caller is spinning on shared memory
+static inline void pcie_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+// Multiplicative hash spreading consecutive IDs over a power-of-two table
+static inline uint32_t pcie_hash_id(uint32_t id) {
+    return (id * 2654435761u) >> 7;
+}
+
 // Common logging function for all PCIe components
 static inline void pcie_log(const char *component, const char *message) {
     if (message) {
@@ -12,4 +64,8 @@ static inline void pcie_log(const char *component, const char *message) {
     }
 }
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // PCIE_COMMON_H
\ No newline at end of file
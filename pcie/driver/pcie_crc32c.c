@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "pcie_crc32c.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#elif defined(__aarch64__) && defined(__linux__)
+// The CRC extension is optional in ARMv8.0, so the baseline compiler target
+// (armv8-a) does not enable it. Build the ARMv8 path for it regardless and
+// select it at run time from the HWCAP bits, like the SSE4.2 path.
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define CRC32C_HAVE_ARMV8 1
+#ifdef __clang__
+#define CRC32C_TARGET_ARMV8 __attribute__((target("crc")))
+#else
+#define CRC32C_TARGET_ARMV8 __attribute__((target("+crc")))
+#endif
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+// Reflected Castagnoli polynomial
+#define CRC32C_POLY 0x82F63B78u
+
+typedef uint32_t (*crc_update_fn)(uint32_t crc, const uint8_t *data, size_t length);
+typedef void (*crc_batch_fn)(uint32_t *crcs, const void *const *data, const size_t *lengths, size_t count);
+
+// Slicing-by-8 tables for the portable path, built on first use
+static uint32_t crc_table[8][256];
+
+static crc_update_fn g_crc_update = NULL;
+static crc_batch_fn g_crc_batch = NULL;
+static const char *g_crc_impl = "portable";
+
+static inline uint64_t load_u64(const uint8_t *p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static void build_tables(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (CRC32C_POLY & (0u - (crc & 1)));
+        }
+        crc_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            crc_table[k][i] = (crc_table[k - 1][i] >> 8) ^ crc_table[0][crc_table[k - 1][i] & 0xFF];
+        }
+    }
+}
+
+static uint32_t crc_update_portable(uint32_t crc, const uint8_t *p, size_t length) {
+    while (length >= 8) {
+        // Little-endian word order as it appears on the wire
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        uint32_t hi = (uint32_t)p[4] | (uint32_t)p[5] << 8 | (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+        crc = crc_table[7][lo & 0xFF] ^ crc_table[6][(lo >> 8) & 0xFF] ^
+              crc_table[5][(lo >> 16) & 0xFF] ^ crc_table[4][lo >> 24] ^
+              crc_table[3][hi & 0xFF] ^ crc_table[2][(hi >> 8) & 0xFF] ^
+              crc_table[1][(hi >> 16) & 0xFF] ^ crc_table[0][hi >> 24];
+        p += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+static void crc_batch_portable(uint32_t *crcs, const void *const *data, const size_t *lengths, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        crcs[i] = crc_update_portable(crcs[i], (const uint8_t *)data[i], lengths[i]);
+    }
+}
+
+#ifdef CRC32C_HAVE_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc_update_sse42(uint32_t crc, const uint8_t *p, size_t length) {
+    uint64_t crc64 = crc;
+    while (length >= 8) {
+        crc64 = _mm_crc32_u64(crc64, load_u64(p));
+        p += 8;
+        length -= 8;
+    }
+    crc = (uint32_t)crc64;
+    while (length--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+
+__attribute__((target("sse4.2")))
+static void crc_batch_sse42(uint32_t *crcs, const void *const *data, const size_t *lengths, size_t count) {
+    size_t i = 0;
+
+    // Three independent dependency chains keep the CRC unit busy
+    for (; i + 3 <= count; i += 3) {
+        const uint8_t *a = (const uint8_t *)data[i];
+        const uint8_t *b = (const uint8_t *)data[i + 1];
+        const uint8_t *c = (const uint8_t *)data[i + 2];
+        size_t common = lengths[i];
+        if (lengths[i + 1] < common) common = lengths[i + 1];
+        if (lengths[i + 2] < common) common = lengths[i + 2];
+        common &= ~(size_t)7;
+
+        uint64_t crc_a = crcs[i], crc_b = crcs[i + 1], crc_c = crcs[i + 2];
+        for (size_t off = 0; off < common; off += 8) {
+            crc_a = _mm_crc32_u64(crc_a, load_u64(a + off));
+            crc_b = _mm_crc32_u64(crc_b, load_u64(b + off));
+            crc_c = _mm_crc32_u64(crc_c, load_u64(c + off));
+        }
+
+        crcs[i] = crc_update_sse42((uint32_t)crc_a, a + common, lengths[i] - common);
+        crcs[i + 1] = crc_update_sse42((uint32_t)crc_b, b + common, lengths[i + 1] - common);
+        crcs[i + 2] = crc_update_sse42((uint32_t)crc_c, c + common, lengths[i + 2] - common);
+    }
+
+    for (; i < count; i++) {
+        crcs[i] = crc_update_sse42(crcs[i], (const uint8_t *)data[i], lengths[i]);
+    }
+}
+#endif // CRC32C_HAVE_SSE42
+
+#ifdef CRC32C_HAVE_ARMV8
+CRC32C_TARGET_ARMV8
+static uint32_t crc_update_armv8(uint32_t crc, const uint8_t *p, size_t length) {
+    while (length >= 8) {
+        crc = __crc32cd(crc, load_u64(p));
+        p += 8;
+        length -= 8;
+    }
+    while (length--) {
+        crc = __crc32cb(crc, *p++);
+    }
+    return crc;
+}
+
+CRC32C_TARGET_ARMV8
+static void crc_batch_armv8(uint32_t *crcs, const void *const *data, const size_t *lengths, size_t count) {
+    size_t i = 0;
+
+    // Three independent dependency chains keep the CRC unit busy
+    for (; i + 3 <= count; i += 3) {
+        const uint8_t *a = (const uint8_t *)data[i];
+        const uint8_t *b = (const uint8_t *)data[i + 1];
+        const uint8_t *c = (const uint8_t *)data[i + 2];
+        size_t common = lengths[i];
+        if (lengths[i + 1] < common) common = lengths[i + 1];
+        if (lengths[i + 2] < common) common = lengths[i + 2];
+        common &= ~(size_t)7;
+
+        uint32_t crc_a = crcs[i], crc_b = crcs[i + 1], crc_c = crcs[i + 2];
+        for (size_t off = 0; off < common; off += 8) {
+            crc_a = __crc32cd(crc_a, load_u64(a + off));
+            crc_b = __crc32cd(crc_b, load_u64(b + off));
+            crc_c = __crc32cd(crc_c, load_u64(c + off));
+        }
+
+        crcs[i] = crc_update_armv8(crc_a, a + common, lengths[i] - common);
+        crcs[i + 1] = crc_update_armv8(crc_b, b + common, lengths[i + 1] - common);
+        crcs[i + 2] = crc_update_armv8(crc_c, c + common, lengths[i + 2] - common);
+    }
+
+    for (; i < count; i++) {
+        crcs[i] = crc_update_armv8(crcs[i], (const uint8_t *)data[i], lengths[i]);
+    }
+}
+#endif // CRC32C_HAVE_ARMV8
+
+static void set_impl(crc_update_fn update, crc_batch_fn batch, const char *name) {
+    if (update == crc_update_portable) {
+        build_tables();
+    }
+    g_crc_impl = name;
+    __atomic_store_n(&g_crc_batch, batch, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_crc_update, update, __ATOMIC_RELEASE);
+}
+
+// Pick the fastest implementation the CPU supports; concurrent first callers
+// select the same one
+static void select_impl(void) {
+#if defined(CRC32C_HAVE_SSE42)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        set_impl(crc_update_sse42, crc_batch_sse42, "sse4.2");
+        return;
+    }
+#elif defined(CRC32C_HAVE_ARMV8)
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+        set_impl(crc_update_armv8, crc_batch_armv8, "armv8");
+        return;
+    }
+#endif
+    set_impl(crc_update_portable, crc_batch_portable, "portable");
+}
+
+static inline crc_update_fn get_update(void) {
+    crc_update_fn update = __atomic_load_n(&g_crc_update, __ATOMIC_ACQUIRE);
+    if (update == NULL) {
+        select_impl();
+        update = g_crc_update;
+    }
+    return update;
+}
+
+// Continue a running CRC register
+uint32_t pcie_crc32c_update(uint32_t crc, const void *data, size_t length) {
+    return get_update()(crc, (const uint8_t *)data, length);
+}
+
+// CRC32C of a buffer
+uint32_t pcie_crc32c(const void *data, size_t length) {
+    return ~pcie_crc32c_update(PCIE_CRC32C_INIT, data, length);
+}
+
+// Continue count independent CRC registers at once
+void pcie_crc32c_update_batch(uint32_t *crcs, const void *const *data, const size_t *lengths, size_t count) {
+    get_update();
+    __atomic_load_n(&g_crc_batch, __ATOMIC_ACQUIRE)(crcs, data, lengths, count);
+}
+
+// Name of the selected implementation
+const char *pcie_crc32c_impl(void) {
+    get_update();
+    return g_crc_impl;
+}
+
+// Select an implementation by name, NULL for the automatic choice
+int pcie_crc32c_use_impl(const char *name) {
+    if (name == NULL) {
+        select_impl();
+        return 0;
+    }
+    if (strcmp(name, "portable") == 0) {
+        set_impl(crc_update_portable, crc_batch_portable, "portable");
+        return 0;
+    }
+
+    // Hardware paths only if the automatic choice would pick them too
+    select_impl();
+    return strcmp(name, g_crc_impl) == 0 ? 0 : -1;
+}
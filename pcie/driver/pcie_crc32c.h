@@ -0,0 +1,42 @@
+#ifndef PCIE_CRC32C_H
+#define PCIE_CRC32C_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// CRC32C (Castagnoli) for integrity checks on the PCIe wire format.
+//
+// Uses the CRC32 instructions of SSE4.2 on x86-64 and of the ARMv8 CRC
+// extension on aarch64 Linux (e.g. Jetson), both selected at run time, with a
+// table-driven fallback everywhere else.
+
+// Initial register value; a finished CRC is the register inverted
+#define PCIE_CRC32C_INIT 0xFFFFFFFFu
+
+// CRC32C of a buffer
+uint32_t pcie_crc32c(const void *data, size_t length);
+
+// Continue a running CRC register (start with PCIE_CRC32C_INIT, invert at the end)
+uint32_t pcie_crc32c_update(uint32_t crc, const void *data, size_t length);
+
+// Continue count independent CRC registers at once. The hardware paths
+// interleave three buffers to hide the latency of the CRC instruction.
+void pcie_crc32c_update_batch(uint32_t *crcs, const void *const *data, const size_t *lengths, size_t count);
+
+// Name of the selected implementation ("sse4.2", "armv8" or "portable")
+const char *pcie_crc32c_impl(void);
+
+// Switch to an implementation by name, or back to the automatic choice with
+// NULL; returns -1 if the CPU does not support it. For tests and benchmarks,
+// not while other threads compute CRCs.
+int pcie_crc32c_use_impl(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PCIE_CRC32C_H
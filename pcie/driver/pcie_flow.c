@@ -0,0 +1,494 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "pcie_common.h"
+#include "pcie_crc32c.h"
+#include "pcie_flow.h"
+#include "pcie_trace.h"
+
+// Sleep interval while a blocking sender waits for credits
+#define FLOW_BLOCK_SLEEP_NS 20000
+
+// Attempts to resynchronize after being lapped before reporting empty
+#define FLOW_MAX_RESYNC 4
+
+// Messages whose CRCs are verified together by pcie_flow_receive_batch
+#define FLOW_BATCH_MAX 32
+
+// copy_slot() result when the sender overwrote the slot
+#define FLOW_SLOT_LAPPED 2
+
+// copy_slot() result for a committed slot with a length no message can have
+#define FLOW_SLOT_INVALID 3
+
+static inline pcie_flow_slot_t *slot_at(const pcie_flow_t *flow, uint64_t index) {
+    return (pcie_flow_slot_t *)(flow->region + sizeof(pcie_flow_ctrl_t) +
+                                (size_t)(index % flow->slot_count) * PCIE_FLOW_SLOT_SIZE);
+}
+
+static inline uint8_t *slot_payload(pcie_flow_slot_t *slot) {
+    return (uint8_t *)slot + sizeof(pcie_flow_slot_t);
+}
+
+// CRC register after the header fields that precede the crc field
+static inline uint32_t slot_crc_seed(const pcie_flow_slot_t *header) {
+    return pcie_crc32c_update(PCIE_CRC32C_INIT, header, offsetof(pcie_flow_slot_t, crc));
+}
+
+static void reset_flow(pcie_flow_t *flow, void *region, size_t region_size) {
+    memset(flow, 0, sizeof(*flow));
+    flow->region = (uint8_t *)region;
+    flow->region_size = region_size;
+    flow->ctrl = (pcie_flow_ctrl_t *)region;
+
+    // Default: never overwrite unconsumed data, wait a bounded time for a credit
+    for (int i = 0; i < PCIE_FLOW_NUM_CLASSES; i++) {
+        flow->classes[i].policy = PCIE_FLOW_BLOCK;
+        flow->classes[i].timeout_us = 0;
+    }
+}
+
+// Format a region as a transmit ring (sender side)
+int pcie_flow_init_sender(pcie_flow_t *flow, void *region, size_t region_size) {
+    if (flow == NULL || region == NULL) {
+        pcie_log("Flow", "Error: Invalid arguments for sender initialization.");
+        return -1;
+    }
+
+    if (region_size < sizeof(pcie_flow_ctrl_t) + 2 * PCIE_FLOW_SLOT_SIZE) {
+        pcie_log("Flow", "Error: Region too small for a flow control ring.");
+        return -1;
+    }
+
+    reset_flow(flow, region, region_size);
+    flow->slot_count = (uint32_t)((region_size - sizeof(pcie_flow_ctrl_t)) / PCIE_FLOW_SLOT_SIZE);
+    flow->crc = 1;
+
+    // Invalidate the ring before announcing it to the receiver. The new
+    // generation tells the peer this ring no longer belongs to an earlier boot.
+    pcie_flow_ctrl_t *ctrl = flow->ctrl;
+    uint32_t generation = __atomic_load_n(&ctrl->generation, __ATOMIC_ACQUIRE) + 1;
+    if (generation == 0) {
+        generation = 1;
+    }
+    __atomic_store_n(&ctrl->magic, 0, __ATOMIC_RELEASE);
+    for (uint32_t i = 0; i < flow->slot_count; i++) {
+        pcie_store_release(&slot_at(flow, i)->seq, 0);
+    }
+    ctrl->slot_count = flow->slot_count;
+    ctrl->slot_size = PCIE_FLOW_SLOT_SIZE;
+    pcie_store_release(&ctrl->head, 0);
+    pcie_store_release(&ctrl->consumed, 0);
+    __atomic_store_n(&ctrl->peer_generation, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&ctrl->generation, generation, __ATOMIC_RELEASE);
+    __atomic_store_n(&ctrl->magic, PCIE_FLOW_MAGIC, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+// Attach to a region formatted by the peer (receiver side)
+int pcie_flow_init_receiver(pcie_flow_t *flow, void *region, size_t region_size) {
+    if (flow == NULL || region == NULL || region_size < sizeof(pcie_flow_ctrl_t)) {
+        pcie_log("Flow", "Error: Invalid arguments for receiver initialization.");
+        return -1;
+    }
+
+    // The ring geometry is read from the control block once the peer formatted it
+    reset_flow(flow, region, region_size);
+    return 0;
+}
+
+// Generation of a formatted ring, 0 if the ring is not formatted
+uint32_t pcie_flow_generation(const pcie_flow_t *flow) {
+    if (flow == NULL || flow->ctrl == NULL ||
+        __atomic_load_n(&flow->ctrl->magic, __ATOMIC_ACQUIRE) != PCIE_FLOW_MAGIC) {
+        return 0;
+    }
+    return __atomic_load_n(&flow->ctrl->generation, __ATOMIC_ACQUIRE);
+}
+
+// Echo the generation of the receive ring into the transmit ring
+void pcie_flow_ack_peer(pcie_flow_t *tx, const pcie_flow_t *rx) {
+    if (tx == NULL || tx->ctrl == NULL || tx->slot_count == 0) {
+        return;
+    }
+
+    uint32_t generation = pcie_flow_generation(rx);
+    if (generation != 0 && __atomic_load_n(&tx->ctrl->peer_generation, __ATOMIC_RELAXED) != generation) {
+        __atomic_store_n(&tx->ctrl->peer_generation, generation, __ATOMIC_RELEASE);
+    }
+}
+
+// Whether the peer formatted rx and acknowledged the current generation of tx
+int pcie_flow_peer_acked(const pcie_flow_t *rx, const pcie_flow_t *tx) {
+    uint32_t ours = pcie_flow_generation(tx);
+    if (ours == 0 || pcie_flow_generation(rx) == 0) {
+        return 0;
+    }
+    return __atomic_load_n(&rx->ctrl->peer_generation, __ATOMIC_ACQUIRE) == ours;
+}
+
+// Enable or disable CRC32C protection of sent messages
+int pcie_flow_set_crc(pcie_flow_t *flow, int enabled) {
+    if (flow == NULL) {
+        return -1;
+    }
+
+    flow->crc = enabled != 0;
+    return 0;
+}
+
+// Configure the overflow policy of a priority class
+int pcie_flow_set_policy(pcie_flow_t *flow, uint32_t priority_class, pcie_flow_policy_t policy, uint32_t timeout_us) {
+    if (flow == NULL || priority_class >= PCIE_FLOW_NUM_CLASSES) {
+        pcie_log("Flow", "Error: Invalid priority class.");
+        return -1;
+    }
+
+    flow->classes[priority_class].policy = policy;
+    flow->classes[priority_class].timeout_us = timeout_us;
+    return 0;
+}
+
+// Number of credits currently available to the sender
+uint32_t pcie_flow_credits(const pcie_flow_t *flow) {
+    if (flow == NULL || flow->slot_count == 0) {
+        return 0;
+    }
+
+    uint64_t in_flight = flow->index - pcie_load_acquire(&flow->ctrl->consumed);
+    return in_flight >= flow->slot_count ? 0 : (uint32_t)(flow->slot_count - in_flight);
+}
+
+// Wait for a credit until deadline_ns, sleeping or spinning in between
+static int wait_for_credit(pcie_flow_t *flow, uint64_t deadline_ns, int sleep) {
+    struct timespec pause = {0, FLOW_BLOCK_SLEEP_NS};
+
+    while (pcie_flow_credits(flow) == 0) {
+        if (pcie_time_ns() >= deadline_ns) {
+            return -1;
+        }
+        if (sleep) {
+            nanosleep(&pause, NULL);
+        }
+    }
+    return 0;
+}
+
+// Publish a message; returns 0, PCIE_FLOW_DROPPED or -1
+int pcie_flow_send(pcie_flow_t *flow, const void *data, size_t length, uint32_t priority) {
+    if (flow == NULL || flow->slot_count == 0 || data == NULL) {
+        pcie_log("Flow", "Error: Flow not initialized for sending.");
+        return -1;
+    }
+
+    if (length > PCIE_FLOW_PAYLOAD_SIZE) {
+        pcie_log("Flow", "Error: Message too large for a flow control slot.");
+        return -1;
+    }
+
+    if (pcie_flow_credits(flow) == 0) {
+        const pcie_flow_class_config_t *cls = &flow->classes[pcie_flow_class(priority)];
+
+        switch (cls->policy) {
+            case PCIE_FLOW_BLOCK:
+            case PCIE_FLOW_SPIN_TIMEOUT: {
+                int block = cls->policy == PCIE_FLOW_BLOCK;
+                uint64_t timeout_us = block && cls->timeout_us == 0 ? PCIE_FLOW_BLOCK_TIMEOUT_US : cls->timeout_us;
+                flow->stats.stalls++;
+                if (wait_for_credit(flow, pcie_time_ns() + timeout_us * 1000u + 1, block) != 0) {
+                    flow->stats.timeouts++;
+                    PCIE_TRACE4(flow_drop, PCIE_TRACE_MESSAGE_ID(data, length), PCIE_TRACE_ZONE(data, length), flow->index, priority);
+                    return PCIE_FLOW_DROPPED;
+                }
+                break;
+            }
+            case PCIE_FLOW_DROP_OLDEST:
+                // The receiver detects the overwritten slot and skips ahead
+                flow->stats.dropped_oldest++;
+                break;
+            case PCIE_FLOW_DROP_NEWEST:
+            default:
+                flow->stats.dropped_newest++;
+                PCIE_TRACE4(flow_drop, PCIE_TRACE_MESSAGE_ID(data, length), PCIE_TRACE_ZONE(data, length), flow->index, priority);
+                return PCIE_FLOW_DROPPED;
+        }
+    }
+
+    // Header as it will read once committed; the CRC is taken over the
+    // caller's buffer so the mapped region is never read back
+    uint64_t index = flow->index;
+    PCIE_TRACE4(flow_enqueue, PCIE_TRACE_MESSAGE_ID(data, length), PCIE_TRACE_ZONE(data, length), index, priority);
+    pcie_flow_slot_t header;
+    header.seq = 2 * (index + 1);
+    header.length = (uint16_t)length;
+    header.priority = (uint8_t)(priority > 0xFF ? 0xFF : priority);
+    header.flags = flow->crc ? PCIE_FLOW_SLOT_CRC : 0;
+    header.crc = flow->crc ? ~pcie_crc32c_update(slot_crc_seed(&header), data, length) : 0;
+
+    // Mark the slot as being written, fill it, then commit it
+    pcie_flow_slot_t *slot = slot_at(flow, index);
+    pcie_store_release(&slot->seq, header.seq - 1);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->length = header.length;
+    slot->priority = header.priority;
+    slot->flags = header.flags;
+    slot->crc = header.crc;
+    memcpy(slot_payload(slot), data, length);
+    pcie_store_release(&slot->seq, header.seq);
+    PCIE_TRACE4(flow_flush, PCIE_TRACE_MESSAGE_ID(data, length), PCIE_TRACE_ZONE(data, length), index, length);
+
+    flow->index = index + 1;
+    pcie_store_release(&flow->ctrl->head, flow->index);
+    PCIE_TRACE3(flow_doorbell, PCIE_TRACE_MESSAGE_ID(data, length), PCIE_TRACE_ZONE(data, length), index);
+    flow->stats.sent++;
+    return 0;
+}
+
+// Attach to the ring once the peer formatted it; returns 0, PCIE_FLOW_EMPTY or -1
+static int prepare_receive(pcie_flow_t *flow) {
+    pcie_flow_ctrl_t *ctrl = flow->ctrl;
+
+    // Nothing to read until the peer has formatted the ring
+    if (__atomic_load_n(&ctrl->magic, __ATOMIC_ACQUIRE) != PCIE_FLOW_MAGIC) {
+        return PCIE_FLOW_EMPTY;
+    }
+
+    if (flow->slot_count == 0) {
+        uint32_t slot_count = ctrl->slot_count;
+        if (ctrl->slot_size != PCIE_FLOW_SLOT_SIZE || slot_count == 0 ||
+            sizeof(pcie_flow_ctrl_t) + (size_t)slot_count * PCIE_FLOW_SLOT_SIZE > flow->region_size) {
+            pcie_log("Flow", "Error: Peer ring geometry does not fit the mapped region.");
+            return -1;
+        }
+        flow->slot_count = slot_count;
+        flow->index = pcie_load_acquire(&ctrl->consumed);
+    }
+
+    // The sender restarted and reformatted the ring
+    uint64_t head = pcie_load_acquire(&ctrl->head);
+    if (head < flow->index) {
+        flow->index = head;
+        pcie_store_release(&ctrl->consumed, head);
+    }
+    return 0;
+}
+
+// Copy the slot of message index into buffer and its header into header;
+// returns 0, PCIE_FLOW_EMPTY (not committed yet), FLOW_SLOT_LAPPED,
+// FLOW_SLOT_INVALID or -1 (buffer too small, the message stays pending)
+static int copy_slot(pcie_flow_t *flow, uint64_t index, void *buffer, size_t buffer_size, pcie_flow_slot_t *header) {
+    uint64_t expected = 2 * (index + 1);
+    pcie_flow_slot_t *slot = slot_at(flow, index);
+    uint64_t seq = pcie_load_acquire(&slot->seq);
+
+    if (seq < expected) {
+        // Older message or still being written
+        return PCIE_FLOW_EMPTY;
+    }
+    if (seq > expected) {
+        return FLOW_SLOT_LAPPED;
+    }
+
+    memcpy(header, slot, sizeof(*header));
+    header->seq = expected;
+    if (header->length > PCIE_FLOW_PAYLOAD_SIZE || header->length > buffer_size) {
+        // A torn header from a concurrent overwrite is not an error
+        if (pcie_load_acquire(&slot->seq) != expected) {
+            return FLOW_SLOT_LAPPED;
+        }
+        if (header->length > PCIE_FLOW_PAYLOAD_SIZE) {
+            // Corrupted on the link; the caller consumes it like a CRC error
+            pcie_log("Flow", "Error: Invalid message length in slot, message discarded.");
+            return FLOW_SLOT_INVALID;
+        }
+        pcie_log("Flow", "Error: Receive buffer too small for message.");
+        return -1;
+    }
+
+    memcpy(buffer, slot_payload(slot), header->length);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    // Only accept the copy if the sender did not overwrite it meanwhile
+    return pcie_load_acquire(&slot->seq) == expected ? 0 : FLOW_SLOT_LAPPED;
+}
+
+// Lapped by a drop-oldest sender: skip to the oldest intact message
+static void resync(pcie_flow_t *flow) {
+    uint64_t head = pcie_load_acquire(&flow->ctrl->head);
+    uint64_t oldest = head >= flow->slot_count ? head - flow->slot_count + 1 : 0;
+    if (oldest > flow->index) {
+        flow->stats.overruns += oldest - flow->index;
+        flow->index = oldest;
+        pcie_store_release(&flow->ctrl->consumed, oldest);
+    }
+}
+
+static inline int crc_matches(const pcie_flow_slot_t *header, uint32_t crc) {
+    return !(header->flags & PCIE_FLOW_SLOT_CRC) || ~crc == header->crc;
+}
+
+// Non-consuming check whether pcie_flow_receive() has something to act on
+int pcie_flow_readable(const pcie_flow_t *flow) {
+    if (flow == NULL || flow->ctrl == NULL ||
+        __atomic_load_n(&flow->ctrl->magic, __ATOMIC_ACQUIRE) != PCIE_FLOW_MAGIC) {
+        return 0;
+    }
+
+    // The head is published after the slot is committed. Not being attached
+    // yet or a head behind our index (peer restarted) also need the receive path.
+    return flow->slot_count == 0 || pcie_load_acquire(&flow->ctrl->head) != flow->index;
+}
+
+// Consume the next message and return its credit; returns 0, PCIE_FLOW_EMPTY or -1
+int pcie_flow_receive(pcie_flow_t *flow, void *buffer, size_t buffer_size, size_t *length) {
+    if (flow == NULL || flow->ctrl == NULL || buffer == NULL) {
+        pcie_log("Flow", "Error: Flow not initialized for receiving.");
+        return -1;
+    }
+
+    int ret = prepare_receive(flow);
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (int attempt = 0; attempt < FLOW_MAX_RESYNC; attempt++) {
+        pcie_flow_slot_t header;
+        ret = copy_slot(flow, flow->index, buffer, buffer_size, &header);
+        if (ret == PCIE_FLOW_EMPTY || ret < 0) {
+            return ret;
+        }
+
+        if (ret == FLOW_SLOT_LAPPED) {
+            resync(flow);
+            continue;
+        }
+        if (ret == FLOW_SLOT_INVALID) {
+            // Skip it rather than stopping the ring at this slot for good
+            flow->index++;
+            pcie_store_release(&flow->ctrl->consumed, flow->index);
+            flow->stats.invalid++;
+            continue;
+        }
+
+        flow->index++;
+        pcie_store_release(&flow->ctrl->consumed, flow->index);
+
+        uint32_t crc = 0;
+        if (header.flags & PCIE_FLOW_SLOT_CRC) {
+            crc = pcie_crc32c_update(slot_crc_seed(&header), buffer, header.length);
+        }
+        if (!crc_matches(&header, crc)) {
+            // Corrupted or half-written on the link: never hand it on
+            flow->stats.crc_errors++;
+            pcie_log("Flow", "Error: CRC mismatch, message discarded.");
+            continue;
+        }
+
+        flow->stats.received++;
+        PCIE_TRACE4(flow_receive, PCIE_TRACE_MESSAGE_ID(buffer, header.length), PCIE_TRACE_ZONE(buffer, header.length),
+                    flow->index - 1, header.length);
+        if (length != NULL) {
+            *length = header.length;
+        }
+        return 0;
+    }
+
+    return PCIE_FLOW_EMPTY;
+}
+
+// Consume up to max_count messages, verifying their CRCs together
+int pcie_flow_receive_batch(pcie_flow_t *flow, void *buffers, size_t stride, size_t max_count, size_t *lengths) {
+    if (flow == NULL || flow->ctrl == NULL || buffers == NULL || lengths == NULL || stride == 0) {
+        pcie_log("Flow", "Error: Invalid arguments for batch receive.");
+        return -1;
+    }
+
+    int ret = prepare_receive(flow);
+    if (ret != 0) {
+        return ret == PCIE_FLOW_EMPTY ? 0 : -1;
+    }
+
+    uint8_t *out = (uint8_t *)buffers;
+    uint64_t first = flow->index;
+    size_t delivered = 0;
+    int resyncs = 0;
+    int error = 0;
+
+    while (delivered < max_count && !error) {
+        size_t want = max_count - delivered < FLOW_BATCH_MAX ? max_count - delivered : FLOW_BATCH_MAX;
+        pcie_flow_slot_t headers[FLOW_BATCH_MAX];
+        uint32_t crcs[FLOW_BATCH_MAX];
+        const void *data[FLOW_BATCH_MAX];
+        size_t sizes[FLOW_BATCH_MAX];
+        size_t copied = 0;
+
+        // Copy a run of committed slots without touching the control block
+        while (copied < want) {
+            ret = copy_slot(flow, flow->index, out + (delivered + copied) * stride, stride, &headers[copied]);
+            if (ret == 0) {
+                flow->index++;
+                copied++;
+            } else if (ret == FLOW_SLOT_INVALID) {
+                // Its credit goes back with the rest of the batch
+                flow->index++;
+                flow->stats.invalid++;
+            } else if (ret == FLOW_SLOT_LAPPED && resyncs++ < FLOW_MAX_RESYNC) {
+                resync(flow);
+            } else {
+                error = ret < 0;
+                break;
+            }
+        }
+
+        // One pass over all CRCs lets the hardware paths interleave them
+        for (size_t i = 0; i < copied; i++) {
+            crcs[i] = (headers[i].flags & PCIE_FLOW_SLOT_CRC) ? slot_crc_seed(&headers[i]) : 0;
+            data[i] = out + (delivered + i) * stride;
+            sizes[i] = (headers[i].flags & PCIE_FLOW_SLOT_CRC) ? headers[i].length : 0;
+        }
+        pcie_crc32c_update_batch(crcs, data, sizes, copied);
+
+        // Close the gaps left by discarded messages
+        size_t kept = 0;
+        for (size_t i = 0; i < copied; i++) {
+            if (!crc_matches(&headers[i], crcs[i])) {
+                flow->stats.crc_errors++;
+                continue;
+            }
+            if (kept != i) {
+                memmove(out + (delivered + kept) * stride, data[i], headers[i].length);
+            }
+            lengths[delivered + kept] = headers[i].length;
+            PCIE_TRACE4(flow_receive, PCIE_TRACE_MESSAGE_ID(out + (delivered + kept) * stride, headers[i].length),
+                        PCIE_TRACE_ZONE(out + (delivered + kept) * stride, headers[i].length),
+                        (headers[i].seq >> 1) - 1, headers[i].length);
+            kept++;
+        }
+        if (kept != copied) {
+            pcie_log("Flow", "Error: CRC mismatch, messages discarded.");
+        }
+
+        flow->stats.received += kept;
+        delivered += kept;
+        if (copied < want) {
+            break;
+        }
+    }
+
+    // Return all credits of this batch at once
+    pcie_store_release(&flow->ctrl->consumed, flow->index);
+    if (delivered > 0) {
+        PCIE_TRACE2(flow_receive_batch, first, delivered);
+    }
+
+    if (error && delivered == 0) {
+        return -1;
+    }
+    return (int)delivered;
+}
@@ -0,0 +1,163 @@
+#ifndef PCIE_FLOW_H
+#define PCIE_FLOW_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Credit-based flow control over a shared (BAR-mapped) memory region.
+//
+// The sender formats the region as a control block followed by a ring of
+// fixed-size slots. Every published slot consumes one credit; the receiver
+// returns credits by advancing the consumed counter in the control block.
+// When no credit is left the per-priority-class overflow policy decides
+// whether the sender waits or which message gets dropped.
+
+// Number of priority classes with their own overflow policy.
+// Priorities above the last class are folded into it.
+#define PCIE_FLOW_NUM_CLASSES 4
+
+// Size of one ring slot (slot header + payload)
+#define PCIE_FLOW_SLOT_SIZE 256
+
+// Marker written by the sender once the region is formatted ("PCFR")
+#define PCIE_FLOW_MAGIC 0x50434652u
+
+// Slot flag: the crc field holds a CRC32C over the slot header and payload
+#define PCIE_FLOW_SLOT_CRC 0x01
+
+// Longest a PCIE_FLOW_BLOCK sender waits for a credit when the class timeout
+// is 0; a dead or missing receiver must not stall the sender forever
+#define PCIE_FLOW_BLOCK_TIMEOUT_US 100000
+
+// Return codes in addition to 0 (success) and -1 (error)
+#define PCIE_FLOW_DROPPED 1   // Message discarded by the overflow policy
+#define PCIE_FLOW_EMPTY   1   // No new message available
+
+// Behavior when the sender runs out of credits
+typedef enum {
+    PCIE_FLOW_BLOCK,         // Sleep until the receiver returns a credit, drop the message on timeout
+    PCIE_FLOW_SPIN_TIMEOUT,  // Busy-wait for a credit, drop the message on timeout
+    PCIE_FLOW_DROP_OLDEST,   // Overwrite the oldest unconsumed message
+    PCIE_FLOW_DROP_NEWEST    // Discard the message being sent
+} pcie_flow_policy_t;
+
+// Overflow configuration of one priority class
+typedef struct {
+    pcie_flow_policy_t policy;
+    uint32_t timeout_us;     // PCIE_FLOW_SPIN_TIMEOUT and PCIE_FLOW_BLOCK (0 = PCIE_FLOW_BLOCK_TIMEOUT_US)
+} pcie_flow_class_config_t;
+
+// Loss and backpressure counters
+typedef struct {
+    uint64_t sent;             // Messages published by the sender
+    uint64_t received;         // Messages consumed by the receiver
+    uint64_t dropped_newest;   // Messages discarded because no credit was left
+    uint64_t dropped_oldest;   // Unconsumed messages overwritten by the sender
+    uint64_t timeouts;         // Credit waits that expired (message dropped)
+    uint64_t stalls;           // Sends that had to wait for a credit
+    uint64_t overruns;         // Messages the receiver lost because it was lapped
+    uint64_t crc_errors;       // Messages discarded because the CRC did not match
+    uint64_t invalid;          // Messages discarded because their slot length was out of range
+    uint64_t oversized;        // Messages discarded because they did not fit the caller's buffer
+} pcie_flow_stats_t;
+
+// Control block at the start of the shared region. Producer and consumer
+// counters live on separate cache lines.
+typedef struct {
+    uint32_t magic;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint32_t generation;       // Bumped every time a sender formats the ring
+    uint64_t head;             // Messages published (written by the sender)
+    uint32_t peer_generation;  // Generation of the reverse ring the sender has seen
+    uint8_t pad0[36];
+    uint64_t consumed;         // Messages consumed (written by the receiver)
+    uint8_t pad1[56];
+} pcie_flow_ctrl_t;
+
+// Header in front of every slot payload
+typedef struct {
+    uint64_t seq;              // 2*(index+1)-1 while written, 2*(index+1) once committed
+    uint16_t length;           // Payload length in bytes
+    uint8_t priority;          // Priority the message was sent with (saturated at 255)
+    uint8_t flags;             // PCIE_FLOW_SLOT_CRC
+    uint32_t crc;              // CRC32C over committed seq, length, priority, flags and payload
+} pcie_flow_slot_t;
+
+#define PCIE_FLOW_PAYLOAD_SIZE (PCIE_FLOW_SLOT_SIZE - sizeof(pcie_flow_slot_t))
+
+// Local view of one direction of the link
+typedef struct {
+    uint8_t *region;
+    size_t region_size;
+    pcie_flow_ctrl_t *ctrl;
+    uint32_t slot_count;
+    uint64_t index;            // Next message to write (sender) or read (receiver)
+    int crc;                   // Sender: protect published slots with a CRC32C
+    pcie_flow_class_config_t classes[PCIE_FLOW_NUM_CLASSES];
+    pcie_flow_stats_t stats;
+} pcie_flow_t;
+
+// Map a message priority (0=highest) to its priority class
+static inline uint32_t pcie_flow_class(uint32_t priority) {
+    return priority < PCIE_FLOW_NUM_CLASSES ? priority : PCIE_FLOW_NUM_CLASSES - 1;
+}
+
+// Format a region as a transmit ring (sender side)
+int pcie_flow_init_sender(pcie_flow_t *flow, void *region, size_t region_size);
+
+// Attach to a region formatted by the peer (receiver side)
+int pcie_flow_init_receiver(pcie_flow_t *flow, void *region, size_t region_size);
+
+// Enable or disable CRC32C protection of sent messages (enabled by default).
+// Receivers always verify slots that carry a CRC.
+int pcie_flow_set_crc(pcie_flow_t *flow, int enabled);
+
+// Configure the overflow policy of a priority class
+int pcie_flow_set_policy(pcie_flow_t *flow, uint32_t priority_class, pcie_flow_policy_t policy, uint32_t timeout_us);
+
+// Number of credits currently available to the sender
+uint32_t pcie_flow_credits(const pcie_flow_t *flow);
+
+// Non-consuming check whether pcie_flow_receive() has something to act on
+// (a committed message, a lapped ring to resynchronize or a new peer ring)
+int pcie_flow_readable(const pcie_flow_t *flow);
+
+// Link handshake. Every format bumps the generation of a ring and each side
+// echoes the generation of the ring it receives from into its own transmit
+// ring. A peer is up once its ring echoes the current generation of ours,
+// which a ring left behind by an earlier boot of the peer cannot do.
+
+// Generation of a formatted ring, 0 if the ring is not formatted
+uint32_t pcie_flow_generation(const pcie_flow_t *flow);
+
+// Echo the generation of the receive ring rx into the transmit ring tx
+void pcie_flow_ack_peer(pcie_flow_t *tx, const pcie_flow_t *rx);
+
+// Whether the peer formatted rx and acknowledged the current generation of tx
+int pcie_flow_peer_acked(const pcie_flow_t *rx, const pcie_flow_t *tx);
+
+// Publish a message; returns 0, PCIE_FLOW_DROPPED or -1
+int pcie_flow_send(pcie_flow_t *flow, const void *data, size_t length, uint32_t priority);
+
+// Consume the next message and return its credit; returns 0, PCIE_FLOW_EMPTY or -1.
+// Slots with an impossible length are consumed and counted as invalid; a
+// message larger than buffer_size stays pending and returns -1.
+int pcie_flow_receive(pcie_flow_t *flow, void *buffer, size_t buffer_size, size_t *length);
+
+// Consume up to max_count messages into buffers spaced stride bytes apart,
+// verifying their CRCs together and returning all credits at once. Messages
+// failing the check or with an impossible length are discarded. Returns the
+// number of messages stored in the first slots of buffers (lengths in
+// lengths) or -1.
+int pcie_flow_receive_batch(pcie_flow_t *flow, void *buffers, size_t stride, size_t max_count, size_t *lengths);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PCIE_FLOW_H
@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,28 +7,115 @@
 #include <unistd.h>
 #include <sys/mman.h>
 #include <errno.h>
-#include <poll.h>
+#include <time.h>
 #include <stdint.h>
 #include "pcie_common.h"
 #include "pcie_client.h"
+#include "pcie_flow.h"
 
 #define BUFFER_SIZE 256
 
+// Interval between ring checks while waiting for data
+#define RX_POLL_INTERVAL_NS 50000
+
+// Messages taken off the ring per ring check
+#define RX_BATCH_SIZE 16
+
 // PCIe device handle for receiving
 static int pcie_rx_fd = -1;
 static void *pcie_rx_map = NULL;
 static size_t rx_map_size = 0x1000;  // 4KB memory-mapped region
 
-// Receive a message via PCIe
-int pcie_client_receive(char *buffer, size_t buffer_size) {
-    // Check if client is initialized first
+// Credit-based flow control ring written by the peer
+static pcie_flow_t rx_flow;
+
+// Messages taken off the ring in one batch but not yet handed out
+static uint8_t rx_batch[RX_BATCH_SIZE][PCIE_FLOW_PAYLOAD_SIZE];
+static size_t rx_batch_lengths[RX_BATCH_SIZE];
+static size_t rx_batch_count = 0;
+static size_t rx_batch_next = 0;
+
+// How long a receive waits for the peer to publish a message
+static uint64_t rx_timeout_ns = PCIE_CLIENT_RECEIVE_TIMEOUT_US * 1000ull;
+
+// Open and map the receive BAR and attach to the peer's ring
+static int receiver_open_device(const pcie_config_t *config) {
+    char device_path[256];
+    snprintf(device_path, sizeof(device_path), "%s/%s/resource1", config->sysfs_root, config->device_id);
+    
+    pcie_rx_fd = open(device_path, O_RDWR | O_SYNC);
+    if (pcie_rx_fd < 0) {
+        pcie_log("Receiver", "Error: Failed to open PCIe device.");
+        fprintf(stderr, "Open failed: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    // Memory map the PCIe BAR region for receiving
+    pcie_rx_map = mmap(NULL, rx_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, pcie_rx_fd, 0);
+    if (pcie_rx_map == MAP_FAILED) {
+        pcie_log("Receiver", "Error: Failed to memory map PCIe region.");
+        fprintf(stderr, "mmap failed: %s\n", strerror(errno));
+        close(pcie_rx_fd);
+        pcie_rx_fd = -1;
+        return -1;
+    }
+    
+    // Fault the mapping in now rather than on the first message
+    pcie_prefault(pcie_rx_map, rx_map_size);
+    
+    if (pcie_flow_init_receiver(&rx_flow, pcie_rx_map, rx_map_size) != 0) {
+        munmap(pcie_rx_map, rx_map_size);
+        pcie_rx_map = NULL;
+        close(pcie_rx_fd);
+        pcie_rx_fd = -1;
+        return -1;
+    }
+    
+    pcie_log("Receiver", "PCIe device opened and mapped successfully.");
+    return 0;
+}
+
+// Open the receive BAR ahead of the first message
+int pcie_receiver_open() {
     if (!pcie_client_is_initialized()) {
         pcie_log("Receiver", "Error: PCIe client not initialized.");
         return -1;
     }
     
-    if (buffer == NULL || buffer_size == 0) {
-        pcie_log("Receiver", "Error: Invalid buffer for receiving message.");
+    const pcie_config_t *config = pcie_client_get_config();
+    if (!config) {
+        pcie_log("Receiver", "Error: Failed to get PCIe configuration.");
+        return -1;
+    }
+    
+    return pcie_rx_fd >= 0 ? 0 : receiver_open_device(config);
+}
+
+// Receive ring for direct use
+pcie_flow_t *pcie_client_rx_flow(void) {
+    return pcie_receiver_open() == 0 ? &rx_flow : NULL;
+}
+
+// Check whether the peer has formatted the ring we receive from and
+// acknowledged the current generation of ours. A magic alone may be left over
+// from an earlier boot of the peer.
+int pcie_receiver_peer_ready() {
+    if (pcie_rx_fd < 0 || rx_flow.ctrl == NULL) {
+        return 0;
+    }
+
+    pcie_flow_t *tx = pcie_sender_flow();
+    if (tx == NULL) {
+        return 0;
+    }
+    pcie_flow_ack_peer(tx, &rx_flow);
+    return pcie_flow_peer_acked(&rx_flow, tx);
+}
+
+// Check the client state and open the receive BAR on first use
+static int receiver_prepare(void) {
+    if (!pcie_client_is_initialized()) {
+        pcie_log("Receiver", "Error: PCIe client not initialized.");
         return -1;
     }
     
@@ -38,73 +127,175 @@ int pcie_client_receive(char *buffer, size_t buffer_size) {
     }
     
     // Open PCIe device if not already open
-    if (pcie_rx_fd < 0) {
-        char device_path[128];
-        snprintf(device_path, sizeof(device_path), "/sys/bus/pci/devices/%s/resource1", config->device_id);
-        
-        pcie_rx_fd = open(device_path, O_RDWR | O_SYNC);
-        if (pcie_rx_fd < 0) {
-            pcie_log("Receiver", "Error: Failed to open PCIe device.");
-            fprintf(stderr, "Open failed: %s\n", strerror(errno));
-            return -1;
-        }
-        
-        // Memory map the PCIe BAR region for receiving
-        pcie_rx_map = mmap(NULL, rx_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, pcie_rx_fd, 0);
-        if (pcie_rx_map == MAP_FAILED) {
-            pcie_log("Receiver", "Error: Failed to memory map PCIe region.");
-            fprintf(stderr, "mmap failed: %s\n", strerror(errno));
-            close(pcie_rx_fd);
-            pcie_rx_fd = -1;
+    if (pcie_rx_fd < 0 && receiver_open_device(config) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Refill the staged batch unless messages are left in it, waiting up to the
+// receive timeout for the peer; returns 0, PCIE_FLOW_EMPTY or -1
+static int receiver_fill_batch(void) {
+    if (rx_batch_next < rx_batch_count) {
+        return 0;
+    }
+    
+    // Let a peer waiting in its handshake know we see its ring
+    pcie_flow_ack_peer(pcie_sender_flow(), &rx_flow);
+    
+    uint64_t deadline = pcie_time_ns() + rx_timeout_ns;
+    struct timespec pause = {0, RX_POLL_INTERVAL_NS};
+    
+    for (;;) {
+        int count = pcie_flow_receive_batch(&rx_flow, rx_batch, PCIE_FLOW_PAYLOAD_SIZE, RX_BATCH_SIZE, rx_batch_lengths);
+        if (count < 0) {
             return -1;
         }
-        
-        pcie_log("Receiver", "PCIe device opened and mapped successfully.");
-    }
-    
-    // Set up polling to wait for data
-    struct pollfd pfd;
-    pfd.fd = pcie_rx_fd;
-    pfd.events = POLLIN;
-    
-    // Wait up to 100ms for data to be available
-    int ret = poll(&pfd, 1, 100);
-    if (ret <= 0) {
-        if (ret == 0) {
-            pcie_log("Receiver", "Timed out waiting for PCIe data.");
-            // For testing, let's return a fake message
-            snprintf(buffer, buffer_size, "Received message via device %s (timeout)", config->device_id);
+        if (count > 0) {
+            rx_batch_count = (size_t)count;
+            rx_batch_next = 0;
             return 0;
-        } else {
-            pcie_log("Receiver", "Error polling PCIe device.");
-            return -1;
         }
+        if (pcie_time_ns() >= deadline) {
+            return PCIE_FLOW_EMPTY;
+        }
+        nanosleep(&pause, NULL);
+    }
+}
+
+// Receive a binary message via PCIe and return its credit to the sender
+int pcie_client_receive_buffer(void *buffer, size_t buffer_size, size_t *received) {
+    if (buffer == NULL || buffer_size == 0) {
+        pcie_log("Receiver", "Error: Invalid buffer for receiving message.");
+        return -1;
     }
     
-    // Read message header (length)
-    uint32_t *header = (uint32_t *)pcie_rx_map;
-    uint32_t msg_len = *header;
+    if (receiver_prepare() != 0) {
+        return -1;
+    }
     
-    // Validate message length
-    if (msg_len == 0 || msg_len > rx_map_size - sizeof(uint32_t)) {
-        pcie_log("Receiver", "Invalid message length received.");
+    // A message that does not fit is dropped: keeping it staged would fail
+    // every later call of a caller with a fixed-size buffer
+    size_t length;
+    for (;;) {
+        int ret = receiver_fill_batch();
+        if (ret != 0) {
+            return ret;
+        }
+        length = rx_batch_lengths[rx_batch_next];
+        if (length <= buffer_size) {
+            break;
+        }
+        rx_batch_next++;
+        rx_flow.stats.oversized++;
+        pcie_log("Receiver", "Error: Receive buffer too small for message, message discarded.");
+    }
+    memcpy(buffer, rx_batch[rx_batch_next], length);
+    rx_batch_next++;
+    if (received != NULL) {
+        *received = length;
+    }
+    return 0;
+}
+
+// Next staged message without taking it, so callers can size their buffer
+// from the header and copy the message once
+int pcie_client_peek_buffer(const void **data, size_t *length) {
+    if (data == NULL || length == NULL) {
+        pcie_log("Receiver", "Error: Invalid pointers for peeking at a message.");
         return -1;
     }
     
-    // Check if buffer is large enough
-    if (msg_len > buffer_size) {
-        pcie_log("Receiver", "Receive buffer too small for message.");
+    if (receiver_prepare() != 0) {
         return -1;
     }
     
-    // Copy message from mapped memory
-    char *data_region = (char *)pcie_rx_map + sizeof(uint32_t);
-    memcpy(buffer, data_region, msg_len);
+    int ret = receiver_fill_batch();
+    if (ret != 0) {
+        return ret;
+    }
+    *data = rx_batch[rx_batch_next];
+    *length = rx_batch_lengths[rx_batch_next];
+    return 0;
+}
+
+// Take the message returned by the last peek
+void pcie_client_consume_buffer(void) {
+    if (rx_batch_next < rx_batch_count) {
+        rx_batch_next++;
+    }
+}
+
+// Receive several messages per ring check
+int pcie_client_receive_batch(void *buffers, size_t stride, size_t max_count, size_t *lengths) {
+    if (buffers == NULL || stride == 0 || max_count == 0 || lengths == NULL) {
+        pcie_log("Receiver", "Error: Invalid buffers for receiving messages.");
+        return -1;
+    }
+    
+    if (receiver_prepare() != 0) {
+        return -1;
+    }
+    
+    int ret = receiver_fill_batch();
+    if (ret < 0) {
+        return -1;
+    }
+    if (ret == PCIE_FLOW_EMPTY) {
+        return 0;
+    }
+    
+    size_t count = 0;
+    while (count < max_count && rx_batch_next < rx_batch_count) {
+        size_t length = rx_batch_lengths[rx_batch_next++];
+        if (length > stride) {
+            rx_flow.stats.oversized++;
+            pcie_log("Receiver", "Error: Receive buffers too small for message, message discarded.");
+            continue;
+        }
+        memcpy((uint8_t *)buffers + count * stride, rx_batch[rx_batch_next - 1], length);
+        lengths[count++] = length;
+    }
+    return (int)count;
+}
+
+// Set how long a receive waits for the peer
+int pcie_client_set_receive_timeout(uint32_t timeout_us) {
+    rx_timeout_ns = (uint64_t)timeout_us * 1000ull;
+    return 0;
+}
+
+// Receive a message via PCIe
+int pcie_client_receive(char *buffer, size_t buffer_size) {
+    // Check if client is initialized first
+    if (!pcie_client_is_initialized()) {
+        pcie_log("Receiver", "Error: PCIe client not initialized.");
+        return -1;
+    }
+    
+    if (buffer == NULL || buffer_size == 0) {
+        pcie_log("Receiver", "Error: Invalid buffer for receiving message.");
+        return -1;
+    }
+    
+    size_t msg_len = 0;
+    int ret = pcie_client_receive_buffer(buffer, buffer_size, &msg_len);
+    if (ret < 0) {
+        return -1;
+    }
+    
+    if (ret == PCIE_FLOW_EMPTY) {
+        pcie_log("Receiver", "Timed out waiting for PCIe data.");
+        // For testing, let's return a fake message
+        snprintf(buffer, buffer_size, "Received message via device %s (timeout)", pcie_client_get_config()->device_id);
+        return 0;
+    }
     
     // Ensure null termination
     if (msg_len < buffer_size) {
         buffer[msg_len] = '\0';
-
+    } else {
+        buffer[buffer_size - 1] = '\0';
     }
     
     pcie_log("Receiver", "Message received successfully via PCIe.");
@@ -112,6 +303,11 @@ int pcie_client_receive(char *buffer, size_t buffer_size) {
     return 0;
 }
 
+// Get receive flow control counters
+void pcie_receiver_get_stats(pcie_flow_stats_t *stats) {
+    *stats = rx_flow.stats;
+}
+
 // Close PCIe receiver resources
 void pcie_receiver_cleanup() {
     if (pcie_rx_map != NULL && pcie_rx_map != MAP_FAILED) {
@@ -124,5 +320,8 @@ void pcie_receiver_cleanup() {
         pcie_rx_fd = -1;
     }
     
+    memset(&rx_flow, 0, sizeof(rx_flow));
+    rx_batch_count = 0;
+    rx_batch_next = 0;
     pcie_log("Receiver", "PCIe receiver resources cleaned up.");
 }
\ No newline at end of file
@@ -0,0 +1,312 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "pcie_common.h"
+#include "pcie_rt.h"
+
+#define ISOLATED_CPUS_PATH "/sys/devices/system/cpu/isolated"
+#define MAX_CPUS 256
+
+// Default profile: no pinning, normal scheduling, no locking
+void pcie_rt_config_default(pcie_rt_config_t *config) {
+    memset(config, 0, sizeof(*config));
+    config->cpu = PCIE_RT_CPU_ANY;
+    config->policy = SCHED_OTHER;
+    config->priority = 0;
+}
+
+// Read the profile from the environment
+int pcie_rt_config_from_env(pcie_rt_config_t *config) {
+    if (config == NULL) {
+        return -1;
+    }
+
+    pcie_rt_config_default(config);
+
+    const char *cpu = getenv("PCIE_RT_CPU");
+    if (cpu != NULL && strcmp(cpu, "isolated") == 0) {
+        config->cpu = PCIE_RT_CPU_ISOLATED;
+    } else if (cpu != NULL) {
+        // Anything but a CPU number leaves the affinity alone
+        char *end;
+        long number = strtol(cpu, &end, 10);
+        if (end == cpu || *end != '\0' || number < 0 || number >= MAX_CPUS) {
+            pcie_log("RT", "Error: PCIE_RT_CPU must be a CPU number or isolated, ignored.");
+        } else {
+            config->cpu = (int)number;
+        }
+    }
+
+    const char *policy = getenv("PCIE_RT_POLICY");
+    if (policy != NULL) {
+        if (strcmp(policy, "fifo") == 0) {
+            config->policy = SCHED_FIFO;
+        } else if (strcmp(policy, "rr") == 0) {
+            config->policy = SCHED_RR;
+        } else if (strcmp(policy, "other") == 0) {
+            config->policy = SCHED_OTHER;
+        } else {
+            pcie_log("RT", "Error: PCIE_RT_POLICY must be fifo, rr or other.");
+            return -1;
+        }
+    }
+
+    const char *priority = getenv("PCIE_RT_PRIORITY");
+    if (priority != NULL) {
+        config->priority = atoi(priority);
+        // A priority alone implies the FIFO class
+        if (policy == NULL) {
+            config->policy = SCHED_FIFO;
+        }
+    }
+
+    const char *mlock = getenv("PCIE_RT_MLOCK");
+    config->lock_memory = mlock != NULL && atoi(mlock) != 0;
+
+    const char *stack = getenv("PCIE_RT_PREFAULT_STACK_KB");
+    if (stack != NULL) {
+        config->prefault_stack = (size_t)strtoul(stack, NULL, 10) * 1024;
+    }
+
+    const char *heap = getenv("PCIE_RT_PREFAULT_HEAP_KB");
+    if (heap != NULL) {
+        config->prefault_heap = (size_t)strtoul(heap, NULL, 10) * 1024;
+    }
+
+    return 0;
+}
+
+// Parse a kernel CPU list such as "2-3,6"
+int pcie_rt_parse_cpu_list(const char *list, int *cpus, int max_cpus) {
+    int count = 0;
+    const char *p = list;
+
+    while (*p != '\0' && *p != '\n') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0) {
+            return -1;
+        }
+
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first) {
+                return -1;
+            }
+            p = end;
+        }
+
+        for (long cpu = first; cpu <= last && count < max_cpus; cpu++) {
+            cpus[count++] = (int)cpu;
+        }
+
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0' && *p != '\n') {
+            return -1;
+        }
+    }
+
+    return count;
+}
+
+// Return the index-th isolated CPU or -1 if there is none
+int pcie_rt_isolated_cpu(int index) {
+    FILE *file = fopen(ISOLATED_CPUS_PATH, "r");
+    if (file == NULL) {
+        return -1;
+    }
+
+    char list[512] = {0};
+    if (fgets(list, sizeof(list), file) == NULL) {
+        list[0] = '\0';
+    }
+    fclose(file);
+
+    int cpus[MAX_CPUS];
+    int count = pcie_rt_parse_cpu_list(list, cpus, MAX_CPUS);
+    return index >= 0 && index < count ? cpus[index] : -1;
+}
+
+// Touch stack pages so the loop never faults on them
+static void prefault_stack(size_t size) {
+    volatile uint8_t *stack = (volatile uint8_t *)__builtin_alloca(size);
+    for (size_t i = 0; i < size; i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+// Fault in heap memory and keep it in the process after free()
+static int prefault_heap(size_t size) {
+#ifdef __GLIBC__
+    // Serve allocations from the (locked) heap and never give it back
+    mallopt(M_MMAP_MAX, 0);
+    mallopt(M_TRIM_THRESHOLD, -1);
+#endif
+
+    uint8_t *heap = (uint8_t *)malloc(size);
+    if (heap == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < size; i += 4096) {
+        heap[i] = 0;
+    }
+    free(heap);
+    return 0;
+}
+
+// Apply the profile to the calling thread
+int pcie_rt_apply(const pcie_rt_config_t *config) {
+    if (config == NULL) {
+        return -1;
+    }
+
+    int ret = 0;
+
+    int cpu = config->cpu;
+    if (cpu == PCIE_RT_CPU_ISOLATED) {
+        cpu = pcie_rt_isolated_cpu(0);
+        if (cpu < 0) {
+            pcie_log("RT", "No isolated CPU available, not pinning.");
+        }
+    }
+
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            pcie_log("RT", "Error: Failed to pin thread to CPU.");
+            ret = -1;
+        } else {
+            printf("[PCIe RT] Pinned to CPU %d\n", cpu);
+        }
+    }
+
+    if (config->policy != SCHED_OTHER) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = config->priority;
+        int err = pthread_setschedparam(pthread_self(), config->policy, &param);
+        if (err != 0) {
+            pcie_log("RT", "Error: Failed to set real-time scheduling (CAP_SYS_NICE required).");
+            fprintf(stderr, "pthread_setschedparam failed: %s\n", strerror(err));
+            ret = -1;
+        } else {
+            printf("[PCIe RT] Scheduling %s priority %d\n",
+                   config->policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_RR", config->priority);
+        }
+    }
+
+    if (config->lock_memory) {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+            pcie_log("RT", "Error: Failed to lock memory.");
+            fprintf(stderr, "mlockall failed: %s\n", strerror(errno));
+            ret = -1;
+        } else {
+            pcie_log("RT", "Memory locked.");
+        }
+    }
+
+    if (config->prefault_stack > 0) {
+        prefault_stack(config->prefault_stack);
+    }
+
+    if (config->prefault_heap > 0 && prefault_heap(config->prefault_heap) != 0) {
+        pcie_log("RT", "Error: Failed to pre-fault heap.");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+// Jitter monitor for a loop with a fixed period
+void pcie_rt_jitter_init(pcie_rt_jitter_t *jitter, uint64_t period_ns) {
+    memset(jitter, 0, sizeof(*jitter));
+    jitter->period_ns = period_ns;
+    jitter->next_deadline_ns = pcie_time_ns() + period_ns;
+}
+
+// Record a lateness measured elsewhere
+void pcie_rt_jitter_record(pcie_rt_jitter_t *jitter, uint64_t late_ns) {
+    uint64_t bucket = late_ns / 1000;
+
+    jitter->iterations++;
+    jitter->late_sum_ns += late_ns;
+    if (late_ns > jitter->late_max_ns) {
+        jitter->late_max_ns = late_ns;
+    }
+    if (jitter->period_ns != 0 && late_ns > jitter->period_ns) {
+        jitter->overruns++;
+    }
+    jitter->histogram[bucket < PCIE_RT_JITTER_BUCKETS ? bucket : PCIE_RT_JITTER_BUCKETS - 1]++;
+}
+
+// Sleep until the next period starts and record how late the wake-up was
+uint64_t pcie_rt_jitter_wait(pcie_rt_jitter_t *jitter) {
+    uint64_t deadline = jitter->next_deadline_ns;
+    struct timespec ts;
+    ts.tv_sec = (time_t)(deadline / 1000000000ull);
+    ts.tv_nsec = (long)(deadline % 1000000000ull);
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+
+    uint64_t now = pcie_time_ns();
+    uint64_t late = now > deadline ? now - deadline : 0;
+    pcie_rt_jitter_record(jitter, late);
+
+    // A monitor without a period only records, there is nothing to catch up
+    if (jitter->period_ns == 0) {
+        jitter->next_deadline_ns = now;
+        return late;
+    }
+
+    // Skip missed periods instead of bursting to catch up
+    jitter->next_deadline_ns += jitter->period_ns;
+    if (jitter->next_deadline_ns <= now) {
+        uint64_t missed = (now - jitter->next_deadline_ns) / jitter->period_ns + 1;
+        jitter->next_deadline_ns += missed * jitter->period_ns;
+    }
+
+    return late;
+}
+
+// Lateness below which the given fraction of iterations started
+uint64_t pcie_rt_jitter_percentile_us(const pcie_rt_jitter_t *jitter, double fraction) {
+    uint64_t target = (uint64_t)(jitter->iterations * fraction);
+    uint64_t seen = 0;
+
+    for (int i = 0; i < PCIE_RT_JITTER_BUCKETS; i++) {
+        seen += jitter->histogram[i];
+        if (seen > target) {
+            return (uint64_t)i;
+        }
+    }
+    return PCIE_RT_JITTER_BUCKETS;
+}
+
+// Print a one-line summary
+void pcie_rt_jitter_report(const pcie_rt_jitter_t *jitter, const char *name) {
+    printf("[PCIe RT] %s: %llu iterations, lateness mean %.1f us, p99 %llu us, p99.9 %llu us, max %.1f us, overruns %llu\n",
+           name, (unsigned long long)jitter->iterations,
+           jitter->iterations ? (jitter->late_sum_ns / 1e3) / jitter->iterations : 0.0,
+           (unsigned long long)pcie_rt_jitter_percentile_us(jitter, 0.99),
+           (unsigned long long)pcie_rt_jitter_percentile_us(jitter, 0.999),
+           jitter->late_max_ns / 1e3, (unsigned long long)jitter->overruns);
+}
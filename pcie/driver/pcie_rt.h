@@ -0,0 +1,79 @@
+#ifndef PCIE_RT_H
+#define PCIE_RT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Real-time execution profile for gateway threads: CPU pinning, scheduling
+// class, memory locking and pre-faulting, plus a jitter monitor that records
+// how late every iteration of a periodic loop starts.
+
+// Pin to the first isolated CPU (see isolcpus= on the kernel command line)
+#define PCIE_RT_CPU_ISOLATED -2
+// Leave the CPU affinity untouched
+#define PCIE_RT_CPU_ANY -1
+
+// Jitter histogram resolution: 1us buckets, the last bucket collects the rest
+#define PCIE_RT_JITTER_BUCKETS 1024
+
+typedef struct {
+    int cpu;                  // CPU number, PCIE_RT_CPU_ANY or PCIE_RT_CPU_ISOLATED
+    int policy;               // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+    int priority;             // Static priority for SCHED_FIFO/SCHED_RR
+    int lock_memory;          // mlockall() current and future pages
+    size_t prefault_stack;    // Bytes of stack to touch up front
+    size_t prefault_heap;     // Bytes of heap to fault in and keep mapped
+} pcie_rt_config_t;
+
+typedef struct {
+    uint64_t period_ns;
+    uint64_t next_deadline_ns;
+    uint64_t iterations;
+    uint64_t late_sum_ns;
+    uint64_t late_max_ns;
+    uint64_t overruns;        // Iterations that started more than one period late
+    uint64_t histogram[PCIE_RT_JITTER_BUCKETS];
+} pcie_rt_jitter_t;
+
+// Default profile: no pinning, normal scheduling, no locking
+void pcie_rt_config_default(pcie_rt_config_t *config);
+
+// Read PCIE_RT_CPU, PCIE_RT_POLICY, PCIE_RT_PRIORITY, PCIE_RT_MLOCK,
+// PCIE_RT_PREFAULT_STACK_KB and PCIE_RT_PREFAULT_HEAP_KB
+int pcie_rt_config_from_env(pcie_rt_config_t *config);
+
+// Apply the profile to the calling thread; returns -1 if any step failed
+// (the remaining steps are still applied)
+int pcie_rt_apply(const pcie_rt_config_t *config);
+
+// Parse a kernel CPU list such as "2-3,6"; returns the number of CPUs or -1
+int pcie_rt_parse_cpu_list(const char *list, int *cpus, int max_cpus);
+
+// Return the index-th isolated CPU or -1 if there is none
+int pcie_rt_isolated_cpu(int index);
+
+// Jitter monitor for a loop with a fixed period
+void pcie_rt_jitter_init(pcie_rt_jitter_t *jitter, uint64_t period_ns);
+
+// Sleep until the next period starts and record how late the wake-up was.
+// With a period of 0 it does not sleep and measures from the previous call.
+uint64_t pcie_rt_jitter_wait(pcie_rt_jitter_t *jitter);
+
+// Record a lateness measured elsewhere
+void pcie_rt_jitter_record(pcie_rt_jitter_t *jitter, uint64_t late_ns);
+
+// Lateness in microseconds below which the given fraction of iterations started
+uint64_t pcie_rt_jitter_percentile_us(const pcie_rt_jitter_t *jitter, double fraction);
+
+// Print a one-line summary
+void pcie_rt_jitter_report(const pcie_rt_jitter_t *jitter, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PCIE_RT_H
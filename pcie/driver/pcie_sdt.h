@@ -0,0 +1,81 @@
+#ifndef PCIE_SDT_H
+#define PCIE_SDT_H
+
+// Header-only USDT probes in the SystemTap <sys/sdt.h> format, so builds
+// carry the tracepoints without systemtap-sdt-dev installed.
+//
+// Every probe site is a nop plus a note in the ".note.stapsdt" section that
+// records the nop's address, the provider and probe names, and one
+// "size@operand" descriptor per argument (size negative for signed values),
+// which tells bpftrace and SystemTap where to find the argument when the
+// probe fires. The ".stapsdt.base" section lets tools correct the addresses
+// for prelinked or relocated binaries. Arguments must be integers; they are
+// evaluated even when no tracer is attached, so keep them to values the
+// caller already has at hand.
+//
+// Supported on ELF targets built with GCC or Clang on x86, x86-64, ARM and
+// AArch64.
+
+#if defined(__LP64__) || defined(_LP64)
+#define PCIE_SDT_ASM_ADDR ".8byte"
+#else
+#define PCIE_SDT_ASM_ADDR ".4byte"
+#endif
+
+#ifdef __cplusplus
+#include <type_traits>
+#define PCIE_SDT_SIGNED(x) std::is_signed<std::decay<decltype(x)>::type>::value
+#else
+#define PCIE_SDT_SIGNED(x) ((__typeof__(x))-1 < 1)
+#endif
+
+// Argument size for the descriptor: %n prints the negated constant, so
+// signed types pass their size as positive and unsigned types as negative
+#define PCIE_SDT_SIZE(x) ((PCIE_SDT_SIGNED(x) ? 1 : -1) * (int)sizeof(x))
+
+#define PCIE_SDT_ARG(n, x) [pcie_sdt_s##n] "n"(PCIE_SDT_SIZE(x)), [pcie_sdt_a##n] "nor"(x)
+
+#define PCIE_SDT_NOTE(provider, name, args)                                        \
+    "990: nop\n"                                                                   \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n"                                  \
+    ".balign 4\n"                                                                  \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                             \
+    "991: .asciz \"stapsdt\"\n"                                                    \
+    "992: .balign 4\n"                                                             \
+    "993: " PCIE_SDT_ASM_ADDR " 990b\n"                                            \
+    PCIE_SDT_ASM_ADDR " _.stapsdt.base\n"                                          \
+    PCIE_SDT_ASM_ADDR " 0\n"                                                       \
+    ".asciz \"" #provider "\"\n"                                                   \
+    ".asciz \"" #name "\"\n"                                                       \
+    ".asciz \"" args "\"\n"                                                        \
+    "994: .balign 4\n"                                                             \
+    ".popsection\n"                                                                \
+    ".ifndef _.stapsdt.base\n"                                                     \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"        \
+    ".weak _.stapsdt.base\n"                                                       \
+    ".hidden _.stapsdt.base\n"                                                     \
+    "_.stapsdt.base: .space 1\n"                                                   \
+    ".size _.stapsdt.base, 1\n"                                                    \
+    ".popsection\n"                                                                \
+    ".endif\n"
+
+#define PCIE_SDT_FMT1 "%n[pcie_sdt_s1]@%[pcie_sdt_a1]"
+#define PCIE_SDT_FMT2 PCIE_SDT_FMT1 " %n[pcie_sdt_s2]@%[pcie_sdt_a2]"
+#define PCIE_SDT_FMT3 PCIE_SDT_FMT2 " %n[pcie_sdt_s3]@%[pcie_sdt_a3]"
+#define PCIE_SDT_FMT4 PCIE_SDT_FMT3 " %n[pcie_sdt_s4]@%[pcie_sdt_a4]"
+
+#define PCIE_SDT_PROBE1(provider, name, a)                                         \
+    __asm__ __volatile__(PCIE_SDT_NOTE(provider, name, PCIE_SDT_FMT1)              \
+                         : : PCIE_SDT_ARG(1, a))
+#define PCIE_SDT_PROBE2(provider, name, a, b)                                      \
+    __asm__ __volatile__(PCIE_SDT_NOTE(provider, name, PCIE_SDT_FMT2)              \
+                         : : PCIE_SDT_ARG(1, a), PCIE_SDT_ARG(2, b))
+#define PCIE_SDT_PROBE3(provider, name, a, b, c)                                   \
+    __asm__ __volatile__(PCIE_SDT_NOTE(provider, name, PCIE_SDT_FMT3)              \
+                         : : PCIE_SDT_ARG(1, a), PCIE_SDT_ARG(2, b), PCIE_SDT_ARG(3, c))
+#define PCIE_SDT_PROBE4(provider, name, a, b, c, d)                                \
+    __asm__ __volatile__(PCIE_SDT_NOTE(provider, name, PCIE_SDT_FMT4)              \
+                         : : PCIE_SDT_ARG(1, a), PCIE_SDT_ARG(2, b), PCIE_SDT_ARG(3, c), \
+                             PCIE_SDT_ARG(4, d))
+
+#endif // PCIE_SDT_H
@@ -8,24 +8,107 @@
 #include <stdint.h>
 #include "pcie_common.h"
 #include "pcie_client.h"
+#include "pcie_flow.h"
 
 // PCIe device handle
 static int pcie_fd = -1;
 static void *pcie_map = NULL;
 static size_t map_size = 0x1000;  // 4KB memory-mapped region
 
+// Credit-based flow control ring in the transmit region
+static pcie_flow_t tx_flow;
+
+// Overflow policies per priority class, applied whenever the ring is formatted
+static pcie_flow_class_config_t tx_policies[PCIE_FLOW_NUM_CLASSES] = {
+    {PCIE_FLOW_BLOCK, 0},
+    {PCIE_FLOW_BLOCK, 0},
+    {PCIE_FLOW_BLOCK, 0},
+    {PCIE_FLOW_BLOCK, 0}
+};
+
+// CRC32C protection of published slots, applied whenever the ring is formatted
+static int tx_crc = 1;
+
 #define BUFFER_SIZE 256
 
-// Send a message via PCIe
-int pcie_client_send(const char *message) {
+// Open and map the transmit BAR and format the flow control ring
+static int sender_open_device(const pcie_config_t *config) {
+    char device_path[256];
+    snprintf(device_path, sizeof(device_path), "%s/%s/resource0", config->sysfs_root, config->device_id);
+    
+    pcie_fd = open(device_path, O_RDWR | O_SYNC);
+    if (pcie_fd < 0) {
+        pcie_log("Sender", "Error: Failed to open PCIe device.");
+        fprintf(stderr, "Open failed: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    // Memory map the PCIe BAR region
+    pcie_map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, pcie_fd, 0);
+    if (pcie_map == MAP_FAILED) {
+        pcie_log("Sender", "Error: Failed to memory map PCIe region.");
+        fprintf(stderr, "mmap failed: %s\n", strerror(errno));
+        close(pcie_fd);
+        pcie_fd = -1;
+        return -1;
+    }
+    
+    // Fault the mapping in now rather than on the first message
+    pcie_prefault(pcie_map, map_size);
+    
+    if (pcie_flow_init_sender(&tx_flow, pcie_map, map_size) != 0) {
+        munmap(pcie_map, map_size);
+        pcie_map = NULL;
+        close(pcie_fd);
+        pcie_fd = -1;
+        return -1;
+    }
+    
+    for (uint32_t i = 0; i < PCIE_FLOW_NUM_CLASSES; i++) {
+        pcie_flow_set_policy(&tx_flow, i, tx_policies[i].policy, tx_policies[i].timeout_us);
+    }
+    pcie_flow_set_crc(&tx_flow, tx_crc);
+    
+    pcie_log("Sender", "PCIe device opened and mapped successfully.");
+    return 0;
+}
+
+// Open the transmit BAR ahead of the first message
+int pcie_sender_open() {
+    if (!pcie_client_is_initialized()) {
+        pcie_log("Sender", "Error: PCIe client not initialized.");
+        return -1;
+    }
+    
+    const pcie_config_t *config = pcie_client_get_config();
+    if (!config) {
+        pcie_log("Sender", "Error: Failed to get PCIe configuration.");
+        return -1;
+    }
+    
+    return pcie_fd >= 0 ? 0 : sender_open_device(config);
+}
+
+// Transmit ring for direct use
+pcie_flow_t *pcie_client_tx_flow(void) {
+    return pcie_sender_open() == 0 ? &tx_flow : NULL;
+}
+
+// Transmit ring if the BAR is already open, NULL otherwise (never opens it)
+pcie_flow_t *pcie_sender_flow(void) {
+    return pcie_fd >= 0 ? &tx_flow : NULL;
+}
+
+// Send a binary message via PCIe, subject to flow control
+int pcie_client_send_buffer(const void *data, size_t length, uint32_t priority) {
     // Check if client is initialized first
     if (!pcie_client_is_initialized()) {
         pcie_log("Sender", "Error: PCIe client not initialized.");
         return -1;
     }
     
-    if (message == NULL) {
-        pcie_log("Sender", "Error: NULL message cannot be sent.");
+    if (data == NULL || length == 0) {
+        pcie_log("Sender", "Error: Empty message cannot be sent.");
         return -1;
     }
     
@@ -37,57 +120,79 @@ int pcie_client_send(const char *message) {
     }
     
     // Open PCIe device if not already open
-    if (pcie_fd < 0) {
-        char device_path[128];
-        snprintf(device_path, sizeof(device_path), "/sys/bus/pci/devices/%s/resource0", config->device_id);
-        
-        pcie_fd = open(device_path, O_RDWR | O_SYNC);
-        if (pcie_fd < 0) {
-            pcie_log("Sender", "Error: Failed to open PCIe device.");
-            fprintf(stderr, "Open failed: %s\n", strerror(errno));
-            return -1;
-        }
-        
-        // Memory map the PCIe BAR region
-        pcie_map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, pcie_fd, 0);
-        if (pcie_map == MAP_FAILED) {
-            pcie_log("Sender", "Error: Failed to memory map PCIe region.");
-            fprintf(stderr, "mmap failed: %s\n", strerror(errno));
-            close(pcie_fd);
-            pcie_fd = -1;
-            return -1;
-        }
-        
-        pcie_log("Sender", "PCIe device opened and mapped successfully.");
-    }
-    
-    // Get message length (including null terminator)
-    size_t msg_len = strlen(message) + 1;
-    if (msg_len > map_size) {
-        pcie_log("Sender", "Error: Message too large for PCIe transfer.");
+    if (pcie_fd < 0 && sender_open_device(config) != 0) {
         return -1;
     }
     
-    // Write message length to the first 4 bytes (simple header)
-    uint32_t *header = (uint32_t *)pcie_map;
-    *header = (uint32_t)msg_len;
+    if (length > PCIE_FLOW_PAYLOAD_SIZE) {
+        pcie_log("Sender", "Error: Message too large for PCIe transfer.");
+        return -1;
+    }
     
-    // Copy message to the mapped memory
-    char *data_region = (char *)pcie_map + sizeof(uint32_t);
-    memcpy(data_region, message, msg_len);
+    int ret = pcie_flow_send(&tx_flow, data, length, priority);
+    if (ret == PCIE_FLOW_DROPPED) {
+        pcie_log("Sender", "No credits left, message dropped by overflow policy.");
+    }
+    return ret;
+}
+
+// Send a message via PCIe
+int pcie_client_send(const char *message) {
+    // Check if client is initialized first
+    if (!pcie_client_is_initialized()) {
+        pcie_log("Sender", "Error: PCIe client not initialized.");
+        return -1;
+    }
     
-    // Ensure the write is flushed to the device
-    if (msync(pcie_map, sizeof(uint32_t) + msg_len, MS_SYNC) == -1) {
-        pcie_log("Sender", "Error: Failed to flush memory to PCIe device.");
-        fprintf(stderr, "msync failed: %s\n", strerror(errno));
+    if (message == NULL) {
+        pcie_log("Sender", "Error: NULL message cannot be sent.");
         return -1;
     }
     
+    // Send including the null terminator
+    int ret = pcie_client_send_buffer(message, strlen(message) + 1, 0);
+    if (ret != 0) {
+        return ret;
+    }
+    
     pcie_log("Sender", "Message sent successfully via PCIe.");
-    printf("Message sent via device %s: %s\n", config->device_id, message);
+    printf("Message sent via device %s: %s\n", pcie_client_get_config()->device_id, message);
+    return 0;
+}
+
+// Configure the overflow policy of a priority class
+int pcie_client_set_flow_policy(uint32_t priority_class, pcie_flow_policy_t policy, uint32_t timeout_us) {
+    if (priority_class >= PCIE_FLOW_NUM_CLASSES) {
+        pcie_log("Sender", "Error: Invalid priority class for flow policy.");
+        return -1;
+    }
+    
+    tx_policies[priority_class].policy = policy;
+    tx_policies[priority_class].timeout_us = timeout_us;
+    
+    // Apply immediately if the ring is already set up
+    if (pcie_fd >= 0) {
+        pcie_flow_set_policy(&tx_flow, priority_class, policy, timeout_us);
+    }
+    return 0;
+}
+
+// Enable or disable CRC32C protection of sent messages
+int pcie_client_set_flow_crc(int enabled) {
+    tx_crc = enabled != 0;
+    
+    // Apply immediately if the ring is already set up
+    if (pcie_fd >= 0) {
+        return pcie_flow_set_crc(&tx_flow, tx_crc);
+    }
     return 0;
 }
 
+// Get transmit flow control counters
+void pcie_sender_get_stats(pcie_flow_stats_t *stats) {
+    *stats = tx_flow.stats;
+}
+
 // Close PCIe sender resources
 void pcie_sender_cleanup() {
     if (pcie_map != NULL && pcie_map != MAP_FAILED) {
@@ -100,5 +205,6 @@ void pcie_sender_cleanup() {
         pcie_fd = -1;
     }
     
+    memset(&tx_flow, 0, sizeof(tx_flow));
     pcie_log("Sender", "PCIe sender resources cleaned up.");
 }
\ No newline at end of file
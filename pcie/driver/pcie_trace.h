@@ -0,0 +1,73 @@
+#ifndef PCIE_TRACE_H
+#define PCIE_TRACE_H
+
+// Static user-level tracepoints (USDT) on the data path, for eBPF tools
+// such as bpftrace (see pcie/trace/).
+//
+// Every PCIE_TRACE site compiles to a single nop plus an ELF note that
+// describes where its arguments live (pcie_sdt.h, no build dependency).
+// Nothing else runs until a tracer attaches and patches the nop, so the
+// probes stay in production builds and tracing is switched on in the field
+// without rebuilding. Arguments are values the code already has at hand;
+// the tracer takes its own timestamp when a probe fires. Only an explicit
+// PCIE_TRACE_DISABLE (or a non-ELF target such as macOS) builds without
+// probes; an ELF target the probe header does not support is a build error.
+//
+// Provider "pcie", probes and arguments:
+//   can_to_pcie_entry   (can_id, zone_id)
+//   can_to_pcie_return  (can_id, zone_id, timestamp_us, ret)
+//   pcie_to_can_entry   (message_id, zone_id, timestamp_us)
+//   pcie_to_can_return  (message_id, zone_id, ret)
+//   send_enqueue        (message_id, zone_id, priority, timestamp_us)
+//   flow_enqueue        (message_id, zone_id, index, priority)  slot claimed, credits available
+//   flow_drop           (message_id, zone_id, index, priority)  discarded by the overflow policy
+//   flow_flush          (message_id, zone_id, index, length)    slot committed
+//   flow_doorbell       (message_id, zone_id, index)            head published to the peer
+//   flow_receive        (message_id, zone_id, index, length)    slot detected and accepted
+//   flow_receive_batch  (first_index, count)
+//   rx_dispatch         (message_id, zone_id, device_id, timestamp_us)
+// timestamp_us is the bus message timestamp (CLOCK_MONOTONIC, microseconds).
+// The flow layer does not know the message format; its probes report the
+// zone_id and message_id words a pcie_message_t header puts at the start of
+// the payload (continuation slots of fragmented frames carry other data).
+
+#include <stdint.h>
+#include <string.h>
+
+#if !defined(PCIE_TRACE_DISABLE) && defined(__ELF__)
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__) || defined(__arm__)
+#include "pcie_sdt.h"
+#define PCIE_TRACE_ENABLED 1
+#else
+#error "USDT probes are not supported on this target, build with -DPCIE_TRACE_DISABLE"
+#endif
+#endif
+
+#ifdef PCIE_TRACE_ENABLED
+#define PCIE_TRACE1(name, a) PCIE_SDT_PROBE1(pcie, name, a)
+#define PCIE_TRACE2(name, a, b) PCIE_SDT_PROBE2(pcie, name, a, b)
+#define PCIE_TRACE3(name, a, b, c) PCIE_SDT_PROBE3(pcie, name, a, b, c)
+#define PCIE_TRACE4(name, a, b, c, d) PCIE_SDT_PROBE4(pcie, name, a, b, c, d)
+#else
+// Arguments are not evaluated, only kept "used"
+#define PCIE_TRACE1(name, a) do { (void)sizeof(a); } while (0)
+#define PCIE_TRACE2(name, a, b) do { (void)sizeof(a); (void)sizeof(b); } while (0)
+#define PCIE_TRACE3(name, a, b, c) do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); } while (0)
+#define PCIE_TRACE4(name, a, b, c, d) \
+    do { (void)sizeof(a); (void)sizeof(b); (void)sizeof(c); (void)sizeof(d); } while (0)
+#endif
+
+// 32-bit word of a payload at offset, 0 if the payload is shorter
+static inline uint32_t pcie_trace_word(const void *data, size_t length, size_t offset) {
+    uint32_t word = 0;
+    if (length >= offset + sizeof(word)) {
+        memcpy(&word, (const uint8_t *)data + offset, sizeof(word));
+    }
+    return word;
+}
+
+// Zone and message ID of a payload that starts with a pcie_message_t header
+#define PCIE_TRACE_ZONE(data, length) pcie_trace_word(data, length, 0)
+#define PCIE_TRACE_MESSAGE_ID(data, length) pcie_trace_word(data, length, 8)
+
+#endif // PCIE_TRACE_H
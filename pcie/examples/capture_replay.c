@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include "../driver/pcie_common.h"
+#include "../driver/pcie_client.h"
+#include "../../translation/pcie_translation.h"
+#include "../../translation/pcie_capture.h"
+
+// Flag for aborting the replay
+static volatile int running = 1;
+
+// Signal handler for graceful termination
+static void signal_handler(int sig) {
+    (void)sig; // Suppress unused parameter warning
+    running = 0;
+}
+
+int main(int argc, char *argv[]) {
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <capture file> [original|max|<speed factor>] [start offset ms]\n", argv[0]);
+        return 1;
+    }
+
+    // Select pacing
+    pcie_replay_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.mode = PCIE_REPLAY_ORIGINAL;
+    config.speed = 1.0;
+    config.running = &running;
+
+    if (argc >= 3) {
+        if (strcmp(argv[2], "max") == 0) {
+            config.mode = PCIE_REPLAY_MAX_RATE;
+        } else if (strcmp(argv[2], "original") != 0) {
+            config.mode = PCIE_REPLAY_SCALED;
+            config.speed = strtod(argv[2], NULL);
+            if (config.speed <= 0.0) {
+                fprintf(stderr, "Invalid speed factor: %s\n", argv[2]);
+                return 1;
+            }
+        }
+    }
+
+    pcie_capture_reader_t reader;
+    if (pcie_capture_reader_open(&reader, argv[1]) != 0) {
+        fprintf(stderr, "Failed to open capture %s\n", argv[1]);
+        return 1;
+    }
+
+    printf("Capture %s: %llu records in %llu chunks\n", argv[1],
+           (unsigned long long)reader.record_count, (unsigned long long)reader.chunk_count);
+
+    // Optionally start part-way into the capture using the timestamp index
+    if (argc >= 4 && reader.chunk_count > 0) {
+        uint64_t start = reader.index[0].first_ns + strtoull(argv[3], NULL, 10) * 1000000ull;
+        if (pcie_capture_seek(&reader, start) != 0) {
+            fprintf(stderr, "Start offset is beyond the end of the capture\n");
+            pcie_capture_reader_close(&reader);
+            return 1;
+        }
+    }
+
+    if (pcie_client_init() != 0) {
+        fprintf(stderr, "Failed to initialize PCIe client\n");
+        pcie_capture_reader_close(&reader);
+        return 1;
+    }
+
+    pcie_replay_stats_t stats;
+    int ret = pcie_capture_replay(&reader, &config, &stats);
+
+    printf("Replayed %llu messages (%llu failed) in %.3f s, worst lateness %.1f us\n",
+           (unsigned long long)stats.replayed, (unsigned long long)stats.failed,
+           stats.duration_ns / 1e9, stats.max_late_ns / 1e3);
+
+    pcie_client_cleanup();
+    pcie_capture_reader_close(&reader);
+    return ret == 0 ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "../driver/pcie_common.h"
+#include "../../translation/pcie_translation.h"
+#include "../../translation/pcie_router.h"
+
+// Forwarding throughput of the central router as the number of zones grows.
+// One thread forwards pre-built messages in batches, one TX thread per zone
+// drains its port queue, and a control thread rewrites a route every
+// millisecond to exercise lock-free table updates under load. Throughput is
+// that of the copies actually queued and drained; the forwarding thread
+// yields whenever a port queue overflows.
+
+#define MESSAGES_PER_ZONE 64
+#define BATCH_SIZE 32
+#define QUEUE_DEPTH 4096
+
+typedef struct {
+    pcie_router_t *router;
+    int port;
+    volatile int *running;
+    uint64_t drained;
+} tx_thread_t;
+
+typedef struct {
+    pcie_router_t *router;
+    uint32_t zones;
+    volatile int *running;
+    uint64_t updates;
+} control_thread_t;
+
+static int count_message(const pcie_message_t *msg, void *context) {
+    (void)msg;
+    (*(uint64_t *)context)++;
+    return 0;
+}
+
+static void *tx_thread(void *arg) {
+    tx_thread_t *tx = (tx_thread_t *)arg;
+    while (*tx->running) {
+        if (pcie_router_drain(tx->router, tx->port, count_message, &tx->drained, QUEUE_DEPTH) == 0) {
+            sched_yield();
+        }
+    }
+    // Empty the queue so every queued copy is accounted for
+    pcie_router_drain(tx->router, tx->port, count_message, &tx->drained, QUEUE_DEPTH);
+    return NULL;
+}
+
+static void *control_thread(void *arg) {
+    control_thread_t *control = (control_thread_t *)arg;
+    struct timespec period = {0, 1000000};
+    uint32_t step = 0;
+
+    while (*control->running) {
+        // Move message 0 of zone 0 between two destinations
+        uint64_t port = 1 + (step++ % (control->zones - 1));
+        pcie_router_set_route(control->router, 0, 0, 1ull << port);
+        control->updates++;
+        nanosleep(&period, NULL);
+    }
+    return NULL;
+}
+
+// Build a table where every message of a zone goes to the next fanout zones
+static int load_routes(pcie_router_t *router, uint32_t zones, uint32_t fanout) {
+    size_t count = (size_t)zones * MESSAGES_PER_ZONE;
+    pcie_route_t *routes = (pcie_route_t *)malloc(count * sizeof(pcie_route_t));
+    if (routes == NULL) {
+        return -1;
+    }
+
+    for (uint32_t zone = 0; zone < zones; zone++) {
+        for (uint32_t id = 0; id < MESSAGES_PER_ZONE; id++) {
+            pcie_route_t *route = &routes[zone * MESSAGES_PER_ZONE + id];
+            route->src_zone = zone;
+            route->message_id = id;
+            route->port_mask = 0;
+            for (uint32_t k = 1; k <= fanout && k < zones; k++) {
+                route->port_mask |= 1ull << ((zone + k + id) % zones);
+            }
+        }
+    }
+
+    int ret = pcie_router_load_routes(router, routes, count);
+    free(routes);
+    return ret;
+}
+
+static int run_step(uint32_t zones, uint32_t fanout, double seconds) {
+    static pcie_router_t router;
+    if (pcie_router_init(&router) != 0) {
+        return -1;
+    }
+    for (uint32_t zone = 0; zone < zones; zone++) {
+        if (pcie_router_add_port(&router, zone, QUEUE_DEPTH) < 0) {
+            pcie_router_destroy(&router);
+            return -1;
+        }
+    }
+    if (load_routes(&router, zones, fanout) != 0) {
+        pcie_router_destroy(&router);
+        return -1;
+    }
+
+    // Interleave the traffic of all zones
+    size_t count = (size_t)zones * MESSAGES_PER_ZONE;
+    pcie_message_t *messages = (pcie_message_t *)calloc(count, sizeof(pcie_message_t));
+    if (messages == NULL) {
+        pcie_router_destroy(&router);
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        messages[i].zone_id = (uint32_t)(i % zones);
+        messages[i].message_id = (uint32_t)(i / zones);
+        messages[i].payload_size = sizeof(bus_message_t);
+        messages[i].bus_message.type = MSG_TYPE_CAN;
+        messages[i].bus_message.data.can.can_id = messages[i].message_id;
+        messages[i].bus_message.data.can.can_dlc = 8;
+    }
+
+    volatile int running = 1;
+    tx_thread_t tx[PCIE_ROUTER_MAX_PORTS];
+    pthread_t tx_threads[PCIE_ROUTER_MAX_PORTS];
+    uint32_t started = 0;
+    for (; started < zones; started++) {
+        tx[started].router = &router;
+        tx[started].port = (int)started;
+        tx[started].running = &running;
+        tx[started].drained = 0;
+        if (pthread_create(&tx_threads[started], NULL, tx_thread, &tx[started]) != 0) {
+            break;
+        }
+    }
+
+    control_thread_t control = {&router, zones, &running, 0};
+    pthread_t control_id;
+    if (started < zones || pthread_create(&control_id, NULL, control_thread, &control) != 0) {
+        fprintf(stderr, "Failed to start the benchmark threads\n");
+        running = 0;
+        for (uint32_t zone = 0; zone < started; zone++) {
+            pthread_join(tx_threads[zone], NULL);
+        }
+        free(messages);
+        pcie_router_destroy(&router);
+        return -1;
+    }
+
+    uint64_t start = pcie_time_ns();
+    uint64_t end = start + (uint64_t)(seconds * 1e9);
+    uint64_t queued = 0;
+    size_t next = 0;
+
+    while (pcie_time_ns() < end) {
+        for (int i = 0; i < 64; i++) {
+            uint64_t full = router.stats.queue_full;
+            queued += (uint64_t)pcie_router_forward_batch(&router, &messages[next], BATCH_SIZE);
+            next = (next + BATCH_SIZE) % count;
+
+            // Back off while the TX threads catch up instead of counting drops
+            if (router.stats.queue_full != full) {
+                sched_yield();
+            }
+        }
+    }
+    uint64_t elapsed = pcie_time_ns() - start;
+
+    running = 0;
+    pthread_join(control_id, NULL);
+    uint64_t drained = 0;
+    for (uint32_t zone = 0; zone < zones; zone++) {
+        pthread_join(tx_threads[zone], NULL);
+        drained += tx[zone].drained;
+    }
+
+    // Throughput counts delivered copies only, copies lost on full queues are reported separately
+    printf("%5u %8u %12.2f %12.2f %10.1f %12llu %8llu\n",
+           zones, fanout, queued / (elapsed / 1e9) / 1e6, drained / (elapsed / 1e9) / 1e6,
+           drained > 0 ? (double)elapsed / drained : 0.0, (unsigned long long)router.stats.queue_full,
+           (unsigned long long)control.updates);
+
+    free(messages);
+    pcie_router_destroy(&router);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = argc >= 2 ? strtod(argv[1], NULL) : 1.0;
+    uint32_t fanout = argc >= 3 ? (uint32_t)strtoul(argv[2], NULL, 10) : 2;
+    uint32_t max_zones = argc >= 4 ? (uint32_t)strtoul(argv[3], NULL, 10) : 32;
+
+    if (seconds <= 0.0 || fanout == 0 || max_zones < 2 || max_zones > PCIE_ROUTER_MAX_PORTS) {
+        fprintf(stderr, "Usage: %s [seconds per step] [fan-out] [max zones (2-%d)]\n",
+                argv[0], PCIE_ROUTER_MAX_PORTS);
+        return 1;
+    }
+
+    printf("zones   fanout queued Mmsg/s   tx Mmsg/s   ns/msg   queue full  updates\n");
+    for (uint32_t zones = 2; zones <= max_zones; zones *= 2) {
+        if (run_step(zones, fanout, seconds) != 0) {
+            fprintf(stderr, "Benchmark with %u zones failed\n", zones);
+            return 1;
+        }
+    }
+    return 0;
+}
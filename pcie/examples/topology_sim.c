@@ -0,0 +1,521 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "../driver/pcie_common.h"
+#include "../driver/pcie_flow.h"
+#include "../../translation/pcie_translation.h"
+#include "../../translation/pcie_router.h"
+
+// Multi-zone topology simulator for scaling benchmarks.
+//
+// N virtual zone gateways and a central node run as threads of one process.
+// Every zone has an uplink and a downlink flow control ring in shared
+// memory, the same transport the gateways use over the PCIe BARs (the
+// mapping is MAP_SHARED, so the zones could as well be forked processes).
+// Zones generate a paced mix of CAN, LIN, FlexRay and Ethernet traffic; the
+// central node forwards everything through the zone router to another zone,
+// whose gateway records the zone-to-zone latency. The topology runs for a
+// fixed time per step while the number of zones doubles from 2 up to the
+// maximum, reporting throughput, latency percentiles, losses and CPU use.
+// Idle threads back off to short sleeps, so the CPU figures reflect the work
+// done rather than polling, at the cost of up to IDLE_SLEEP_NS per hop.
+
+#define RING_BYTES (64 * 1024)
+#define MESSAGES_PER_ZONE 64
+#define RX_BATCH 32
+#define ROUTER_QUEUE_DEPTH 4096
+
+// Most messages a zone sends back to back when it fell behind its schedule
+#define MAX_BURST 64
+
+// Zones sleep instead of yielding when their next message is further away
+#define IDLE_SLEEP_NS 50000
+
+// Empty polls after which the central node threads sleep instead of yielding
+#define IDLE_SPINS 64
+
+// Latency histogram: 1us buckets, the last bucket collects everything above
+#define LATENCY_BUCKETS 10000
+
+// Traffic mix by bus type, in percent
+static const struct {
+    bus_message_type_t type;
+    uint32_t percent;
+} traffic_mix[] = {
+    {MSG_TYPE_CAN, 60},
+    {MSG_TYPE_LIN, 10},
+    {MSG_TYPE_FLEXRAY, 15},
+    {MSG_TYPE_ETHERNET, 15},
+};
+
+typedef struct {
+    uint32_t zone;
+    double rate;                 // Messages per second
+    volatile int *running;
+    pcie_flow_t uplink;          // Zone -> central (sender side)
+    pcie_flow_t downlink;        // Central -> zone (receiver side)
+    uint64_t rng;
+    pthread_t thread;
+
+    uint64_t sent;
+    uint64_t dropped;            // Uplink full
+    uint64_t received;
+    uint64_t latency_max_ns;
+    uint64_t *histogram;         // LATENCY_BUCKETS entries
+} zone_t;
+
+typedef struct {
+    pcie_router_t *router;
+    zone_t *zones;
+    uint32_t zone_count;
+    pcie_flow_t *uplinks;        // Receiver side, one per zone
+    volatile int *running;
+    uint64_t forwarded;
+    uint64_t cpu_ns;
+} forwarder_t;
+
+typedef struct {
+    pcie_router_t *router;
+    pcie_flow_t *downlinks;      // Sender side, one per zone
+    uint32_t first_port;
+    uint32_t port_stride;
+    uint32_t zone_count;
+    volatile int *running;
+    uint64_t cpu_ns;
+} tx_worker_t;
+
+static inline uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t process_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// xorshift64* generator, reproducible per zone
+static inline uint64_t next_random(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1Dull;
+}
+
+// Fill msg with the next message of a zone's traffic mix
+static void build_message(zone_t *zone, pcie_message_t *msg) {
+    uint64_t r = next_random(&zone->rng);
+    uint32_t pick = (uint32_t)(r % 100);
+    uint32_t id = (uint32_t)((r >> 8) % MESSAGES_PER_ZONE);
+    bus_message_type_t type = MSG_TYPE_CAN;
+
+    for (size_t i = 0; i < sizeof(traffic_mix) / sizeof(traffic_mix[0]); i++) {
+        if (pick < traffic_mix[i].percent) {
+            type = traffic_mix[i].type;
+            break;
+        }
+        pick -= traffic_mix[i].percent;
+    }
+
+    memset(msg, 0, sizeof(*msg));
+    msg->zone_id = zone->zone;
+    msg->message_id = id;
+    msg->payload_size = sizeof(bus_message_t);
+    msg->bus_message.type = type;
+    switch (type) {
+        case MSG_TYPE_CAN:
+            msg->bus_message.data.can.can_id = id;
+            msg->bus_message.data.can.can_dlc = 8;
+            break;
+        case MSG_TYPE_LIN:
+            msg->bus_message.data.lin.lin_id = (uint8_t)id;
+            msg->bus_message.data.lin.lin_dlc = 8;
+            break;
+        case MSG_TYPE_FLEXRAY:
+            msg->bus_message.data.flexray.frame_id = (uint16_t)id;
+            msg->bus_message.data.flexray.payload_length = 64;
+            break;
+        case MSG_TYPE_ETHERNET:
+            // Only the Ethernet header crosses the link, as in pcie_send_bus_message
+            msg->bus_message.data.ethernet.ethertype = 0x88B5;
+            break;
+    }
+
+    // Send time in CLOCK_MONOTONIC microseconds, as pcie_send_bus_message
+    // stamps it, so the shipped bpftrace scripts read the same ages here
+    msg->bus_message.timestamp = pcie_time_ns() / 1000;
+}
+
+static void record_latency(zone_t *zone, uint64_t latency_ns) {
+    uint64_t bucket = latency_ns / 1000;
+    zone->histogram[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1]++;
+    if (latency_ns > zone->latency_max_ns) {
+        zone->latency_max_ns = latency_ns;
+    }
+    zone->received++;
+}
+
+static void *zone_thread(void *arg) {
+    zone_t *zone = (zone_t *)arg;
+    uint64_t period = (uint64_t)(1e9 / zone->rate);
+    uint64_t next = pcie_time_ns();
+    pcie_message_t rx[RX_BATCH];
+    size_t lengths[RX_BATCH];
+
+    while (*zone->running) {
+        uint64_t now = pcie_time_ns();
+        int busy = 0;
+
+        // Send everything that is due, the schedule does not slip
+        for (int i = 0; i < MAX_BURST && next <= now; i++) {
+            pcie_message_t msg;
+            build_message(zone, &msg);
+            if (pcie_flow_send(&zone->uplink, &msg, sizeof(msg), 0) == 0) {
+                zone->sent++;
+            } else {
+                zone->dropped++;
+            }
+            next += period;
+            busy = 1;
+        }
+
+        int count = pcie_flow_receive_batch(&zone->downlink, rx, sizeof(pcie_message_t), RX_BATCH, lengths);
+        if (count > 0) {
+            now = pcie_time_ns();
+            uint64_t now_us = now / 1000;
+            for (int i = 0; i < count; i++) {
+                uint64_t sent_us = rx[i].bus_message.timestamp;
+                record_latency(zone, now_us > sent_us ? (now_us - sent_us) * 1000 : 0);
+            }
+            busy = 1;
+        }
+
+        if (!busy) {
+            now = pcie_time_ns();
+            if (next > now + IDLE_SLEEP_NS) {
+                struct timespec pause = {0, IDLE_SLEEP_NS};
+                nanosleep(&pause, NULL);
+            } else {
+                sched_yield();
+            }
+        }
+    }
+    return NULL;
+}
+
+// Central node threads yield while traffic may be about to arrive, then
+// sleep, so an idle step does not burn a core per thread
+static void idle_wait(uint32_t *idle_polls) {
+    if ((*idle_polls)++ < IDLE_SPINS) {
+        sched_yield();
+    } else {
+        struct timespec pause = {0, IDLE_SLEEP_NS};
+        nanosleep(&pause, NULL);
+    }
+}
+
+// Central node: poll every uplink and hand the messages to the router
+static void *forwarder_thread(void *arg) {
+    forwarder_t *fwd = (forwarder_t *)arg;
+    uint64_t cpu_start = thread_cpu_ns();
+    uint32_t idle_polls = 0;
+
+    while (*fwd->running) {
+        int count = pcie_router_receive(fwd->router, fwd->uplinks, fwd->zone_count);
+        if (count > 0) {
+            fwd->forwarded += (uint64_t)count;
+            idle_polls = 0;
+        } else {
+            idle_wait(&idle_polls);
+        }
+    }
+    fwd->cpu_ns = thread_cpu_ns() - cpu_start;
+    return NULL;
+}
+
+// A full downlink leaves the message in the port queue for the next drain
+static int send_downlink(const pcie_message_t *msg, void *context) {
+    return pcie_flow_send((pcie_flow_t *)context, msg, sizeof(*msg), msg->priority);
+}
+
+// Central node: move routed messages from the port queues onto the downlinks
+static void *tx_worker_thread(void *arg) {
+    tx_worker_t *tx = (tx_worker_t *)arg;
+    uint64_t cpu_start = thread_cpu_ns();
+    uint32_t idle_polls = 0;
+
+    while (*tx->running) {
+        size_t drained = 0;
+        for (uint32_t port = tx->first_port; port < tx->zone_count; port += tx->port_stride) {
+            drained += pcie_router_drain(tx->router, (int)port, send_downlink, &tx->downlinks[port], RX_BATCH);
+        }
+        if (drained > 0) {
+            idle_polls = 0;
+        } else {
+            idle_wait(&idle_polls);
+        }
+    }
+    tx->cpu_ns = thread_cpu_ns() - cpu_start;
+    return NULL;
+}
+
+// Route every message of a zone to one other zone
+static int load_routes(pcie_router_t *router, uint32_t zones) {
+    size_t count = (size_t)zones * MESSAGES_PER_ZONE;
+    pcie_route_t *routes = (pcie_route_t *)malloc(count * sizeof(pcie_route_t));
+    if (routes == NULL) {
+        return -1;
+    }
+
+    for (uint32_t zone = 0; zone < zones; zone++) {
+        for (uint32_t id = 0; id < MESSAGES_PER_ZONE; id++) {
+            pcie_route_t *route = &routes[zone * MESSAGES_PER_ZONE + id];
+            route->src_zone = zone;
+            route->message_id = id;
+            route->port_mask = 1ull << ((zone + 1 + id % (zones - 1)) % zones);
+        }
+    }
+
+    int ret = pcie_router_load_routes(router, routes, count);
+    free(routes);
+    return ret;
+}
+
+// Latency below which a fraction of the messages arrived, in microseconds
+static double percentile_us(const uint64_t *histogram, uint64_t total, double fraction) {
+    if (total == 0) {
+        return 0.0;
+    }
+    uint64_t target = (uint64_t)(fraction * (double)total);
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen > target) {
+            return (double)(i + 1);
+        }
+    }
+    return (double)LATENCY_BUCKETS;
+}
+
+static void print_zone(const zone_t *zone, double seconds) {
+    printf("   zone %2u  sent %10llu  recv %10llu  %8.0f msg/s  p50 %6.0f us  p99 %6.0f us  max %8.1f us  drops %llu\n",
+           zone->zone, (unsigned long long)zone->sent, (unsigned long long)zone->received,
+           zone->received / seconds, percentile_us(zone->histogram, zone->received, 0.50),
+           percentile_us(zone->histogram, zone->received, 0.99), zone->latency_max_ns / 1000.0,
+           (unsigned long long)zone->dropped);
+}
+
+// Shared memory and per-zone state of one simulation step
+typedef struct {
+    uint32_t zones;
+    uint8_t *region;             // Uplink and downlink ring of every zone
+    size_t region_size;
+    zone_t *zone;
+    pcie_flow_t *uplinks;
+    pcie_flow_t *downlinks;
+    uint64_t *histograms;
+} topology_t;
+
+static int run_topology(topology_t *topo, double rate, double seconds, uint32_t tx_threads, int per_zone) {
+    static pcie_router_t router;
+    static uint64_t histogram[LATENCY_BUCKETS];
+    uint32_t zones = topo->zones;
+    zone_t *zone = topo->zone;
+
+    if (pcie_router_init(&router) != 0) {
+        return -1;
+    }
+    for (uint32_t z = 0; z < zones; z++) {
+        if (pcie_router_add_port(&router, z, ROUTER_QUEUE_DEPTH) < 0) {
+            pcie_router_destroy(&router);
+            return -1;
+        }
+    }
+    if (load_routes(&router, zones) != 0) {
+        pcie_router_destroy(&router);
+        return -1;
+    }
+
+    volatile int running = 1;
+    for (uint32_t z = 0; z < zones; z++) {
+        uint8_t *up = topo->region + (size_t)z * 2 * RING_BYTES;
+        uint8_t *down = up + RING_BYTES;
+        zone[z].zone = z;
+        zone[z].rate = rate;
+        zone[z].running = &running;
+        zone[z].rng = 0x9E3779B97F4A7C15ull * (z + 1);
+        zone[z].histogram = topo->histograms + (size_t)z * LATENCY_BUCKETS;
+
+        // A zone never waits for the central node, a full uplink drops
+        pcie_flow_init_sender(&zone[z].uplink, up, RING_BYTES);
+        pcie_flow_set_policy(&zone[z].uplink, 0, PCIE_FLOW_DROP_NEWEST, 0);
+        pcie_flow_init_receiver(&topo->uplinks[z], up, RING_BYTES);
+
+        // A full downlink backs up into the router's port queue
+        pcie_flow_init_sender(&topo->downlinks[z], down, RING_BYTES);
+        pcie_flow_set_policy(&topo->downlinks[z], 0, PCIE_FLOW_DROP_NEWEST, 0);
+        pcie_flow_init_receiver(&zone[z].downlink, down, RING_BYTES);
+    }
+
+    forwarder_t fwd = {&router, zone, zones, topo->uplinks, &running, 0, 0};
+    tx_worker_t tx[PCIE_ROUTER_MAX_PORTS];
+    pthread_t fwd_id;
+    pthread_t tx_ids[PCIE_ROUTER_MAX_PORTS];
+    if (tx_threads > zones) {
+        tx_threads = zones;
+    }
+
+    uint64_t cpu_start = process_cpu_ns();
+    uint64_t start = pcie_time_ns();
+    int fwd_started = pthread_create(&fwd_id, NULL, forwarder_thread, &fwd) == 0;
+    uint32_t tx_started = 0;
+    for (; fwd_started && tx_started < tx_threads; tx_started++) {
+        tx_worker_t *worker = &tx[tx_started];
+        worker->router = &router;
+        worker->downlinks = topo->downlinks;
+        worker->first_port = tx_started;
+        worker->port_stride = tx_threads;
+        worker->zone_count = zones;
+        worker->running = &running;
+        worker->cpu_ns = 0;
+        if (pthread_create(&tx_ids[tx_started], NULL, tx_worker_thread, worker) != 0) {
+            break;
+        }
+    }
+    uint32_t zones_started = 0;
+    for (; tx_started == tx_threads && zones_started < zones; zones_started++) {
+        if (pthread_create(&zone[zones_started].thread, NULL, zone_thread, &zone[zones_started]) != 0) {
+            break;
+        }
+    }
+
+    // Stop and join whatever did start before giving up on this step
+    if (!fwd_started || tx_started < tx_threads || zones_started < zones) {
+        fprintf(stderr, "Failed to start the simulation threads\n");
+        running = 0;
+        for (uint32_t z = 0; z < zones_started; z++) {
+            pthread_join(zone[z].thread, NULL);
+        }
+        for (uint32_t t = 0; t < tx_started; t++) {
+            pthread_join(tx_ids[t], NULL);
+        }
+        if (fwd_started) {
+            pthread_join(fwd_id, NULL);
+        }
+        pcie_router_destroy(&router);
+        return -1;
+    }
+
+    struct timespec duration = {(time_t)seconds, (long)((seconds - (double)(time_t)seconds) * 1e9)};
+    nanosleep(&duration, NULL);
+    running = 0;
+
+    for (uint32_t z = 0; z < zones; z++) {
+        pthread_join(zone[z].thread, NULL);
+    }
+    pthread_join(fwd_id, NULL);
+    uint64_t central_cpu = fwd.cpu_ns;
+    for (uint32_t t = 0; t < tx_threads; t++) {
+        pthread_join(tx_ids[t], NULL);
+        central_cpu += tx[t].cpu_ns;
+    }
+    double elapsed = (pcie_time_ns() - start) / 1e9;
+    double cores = (process_cpu_ns() - cpu_start) / 1e9 / elapsed;
+
+    // Aggregate over all zones
+    uint64_t sent = 0, received = 0, dropped = 0, latency_max = 0;
+    double worst_p99 = 0.0;
+    memset(histogram, 0, sizeof(histogram));
+    for (uint32_t z = 0; z < zones; z++) {
+        for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+            histogram[i] += zone[z].histogram[i];
+        }
+        double p99 = percentile_us(zone[z].histogram, zone[z].received, 0.99);
+        if (p99 > worst_p99) {
+            worst_p99 = p99;
+        }
+        sent += zone[z].sent;
+        received += zone[z].received;
+        dropped += zone[z].dropped;
+        if (zone[z].latency_max_ns > latency_max) {
+            latency_max = zone[z].latency_max_ns;
+        }
+    }
+    dropped += router.stats.queue_full;
+
+    printf("%5u %12.0f %10.0f %9llu %7.0f %7.0f %7.0f %10.0f %9.1f %9.1f %7.2f\n",
+           zones, sent / elapsed, received / elapsed, (unsigned long long)dropped,
+           percentile_us(histogram, received, 0.50), percentile_us(histogram, received, 0.99),
+           percentile_us(histogram, received, 0.999), worst_p99, latency_max / 1000.0,
+           100.0 * central_cpu / 1e9 / elapsed, cores);
+    if (per_zone) {
+        for (uint32_t z = 0; z < zones; z++) {
+            print_zone(&zone[z], elapsed);
+        }
+    }
+
+    pcie_router_destroy(&router);
+    return 0;
+}
+
+static int run_step(uint32_t zones, double rate, double seconds, uint32_t tx_threads, int per_zone) {
+    topology_t topo;
+    memset(&topo, 0, sizeof(topo));
+    topo.zones = zones;
+    topo.region_size = (size_t)zones * 2 * RING_BYTES;
+    topo.region = (uint8_t *)mmap(NULL, topo.region_size, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    topo.zone = (zone_t *)calloc(zones, sizeof(zone_t));
+    topo.uplinks = (pcie_flow_t *)calloc(zones, sizeof(pcie_flow_t));
+    topo.downlinks = (pcie_flow_t *)calloc(zones, sizeof(pcie_flow_t));
+    topo.histograms = (uint64_t *)calloc((size_t)zones * LATENCY_BUCKETS, sizeof(uint64_t));
+
+    int ret = -1;
+    if (topo.region == MAP_FAILED || topo.zone == NULL || topo.uplinks == NULL ||
+        topo.downlinks == NULL || topo.histograms == NULL) {
+        fprintf(stderr, "Out of memory\n");
+    } else {
+        ret = run_topology(&topo, rate, seconds, tx_threads, per_zone);
+    }
+
+    free(topo.histograms);
+    free(topo.downlinks);
+    free(topo.uplinks);
+    free(topo.zone);
+    if (topo.region != MAP_FAILED) {
+        munmap(topo.region, topo.region_size);
+    }
+    return ret;
+}
+
+int main(int argc, char *argv[]) {
+    double seconds = argc >= 2 ? strtod(argv[1], NULL) : 2.0;
+    double rate = argc >= 3 ? strtod(argv[2], NULL) : 10000.0;
+    uint32_t max_zones = argc >= 4 ? (uint32_t)strtoul(argv[3], NULL, 10) : 32;
+    uint32_t tx_threads = argc >= 5 ? (uint32_t)strtoul(argv[4], NULL, 10) : 2;
+    int per_zone = argc >= 6 ? atoi(argv[5]) : 0;
+
+    if (seconds <= 0.0 || rate <= 0.0 || max_zones < 2 || max_zones > PCIE_ROUTER_MAX_PORTS || tx_threads == 0) {
+        fprintf(stderr, "Usage: %s [seconds per step] [msg/s per zone] [max zones (2-%d)] [central TX threads] [per-zone detail (0/1)]\n",
+                argv[0], PCIE_ROUTER_MAX_PORTS);
+        return 1;
+    }
+
+    printf("Offered load %.0f msg/s per zone, %.1f s per step, latency in us, CPU in %% of one core\n", rate, seconds);
+    printf("zones    offered/s     recv/s     drops     p50     p99   p99.9  worst p99       max  central%%   cores\n");
+    for (uint32_t zones = 2; zones <= max_zones; zones *= 2) {
+        if (run_step(zones, rate, seconds, tx_threads, per_zone) != 0) {
+            fprintf(stderr, "Simulation with %u zones failed\n", zones);
+            return 1;
+        }
+    }
+    return 0;
+}
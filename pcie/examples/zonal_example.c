@@ -5,11 +5,84 @@
 #include <signal.h>
 #include "../driver/pcie_common.h"
 #include "../driver/pcie_client.h"
+#include "../driver/pcie_rt.h"
 #include "../../translation/pcie_translation.h"
+#include "../../translation/can_cyclic.h"
+#include "../../translation/pcie_capture.h"
+#include "../../translation/pcie_frame_pool.h"
+#include "../../translation/pcie_schedule.h"
+#include "../../translation/pcie_signal_store.h"
 
 // Flag for controlling the main loop
 static volatile int running = 1;
 
+// Last-value cache for cyclic CAN frames (suppression in Zone 1, regeneration in Zone 2)
+static can_cyclic_t can_cache;
+
+// Zone 1 transmits on a time-triggered schedule, one tick per gateway period
+static pcie_sched_t schedule;
+
+// Received messages land in pooled frames, so variable-length payloads
+// need no allocation on the receive path
+static pcie_frame_pool_t frame_pool;
+static pcie_frame_cache_t frame_cache;
+
+// Zone 2 keeps the last value of every received message for local readers;
+// zones with a higher ID are counted as ignored
+#define SIGNAL_STORE_ZONES 4
+static pcie_signal_store_t signal_store;
+
+// Optional recording of the gateway traffic (PCIE_CAPTURE_FILE)
+static pcie_capture_writer_t capture;
+static int capture_enabled = 0;
+
+static void capture_open(void) {
+    const char *path = getenv("PCIE_CAPTURE_FILE");
+    if (path != NULL && pcie_capture_writer_open(&capture, path, 0) == 0) {
+        capture_enabled = 1;
+        printf("Recording traffic to %s\n", path);
+    }
+}
+
+static void capture_message(const bus_message_t *msg, uint32_t zone_id, uint32_t device_id,
+                            uint32_t priority, pcie_capture_direction_t direction) {
+    if (!capture_enabled) {
+        return;
+    }
+
+    pcie_capture_record_t record;
+    record.timestamp_ns = pcie_time_ns();
+    record.zone_id = zone_id;
+    record.device_id = device_id;
+    record.priority = priority;
+    record.direction = direction;
+    memcpy(&record.message, msg, sizeof(bus_message_t));
+    pcie_capture_write(&capture, &record);
+}
+
+static void capture_close(void) {
+    if (capture_enabled) {
+        printf("Captured %llu messages (%llu dropped)\n",
+               (unsigned long long)capture.written, (unsigned long long)capture.dropped);
+        pcie_capture_writer_close(&capture);
+        capture_enabled = 0;
+    }
+}
+
+// Read an optional millisecond setting from the environment, 0 if unset
+static uint32_t env_ms_to_us(const char *name) {
+    const char *value = getenv(name);
+    return value ? (uint32_t)strtoul(value, NULL, 10) * 1000u : 0;
+}
+
+// Apply the real-time profile (PCIE_RT_*) to the gateway thread
+static void apply_rt_profile(void) {
+    pcie_rt_config_t rt_config;
+    if (pcie_rt_config_from_env(&rt_config) == 0 && pcie_rt_apply(&rt_config) != 0) {
+        fprintf(stderr, "Real-time profile only partially applied, continuing\n");
+    }
+}
+
 // Signal handler for graceful termination
 static void signal_handler(int sig) {
     (void)sig; // Suppress unused parameter warning
@@ -42,6 +115,16 @@ void simulate_can_message_send(const can_message_t *can_msg) {
     printf("\n");
 }
 
+// Send a scheduled batch and record the frames that went out
+static int zone1_sink(const pcie_message_t *msgs, size_t count, void *context) {
+    int sent = pcie_sched_client_sink(msgs, count, context);
+    for (int i = 0; i < sent; i++) {
+        capture_message(&msgs[i].bus_message, msgs[i].zone_id, msgs[i].device_id, msgs[i].priority, PCIE_CAPTURE_TX);
+        printf("CAN message sent to PCIe backbone from Zone 1\n");
+    }
+    return sent;
+}
+
 // Example of a CAN-to-PCIe gateway in Zone 1
 void run_zone1_gateway() {
     printf("Starting Zone 1 Gateway (CAN to PCIe)\n");
@@ -52,31 +135,81 @@ void run_zone1_gateway() {
         return;
     }
     
+    // Cyclic CAN frames are superseded by the next cycle, so under overload
+    // prefer the newest data over blocking the gateway loop
+    pcie_client_set_flow_policy(0, PCIE_FLOW_DROP_OLDEST, 0);
+    
+    // Optionally forward unchanged cyclic frames only once per heartbeat
+    uint32_t heartbeat_us = env_ms_to_us("PCIE_CAN_HEARTBEAT_MS");
+    can_cyclic_init(&can_cache, heartbeat_us, 0);
+    capture_open();
+    
+    // Pin, lock and pre-fault before entering the loop, then run it on
+    // absolute deadlines so lateness is measured rather than accumulated
+    apply_rt_profile();
+    uint32_t period_us = env_ms_to_us("PCIE_GATEWAY_PERIOD_MS");
+    if (period_us == 0) {
+        period_us = 1000000u;
+    }
+    
+    // The cyclic frame owns a static slot every tick. With change-based
+    // forwarding only changes and heartbeats are sent, as sporadic traffic.
+    // Ticks start just before the loop deadlines, so every wake-up finds
+    // its tick due.
+    if (pcie_sched_init(&schedule, period_us, 4, pcie_time_ns()) != 0 ||
+        (heartbeat_us == 0 && pcie_sched_add(&schedule, 0x123, period_us, 0, 0) != 0)) {
+        fprintf(stderr, "Failed to build the Zone 1 schedule\n");
+        capture_close();
+        pcie_client_cleanup();
+        return;
+    }
+    static pcie_rt_jitter_t loop_jitter;
+    pcie_rt_jitter_init(&loop_jitter, period_us * 1000ull);
+    
     // Process CAN messages in a loop
     while (running) {
         // 1. Read a CAN message from the CAN bus
         can_message_t can_msg;
         simulate_can_message_receive(&can_msg);
         
-        // 2. Create a bus message structure
-        bus_message_t bus_msg;
-        bus_msg.type = MSG_TYPE_CAN;
-        bus_msg.timestamp = 0;  // Will be set by pcie_send_bus_message
-        memcpy(&(bus_msg.data.can), &can_msg, sizeof(can_message_t));
+        // Skip frames whose payload did not change since the last heartbeat
+        if (heartbeat_us != 0 && !can_cyclic_should_forward(&can_cache, &can_msg, pcie_time_ns() / 1000)) {
+            pcie_rt_jitter_wait(&loop_jitter);
+            continue;
+        }
         
-        // 3. Send the bus message over PCIe
-        // Arguments: message, zone_id, device_id, priority
-        if (pcie_send_bus_message(&bus_msg, 1, 42, 0) != 0) {
-            fprintf(stderr, "Failed to send bus message over PCIe\n");
-        } else {
-            printf("CAN message sent to PCIe backbone from Zone 1\n");
+        // 2. Translate it into a PCIe message stamped with the read time
+        // Arguments: CAN message, PCIe message, zone_id, device_id
+        pcie_message_t pcie_msg;
+        translate_can_to_pcie(&can_msg, &pcie_msg, 1, 42);
+        
+        // 3. Hand it to the schedule and send whatever is due this tick
+        int ret = heartbeat_us == 0 ? pcie_sched_update(&schedule, &pcie_msg) : pcie_sched_submit(&schedule, &pcie_msg);
+        if (ret == PCIE_SCHED_FULL) {
+            fprintf(stderr, "Sporadic queue full, CAN message dropped\n");
+        }
+        if (pcie_sched_poll(&schedule, pcie_time_ns(), zone1_sink, NULL) < 0) {
+            fprintf(stderr, "Failed to send scheduled messages over PCIe\n");
         }
         
-        // Sleep for a bit before sending the next message
-        sleep(1);
+        // Wait for the next period before sending the next message
+        pcie_rt_jitter_wait(&loop_jitter);
     }
+    pcie_rt_jitter_report(&loop_jitter, "Zone 1 loop");
+    
+    // Report flow control losses before shutting down
+    pcie_flow_stats_t tx_stats;
+    pcie_client_get_flow_stats(&tx_stats, NULL);
+    printf("Zone 1 flow control: sent %llu, dropped oldest %llu, dropped newest %llu, timeouts %llu\n",
+           (unsigned long long)tx_stats.sent, (unsigned long long)tx_stats.dropped_oldest,
+           (unsigned long long)tx_stats.dropped_newest, (unsigned long long)tx_stats.timeouts);
+    printf("Zone 1 schedule: %llu ticks, %llu missed, %llu cyclic, %llu sporadic, %llu sink errors\n",
+           (unsigned long long)schedule.stats.ticks, (unsigned long long)schedule.stats.missed_ticks,
+           (unsigned long long)schedule.stats.static_frames, (unsigned long long)schedule.stats.sporadic_frames,
+           (unsigned long long)schedule.stats.sink_errors);
     
     // Cleanup the PCIe client
+    capture_close();
     pcie_client_cleanup();
     printf("Zone 1 Gateway stopped\n");
 }
@@ -91,33 +224,106 @@ void run_zone2_gateway() {
         return;
     }
     
+    // Optionally regenerate the cyclic stream from the last received values
+    uint32_t cycle_us = env_ms_to_us("PCIE_CAN_REGEN_MS");
+    can_cyclic_init(&can_cache, env_ms_to_us("PCIE_CAN_HEARTBEAT_MS"), cycle_us);
+    capture_open();
+    
+    // Reserve all receive frames up front
+    if (pcie_frame_pool_init(&frame_pool, NULL) != 0) {
+        fprintf(stderr, "Failed to reserve the frame pool in Zone 2\n");
+        capture_close();
+        pcie_client_cleanup();
+        return;
+    }
+    pcie_frame_cache_init(&frame_cache, &frame_pool);
+    if (pcie_signal_store_init(&signal_store, SIGNAL_STORE_ZONES) != 0) {
+        fprintf(stderr, "Failed to create the signal store in Zone 2\n");
+        pcie_frame_pool_destroy(&frame_pool);
+        capture_close();
+        pcie_client_cleanup();
+        return;
+    }
+    
+    // The receive loop is event driven, so track how long each message
+    // waited since it was stamped by the sender (same-host clock)
+    apply_rt_profile();
+    static pcie_rt_jitter_t loop_jitter;
+    pcie_rt_jitter_init(&loop_jitter, 0);
+    
     // Process PCIe messages in a loop
     while (running) {
-        // 1. Receive a bus message from PCIe
-        bus_message_t bus_msg;
-        uint32_t source_zone_id;
-        uint32_t source_device_id;
+        // Wake up in time for the next regenerated frame
+        if (cycle_us != 0) {
+            uint64_t wait_us = can_cyclic_next_regen_us(&can_cache, pcie_time_ns() / 1000);
+            pcie_client_set_receive_timeout(wait_us < PCIE_CLIENT_RECEIVE_TIMEOUT_US ?
+                                            (uint32_t)wait_us : PCIE_CLIENT_RECEIVE_TIMEOUT_US);
+        }
+        
+        // 1. Receive a bus message from PCIe into a pooled frame
+        pcie_frame_t *frame = NULL;
+        int ret = pcie_receive_frame(&frame_cache, &frame);
         
-        if (pcie_receive_bus_message(&bus_msg, &source_zone_id, &source_device_id) != 0) {
+        // Emit regenerated frames that became due while waiting
+        if (cycle_us != 0) {
+            can_message_t regen_msg;
+            while (can_cyclic_poll_regen(&can_cache, pcie_time_ns() / 1000, &regen_msg)) {
+                simulate_can_message_send(&regen_msg);
+            }
+        }
+        
+        if (ret == PCIE_FLOW_EMPTY) {
+            // Nothing new from the peer yet
+            continue;
+        }
+        if (ret != 0) {
             fprintf(stderr, "Failed to receive bus message from PCIe\n");
             sleep(1);
             continue;
         }
         
+        const bus_message_t *bus_msg = &frame->msg.bus_message;
+        uint32_t source_zone_id = frame->msg.zone_id;
+        uint32_t source_device_id = frame->msg.device_id;
+        
+        // Age since pcie_send_bus_message stamped it; unstamped messages carry no age
+        uint64_t now_us = pcie_time_ns() / 1000;
+        if (bus_msg->timestamp != 0) {
+            pcie_rt_jitter_record(&loop_jitter, now_us > bus_msg->timestamp ? (now_us - bus_msg->timestamp) * 1000 : 0);
+        }
         printf("Received message from Zone %u, Device %u\n", source_zone_id, source_device_id);
+        capture_message(bus_msg, source_zone_id, source_device_id, frame->msg.priority, PCIE_CAPTURE_RX);
+        pcie_signal_store_update(&signal_store, bus_msg, source_zone_id, source_device_id);
         
         // 2. Check if it's a CAN message
-        if (bus_msg.type == MSG_TYPE_CAN) {
+        if (bus_msg->type == MSG_TYPE_CAN) {
             // 3. Convert to CAN message and send on local CAN bus
-            simulate_can_message_send(&(bus_msg.data.can));
+            simulate_can_message_send(&(bus_msg->data.can));
+            if (cycle_us != 0) {
+                can_cyclic_update(&can_cache, &(bus_msg->data.can), pcie_time_ns() / 1000);
+            }
         } else {
-            printf("Ignoring non-CAN message of type %d\n", bus_msg.type);
+            printf("Ignoring non-CAN message of type %d\n", bus_msg->type);
         }
+        pcie_frame_release(&frame_cache, frame);
         
         // Process messages as fast as they arrive
     }
+    pcie_rt_jitter_report(&loop_jitter, "Zone 2 message age");
+    
+    // Report messages lost on the link before shutting down
+    pcie_flow_stats_t rx_stats;
+    pcie_client_get_flow_stats(NULL, &rx_stats);
+    printf("Zone 2 flow control: received %llu, overruns %llu\n",
+           (unsigned long long)rx_stats.received, (unsigned long long)rx_stats.overruns);
+    printf("Zone 2 signal store: %llu updates, %llu ignored\n",
+           (unsigned long long)signal_store.stats.updates, (unsigned long long)signal_store.stats.ignored);
     
     // Cleanup the PCIe client
+    capture_close();
+    pcie_signal_store_destroy(&signal_store);
+    pcie_frame_cache_flush(&frame_cache);
+    pcie_frame_pool_destroy(&frame_pool);
     pcie_client_cleanup();
     printf("Zone 2 Gateway stopped\n");
 }
@@ -0,0 +1,278 @@
+#include "gtest/gtest.h"
+#include "../translation/pcie_broadcast.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <string>
+#include <thread>
+
+static bus_message_t make_can(uint32_t can_id) {
+    bus_message_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_TYPE_CAN;
+    msg.data.can.can_id = can_id;
+    msg.data.can.can_dlc = 8;
+    for (int i = 0; i < 8; i++) {
+        msg.data.can.data[i] = (uint8_t)(can_id + i);
+    }
+    return msg;
+}
+
+class BroadcastTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        name = "/pcie_broadcast_test_" + std::to_string(getpid());
+        ASSERT_EQ(pcie_broadcast_create(&publisher, name.c_str(), 16), 0);
+    }
+
+    void TearDown() override {
+        pcie_broadcast_close(&publisher);
+    }
+
+    std::string name;
+    pcie_broadcast_t publisher;
+    pcie_broadcast_record_t record;
+};
+
+TEST_F(BroadcastTest, EverySubscriberSeesEveryRecord) {
+    pcie_broadcast_t first, second;
+    ASSERT_EQ(pcie_broadcast_attach(&first, name.c_str()), 0);
+    ASSERT_EQ(pcie_broadcast_attach(&second, name.c_str()), 0);
+
+    for (uint32_t i = 0; i < 10; i++) {
+        bus_message_t msg = make_can(0x100 + i);
+        ASSERT_EQ(pcie_broadcast_publish(&publisher, &msg, 2, 5), 0);
+    }
+    EXPECT_EQ(pcie_broadcast_pending(&first), 10u);
+
+    for (pcie_broadcast_t *subscriber : {&first, &second}) {
+        for (uint32_t i = 0; i < 10; i++) {
+            ASSERT_EQ(pcie_broadcast_read(subscriber, &record), 0);
+            EXPECT_EQ(record.sequence, i);
+            EXPECT_EQ(record.zone_id, 2u);
+            EXPECT_EQ(record.device_id, 5u);
+            EXPECT_EQ(record.message.data.can.can_id, 0x100 + i);
+            EXPECT_EQ(record.message.data.can.data[7], (uint8_t)(0x107 + i));
+        }
+        EXPECT_EQ(pcie_broadcast_read(subscriber, &record), PCIE_BROADCAST_EMPTY);
+        EXPECT_EQ(subscriber->stats.received, 10u);
+    }
+
+    pcie_broadcast_close(&first);
+    pcie_broadcast_close(&second);
+}
+
+TEST_F(BroadcastTest, SubscriberStartsAtNewestRecord) {
+    bus_message_t msg = make_can(0x1);
+    ASSERT_EQ(pcie_broadcast_publish(&publisher, &msg, 1, 1), 0);
+
+    pcie_broadcast_t subscriber;
+    ASSERT_EQ(pcie_broadcast_attach(&subscriber, name.c_str()), 0);
+    EXPECT_EQ(pcie_broadcast_read(&subscriber, &record), PCIE_BROADCAST_EMPTY);
+
+    msg = make_can(0x2);
+    ASSERT_EQ(pcie_broadcast_publish(&publisher, &msg, 1, 1), 0);
+    ASSERT_EQ(pcie_broadcast_read(&subscriber, &record), 0);
+    EXPECT_EQ(record.message.data.can.can_id, 0x2u);
+
+    // Subscribers cannot publish, and missing rings cannot be attached
+    EXPECT_EQ(pcie_broadcast_publish(&subscriber, &msg, 1, 1), -1);
+    pcie_broadcast_close(&subscriber);
+    pcie_broadcast_t missing;
+    EXPECT_EQ(pcie_broadcast_attach(&missing, "/pcie_broadcast_missing"), -1);
+    EXPECT_EQ(pcie_broadcast_create(&missing, "no_slash", 16), -1);
+}
+
+TEST_F(BroadcastTest, EthernetPayloadIsCarriedInline) {
+    pcie_broadcast_t subscriber;
+    ASSERT_EQ(pcie_broadcast_attach(&subscriber, name.c_str()), 0);
+
+    uint8_t payload[1500];
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)(i * 7);
+    }
+    bus_message_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_TYPE_ETHERNET;
+    msg.data.ethernet.ethertype = 0x88B5;
+    msg.data.ethernet.data = payload;
+    msg.data.ethernet.data_len = sizeof(payload);
+    ASSERT_EQ(pcie_broadcast_publish(&publisher, &msg, 3, 4), 0);
+
+    ASSERT_EQ(pcie_broadcast_read(&subscriber, &record), 0);
+    EXPECT_EQ(record.message.data.ethernet.ethertype, 0x88B5);
+    EXPECT_EQ(record.message.data.ethernet.data, record.payload);
+    ASSERT_EQ(record.message.data.ethernet.data_len, sizeof(payload));
+    EXPECT_EQ(memcmp(record.payload, payload, sizeof(payload)), 0);
+
+    // Oversized payloads are rejected
+    uint8_t jumbo[PCIE_BROADCAST_MAX_PAYLOAD + 1];
+    msg.data.ethernet.data = jumbo;
+    msg.data.ethernet.data_len = sizeof(jumbo);
+    EXPECT_EQ(pcie_broadcast_publish(&publisher, &msg, 3, 4), -1);
+    EXPECT_EQ(publisher.stats.too_large, 1u);
+    pcie_broadcast_close(&subscriber);
+}
+
+TEST_F(BroadcastTest, LappedSubscriberSkipsToOldestRecord) {
+    pcie_broadcast_t subscriber;
+    ASSERT_EQ(pcie_broadcast_attach(&subscriber, name.c_str()), 0);
+
+    // 40 records through 16 slots: the first 25 are gone
+    for (uint32_t i = 0; i < 40; i++) {
+        bus_message_t msg = make_can(i);
+        ASSERT_EQ(pcie_broadcast_publish(&publisher, &msg, 1, 1), 0);
+    }
+
+    ASSERT_EQ(pcie_broadcast_read(&subscriber, &record), 0);
+    EXPECT_EQ(record.sequence, 25u);
+    EXPECT_EQ(subscriber.stats.lapped, 1u);
+    EXPECT_EQ(subscriber.stats.lost, 25u);
+
+    uint64_t expected = 26;
+    while (pcie_broadcast_read(&subscriber, &record) == 0) {
+        EXPECT_EQ(record.sequence, expected);
+        EXPECT_EQ(record.message.data.can.can_id, expected);
+        expected++;
+    }
+    EXPECT_EQ(expected, 40u);
+    pcie_broadcast_close(&subscriber);
+}
+
+TEST_F(BroadcastTest, SubscriberFollowsRestartedPublisher) {
+    pcie_broadcast_t subscriber;
+    ASSERT_EQ(pcie_broadcast_attach(&subscriber, name.c_str()), 0);
+    for (uint32_t i = 0; i < 5; i++) {
+        bus_message_t msg = make_can(i);
+        ASSERT_EQ(pcie_broadcast_publish(&publisher, &msg, 1, 1), 0);
+    }
+    while (pcie_broadcast_read(&subscriber, &record) == 0) {
+    }
+
+    // A new publisher takes over the same ring and starts counting from zero
+    pcie_broadcast_t restarted;
+    ASSERT_EQ(pcie_broadcast_create(&restarted, name.c_str(), 16), 0);
+    bus_message_t msg = make_can(0x77);
+    ASSERT_EQ(pcie_broadcast_publish(&restarted, &msg, 1, 1), 0);
+
+    ASSERT_EQ(pcie_broadcast_read(&subscriber, &record), 0);
+    EXPECT_EQ(record.sequence, 0u);
+    EXPECT_EQ(record.message.data.can.can_id, 0x77u);
+    EXPECT_EQ(subscriber.stats.lost, 0u);
+
+    pcie_broadcast_close(&subscriber);
+    pcie_broadcast_close(&restarted);
+}
+
+TEST_F(BroadcastTest, RingOfAnotherSizeIsReplacedNotResized) {
+    pcie_broadcast_t subscriber;
+    ASSERT_EQ(pcie_broadcast_attach(&subscriber, name.c_str()), 0);
+    bus_message_t msg = make_can(1);
+    ASSERT_EQ(pcie_broadcast_publish(&publisher, &msg, 1, 1), 0);
+
+    // A smaller ring must not truncate the segment the subscriber maps
+    pcie_broadcast_t smaller;
+    ASSERT_EQ(pcie_broadcast_create(&smaller, name.c_str(), 4), 0);
+    EXPECT_EQ(pcie_broadcast_read(&subscriber, &record), -1);
+    EXPECT_EQ(subscriber.ctrl->generation, publisher.generation);
+
+    // Attaching again follows the new ring
+    pcie_broadcast_close(&subscriber);
+    ASSERT_EQ(pcie_broadcast_attach(&subscriber, name.c_str()), 0);
+    EXPECT_EQ(subscriber.slot_count, 4u);
+    EXPECT_GT(smaller.generation, publisher.generation);
+    msg = make_can(2);
+    ASSERT_EQ(pcie_broadcast_publish(&smaller, &msg, 1, 1), 0);
+    ASSERT_EQ(pcie_broadcast_read(&subscriber, &record), 0);
+    EXPECT_EQ(record.message.data.can.can_id, 2u);
+
+    pcie_broadcast_close(&subscriber);
+    pcie_broadcast_close(&smaller);
+}
+
+TEST_F(BroadcastTest, ConcurrentReaderNeverSeesTornRecords) {
+    pcie_broadcast_t subscriber;
+    ASSERT_EQ(pcie_broadcast_attach(&subscriber, name.c_str()), 0);
+
+    const uint32_t total = 200000;
+    std::thread writer([this, total] {
+        for (uint32_t i = 0; i < total; i++) {
+            bus_message_t msg = make_can(i);
+            pcie_broadcast_publish(&publisher, &msg, 1, 1);
+        }
+    });
+
+    uint64_t last = 0;
+    uint64_t read = 0;
+    int first = 1;
+    while (last + 1 < total) {
+        if (pcie_broadcast_read(&subscriber, &record) != 0) {
+            continue;
+        }
+        // Every field belongs to the same record and records only move forward
+        uint32_t id = record.message.data.can.can_id;
+        ASSERT_EQ(id, record.sequence);
+        for (int i = 0; i < 8; i++) {
+            ASSERT_EQ(record.message.data.can.data[i], (uint8_t)(id + i));
+        }
+        ASSERT_TRUE(first || record.sequence > last);
+        first = 0;
+        last = record.sequence;
+        read++;
+    }
+    writer.join();
+    EXPECT_EQ(read + subscriber.stats.lost, total);
+    pcie_broadcast_close(&subscriber);
+}
+
+TEST_F(BroadcastTest, SubscriberInAnotherProcess) {
+    // Large enough that the child is never lapped
+    pcie_broadcast_close(&publisher);
+    ASSERT_EQ(pcie_broadcast_create(&publisher, name.c_str(), 128), 0);
+
+    int ready[2];
+    ASSERT_EQ(pipe(ready), 0);
+
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        // Child: attach, signal the parent, then read 100 records in order
+        pcie_broadcast_t subscriber;
+        if (pcie_broadcast_attach(&subscriber, name.c_str()) != 0) {
+            _exit(1);
+        }
+        char byte = 1;
+        if (write(ready[1], &byte, 1) != 1) {
+            _exit(1);
+        }
+        uint32_t next = 0;
+        pcie_broadcast_record_t local;
+        while (next < 100) {
+            int ret = pcie_broadcast_read(&subscriber, &local);
+            if (ret < 0 || subscriber.stats.lost != 0) {
+                _exit(2);
+            }
+            if (ret == 0) {
+                if (local.message.data.can.can_id != next) {
+                    _exit(3);
+                }
+                next++;
+            }
+        }
+        _exit(0);
+    }
+
+    char byte;
+    ASSERT_EQ(read(ready[0], &byte, 1), 1);
+    for (uint32_t i = 0; i < 100; i++) {
+        bus_message_t msg = make_can(i);
+        ASSERT_EQ(pcie_broadcast_publish(&publisher, &msg, 1, 1), 0);
+    }
+
+    int status = 0;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    close(ready[0]);
+    close(ready[1]);
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+}
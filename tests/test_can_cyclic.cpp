@@ -0,0 +1,136 @@
+#include "gtest/gtest.h"
+#include "../translation/can_cyclic.h"
+#include <string.h>
+
+class CanCyclicTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        can_cyclic_init(&cache, 100000, 0);  // 100ms default heartbeat
+
+        memset(&frame, 0, sizeof(frame));
+        frame.can_id = 0x123;
+        frame.can_dlc = 8;
+        for (int i = 0; i < frame.can_dlc; i++) {
+            frame.data[i] = i;
+        }
+    }
+
+    can_cyclic_t cache;
+    can_message_t frame;
+};
+
+TEST_F(CanCyclicTest, UnchangedFramesAreSuppressed) {
+    // First occurrence is always forwarded
+    EXPECT_EQ(can_cyclic_should_forward(&cache, &frame, 0), 1);
+
+    // Same payload every 10ms within the heartbeat interval
+    for (uint64_t t = 10000; t < 100000; t += 10000) {
+        EXPECT_EQ(can_cyclic_should_forward(&cache, &frame, t), 0);
+    }
+    EXPECT_EQ(cache.stats.suppressed, 9u);
+}
+
+TEST_F(CanCyclicTest, ChangedPayloadIsForwarded) {
+    EXPECT_EQ(can_cyclic_should_forward(&cache, &frame, 0), 1);
+
+    frame.data[3] = 0xFF;
+    EXPECT_EQ(can_cyclic_should_forward(&cache, &frame, 10000), 1);
+
+    frame.can_dlc = 4;
+    EXPECT_EQ(can_cyclic_should_forward(&cache, &frame, 20000), 1);
+    EXPECT_EQ(cache.stats.forwarded, 3u);
+}
+
+TEST_F(CanCyclicTest, HeartbeatRefreshesUnchangedFrame) {
+    EXPECT_EQ(can_cyclic_should_forward(&cache, &frame, 0), 1);
+    EXPECT_EQ(can_cyclic_should_forward(&cache, &frame, 50000), 0);
+    EXPECT_EQ(can_cyclic_should_forward(&cache, &frame, 100000), 1);
+    EXPECT_EQ(can_cyclic_should_forward(&cache, &frame, 150000), 0);
+    EXPECT_EQ(can_cyclic_should_forward(&cache, &frame, 200000), 1);
+    EXPECT_EQ(cache.stats.heartbeats, 2u);
+}
+
+TEST_F(CanCyclicTest, PerIdConfigurationOverridesDefault) {
+    // Heartbeat 0 disables suppression for this ID
+    ASSERT_EQ(can_cyclic_configure(&cache, 0x200, 0, 0), 0);
+    frame.can_id = 0x200;
+
+    EXPECT_EQ(can_cyclic_should_forward(&cache, &frame, 0), 1);
+    EXPECT_EQ(can_cyclic_should_forward(&cache, &frame, 1000), 1);
+    EXPECT_EQ(cache.stats.suppressed, 0u);
+}
+
+TEST_F(CanCyclicTest, ReceiverRegeneratesCyclicStream) {
+    ASSERT_EQ(can_cyclic_configure(&cache, 0x123, 100000, 10000), 0);
+    ASSERT_EQ(can_cyclic_update(&cache, &frame, 0), 0);
+
+    can_message_t out;
+    EXPECT_EQ(can_cyclic_poll_regen(&cache, 5000, &out), 0);
+    ASSERT_EQ(can_cyclic_poll_regen(&cache, 10000, &out), 1);
+    EXPECT_EQ(out.can_id, 0x123u);
+    EXPECT_EQ(out.can_dlc, 8);
+    EXPECT_EQ(memcmp(out.data, frame.data, 8), 0);
+
+    // Nothing more due in the same period
+    EXPECT_EQ(can_cyclic_poll_regen(&cache, 15000, &out), 0);
+    EXPECT_EQ(can_cyclic_poll_regen(&cache, 20000, &out), 1);
+}
+
+TEST_F(CanCyclicTest, NextRegenerationDeadline) {
+    EXPECT_EQ(can_cyclic_next_regen_us(&cache, 0), CAN_CYCLIC_NO_REGEN);
+
+    ASSERT_EQ(can_cyclic_configure(&cache, 0x123, 100000, 10000), 0);
+    ASSERT_EQ(can_cyclic_update(&cache, &frame, 0), 0);
+    EXPECT_EQ(can_cyclic_next_regen_us(&cache, 3000), 7000u);
+    EXPECT_EQ(can_cyclic_next_regen_us(&cache, 12000), 0u);
+
+    can_message_t out;
+    ASSERT_EQ(can_cyclic_poll_regen(&cache, 12000, &out), 1);
+    EXPECT_EQ(can_cyclic_next_regen_us(&cache, 12000), 10000u);
+
+    // A silent sender ends the regeneration
+    EXPECT_EQ(can_cyclic_next_regen_us(&cache, 400000), CAN_CYCLIC_NO_REGEN);
+}
+
+TEST_F(CanCyclicTest, RegenerationStopsWhenSenderIsSilent) {
+    ASSERT_EQ(can_cyclic_configure(&cache, 0x123, 100000, 10000), 0);
+    ASSERT_EQ(can_cyclic_update(&cache, &frame, 0), 0);
+
+    can_message_t out;
+    EXPECT_EQ(can_cyclic_poll_regen(&cache, 290000, &out), 1);
+    EXPECT_EQ(can_cyclic_poll_regen(&cache, 400000, &out), 0);
+}
+
+TEST_F(CanCyclicTest, RegenerationWithoutHeartbeatStopsAfterCycles) {
+    // Unsuppressed IDs count as silent after a few of their own cycles
+    ASSERT_EQ(can_cyclic_configure(&cache, 0x123, 0, 10000), 0);
+    ASSERT_EQ(can_cyclic_update(&cache, &frame, 0), 0);
+    EXPECT_EQ(cache.regen_entries, 1u);
+
+    can_message_t out;
+    EXPECT_EQ(can_cyclic_poll_regen(&cache, 30000, &out), 1);
+    EXPECT_EQ(can_cyclic_poll_regen(&cache, 40000, &out), 0);
+    EXPECT_EQ(can_cyclic_next_regen_us(&cache, 40000), CAN_CYCLIC_NO_REGEN);
+
+    // A new frame revives it
+    ASSERT_EQ(can_cyclic_update(&cache, &frame, 50000), 0);
+    EXPECT_EQ(cache.regen_entries, 1u);
+    EXPECT_EQ(can_cyclic_next_regen_us(&cache, 50000), 10000u);
+
+    // Without a regeneration period the ID is no candidate
+    ASSERT_EQ(can_cyclic_configure(&cache, 0x123, 0, 0), 0);
+    EXPECT_EQ(cache.regen_entries, 0u);
+    EXPECT_EQ(can_cyclic_next_regen_us(&cache, 50000), CAN_CYCLIC_NO_REGEN);
+}
+
+TEST_F(CanCyclicTest, FullCacheForwardsEverything) {
+    for (uint32_t id = 0; id < CAN_CYCLIC_CAPACITY; id++) {
+        frame.can_id = 0x1000 + id;
+        ASSERT_EQ(can_cyclic_should_forward(&cache, &frame, 0), 1);
+    }
+
+    frame.can_id = 0x7FF;
+    EXPECT_EQ(can_cyclic_should_forward(&cache, &frame, 0), 1);
+    EXPECT_EQ(can_cyclic_should_forward(&cache, &frame, 1), 1);
+    EXPECT_EQ(cache.stats.untracked, 2u);
+}
@@ -0,0 +1,117 @@
+#include "gtest/gtest.h"
+#include "../pcie/driver/pcie_crc32c.h"
+#include <string.h>
+#include <vector>
+
+// Bitwise reference implementation
+static uint32_t reference_crc32c(const uint8_t *data, size_t length) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static std::vector<uint8_t> pattern(size_t length, uint32_t seed) {
+    std::vector<uint8_t> data(length);
+    for (size_t i = 0; i < length; i++) {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = (uint8_t)(seed >> 16);
+    }
+    return data;
+}
+
+TEST(PCIeCrc32cTest, KnownVectors) {
+    EXPECT_EQ(pcie_crc32c("123456789", 9), 0xE3069283u);
+
+    // iSCSI test vectors (RFC 3720, B.4)
+    uint8_t buffer[32];
+    memset(buffer, 0, sizeof(buffer));
+    EXPECT_EQ(pcie_crc32c(buffer, sizeof(buffer)), 0x8A9136AAu);
+    memset(buffer, 0xFF, sizeof(buffer));
+    EXPECT_EQ(pcie_crc32c(buffer, sizeof(buffer)), 0x62A8AB43u);
+    for (int i = 0; i < 32; i++) {
+        buffer[i] = (uint8_t)i;
+    }
+    EXPECT_EQ(pcie_crc32c(buffer, sizeof(buffer)), 0x46DD794Eu);
+
+    EXPECT_EQ(pcie_crc32c(buffer, 0), 0u);
+    EXPECT_NE(pcie_crc32c_impl(), nullptr);
+}
+
+TEST(PCIeCrc32cTest, MatchesReferenceAtAnyAlignment) {
+    std::vector<uint8_t> data = pattern(300, 7);
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t length = 0; length < 260; length += 13) {
+            ASSERT_EQ(pcie_crc32c(data.data() + offset, length),
+                      reference_crc32c(data.data() + offset, length))
+                << "offset " << offset << " length " << length;
+        }
+    }
+}
+
+TEST(PCIeCrc32cTest, IncrementalUpdate) {
+    std::vector<uint8_t> data = pattern(200, 3);
+    uint32_t expected = pcie_crc32c(data.data(), data.size());
+
+    for (size_t split = 0; split <= data.size(); split += 17) {
+        uint32_t crc = pcie_crc32c_update(PCIE_CRC32C_INIT, data.data(), split);
+        crc = pcie_crc32c_update(crc, data.data() + split, data.size() - split);
+        EXPECT_EQ(~crc, expected);
+    }
+}
+
+TEST(PCIeCrc32cTest, BatchMatchesSingle) {
+    // Mixed lengths so the interleaved loop has ragged tails
+    const size_t lengths[] = {112, 7, 240, 0, 64, 113, 8, 1, 200, 96};
+    const size_t count = sizeof(lengths) / sizeof(lengths[0]);
+
+    std::vector<std::vector<uint8_t>> buffers;
+    const void *data[count];
+    uint32_t crcs[count];
+    for (size_t i = 0; i < count; i++) {
+        buffers.push_back(pattern(lengths[i], (uint32_t)i));
+        data[i] = buffers[i].data();
+        crcs[i] = PCIE_CRC32C_INIT;
+    }
+
+    for (size_t n = 0; n <= count; n++) {
+        for (size_t i = 0; i < count; i++) {
+            crcs[i] = PCIE_CRC32C_INIT;
+        }
+        pcie_crc32c_update_batch(crcs, data, lengths, n);
+        for (size_t i = 0; i < n; i++) {
+            EXPECT_EQ(~crcs[i], reference_crc32c(buffers[i].data(), lengths[i])) << "batch " << n << " item " << i;
+        }
+    }
+}
+
+TEST(PCIeCrc32cTest, PortablePathMatchesReference) {
+    ASSERT_EQ(pcie_crc32c_use_impl("portable"), 0);
+    EXPECT_STREQ(pcie_crc32c_impl(), "portable");
+
+    std::vector<uint8_t> data = pattern(300, 11);
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t length = 0; length < 260; length += 7) {
+            ASSERT_EQ(pcie_crc32c(data.data() + offset, length),
+                      reference_crc32c(data.data() + offset, length))
+                << "offset " << offset << " length " << length;
+        }
+    }
+
+    const void *buffers[3] = {data.data(), data.data() + 1, data.data() + 2};
+    const size_t lengths[3] = {240, 17, 112};
+    uint32_t crcs[3] = {PCIE_CRC32C_INIT, PCIE_CRC32C_INIT, PCIE_CRC32C_INIT};
+    pcie_crc32c_update_batch(crcs, buffers, lengths, 3);
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(~crcs[i], reference_crc32c((const uint8_t *)buffers[i], lengths[i]));
+    }
+
+    // Unknown names are rejected, NULL returns to the automatic choice
+    EXPECT_EQ(pcie_crc32c_use_impl("crc64"), -1);
+    ASSERT_EQ(pcie_crc32c_use_impl(NULL), 0);
+    EXPECT_EQ(pcie_crc32c("123456789", 9), 0xE3069283u);
+}
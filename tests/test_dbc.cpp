@@ -0,0 +1,105 @@
+#include "gtest/gtest.h"
+#include "example_dbc.h"
+#include <string.h>
+
+// Decoders generated by dbcgen.py from translation/dbc/example.dbc
+class DbcDecoderTest : public ::testing::Test {
+protected:
+    static can_message_t make_frame(uint32_t can_id, const uint8_t *data) {
+        can_message_t frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.can_id = can_id;
+        frame.can_dlc = 8;
+        memcpy(frame.data, data, 8);
+        return frame;
+    }
+
+    // Intel signals: doors 10/20, 21.5 degC, 100 lux, counter 5
+    const uint8_t body_bytes[8] = {10, 20, 0x67, 0x02, 0xC8, 0x00, 0x00, 0x50};
+
+    // Motorola signals: 3000 rpm, -100 Nm, 90 degC, 50 %
+    const uint8_t engine_bytes[8] = {0x2E, 0xE0, 0xF3, 0x88, 0x20, 0x7D, 0x00, 0x00};
+};
+
+TEST_F(DbcDecoderTest, DecodeLittleEndianSignals) {
+    example_body_status_t msg;
+    example_body_status_decode(body_bytes, &msg);
+
+    EXPECT_FLOAT_EQ(msg.DoorFrontLeft, 10.0f);
+    EXPECT_FLOAT_EQ(msg.DoorFrontRight, 20.0f);
+    EXPECT_NEAR(msg.InteriorTemp, 21.5f, 0.001f);
+    EXPECT_FLOAT_EQ(msg.LightLevel, 100.0f);
+    EXPECT_FLOAT_EQ(msg.Counter, 5.0f);
+}
+
+TEST_F(DbcDecoderTest, DecodeBigEndianAndSignedSignals) {
+    example_engine_data_t msg;
+    example_engine_data_decode(engine_bytes, &msg);
+
+    EXPECT_FLOAT_EQ(msg.EngineSpeed, 3000.0f);
+    EXPECT_FLOAT_EQ(msg.Torque, -100.0f);
+    EXPECT_FLOAT_EQ(msg.CoolantTemp, 90.0f);
+    EXPECT_NEAR(msg.ThrottlePos, 50.0f, 0.001f);
+}
+
+TEST_F(DbcDecoderTest, EncodeRoundTrip) {
+    uint8_t data[8];
+
+    example_body_status_t body;
+    example_body_status_decode(body_bytes, &body);
+    example_body_status_encode(&body, data);
+    EXPECT_EQ(memcmp(data, body_bytes, 8), 0);
+
+    example_engine_data_t engine;
+    example_engine_data_decode(engine_bytes, &engine);
+    example_engine_data_encode(&engine, data);
+    EXPECT_EQ(memcmp(data, engine_bytes, 8), 0);
+}
+
+TEST_F(DbcDecoderTest, BatchDecodeIntoStructOfArrays) {
+    example_batch_t batch;
+    ASSERT_EQ(example_batch_init(&batch, 4), 0);
+
+    const uint8_t zero[8] = {0};
+    can_message_t frames[5] = {
+        make_frame(EXAMPLE_ENGINE_DATA_ID, engine_bytes),
+        make_frame(0x7FF, zero),
+        make_frame(EXAMPLE_BODY_STATUS_ID, body_bytes),
+        make_frame(EXAMPLE_ENGINE_DATA_ID, zero),
+        make_frame(EXAMPLE_BODY_STATUS_ID, zero),
+    };
+
+    EXPECT_EQ(example_decode_batch(frames, 5, &batch), 4u);
+    EXPECT_EQ(batch.unknown, 1u);
+    EXPECT_EQ(batch.overflow, 0u);
+
+    ASSERT_EQ(batch.engine_data.count, 2u);
+    EXPECT_EQ(batch.engine_data.frame_index[0], 0u);
+    EXPECT_EQ(batch.engine_data.frame_index[1], 3u);
+    EXPECT_FLOAT_EQ(batch.engine_data.EngineSpeed[0], 3000.0f);
+    EXPECT_FLOAT_EQ(batch.engine_data.Torque[0], -100.0f);
+    EXPECT_FLOAT_EQ(batch.engine_data.CoolantTemp[1], -40.0f);
+
+    ASSERT_EQ(batch.body_status.count, 2u);
+    EXPECT_NEAR(batch.body_status.InteriorTemp[0], 21.5f, 0.001f);
+    EXPECT_FLOAT_EQ(batch.body_status.Counter[0], 5.0f);
+    EXPECT_EQ(batch.battery_state.count, 0u);
+
+    example_batch_free(&batch);
+}
+
+TEST_F(DbcDecoderTest, BatchOverflowIsCounted) {
+    example_batch_t batch;
+    ASSERT_EQ(example_batch_init(&batch, 1), 0);
+
+    can_message_t frames[3] = {
+        make_frame(EXAMPLE_BODY_STATUS_ID, body_bytes),
+        make_frame(EXAMPLE_BODY_STATUS_ID, body_bytes),
+        make_frame(EXAMPLE_ENGINE_DATA_ID, engine_bytes),
+    };
+
+    EXPECT_EQ(example_decode_batch(frames, 3, &batch), 2u);
+    EXPECT_EQ(batch.overflow, 1u);
+
+    example_batch_free(&batch);
+}
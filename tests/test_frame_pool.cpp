@@ -0,0 +1,341 @@
+#include "gtest/gtest.h"
+#include "../translation/pcie_frame_pool.h"
+#include "../pcie/driver/pcie_client.h"
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+class FramePoolTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        const uint32_t counts[PCIE_FRAME_NUM_CLASSES] = {64, 16, 16, 4, 2};
+        ASSERT_EQ(pcie_frame_pool_init(&pool, counts), 0);
+        pcie_frame_cache_init(&cache, &pool);
+    }
+
+    void TearDown() override {
+        pcie_frame_cache_flush(&cache);
+        pcie_frame_pool_destroy(&pool);
+    }
+
+    pcie_frame_pool_t pool;
+    pcie_frame_cache_t cache;
+};
+
+TEST_F(FramePoolTest, SizeClasses) {
+    EXPECT_EQ(pcie_frame_class_for(0), PCIE_FRAME_CAN);
+    EXPECT_EQ(pcie_frame_class_for(8), PCIE_FRAME_CAN);
+    EXPECT_EQ(pcie_frame_class_for(9), PCIE_FRAME_CANFD);
+    EXPECT_EQ(pcie_frame_class_for(64), PCIE_FRAME_CANFD);
+    EXPECT_EQ(pcie_frame_class_for(254), PCIE_FRAME_FLEXRAY);
+    EXPECT_EQ(pcie_frame_class_for(1500), PCIE_FRAME_ETHERNET);
+    EXPECT_EQ(pcie_frame_class_for(9000), PCIE_FRAME_JUMBO);
+    EXPECT_EQ(pcie_frame_class_for(9217), -1);
+
+    pcie_frame_t *frame = pcie_frame_alloc(&cache, 9000);
+    ASSERT_NE(frame, nullptr);
+    EXPECT_EQ(frame->size_class, (uint32_t)PCIE_FRAME_JUMBO);
+    EXPECT_GE(frame->capacity, 9000u);
+    // The payload follows the header directly
+    EXPECT_EQ(pcie_frame_payload(frame), (uint8_t *)&frame->msg + sizeof(pcie_message_t));
+    pcie_frame_release(&cache, frame);
+}
+
+TEST_F(FramePoolTest, ReleasedFrameIsReusedFromCache) {
+    pcie_frame_t *first = pcie_frame_alloc(&cache, 8);
+    ASSERT_NE(first, nullptr);
+    first->msg.message_id = 0x123;
+    pcie_frame_release(&cache, first);
+
+    pcie_frame_t *second = pcie_frame_alloc(&cache, 8);
+    EXPECT_EQ(second, first);
+    EXPECT_EQ(second->refs, 1u);
+    EXPECT_EQ(second->msg.message_id, 0u);   // Header cleared on allocation
+    EXPECT_EQ(cache.stats.refills, 1u);
+    EXPECT_EQ(cache.stats.hits, 1u);
+    pcie_frame_release(&cache, second);
+}
+
+TEST_F(FramePoolTest, ExhaustedClassFailsWithoutHeapFallback) {
+    pcie_frame_t *jumbo[2];
+    for (int i = 0; i < 2; i++) {
+        jumbo[i] = pcie_frame_alloc(&cache, 9000);
+        ASSERT_NE(jumbo[i], nullptr);
+    }
+    EXPECT_EQ(pcie_frame_alloc(&cache, 9000), nullptr);
+    EXPECT_EQ(cache.stats.exhausted, 1u);
+
+    // Other classes are unaffected, and a release makes the class usable again
+    pcie_frame_t *can = pcie_frame_alloc(&cache, 8);
+    EXPECT_NE(can, nullptr);
+    pcie_frame_release(&cache, can);
+    pcie_frame_release(&cache, jumbo[0]);
+    EXPECT_EQ(pcie_frame_alloc(&cache, 9000), jumbo[0]);
+    pcie_frame_release(&cache, jumbo[0]);
+    pcie_frame_release(&cache, jumbo[1]);
+}
+
+TEST_F(FramePoolTest, ReferencesKeepFrameForFanout) {
+    pcie_frame_t *frame = pcie_frame_alloc(&cache, 8);
+    ASSERT_NE(frame, nullptr);
+    pcie_frame_ref(frame);
+    pcie_frame_ref(frame);
+
+    pcie_frame_release(&cache, frame);
+    pcie_frame_release(&cache, frame);
+    EXPECT_EQ(frame->refs, 1u);
+    EXPECT_EQ(cache.count[PCIE_FRAME_CAN], PCIE_FRAME_CACHE_SIZE / 2 - 1);
+
+    pcie_frame_release(&cache, frame);
+    EXPECT_EQ(cache.count[PCIE_FRAME_CAN], PCIE_FRAME_CACHE_SIZE / 2);
+}
+
+TEST_F(FramePoolTest, FramesFreedOnOtherThreadsReturnToDepot) {
+    std::vector<pcie_frame_t *> frames;
+    for (int i = 0; i < 64; i++) {
+        pcie_frame_t *frame = pcie_frame_alloc(&cache, 8);
+        ASSERT_NE(frame, nullptr);
+        frames.push_back(frame);
+    }
+    EXPECT_EQ(pcie_frame_alloc(&cache, 8), nullptr);
+
+    // A consumer thread releases everything through its own cache
+    std::thread consumer([this, &frames] {
+        pcie_frame_cache_t local;
+        pcie_frame_cache_init(&local, &pool);
+        for (pcie_frame_t *frame : frames) {
+            pcie_frame_release(&local, frame);
+        }
+        EXPECT_GT(local.stats.flushes, 0u);
+        pcie_frame_cache_flush(&local);
+    });
+    consumer.join();
+
+    EXPECT_EQ(pcie_frame_pool_available(&pool, PCIE_FRAME_CAN), 64u);
+}
+
+TEST_F(FramePoolTest, EthernetPayloadIsOwnedByFrame) {
+    uint8_t payload[1000];
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)i;
+    }
+
+    bus_message_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_TYPE_ETHERNET;
+    msg.data.ethernet.ethertype = 0x88B5;
+    msg.data.ethernet.data = payload;
+    msg.data.ethernet.data_len = sizeof(payload);
+
+    pcie_frame_t *frame = pcie_frame_from_bus(&cache, &msg, 3, 7, 1);
+    ASSERT_NE(frame, nullptr);
+    EXPECT_EQ(frame->size_class, (uint32_t)PCIE_FRAME_ETHERNET);
+    EXPECT_EQ(frame->msg.zone_id, 3u);
+    EXPECT_EQ(frame->msg.device_id, 7u);
+    EXPECT_EQ(frame->msg.message_id, 0x88B5u);
+    EXPECT_EQ(frame->length, sizeof(payload));
+    EXPECT_EQ(frame->msg.bus_message.data.ethernet.data, pcie_frame_payload(frame));
+
+    // Later changes to the caller's buffer do not reach the frame
+    memset(payload, 0xFF, sizeof(payload));
+    EXPECT_EQ(frame->msg.bus_message.data.ethernet.data[999], (uint8_t)(999 & 0xFF));
+    pcie_frame_release(&cache, frame);
+
+    msg.type = MSG_TYPE_CAN;
+    msg.data.can.can_id = 0x42;
+    frame = pcie_frame_from_bus(&cache, &msg, 1, 1, 0);
+    ASSERT_NE(frame, nullptr);
+    EXPECT_EQ(frame->size_class, (uint32_t)PCIE_FRAME_CAN);
+    EXPECT_EQ(frame->msg.message_id, 0x42u);
+    EXPECT_EQ(frame->length, 0u);
+    pcie_frame_release(&cache, frame);
+}
+
+TEST_F(FramePoolTest, CanTranslatesInPlace) {
+    can_message_t can;
+    memset(&can, 0, sizeof(can));
+    can.can_id = 0x321;
+    can.can_dlc = 2;
+    can.data[1] = 0x5A;
+
+    pcie_frame_t *frame = pcie_frame_from_can(&cache, &can, 2, 9);
+    ASSERT_NE(frame, nullptr);
+    EXPECT_EQ(frame->size_class, (uint32_t)PCIE_FRAME_CAN);
+    EXPECT_EQ(frame->msg.zone_id, 2u);
+    EXPECT_EQ(frame->msg.message_id, 0x321u);
+    EXPECT_EQ(frame->msg.bus_message.type, MSG_TYPE_CAN);
+
+    can_message_t out;
+    ASSERT_EQ(pcie_frame_to_can(frame, &out), 0);
+    EXPECT_EQ(out.can_id, 0x321u);
+    EXPECT_EQ(out.data[1], 0x5A);
+
+    frame->msg.bus_message.type = MSG_TYPE_LIN;
+    EXPECT_EQ(pcie_frame_to_can(frame, &out), -1);
+    pcie_frame_release(&cache, frame);
+    EXPECT_EQ(pcie_frame_from_can(&cache, NULL, 2, 9), nullptr);
+}
+
+// Both BARs are the same file, so everything sent comes back on the receive side
+class FrameLinkTest : public FramePoolTest {
+protected:
+    void SetUp() override {
+        FramePoolTest::SetUp();
+        char pattern[] = "/tmp/pcie_frames_XXXXXX";
+        ASSERT_NE(mkdtemp(pattern), nullptr);
+        root = pattern;
+        device = root + "/0000:02:00.0";
+        ASSERT_EQ(mkdir(device.c_str(), 0755), 0);
+        int fd = open((device + "/resource0").c_str(), O_RDWR | O_CREAT, 0644);
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(ftruncate(fd, 4096), 0);
+        close(fd);
+        ASSERT_EQ(symlink("resource0", (device + "/resource1").c_str()), 0);
+
+        setenv("PCIE_SYSFS_ROOT", root.c_str(), 1);
+        setenv("PCIE_DEVICE_ID", "0000:02:00.0", 1);
+        setenv("PCIE_VENDOR_ID", "0x1234", 1);
+        setenv("PCIE_SUBSYSTEM_ID", "0x5678", 1);
+        ASSERT_EQ(pcie_client_init(), 0);
+    }
+
+    void TearDown() override {
+        pcie_client_cleanup();
+        FramePoolTest::TearDown();
+        unsetenv("PCIE_SYSFS_ROOT");
+        unsetenv("PCIE_DEVICE_ID");
+        unsetenv("PCIE_VENDOR_ID");
+        unsetenv("PCIE_SUBSYSTEM_ID");
+        unlink((device + "/resource1").c_str());
+        unlink((device + "/resource0").c_str());
+        rmdir(device.c_str());
+        rmdir(root.c_str());
+    }
+
+    pcie_frame_t *ethernet_frame(pcie_frame_cache_t *from, size_t length) {
+        std::vector<uint8_t> payload(length);
+        for (size_t i = 0; i < length; i++) {
+            payload[i] = (uint8_t)(i * 7);
+        }
+        bus_message_t msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.type = MSG_TYPE_ETHERNET;
+        msg.data.ethernet.ethertype = 0x88B5;
+        msg.data.ethernet.data = payload.data();
+        msg.data.ethernet.data_len = length;
+        return pcie_frame_from_bus(from, &msg, 4, 9, 0);
+    }
+
+    static void expect_payload(const pcie_frame_t *frame, size_t length) {
+        ASSERT_EQ(frame->length, length);
+        EXPECT_EQ(frame->msg.bus_message.data.ethernet.data_len, length);
+        for (size_t i = 0; i < length; i++) {
+            ASSERT_EQ(frame->msg.bus_message.data.ethernet.data[i], (uint8_t)(i * 7)) << i;
+        }
+    }
+
+    std::string root;
+    std::string device;
+};
+
+TEST_F(FrameLinkTest, SendAndReceiveFrames) {
+    bus_message_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_TYPE_CAN;
+    msg.data.can.can_id = 0x321;
+    pcie_frame_t *can = pcie_frame_from_bus(&cache, &msg, 2, 5, 0);
+    ASSERT_NE(can, nullptr);
+    ASSERT_EQ(pcie_send_frame(can), 0);
+    pcie_frame_release(&cache, can);
+
+    // 1000 bytes take the first slot and four continuation slots
+    pcie_frame_t *ethernet = ethernet_frame(&cache, 1000);
+    ASSERT_NE(ethernet, nullptr);
+    ASSERT_EQ(pcie_send_frame(ethernet), 0);
+    pcie_frame_release(&cache, ethernet);
+
+    pcie_frame_t *rx = NULL;
+    ASSERT_EQ(pcie_receive_frame(&cache, &rx), 0);
+    EXPECT_EQ(rx->size_class, (uint32_t)PCIE_FRAME_CAN);
+    EXPECT_EQ(rx->msg.zone_id, 2u);
+    EXPECT_EQ(rx->msg.message_id, 0x321u);
+    EXPECT_EQ(rx->length, 0u);
+    pcie_frame_release(&cache, rx);
+
+    ASSERT_EQ(pcie_receive_frame(&cache, &rx), 0);
+    EXPECT_EQ(rx->size_class, (uint32_t)PCIE_FRAME_ETHERNET);
+    EXPECT_EQ(rx->msg.message_id, 0x88B5u);
+    EXPECT_EQ(rx->msg.bus_message.data.ethernet.data, pcie_frame_payload(rx));
+    expect_payload(rx, 1000);
+    pcie_frame_release(&cache, rx);
+
+    ASSERT_EQ(pcie_client_set_receive_timeout(0), 0);
+    EXPECT_EQ(pcie_receive_frame(&cache, &rx), PCIE_FLOW_EMPTY);
+    pcie_client_set_receive_timeout(PCIE_CLIENT_RECEIVE_TIMEOUT_US);
+}
+
+TEST_F(FrameLinkTest, JumboFrameLargerThanTheRing) {
+    pcie_frame_t *jumbo = ethernet_frame(&cache, 9000);
+    ASSERT_NE(jumbo, nullptr);
+    // Leave the other jumbo frame to the receiving thread
+    pcie_frame_cache_flush(&cache);
+
+    // The sender waits for credits while the receiver reassembles
+    std::thread receiver([this] {
+        pcie_frame_cache_t local;
+        pcie_frame_cache_init(&local, &pool);
+        pcie_frame_t *rx = NULL;
+        ASSERT_EQ(pcie_receive_frame(&local, &rx), 0);
+        EXPECT_EQ(rx->size_class, (uint32_t)PCIE_FRAME_JUMBO);
+        expect_payload(rx, 9000);
+        pcie_frame_release(&local, rx);
+        pcie_frame_cache_flush(&local);
+    });
+
+    EXPECT_EQ(pcie_send_frame(jumbo), 0);
+    pcie_frame_release(&cache, jumbo);
+    receiver.join();
+}
+
+TEST_F(FrameLinkTest, IncompleteFrameIsDiscarded) {
+    // Only the first slot of a 1000 byte frame makes it onto the link
+    pcie_frame_t *partial = ethernet_frame(&cache, 1000);
+    ASSERT_NE(partial, nullptr);
+    partial->msg.payload_size = sizeof(bus_message_t) + 1000;
+    ASSERT_EQ(pcie_client_send_buffer(&partial->msg, sizeof(pcie_message_t) + PCIE_FRAME_FIRST_CHUNK, 0), 0);
+    pcie_frame_release(&cache, partial);
+
+    pcie_frame_t *next = ethernet_frame(&cache, 300);
+    ASSERT_NE(next, nullptr);
+    ASSERT_EQ(pcie_send_frame(next), 0);
+    pcie_frame_release(&cache, next);
+
+    // The next frame's first slot ends the broken one and is not lost
+    pcie_frame_t *rx = NULL;
+    ASSERT_EQ(pcie_receive_frame(&cache, &rx), 0);
+    expect_payload(rx, 300);
+    pcie_frame_release(&cache, rx);
+}
+
+TEST(ArenaTest, AlignedAllocationAndReset) {
+    pcie_arena_t arena;
+    ASSERT_EQ(pcie_arena_init(&arena, 256), 0);
+
+    void *a = pcie_arena_alloc(&arena, 3);
+    void *b = pcie_arena_alloc(&arena, 100);
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    EXPECT_EQ((uintptr_t)b % 16, 0u);
+    EXPECT_EQ((uint8_t *)b - (uint8_t *)a, 16);
+
+    EXPECT_EQ(pcie_arena_alloc(&arena, 200), nullptr);
+    EXPECT_EQ(arena.high_water, 116u);
+
+    pcie_arena_reset(&arena);
+    EXPECT_EQ(pcie_arena_alloc(&arena, 200), a);
+    pcie_arena_destroy(&arena);
+}
@@ -0,0 +1,236 @@
+#include "gtest/gtest.h"
+#include "../translation/pcie_async.hpp"
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace pcie::async;
+
+// One direction of a link in a plain memory region instead of a BAR mapping
+struct Ring {
+    explicit Ring(size_t slots) : region(sizeof(pcie_flow_ctrl_t) + slots * PCIE_FLOW_SLOT_SIZE, 0) {
+        EXPECT_EQ(pcie_flow_init_sender(&tx, region.data(), region.size()), 0);
+        EXPECT_EQ(pcie_flow_init_receiver(&rx, region.data(), region.size()), 0);
+    }
+
+    std::vector<uint8_t> region;
+    pcie_flow_t tx;
+    pcie_flow_t rx;
+};
+
+static Task<int> add(int a, int b) {
+    co_return a + b;
+}
+
+static Task<void> sum_tasks(int *result) {
+    int first = co_await add(1, 2);
+    int second = co_await add(first, 10);
+    *result = second;
+}
+
+TEST(PCIeAsyncTest, TasksChainAndLoopEndsWhenDone) {
+    EventLoop loop;
+    int result = 0;
+
+    loop.spawn(sum_tasks(&result));
+    EXPECT_EQ(loop.active_tasks(), 1u);
+    loop.run();
+
+    EXPECT_EQ(result, 13);
+    EXPECT_EQ(loop.active_tasks(), 0u);
+}
+
+static Task<void> produce(EventLoop &loop, RingEndpoint &ring, uint32_t count, int *failures) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (co_await async_send(loop, ring, &i, sizeof(i), 0) != 0) {
+            (*failures)++;
+        }
+    }
+}
+
+static Task<void> consume(EventLoop &loop, RingEndpoint &ring, uint32_t count, std::vector<uint32_t> *received) {
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t value = 0;
+        size_t length = 0;
+        if (co_await async_receive(loop, ring, &value, sizeof(value), &length) == 0 && length == sizeof(value)) {
+            received->push_back(value);
+        }
+    }
+}
+
+// A ring smaller than the burst makes the producer wait for credits
+static void run_ring_transfer(bool doorbells) {
+    Ring ring(4);
+    int to_receiver = doorbells ? eventfd(0, EFD_NONBLOCK) : -1;
+    int to_sender = doorbells ? eventfd(0, EFD_NONBLOCK) : -1;
+    RingEndpoint sender(&ring.tx, nullptr, to_sender, to_receiver);
+    RingEndpoint receiver(nullptr, &ring.rx, to_receiver, to_sender);
+
+    EventLoop loop(std::chrono::microseconds(10));
+    std::vector<uint32_t> received;
+    int failures = 0;
+
+    // Start the consumer first so it suspends on the empty ring
+    loop.spawn(consume(loop, receiver, 1000, &received));
+    loop.spawn(produce(loop, sender, 1000, &failures));
+    loop.run();
+
+    EXPECT_EQ(failures, 0);
+    ASSERT_EQ(received.size(), 1000u);
+    for (uint32_t i = 0; i < 1000; i++) {
+        EXPECT_EQ(received[i], i);
+    }
+    if (doorbells) {
+        EXPECT_EQ(loop.stats().timer_ticks, 0u);
+        close(to_receiver);
+        close(to_sender);
+    }
+}
+
+TEST(PCIeAsyncTest, RingTransferWithDoorbells) {
+    run_ring_transfer(true);
+}
+
+TEST(PCIeAsyncTest, RingTransferWithPolling) {
+    run_ring_transfer(false);
+}
+
+static Task<void> echo(EventLoop &loop, RingEndpoint &ring, uint32_t rounds) {
+    for (uint32_t i = 0; i < rounds; i++) {
+        uint32_t value = 0;
+        if (co_await async_receive(loop, ring, &value, sizeof(value), nullptr) != 0) {
+            co_return;
+        }
+        value++;
+        co_await async_send(loop, ring, &value, sizeof(value), 0);
+    }
+}
+
+static Task<void> ping(EventLoop &loop, RingEndpoint &ring, uint32_t rounds, uint32_t *completed) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < rounds; i++) {
+        co_await async_send(loop, ring, &value, sizeof(value), 0);
+        if (co_await async_receive(loop, ring, &value, sizeof(value), nullptr) != 0) {
+            co_return;
+        }
+    }
+    *completed = value;
+}
+
+// One thread serves many independent request/response channels
+TEST(PCIeAsyncTest, ThousandChannelsOnOneThread) {
+    const size_t channels = 1000;
+    const uint32_t rounds = 5;
+
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::vector<std::unique_ptr<RingEndpoint>> endpoints;
+    std::vector<uint32_t> completed(channels, 0);
+    EventLoop loop(std::chrono::microseconds(10));
+
+    for (size_t i = 0; i < channels; i++) {
+        rings.push_back(std::make_unique<Ring>(2));   // Client -> server
+        rings.push_back(std::make_unique<Ring>(2));   // Server -> client
+        Ring &request = *rings[2 * i];
+        Ring &response = *rings[2 * i + 1];
+        endpoints.push_back(std::make_unique<RingEndpoint>(&request.tx, &response.rx));
+        endpoints.push_back(std::make_unique<RingEndpoint>(&response.tx, &request.rx));
+        loop.spawn(echo(loop, *endpoints[2 * i + 1], rounds));
+        loop.spawn(ping(loop, *endpoints[2 * i], rounds, &completed[i]));
+    }
+    loop.run();
+
+    EXPECT_EQ(loop.active_tasks(), 0u);
+    for (size_t i = 0; i < channels; i++) {
+        EXPECT_EQ(completed[i], rounds) << "channel " << i;
+    }
+}
+
+static Task<void> send_frames(EventLoop &loop, CanSocket &socket, uint32_t count, int *failures) {
+    for (uint32_t i = 0; i < count; i++) {
+        can_message_t msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.can_id = 0x100 + i;
+        msg.can_dlc = 4;
+        memcpy(msg.data, &i, sizeof(i));
+        if (co_await async_send(loop, socket, msg) != 0) {
+            (*failures)++;
+        }
+    }
+}
+
+static Task<void> receive_frames(EventLoop &loop, CanSocket &socket, uint32_t count, std::vector<can_message_t> *frames) {
+    for (uint32_t i = 0; i < count; i++) {
+        can_message_t msg;
+        if (co_await async_receive(loop, socket, msg) != 0) {
+            co_return;
+        }
+        frames->push_back(msg);
+    }
+}
+
+// A datagram socket pair stands in for a SocketCAN interface
+TEST(PCIeAsyncTest, CanSocketSendAndReceive) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds), 0);
+    CanSocket bus_a(fds[0]);
+    CanSocket bus_b(fds[1]);
+
+    EventLoop loop;
+    std::vector<can_message_t> frames;
+    int failures = 0;
+
+    // More frames than the socket buffer holds makes the sender wait as well
+    loop.spawn(receive_frames(loop, bus_b, 2000, &frames));
+    loop.spawn(send_frames(loop, bus_a, 2000, &failures));
+    loop.run();
+
+    EXPECT_EQ(failures, 0);
+    ASSERT_EQ(frames.size(), 2000u);
+    for (uint32_t i = 0; i < 2000; i++) {
+        uint32_t value = 0;
+        memcpy(&value, frames[i].data, sizeof(value));
+        EXPECT_EQ(frames[i].can_id, 0x100 + i);
+        EXPECT_EQ(frames[i].can_dlc, 4);
+        EXPECT_EQ(value, i);
+    }
+}
+
+static Task<void> wait_forever(EventLoop &loop, CanSocket &socket, int *received) {
+    can_message_t msg;
+    if (co_await async_receive(loop, socket, msg) == 0) {
+        (*received)++;
+    }
+}
+
+TEST(PCIeAsyncTest, StopFromAnotherThread) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds), 0);
+    CanSocket idle(fds[0]);
+    CanSocket peer(fds[1]);
+    int received = 0;
+
+    {
+        EventLoop loop;
+        loop.spawn(wait_forever(loop, idle, &received));
+
+        std::thread stopper([&loop] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            loop.stop();
+        });
+        loop.run();
+        stopper.join();
+
+        // The suspended task is destroyed with the loop
+        EXPECT_EQ(loop.active_tasks(), 1u);
+    }
+    EXPECT_EQ(received, 0);
+}
+
+TEST(PCIeAsyncTest, InvalidEndpointsThrow) {
+    // The client rings only exist after pcie_client_init()
+    EXPECT_THROW(RingEndpoint::client(), std::system_error);
+    EXPECT_THROW(CanSocket(-1), std::system_error);
+}
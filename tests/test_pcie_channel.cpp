@@ -0,0 +1,132 @@
+#include "gtest/gtest.h"
+#include "../translation/pcie_channel.hpp"
+#include <array>
+#include <string.h>
+#include <vector>
+
+// Layout and dispatch are resolved at compile time
+static_assert(pcie::CanChannel::type == MSG_TYPE_CAN, "CAN channel type");
+static_assert(pcie::FlexRayChannel::type == MSG_TYPE_FLEXRAY, "FlexRay channel type");
+static_assert(pcie::CanChannel::encoded_size == sizeof(pcie_message_t), "Wire layout shared with the C API");
+
+class PCIeChannelTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        setenv("PCIE_DEVICE_ID", "0000:00:00.0", 1);
+        setenv("PCIE_VENDOR_ID", "0x1234", 1);
+        setenv("PCIE_SUBSYSTEM_ID", "0x5678", 1);
+    }
+
+    void TearDown() override {
+        unsetenv("PCIE_DEVICE_ID");
+        unsetenv("PCIE_VENDOR_ID");
+        unsetenv("PCIE_SUBSYSTEM_ID");
+    }
+
+    static can_message_t make_can(uint32_t can_id) {
+        can_message_t frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.can_id = can_id;
+        frame.can_dlc = 8;
+        for (int i = 0; i < 8; i++) {
+            frame.data[i] = (uint8_t)(can_id + i);
+        }
+        return frame;
+    }
+};
+
+TEST_F(PCIeChannelTest, EncodeMatchesCTranslation) {
+    can_message_t frame = make_can(0x123);
+
+    pcie_message_t typed;
+    pcie::CanChannel::encode(frame, 1, 42, 0, 0, typed);
+
+    pcie_message_t untyped;
+    ASSERT_EQ(translate_can_to_pcie(&frame, &untyped, 1, 42), 0);
+
+    EXPECT_EQ(typed.zone_id, untyped.zone_id);
+    EXPECT_EQ(typed.device_id, untyped.device_id);
+    EXPECT_EQ(typed.message_id, untyped.message_id);
+    EXPECT_EQ(typed.payload_size, untyped.payload_size);
+    EXPECT_EQ(typed.bus_message.type, untyped.bus_message.type);
+    EXPECT_EQ(memcmp(&typed.bus_message.data.can, &untyped.bus_message.data.can, sizeof(can_message_t)), 0);
+}
+
+TEST_F(PCIeChannelTest, DecodeChecksBusType) {
+    flexray_message_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.frame_id = 77;
+    frame.payload_length = 16;
+    frame.data[15] = 0xAB;
+
+    pcie_message_t msg;
+    pcie::FlexRayChannel::encode(frame, 3, 9, 1, 1234, msg);
+    EXPECT_EQ(msg.message_id, 77u);
+
+    flexray_message_t decoded;
+    pcie::Source source;
+    ASSERT_TRUE(pcie::FlexRayChannel::decode(msg, decoded, &source));
+    EXPECT_EQ(decoded.frame_id, 77u);
+    EXPECT_EQ(decoded.data[15], 0xAB);
+    EXPECT_EQ(source.zone_id, 3u);
+    EXPECT_EQ(source.device_id, 9u);
+    EXPECT_EQ(source.timestamp_us, 1234u);
+
+    can_message_t can;
+    EXPECT_FALSE(pcie::CanChannel::decode(msg, can));
+}
+
+TEST_F(PCIeChannelTest, SpanViews) {
+    can_message_t frames[3] = {make_can(1), make_can(2), make_can(3)};
+    pcie::Span<const can_message_t> from_array(frames);
+    EXPECT_EQ(from_array.size(), 3u);
+    EXPECT_EQ(from_array[2].can_id, 3u);
+
+    std::vector<can_message_t> vector(frames, frames + 3);
+    pcie::Span<can_message_t> from_vector(vector);
+    EXPECT_EQ(from_vector.data(), vector.data());
+    EXPECT_EQ(from_vector.subspan(1, 2)[0].can_id, 2u);
+
+    std::array<uint8_t, 4> bytes = {{1, 2, 3, 4}};
+    pcie::Span<const uint8_t> from_std_array(bytes);
+    EXPECT_EQ(from_std_array.size(), 4u);
+
+    size_t sum = 0;
+    for (const can_message_t &frame : from_array) {
+        sum += frame.can_id;
+    }
+    EXPECT_EQ(sum, 6u);
+}
+
+TEST_F(PCIeChannelTest, ClientHandlesShareTheLink) {
+    EXPECT_EQ(pcie::Client::references(), 0);
+    {
+        pcie::Endpoint endpoint(1, 42);
+        EXPECT_TRUE(pcie_client_is_initialized());
+        {
+            pcie::CanChannel channel(endpoint);
+            EXPECT_EQ(pcie::Client::references(), 2);
+        }
+        EXPECT_EQ(pcie::Client::references(), 1);
+        EXPECT_TRUE(pcie_client_is_initialized());
+    }
+    EXPECT_EQ(pcie::Client::references(), 0);
+    EXPECT_FALSE(pcie_client_is_initialized());
+}
+
+TEST_F(PCIeChannelTest, ClientInitializationFailureThrows) {
+    unsetenv("PCIE_DEVICE_ID");
+    EXPECT_THROW(pcie::Client client, pcie::Error);
+    EXPECT_EQ(pcie::Client::references(), 0);
+}
+
+TEST_F(PCIeChannelTest, SendWithoutDeviceReportsError) {
+    pcie::CanChannel channel(pcie::Endpoint(1, 42));
+
+    // No PCIe device in the test environment
+    can_message_t frames[2] = {make_can(1), make_can(2)};
+    pcie::Status status = pcie::Status::Ok;
+    EXPECT_EQ(channel.send(pcie::Span<const can_message_t>(frames), &status), 0u);
+    EXPECT_EQ(status, pcie::Status::Error);
+    EXPECT_EQ(channel.send(frames[0]), pcie::Status::Error);
+}
@@ -1,6 +1,12 @@
 #include "gtest/gtest.h"
 #include "../pcie/driver/pcie_client.h"
+#include "../pcie/driver/pcie_common.h"
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
 
 class PCIeClientTest : public ::testing::Test {
 protected:
@@ -92,4 +98,255 @@ TEST_F(PCIeClientTest, CleanupAndReinit) {
     
     // Should be able to initialize again
     EXPECT_EQ(pcie_client_init(), 0);
-}
\ No newline at end of file
+}
+
+// A directory with resource files stands in for the sysfs device
+class PCIeClientStartupTest : public PCIeClientTest {
+protected:
+    void SetUp() override {
+        PCIeClientTest::SetUp();
+        char pattern[] = "/tmp/pcie_sysfs_XXXXXX";
+        ASSERT_NE(mkdtemp(pattern), nullptr);
+        root = pattern;
+        device = root + "/0000:01:00.0";
+        ASSERT_EQ(mkdir(device.c_str(), 0755), 0);
+        create_resource("resource0");
+        create_resource("resource1");
+
+        setenv("PCIE_SYSFS_ROOT", root.c_str(), 1);
+        setenv("PCIE_DEVICE_ID", "0000:01:00.0", 1);
+    }
+
+    void TearDown() override {
+        PCIeClientTest::TearDown();
+        unsetenv("PCIE_SYSFS_ROOT");
+        unsetenv("PCIE_EAGER_INIT");
+        unlink((device + "/resource0").c_str());
+        unlink((device + "/resource1").c_str());
+        rmdir(device.c_str());
+        rmdir(root.c_str());
+    }
+
+    void create_resource(const char *name) {
+        int fd = open((device + "/" + name).c_str(), O_RDWR | O_CREAT, 0644);
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(ftruncate(fd, 4096), 0);
+        close(fd);
+    }
+
+    // Format the ring we receive from and acknowledge the generation of the
+    // ring we transmit on, as the peer would
+    void start_peer() {
+        int fd = open((device + "/resource1").c_str(), O_RDWR);
+        ASSERT_GE(fd, 0);
+        void *map = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ASSERT_NE(map, MAP_FAILED);
+        pcie_flow_t peer;
+        EXPECT_EQ(pcie_flow_init_sender(&peer, map, 4096), 0);
+        ack_ours(&peer);
+        munmap(map, 4096);
+        close(fd);
+    }
+
+    // Echo the current generation of our transmit ring into the peer's ring
+    void ack_ours(pcie_flow_t *peer) {
+        int fd = open((device + "/resource0").c_str(), O_RDWR);
+        ASSERT_GE(fd, 0);
+        void *map = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ASSERT_NE(map, MAP_FAILED);
+        pcie_flow_t ours;
+        EXPECT_EQ(pcie_flow_init_receiver(&ours, map, 4096), 0);
+        pcie_flow_ack_peer(peer, &ours);
+        munmap(map, 4096);
+        close(fd);
+    }
+
+    std::string root;
+    std::string device;
+};
+
+TEST_F(PCIeClientStartupTest, StartRequiresInit) {
+    pcie_client_startup_t report;
+    EXPECT_EQ(pcie_client_start(0, &report), -1);
+}
+
+TEST_F(PCIeClientStartupTest, StartOpensBothRegionsAndReports) {
+    ASSERT_EQ(pcie_client_init(), 0);
+
+    pcie_client_startup_t report;
+    ASSERT_EQ(pcie_client_start(0, &report), 0);
+    EXPECT_GT(report.tx_open_ns, 0u);
+    EXPECT_GT(report.rx_open_ns, 0u);
+    EXPECT_GE(report.total_ns, report.tx_open_ns + report.rx_open_ns);
+    EXPECT_EQ(report.handshake_ns, 0u);
+    EXPECT_EQ(report.peer_ready, 0);
+
+    // The transmit ring is formatted before the first message
+    pcie_flow_stats_t stats;
+    pcie_client_get_flow_stats(&stats, NULL);
+    EXPECT_EQ(stats.sent, 0u);
+    EXPECT_EQ(pcie_client_send_buffer("x", 1, 0), 0);
+}
+
+TEST_F(PCIeClientStartupTest, HandshakeWaitsForPeer) {
+    ASSERT_EQ(pcie_client_init(), 0);
+
+    pcie_client_startup_t report;
+    EXPECT_EQ(pcie_client_start(20, &report), PCIE_CLIENT_NO_PEER);
+    EXPECT_GE(report.handshake_ns, 20000000u);
+    EXPECT_EQ(report.peer_ready, 0);
+
+    start_peer();
+    EXPECT_EQ(pcie_client_start(1000, &report), 0);
+    EXPECT_EQ(report.peer_ready, 1);
+    EXPECT_LT(report.handshake_ns, 1000000000u);
+}
+
+TEST_F(PCIeClientStartupTest, StaleRingFromEarlierBootIsNotReady) {
+    ASSERT_EQ(pcie_client_init(), 0);
+    pcie_client_startup_t report;
+    EXPECT_EQ(pcie_client_start(0, &report), 0);
+    start_peer();
+    EXPECT_EQ(pcie_client_start(20, &report), 0);
+    EXPECT_EQ(report.peer_ready, 1);
+
+    // We reboot, the peer's ring still carries its magic and our old generation
+    pcie_client_cleanup();
+    ASSERT_EQ(pcie_client_init(), 0);
+    EXPECT_EQ(pcie_client_start(20, &report), PCIE_CLIENT_NO_PEER);
+    EXPECT_EQ(report.peer_ready, 0);
+
+    start_peer();
+    EXPECT_EQ(pcie_client_start(1000, &report), 0);
+    EXPECT_EQ(report.peer_ready, 1);
+}
+
+TEST_F(PCIeClientStartupTest, FailedStartUnmapsTransmitRegion) {
+    ASSERT_EQ(pcie_client_init(), 0);
+    unlink((device + "/resource1").c_str());
+
+    pcie_client_startup_t report;
+    EXPECT_EQ(pcie_client_start(0, &report), -1);
+    EXPECT_EQ(pcie_sender_flow(), nullptr);
+}
+
+TEST_F(PCIeClientStartupTest, ReceiveTimeoutIsConfigurable) {
+    ASSERT_EQ(pcie_client_init(), 0);
+    start_peer();
+
+    char buffer[64];
+    size_t received = 0;
+    ASSERT_EQ(pcie_client_set_receive_timeout(0), 0);
+    uint64_t start = pcie_time_ns();
+    EXPECT_EQ(pcie_client_receive_buffer(buffer, sizeof(buffer), &received), PCIE_FLOW_EMPTY);
+    EXPECT_LT(pcie_time_ns() - start, 50000000u);
+
+    ASSERT_EQ(pcie_client_set_receive_timeout(5000), 0);
+    start = pcie_time_ns();
+    EXPECT_EQ(pcie_client_receive_buffer(buffer, sizeof(buffer), &received), PCIE_FLOW_EMPTY);
+    EXPECT_GE(pcie_time_ns() - start, 5000000u);
+    pcie_client_set_receive_timeout(PCIE_CLIENT_RECEIVE_TIMEOUT_US);
+}
+
+TEST_F(PCIeClientStartupTest, ReceiveDrainsRingInBatches) {
+    ASSERT_EQ(pcie_client_init(), 0);
+
+    // The peer publishes three messages before we look
+    int fd = open((device + "/resource1").c_str(), O_RDWR);
+    ASSERT_GE(fd, 0);
+    void *map = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT_NE(map, MAP_FAILED);
+    pcie_flow_t peer;
+    ASSERT_EQ(pcie_flow_init_sender(&peer, map, 4096), 0);
+    for (uint32_t i = 0; i < 3; i++) {
+        uint32_t value = 500 + i;
+        ASSERT_EQ(pcie_flow_send(&peer, &value, sizeof(value), 0), 0);
+    }
+
+    // A single receive takes the whole ring, the rest stays staged
+    uint32_t value = 0;
+    size_t received = 0;
+    ASSERT_EQ(pcie_client_receive_buffer(&value, sizeof(value), &received), 0);
+    EXPECT_EQ(value, 500u);
+    EXPECT_EQ(received, sizeof(value));
+    EXPECT_EQ(pcie_flow_credits(&peer), (4096 - sizeof(pcie_flow_ctrl_t)) / PCIE_FLOW_SLOT_SIZE);
+
+    uint32_t values[4];
+    size_t lengths[4];
+    ASSERT_EQ(pcie_client_receive_batch(values, sizeof(values[0]), 4, lengths), 2);
+    EXPECT_EQ(values[0], 501u);
+    EXPECT_EQ(values[1], 502u);
+    EXPECT_EQ(lengths[1], sizeof(uint32_t));
+
+    ASSERT_EQ(pcie_client_set_receive_timeout(0), 0);
+    EXPECT_EQ(pcie_client_receive_batch(values, sizeof(values[0]), 4, lengths), 0);
+    pcie_client_set_receive_timeout(PCIE_CLIENT_RECEIVE_TIMEOUT_US);
+    munmap(map, 4096);
+    close(fd);
+}
+
+TEST_F(PCIeClientStartupTest, OversizedMessageIsDropped) {
+    ASSERT_EQ(pcie_client_init(), 0);
+
+    int fd = open((device + "/resource1").c_str(), O_RDWR);
+    ASSERT_GE(fd, 0);
+    void *map = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT_NE(map, MAP_FAILED);
+    pcie_flow_t peer;
+    ASSERT_EQ(pcie_flow_init_sender(&peer, map, 4096), 0);
+    uint64_t big = 0x1122334455667788ull;
+    ASSERT_EQ(pcie_flow_send(&peer, &big, sizeof(big), 0), 0);
+    uint32_t small = 600;
+    ASSERT_EQ(pcie_flow_send(&peer, &small, sizeof(small), 0), 0);
+
+    // A fixed-size buffer skips the message it cannot hold
+    uint32_t value = 0;
+    size_t received = 0;
+    ASSERT_EQ(pcie_client_receive_buffer(&value, sizeof(value), &received), 0);
+    EXPECT_EQ(value, 600u);
+
+    pcie_flow_stats_t rx_stats;
+    pcie_client_get_flow_stats(NULL, &rx_stats);
+    EXPECT_EQ(rx_stats.oversized, 1u);
+    EXPECT_EQ(rx_stats.received, 2u);
+    munmap(map, 4096);
+    close(fd);
+}
+
+TEST_F(PCIeClientStartupTest, RingsForDirectUse) {
+    EXPECT_EQ(pcie_client_tx_flow(), nullptr);
+    ASSERT_EQ(pcie_client_init(), 0);
+
+    pcie_flow_t *tx = pcie_client_tx_flow();
+    ASSERT_NE(tx, nullptr);
+    EXPECT_EQ(pcie_client_tx_flow(), tx);
+    EXPECT_GT(pcie_flow_credits(tx), 0u);
+    EXPECT_NE(pcie_client_rx_flow(), nullptr);
+}
+
+TEST_F(PCIeClientStartupTest, EagerInitFromEnvironment) {
+    setenv("PCIE_EAGER_INIT", "1", 1);
+    ASSERT_EQ(pcie_client_init(), 0);
+
+    pcie_client_startup_t report;
+    pcie_client_get_startup(&report);
+    EXPECT_GT(report.total_ns, 0u);
+
+    // A device that cannot be opened makes eager init fail
+    pcie_client_cleanup();
+    setenv("PCIE_DEVICE_ID", "0000:02:00.0", 1);
+    EXPECT_EQ(pcie_client_init(), -1);
+    EXPECT_EQ(pcie_client_is_initialized(), 0);
+}
+
+TEST_F(PCIeClientStartupTest, InvalidConfigurationIsRejected) {
+    setenv("PCIE_DEVICE_ID", "not-a-device", 1);
+    ASSERT_EQ(pcie_client_init(), 0);
+    EXPECT_EQ(pcie_client_start(0, NULL), -1);
+
+    pcie_client_cleanup();
+    setenv("PCIE_DEVICE_ID", "0000:01:00.0", 1);
+    setenv("PCIE_VENDOR_ID", "vendor", 1);
+    ASSERT_EQ(pcie_client_init(), 0);
+    EXPECT_EQ(pcie_client_start(0, NULL), -1);
+}
@@ -0,0 +1,258 @@
+#include "gtest/gtest.h"
+#include "../pcie/driver/pcie_flow.h"
+#include <string.h>
+#include <vector>
+
+// Sender and receiver share a plain memory region instead of a BAR mapping
+class PCIeFlowTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        region.assign(sizeof(pcie_flow_ctrl_t) + 4 * PCIE_FLOW_SLOT_SIZE, 0);
+        ASSERT_EQ(pcie_flow_init_sender(&tx, region.data(), region.size()), 0);
+        ASSERT_EQ(pcie_flow_init_receiver(&rx, region.data(), region.size()), 0);
+    }
+
+    int send_value(uint32_t value, uint32_t priority = 0) {
+        return pcie_flow_send(&tx, &value, sizeof(value), priority);
+    }
+
+    int receive_value(uint32_t *value) {
+        size_t length = 0;
+        int ret = pcie_flow_receive(&rx, value, sizeof(*value), &length);
+        if (ret == 0) {
+            EXPECT_EQ(length, sizeof(*value));
+        }
+        return ret;
+    }
+
+    std::vector<uint8_t> region;
+    pcie_flow_t tx;
+    pcie_flow_t rx;
+};
+
+TEST_F(PCIeFlowTest, SendAndReceiveInOrder) {
+    EXPECT_EQ(pcie_flow_credits(&tx), 4u);
+
+    for (uint32_t i = 0; i < 3; i++) {
+        ASSERT_EQ(send_value(100 + i), 0);
+    }
+    EXPECT_EQ(pcie_flow_credits(&tx), 1u);
+
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < 3; i++) {
+        ASSERT_EQ(receive_value(&value), 0);
+        EXPECT_EQ(value, 100 + i);
+    }
+
+    // Consumed slots are returned as credits, old data is not re-read
+    EXPECT_EQ(pcie_flow_credits(&tx), 4u);
+    EXPECT_EQ(receive_value(&value), PCIE_FLOW_EMPTY);
+}
+
+TEST_F(PCIeFlowTest, ReceiveBeforeSenderFormatted) {
+    std::vector<uint8_t> blank(region.size(), 0);
+    pcie_flow_t flow;
+    ASSERT_EQ(pcie_flow_init_receiver(&flow, blank.data(), blank.size()), 0);
+
+    uint32_t value = 0;
+    EXPECT_EQ(pcie_flow_receive(&flow, &value, sizeof(value), NULL), PCIE_FLOW_EMPTY);
+}
+
+TEST_F(PCIeFlowTest, DropNewestWhenOutOfCredits) {
+    ASSERT_EQ(pcie_flow_set_policy(&tx, 0, PCIE_FLOW_DROP_NEWEST, 0), 0);
+
+    for (uint32_t i = 0; i < 4; i++) {
+        ASSERT_EQ(send_value(i), 0);
+    }
+    EXPECT_EQ(send_value(99), PCIE_FLOW_DROPPED);
+    EXPECT_EQ(tx.stats.dropped_newest, 1u);
+
+    // The receiver still sees the original four messages
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < 4; i++) {
+        ASSERT_EQ(receive_value(&value), 0);
+        EXPECT_EQ(value, i);
+    }
+    EXPECT_EQ(receive_value(&value), PCIE_FLOW_EMPTY);
+}
+
+TEST_F(PCIeFlowTest, DropOldestOverwritesAndReceiverSkips) {
+    ASSERT_EQ(pcie_flow_set_policy(&tx, 1, PCIE_FLOW_DROP_OLDEST, 0), 0);
+
+    for (uint32_t i = 0; i < 6; i++) {
+        ASSERT_EQ(send_value(i, 1), 0);
+    }
+    EXPECT_EQ(tx.stats.dropped_oldest, 2u);
+
+    // The oldest intact messages are delivered, the lost ones are counted
+    uint32_t value = 0;
+    ASSERT_EQ(receive_value(&value), 0);
+    EXPECT_EQ(value, 3u);
+    EXPECT_EQ(rx.stats.overruns, 3u);
+
+    ASSERT_EQ(receive_value(&value), 0);
+    EXPECT_EQ(value, 4u);
+    ASSERT_EQ(receive_value(&value), 0);
+    EXPECT_EQ(value, 5u);
+    EXPECT_EQ(receive_value(&value), PCIE_FLOW_EMPTY);
+}
+
+TEST_F(PCIeFlowTest, SpinTimeoutDropsMessage) {
+    ASSERT_EQ(pcie_flow_set_policy(&tx, 2, PCIE_FLOW_SPIN_TIMEOUT, 100), 0);
+
+    for (uint32_t i = 0; i < 4; i++) {
+        ASSERT_EQ(send_value(i, 2), 0);
+    }
+    EXPECT_EQ(send_value(4, 2), PCIE_FLOW_DROPPED);
+    EXPECT_EQ(tx.stats.stalls, 1u);
+    EXPECT_EQ(tx.stats.timeouts, 1u);
+
+    // Once a credit comes back the next send goes through
+    uint32_t value = 0;
+    ASSERT_EQ(receive_value(&value), 0);
+    EXPECT_EQ(send_value(5, 2), 0);
+}
+
+TEST_F(PCIeFlowTest, BlockGivesUpWithoutReceiver) {
+    for (uint32_t i = 0; i < 4; i++) {
+        ASSERT_EQ(send_value(i), 0);
+    }
+
+    // Nobody consumes: the default policy waits a bounded time, then drops
+    ASSERT_EQ(pcie_flow_set_policy(&tx, 0, PCIE_FLOW_BLOCK, 2000), 0);
+    EXPECT_EQ(send_value(4), PCIE_FLOW_DROPPED);
+    ASSERT_EQ(pcie_flow_set_policy(&tx, 0, PCIE_FLOW_BLOCK, 0), 0);
+    EXPECT_EQ(send_value(5), PCIE_FLOW_DROPPED);
+    EXPECT_EQ(tx.stats.stalls, 2u);
+    EXPECT_EQ(tx.stats.timeouts, 2u);
+}
+
+TEST_F(PCIeFlowTest, PoliciesArePerPriorityClass) {
+    ASSERT_EQ(pcie_flow_set_policy(&tx, 0, PCIE_FLOW_DROP_OLDEST, 0), 0);
+    ASSERT_EQ(pcie_flow_set_policy(&tx, 3, PCIE_FLOW_DROP_NEWEST, 0), 0);
+
+    for (uint32_t i = 0; i < 4; i++) {
+        ASSERT_EQ(send_value(i, 0), 0);
+    }
+
+    // Priorities beyond the last class share its policy
+    EXPECT_EQ(send_value(10, 7), PCIE_FLOW_DROPPED);
+    EXPECT_EQ(send_value(11, 0), 0);
+    EXPECT_EQ(tx.stats.dropped_newest, 1u);
+    EXPECT_EQ(tx.stats.dropped_oldest, 1u);
+}
+
+TEST_F(PCIeFlowTest, InvalidParameters) {
+    uint8_t big[PCIE_FLOW_SLOT_SIZE] = {0};
+    uint32_t value = 0;
+
+    EXPECT_EQ(pcie_flow_send(&tx, big, sizeof(big), 0), -1);
+    EXPECT_EQ(pcie_flow_send(&tx, NULL, 4, 0), -1);
+    EXPECT_EQ(pcie_flow_set_policy(&tx, PCIE_FLOW_NUM_CLASSES, PCIE_FLOW_BLOCK, 0), -1);
+    EXPECT_EQ(pcie_flow_init_sender(&tx, region.data(), 16), -1);
+
+    // Buffer too small for the pending message
+    ASSERT_EQ(send_value(1), 0);
+    uint8_t small[2];
+    EXPECT_EQ(pcie_flow_receive(&rx, small, sizeof(small), NULL), -1);
+    EXPECT_EQ(receive_value(&value), 0);
+}
+
+TEST_F(PCIeFlowTest, CrcDetectsCorruptedSlot) {
+    ASSERT_EQ(send_value(0x11111111), 0);
+    ASSERT_EQ(send_value(0x22222222), 0);
+
+    // Flip a payload bit of the first slot as a faulty link would
+    region[sizeof(pcie_flow_ctrl_t) + sizeof(pcie_flow_slot_t)] ^= 0x01;
+
+    uint32_t value = 0;
+    ASSERT_EQ(receive_value(&value), 0);
+    EXPECT_EQ(value, 0x22222222u);
+    EXPECT_EQ(rx.stats.crc_errors, 1u);
+    EXPECT_EQ(rx.stats.received, 1u);
+
+    // The discarded message still returned its credit
+    EXPECT_EQ(pcie_flow_credits(&tx), 4u);
+}
+
+TEST_F(PCIeFlowTest, CrcCanBeDisabled) {
+    ASSERT_EQ(pcie_flow_set_crc(&tx, 0), 0);
+    ASSERT_EQ(send_value(0x33333333), 0);
+
+    pcie_flow_slot_t *slot = (pcie_flow_slot_t *)(region.data() + sizeof(pcie_flow_ctrl_t));
+    EXPECT_EQ(slot->flags & PCIE_FLOW_SLOT_CRC, 0);
+    region[sizeof(pcie_flow_ctrl_t) + sizeof(pcie_flow_slot_t)] ^= 0x01;
+
+    uint32_t value = 0;
+    ASSERT_EQ(receive_value(&value), 0);
+    EXPECT_EQ(value, 0x33333332u);
+    EXPECT_EQ(rx.stats.crc_errors, 0u);
+}
+
+TEST_F(PCIeFlowTest, BatchReceiveVerifiesAndCompacts) {
+    for (uint32_t i = 0; i < 4; i++) {
+        ASSERT_EQ(send_value(200 + i), 0);
+    }
+    EXPECT_EQ(pcie_flow_credits(&tx), 0u);
+
+    // Corrupt the header of the second message
+    pcie_flow_slot_t *slot = (pcie_flow_slot_t *)(region.data() + sizeof(pcie_flow_ctrl_t) + PCIE_FLOW_SLOT_SIZE);
+    slot->priority ^= 0x40;
+
+    uint32_t values[8];
+    size_t lengths[8];
+    ASSERT_EQ(pcie_flow_receive_batch(&rx, values, sizeof(values[0]), 8, lengths), 3);
+    EXPECT_EQ(values[0], 200u);
+    EXPECT_EQ(values[1], 202u);
+    EXPECT_EQ(values[2], 203u);
+    EXPECT_EQ(lengths[2], sizeof(uint32_t));
+    EXPECT_EQ(rx.stats.crc_errors, 1u);
+    EXPECT_EQ(rx.stats.received, 3u);
+    EXPECT_EQ(pcie_flow_credits(&tx), 4u);
+
+    EXPECT_EQ(pcie_flow_receive_batch(&rx, values, sizeof(values[0]), 8, lengths), 0);
+}
+
+TEST_F(PCIeFlowTest, InvalidLengthIsSkipped) {
+    for (uint32_t i = 0; i < 3; i++) {
+        ASSERT_EQ(send_value(400 + i), 0);
+    }
+
+    // A length no slot can hold must not stop the ring at this slot
+    pcie_flow_slot_t *slot = (pcie_flow_slot_t *)(region.data() + sizeof(pcie_flow_ctrl_t));
+    slot->length = PCIE_FLOW_PAYLOAD_SIZE + 1;
+    slot = (pcie_flow_slot_t *)(region.data() + sizeof(pcie_flow_ctrl_t) + 2 * PCIE_FLOW_SLOT_SIZE);
+    slot->length = 0xFFFF;
+
+    uint32_t value = 0;
+    ASSERT_EQ(receive_value(&value), 0);
+    EXPECT_EQ(value, 401u);
+    EXPECT_EQ(rx.stats.invalid, 1u);
+
+    uint32_t values[4];
+    size_t lengths[4];
+    EXPECT_EQ(pcie_flow_receive_batch(&rx, values, sizeof(values[0]), 4, lengths), 0);
+    EXPECT_EQ(rx.stats.invalid, 2u);
+    EXPECT_EQ(rx.stats.received, 1u);
+    EXPECT_EQ(pcie_flow_credits(&tx), 4u);
+
+    ASSERT_EQ(send_value(403), 0);
+    ASSERT_EQ(receive_value(&value), 0);
+    EXPECT_EQ(value, 403u);
+}
+
+TEST_F(PCIeFlowTest, BatchReceiveStopsAtMaxCount) {
+    for (uint32_t i = 0; i < 3; i++) {
+        ASSERT_EQ(send_value(300 + i), 0);
+    }
+
+    uint32_t values[2];
+    size_t lengths[2];
+    ASSERT_EQ(pcie_flow_receive_batch(&rx, values, sizeof(values[0]), 2, lengths), 2);
+    EXPECT_EQ(values[1], 301u);
+    EXPECT_EQ(pcie_flow_credits(&tx), 3u);
+
+    uint32_t value = 0;
+    ASSERT_EQ(receive_value(&value), 0);
+    EXPECT_EQ(value, 302u);
+}
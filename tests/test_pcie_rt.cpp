@@ -0,0 +1,139 @@
+#include "gtest/gtest.h"
+#include "../pcie/driver/pcie_rt.h"
+#include "../pcie/driver/pcie_common.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+TEST(PCIeRtTest, ParseCpuList) {
+    int cpus[16];
+    EXPECT_EQ(pcie_rt_parse_cpu_list("2-3,6\n", cpus, 16), 3);
+    EXPECT_EQ(cpus[0], 2);
+    EXPECT_EQ(cpus[1], 3);
+    EXPECT_EQ(cpus[2], 6);
+
+    EXPECT_EQ(pcie_rt_parse_cpu_list("\n", cpus, 16), 0);
+    EXPECT_EQ(pcie_rt_parse_cpu_list("0-15", cpus, 4), 4);
+    EXPECT_EQ(pcie_rt_parse_cpu_list("3-1", cpus, 16), -1);
+    EXPECT_EQ(pcie_rt_parse_cpu_list("a,b", cpus, 16), -1);
+}
+
+TEST(PCIeRtTest, ConfigFromEnv) {
+    setenv("PCIE_RT_CPU", "isolated", 1);
+    setenv("PCIE_RT_PRIORITY", "80", 1);
+    setenv("PCIE_RT_MLOCK", "1", 1);
+    setenv("PCIE_RT_PREFAULT_STACK_KB", "64", 1);
+
+    pcie_rt_config_t config;
+    ASSERT_EQ(pcie_rt_config_from_env(&config), 0);
+    EXPECT_EQ(config.cpu, PCIE_RT_CPU_ISOLATED);
+    EXPECT_EQ(config.policy, SCHED_FIFO);
+    EXPECT_EQ(config.priority, 80);
+    EXPECT_EQ(config.lock_memory, 1);
+    EXPECT_EQ(config.prefault_stack, 64u * 1024);
+    EXPECT_EQ(config.prefault_heap, 0u);
+
+    // A CPU that is not a number is ignored rather than read as CPU 0
+    setenv("PCIE_RT_CPU", "foo", 1);
+    ASSERT_EQ(pcie_rt_config_from_env(&config), 0);
+    EXPECT_EQ(config.cpu, PCIE_RT_CPU_ANY);
+    setenv("PCIE_RT_CPU", "3x", 1);
+    ASSERT_EQ(pcie_rt_config_from_env(&config), 0);
+    EXPECT_EQ(config.cpu, PCIE_RT_CPU_ANY);
+    setenv("PCIE_RT_CPU", "3", 1);
+    ASSERT_EQ(pcie_rt_config_from_env(&config), 0);
+    EXPECT_EQ(config.cpu, 3);
+
+    setenv("PCIE_RT_POLICY", "deadline", 1);
+    EXPECT_EQ(pcie_rt_config_from_env(&config), -1);
+
+    unsetenv("PCIE_RT_CPU");
+    unsetenv("PCIE_RT_PRIORITY");
+    unsetenv("PCIE_RT_MLOCK");
+    unsetenv("PCIE_RT_PREFAULT_STACK_KB");
+    unsetenv("PCIE_RT_POLICY");
+}
+
+TEST(PCIeRtTest, ApplyPinningAndPrefault) {
+    // Pin to a CPU we are already allowed to run on
+    cpu_set_t allowed;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed)) {
+        cpu++;
+    }
+
+    pcie_rt_config_t config;
+    pcie_rt_config_default(&config);
+    config.cpu = cpu;
+    config.prefault_stack = 256 * 1024;
+    config.prefault_heap = 1024 * 1024;
+    EXPECT_EQ(pcie_rt_apply(&config), 0);
+    EXPECT_EQ(sched_getcpu(), cpu);
+
+    // Restore the original affinity for the remaining tests
+    sched_setaffinity(0, sizeof(allowed), &allowed);
+
+    EXPECT_EQ(pcie_rt_apply(NULL), -1);
+}
+
+TEST(PCIeRtTest, JitterStatistics) {
+    pcie_rt_jitter_t jitter;
+    pcie_rt_jitter_init(&jitter, 1000000);
+
+    // 98 on-time iterations, one 50us late and one that missed its period
+    for (int i = 0; i < 98; i++) {
+        pcie_rt_jitter_record(&jitter, 500);
+    }
+    pcie_rt_jitter_record(&jitter, 50000);
+    pcie_rt_jitter_record(&jitter, 2000000);
+
+    EXPECT_EQ(jitter.iterations, 100u);
+    EXPECT_EQ(jitter.overruns, 1u);
+    EXPECT_EQ(jitter.late_max_ns, 2000000u);
+    EXPECT_EQ(pcie_rt_jitter_percentile_us(&jitter, 0.5), 0u);
+    EXPECT_EQ(pcie_rt_jitter_percentile_us(&jitter, 0.985), 50u);
+    EXPECT_EQ(pcie_rt_jitter_percentile_us(&jitter, 0.995), PCIE_RT_JITTER_BUCKETS - 1u);
+}
+
+TEST(PCIeRtTest, JitterWaitKeepsPeriod) {
+    pcie_rt_jitter_t jitter;
+    uint64_t start = pcie_time_ns();
+    pcie_rt_jitter_init(&jitter, 2000000);
+
+    for (int i = 0; i < 10; i++) {
+        pcie_rt_jitter_wait(&jitter);
+    }
+
+    // Absolute deadlines: ten 2ms periods take at least 20ms overall
+    uint64_t elapsed = pcie_time_ns() - start;
+    EXPECT_GE(elapsed, 20000000u);
+    EXPECT_LT(elapsed, 200000000u);
+    EXPECT_EQ(jitter.iterations, 10u);
+}
+
+TEST(PCIeRtTest, JitterWaitSkipsMissedPeriods) {
+    pcie_rt_jitter_t jitter;
+    pcie_rt_jitter_init(&jitter, 1000000);
+
+    // Stall for several periods, then the next deadline must be in the future
+    struct timespec stall = {0, 5000000};
+    nanosleep(&stall, NULL);
+    pcie_rt_jitter_wait(&jitter);
+
+    EXPECT_GT(jitter.late_max_ns, 3000000u);
+    EXPECT_GT(jitter.next_deadline_ns, pcie_time_ns());
+}
+
+TEST(PCIeRtTest, JitterWaitWithoutPeriod) {
+    pcie_rt_jitter_t jitter;
+    pcie_rt_jitter_init(&jitter, 0);
+
+    // Late wake-ups must not divide by the missing period
+    struct timespec stall = {0, 1000000};
+    nanosleep(&stall, NULL);
+    pcie_rt_jitter_wait(&jitter);
+    pcie_rt_jitter_wait(&jitter);
+    EXPECT_EQ(jitter.iterations, 2u);
+    EXPECT_EQ(jitter.overruns, 0u);
+}
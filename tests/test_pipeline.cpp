@@ -0,0 +1,195 @@
+#include "gtest/gtest.h"
+#include "../translation/pcie_pipeline.h"
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+// Source emitting message IDs 0 .. total - 1, finishing afterwards
+struct Source {
+    uint32_t next = 0;
+    uint32_t total = 0;
+};
+
+static int source_stage(void *context, const pcie_message_t *, size_t, pcie_message_t *out, size_t capacity) {
+    Source *source = (Source *)context;
+    if (source->next == source->total) {
+        return -1;
+    }
+    size_t count = 0;
+    while (count < capacity && source->next < source->total) {
+        memset(&out[count], 0, sizeof(out[count]));
+        out[count].message_id = source->next++;
+        out[count].bus_message.type = MSG_TYPE_CAN;
+        count++;
+    }
+    return (int)count;
+}
+
+// Source that never runs dry, ended by pcie_pipeline_stop()
+static int endless_stage(void *context, const pcie_message_t *, size_t, pcie_message_t *out, size_t capacity) {
+    Source *source = (Source *)context;
+    for (size_t i = 0; i < capacity; i++) {
+        memset(&out[i], 0, sizeof(out[i]));
+        out[i].message_id = source->next++;
+    }
+    return (int)capacity;
+}
+
+// Drops odd message IDs
+static int filter_stage(void *, const pcie_message_t *in, size_t count, pcie_message_t *out, size_t) {
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if ((in[i].message_id & 1) == 0) {
+            out[kept++] = in[i];
+        }
+    }
+    return (int)kept;
+}
+
+// Passes messages on unchanged
+static int forward_stage(void *, const pcie_message_t *in, size_t count, pcie_message_t *out, size_t) {
+    memcpy(out, in, count * sizeof(pcie_message_t));
+    return (int)count;
+}
+
+// Records the message IDs it receives, optionally slowly
+struct Sink {
+    std::vector<uint32_t> ids;
+    long delay_ns = 0;
+};
+
+static int sink_stage(void *context, const pcie_message_t *in, size_t count, pcie_message_t *, size_t) {
+    Sink *sink = (Sink *)context;
+    for (size_t i = 0; i < count; i++) {
+        sink->ids.push_back(in[i].message_id);
+    }
+    if (sink->delay_ns > 0) {
+        struct timespec pause = {0, sink->delay_ns};
+        nanosleep(&pause, NULL);
+    }
+    return 0;
+}
+
+class PipelineTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        pcie_pipeline_init(&pipeline);
+    }
+
+    void TearDown() override {
+        pcie_pipeline_stop(&pipeline);
+    }
+
+    void add(const char *name, pcie_stage_fn_t fn, void *context, uint32_t queue_depth = 0) {
+        pcie_stage_config_t config;
+        memset(&config, 0, sizeof(config));
+        config.name = name;
+        config.fn = fn;
+        config.context = context;
+        config.queue_depth = queue_depth;
+        pcie_rt_config_default(&config.rt);
+        ASSERT_GE(pcie_pipeline_add_stage(&pipeline, &config), 0);
+    }
+
+    pcie_pipeline_t pipeline;
+    Source source;
+    Sink sink;
+};
+
+TEST_F(PipelineTest, MessagesLeaveInOrder) {
+    source.total = 10000;
+    add("ingest", source_stage, &source);
+    add("translate", forward_stage, NULL);
+    add("encode", forward_stage, NULL);
+    add("transmit", sink_stage, &sink);
+
+    ASSERT_EQ(pcie_pipeline_start(&pipeline), 0);
+    pcie_pipeline_wait(&pipeline);
+
+    ASSERT_EQ(sink.ids.size(), 10000u);
+    for (uint32_t i = 0; i < sink.ids.size(); i++) {
+        ASSERT_EQ(sink.ids[i], i);
+    }
+    for (uint32_t i = 0; i < 4; i++) {
+        EXPECT_NE(pipeline.stages[i].stats.end_ns, 0u);
+    }
+    EXPECT_EQ(pipeline.stages[3].stats.in, 10000u);
+}
+
+TEST_F(PipelineTest, SlowStageAppliesBackpressureWithoutLoss) {
+    source.total = 2000;
+    sink.delay_ns = 100000;
+    add("ingest", source_stage, &source, 16);
+    add("translate", forward_stage, NULL, 16);
+    add("transmit", sink_stage, &sink);
+
+    ASSERT_EQ(pcie_pipeline_start(&pipeline), 0);
+    pcie_pipeline_wait(&pipeline);
+
+    ASSERT_EQ(sink.ids.size(), 2000u);
+    EXPECT_EQ(sink.ids.back(), 1999u);
+    // The queues never grow past their depth, so the stages before the sink stalled
+    EXPECT_LE(pipeline.stages[0].stats.queue_high_water, 16u);
+    EXPECT_LE(pipeline.stages[1].stats.queue_high_water, 16u);
+    EXPECT_GT(pipeline.stages[0].stats.backpressure + pipeline.stages[1].stats.backpressure, 0u);
+}
+
+TEST_F(PipelineTest, FilterStageDropsMessages) {
+    source.total = 1000;
+    add("ingest", source_stage, &source);
+    add("filter", filter_stage, NULL);
+    add("transmit", sink_stage, &sink);
+
+    ASSERT_EQ(pcie_pipeline_start(&pipeline), 0);
+    pcie_pipeline_wait(&pipeline);
+
+    ASSERT_EQ(sink.ids.size(), 500u);
+    for (uint32_t i = 0; i < sink.ids.size(); i++) {
+        EXPECT_EQ(sink.ids[i], 2 * i);
+    }
+    EXPECT_EQ(pipeline.stages[1].stats.in, 1000u);
+    EXPECT_EQ(pipeline.stages[1].stats.out, 500u);
+
+    for (uint32_t i = 0; i < 3; i++) {
+        double utilization = pcie_pipeline_utilization(&pipeline, i);
+        EXPECT_GE(utilization, 0.0);
+        EXPECT_LE(utilization, 1.0);
+    }
+    EXPECT_EQ(pcie_pipeline_utilization(&pipeline, 3), 0.0);
+    pcie_pipeline_report(&pipeline);
+}
+
+TEST_F(PipelineTest, StopDrainsQueuedMessages) {
+    add("ingest", endless_stage, &source);
+    add("translate", forward_stage, NULL);
+    add("transmit", sink_stage, &sink);
+
+    ASSERT_EQ(pcie_pipeline_start(&pipeline), 0);
+    struct timespec pause = {0, 20000000};
+    nanosleep(&pause, NULL);
+    pcie_pipeline_stop(&pipeline);
+
+    // Everything the source produced reached the sink, in order
+    ASSERT_GT(sink.ids.size(), 0u);
+    EXPECT_EQ(sink.ids.size(), source.next);
+    EXPECT_EQ(sink.ids.back(), source.next - 1);
+}
+
+TEST_F(PipelineTest, InvalidConfiguration) {
+    pcie_stage_config_t config;
+    memset(&config, 0, sizeof(config));
+    pcie_rt_config_default(&config.rt);
+    EXPECT_EQ(pcie_pipeline_add_stage(&pipeline, &config), -1);
+
+    config.fn = forward_stage;
+    config.queue_depth = 100;
+    EXPECT_EQ(pcie_pipeline_add_stage(&pipeline, &config), -1);
+
+    EXPECT_EQ(pcie_pipeline_start(&pipeline), -1);
+
+    config.queue_depth = 0;
+    for (int i = 0; i < PCIE_PIPELINE_MAX_STAGES; i++) {
+        EXPECT_EQ(pcie_pipeline_add_stage(&pipeline, &config), i);
+    }
+    EXPECT_EQ(pcie_pipeline_add_stage(&pipeline, &config), -1);
+}
@@ -0,0 +1,225 @@
+#include "gtest/gtest.h"
+#include "../translation/pcie_router.h"
+#include <string.h>
+#include <pthread.h>
+#include <vector>
+
+class PCIeRouterTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_EQ(pcie_router_init(&router), 0);
+    }
+
+    void TearDown() override {
+        pcie_router_destroy(&router);
+    }
+
+    static pcie_message_t make_message(uint32_t zone_id, uint32_t message_id) {
+        pcie_message_t msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.zone_id = zone_id;
+        msg.message_id = message_id;
+        msg.bus_message.type = MSG_TYPE_CAN;
+        msg.bus_message.data.can.can_id = message_id;
+        return msg;
+    }
+
+    pcie_router_t router;
+};
+
+TEST_F(PCIeRouterTest, RoutesByZoneAndMessageId) {
+    int zone1 = pcie_router_add_port(&router, 1, 0);
+    int zone2 = pcie_router_add_port(&router, 2, 0);
+    int zone3 = pcie_router_add_port(&router, 3, 0);
+    ASSERT_EQ(zone1, 0);
+    ASSERT_EQ(zone2, 1);
+    ASSERT_EQ(zone3, 2);
+    EXPECT_EQ(pcie_router_add_port(&router, 2, 0), -1);
+    EXPECT_EQ(pcie_router_port_for_zone(&router, 3), zone3);
+
+    // 0x123 from zone 1 goes to zone 2, the same ID from zone 3 to zone 1
+    ASSERT_EQ(pcie_router_set_route(&router, 1, 0x123, 1ull << zone2), 0);
+    ASSERT_EQ(pcie_router_set_route(&router, 3, 0x123, 1ull << zone1), 0);
+
+    pcie_message_t msg = make_message(1, 0x123);
+    EXPECT_EQ(pcie_router_forward(&router, &msg), 1);
+    msg = make_message(3, 0x123);
+    EXPECT_EQ(pcie_router_forward(&router, &msg), 1);
+    msg = make_message(2, 0x123);
+    EXPECT_EQ(pcie_router_forward(&router, &msg), 0);
+    EXPECT_EQ(router.stats.unrouted, 1u);
+
+    pcie_message_t out;
+    ASSERT_EQ(pcie_router_dequeue(&router, zone2, &out), 0);
+    EXPECT_EQ(out.zone_id, 1u);
+    EXPECT_EQ(pcie_router_dequeue(&router, zone2, &out), PCIE_ROUTER_EMPTY);
+    ASSERT_EQ(pcie_router_dequeue(&router, zone1, &out), 0);
+    EXPECT_EQ(out.zone_id, 3u);
+    EXPECT_EQ(pcie_router_dequeue(&router, zone3, &out), PCIE_ROUTER_EMPTY);
+}
+
+TEST_F(PCIeRouterTest, FanOutSkipsSourceZone) {
+    for (uint32_t zone = 0; zone < 4; zone++) {
+        ASSERT_EQ(pcie_router_add_port(&router, zone, 0), (int)zone);
+    }
+
+    // Broadcast route covering the source zone's own port
+    ASSERT_EQ(pcie_router_set_route(&router, 0, 0x10, 0xF), 0);
+
+    pcie_message_t msg = make_message(0, 0x10);
+    EXPECT_EQ(pcie_router_forward(&router, &msg), 3);
+
+    pcie_message_t out;
+    EXPECT_EQ(pcie_router_dequeue(&router, 0, &out), PCIE_ROUTER_EMPTY);
+    for (int port = 1; port < 4; port++) {
+        ASSERT_EQ(pcie_router_dequeue(&router, port, &out), 0);
+        EXPECT_EQ(out.message_id, 0x10u);
+    }
+    EXPECT_EQ(router.stats.deliveries, 3u);
+}
+
+TEST_F(PCIeRouterTest, DefaultRouteAndRemoval) {
+    ASSERT_EQ(pcie_router_add_port(&router, 1, 0), 0);
+    ASSERT_EQ(pcie_router_add_port(&router, 2, 0), 1);
+
+    ASSERT_EQ(pcie_router_set_route(&router, 1, PCIE_ROUTER_ANY_MESSAGE, 1ull << 1), 0);
+    ASSERT_EQ(pcie_router_set_route(&router, 1, 0x200, 0x3), 0);
+    EXPECT_EQ(pcie_router_lookup(&router, 1, 0x555), 1ull << 1);
+    EXPECT_EQ(pcie_router_lookup(&router, 1, 0x200), 0x3u);
+    EXPECT_EQ(pcie_router_lookup(&router, 2, 0x555), 0u);
+
+    // Removing the exact route falls back to the default route
+    ASSERT_EQ(pcie_router_set_route(&router, 1, 0x200, 0), 0);
+    EXPECT_EQ(pcie_router_lookup(&router, 1, 0x200), 1ull << 1);
+    EXPECT_EQ(router.table->count, 1u);
+
+    // Loading a table replaces all routes
+    pcie_route_t routes[] = {{2, 0x1, 1ull << 0}};
+    ASSERT_EQ(pcie_router_load_routes(&router, routes, 1), 0);
+    EXPECT_EQ(pcie_router_lookup(&router, 1, 0x200), 0u);
+    EXPECT_EQ(pcie_router_lookup(&router, 2, 0x1), 1ull << 0);
+}
+
+TEST_F(PCIeRouterTest, TableGrowsWithRoutes) {
+    ASSERT_EQ(pcie_router_add_port(&router, 1, 0), 0);
+    for (uint32_t id = 0; id < 1000; id++) {
+        ASSERT_EQ(pcie_router_set_route(&router, 7, id, 1), 0);
+    }
+    EXPECT_EQ(router.table->count, 1000u);
+    EXPECT_GE(router.table->capacity, 2000u);
+    for (uint32_t id = 0; id < 1000; id++) {
+        ASSERT_EQ(pcie_router_lookup(&router, 7, id), 1u);
+    }
+    EXPECT_EQ(pcie_router_lookup(&router, 7, 1000), 0u);
+}
+
+TEST_F(PCIeRouterTest, FullQueueDropsAndDrainResumes) {
+    ASSERT_EQ(pcie_router_add_port(&router, 2, 4), 0);
+    EXPECT_EQ(pcie_router_add_port(&router, 3, 3), -1);
+    ASSERT_EQ(pcie_router_set_route(&router, 1, PCIE_ROUTER_ANY_MESSAGE, 1), 0);
+
+    std::vector<pcie_message_t> batch;
+    for (uint32_t id = 0; id < 6; id++) {
+        batch.push_back(make_message(1, id));
+    }
+    EXPECT_EQ(pcie_router_forward_batch(&router, batch.data(), batch.size()), 4);
+    EXPECT_EQ(router.stats.queue_full, 2u);
+    EXPECT_EQ(router.ports[0].dropped, 2u);
+
+    std::vector<uint32_t> ids;
+    auto sink = [](const pcie_message_t *msg, void *context) -> int {
+        std::vector<uint32_t> *ids = static_cast<std::vector<uint32_t> *>(context);
+        if (ids->size() == 2) {
+            return -1;  // Stall after two messages
+        }
+        ids->push_back(msg->message_id);
+        return 0;
+    };
+    EXPECT_EQ(pcie_router_drain(&router, 0, sink, &ids, 16), 2u);
+
+    // The rejected message stays queued and there is room again
+    EXPECT_EQ(pcie_router_forward(&router, &batch[4]), 1);
+    pcie_message_t out;
+    ASSERT_EQ(pcie_router_dequeue(&router, 0, &out), 0);
+    EXPECT_EQ(out.message_id, 2u);
+}
+
+TEST_F(PCIeRouterTest, ReceiveForwardsFromEveryEndpoint) {
+    ASSERT_EQ(pcie_router_add_port(&router, 1, 0), 0);
+    ASSERT_EQ(pcie_router_add_port(&router, 2, 0), 1);
+    ASSERT_EQ(pcie_router_set_route(&router, 1, PCIE_ROUTER_ANY_MESSAGE, 1ull << 1), 0);
+    ASSERT_EQ(pcie_router_set_route(&router, 2, PCIE_ROUTER_ANY_MESSAGE, 1ull << 0), 0);
+
+    // One uplink ring per zone, sender and receiver share the memory
+    size_t ring_size = sizeof(pcie_flow_ctrl_t) + 8 * PCIE_FLOW_SLOT_SIZE;
+    std::vector<uint8_t> regions(2 * ring_size, 0);
+    pcie_flow_t senders[2];
+    pcie_flow_t endpoints[2];
+    for (int z = 0; z < 2; z++) {
+        ASSERT_EQ(pcie_flow_init_sender(&senders[z], regions.data() + z * ring_size, ring_size), 0);
+        ASSERT_EQ(pcie_flow_init_receiver(&endpoints[z], regions.data() + z * ring_size, ring_size), 0);
+    }
+
+    EXPECT_EQ(pcie_router_receive(&router, endpoints, 2), 0);
+
+    pcie_message_t msg = make_message(1, 0x10);
+    ASSERT_EQ(pcie_flow_send(&senders[0], &msg, sizeof(msg), 0), 0);
+    msg = make_message(2, 0x20);
+    ASSERT_EQ(pcie_flow_send(&senders[1], &msg, sizeof(msg), 0), 0);
+    uint32_t truncated = 0;
+    ASSERT_EQ(pcie_flow_send(&senders[1], &truncated, sizeof(truncated), 0), 0);
+
+    EXPECT_EQ(pcie_router_receive(&router, endpoints, 2), 3);
+    EXPECT_EQ(router.stats.malformed, 1u);
+    EXPECT_EQ(router.stats.deliveries, 2u);
+
+    pcie_message_t out;
+    ASSERT_EQ(pcie_router_dequeue(&router, 1, &out), 0);
+    EXPECT_EQ(out.message_id, 0x10u);
+    ASSERT_EQ(pcie_router_dequeue(&router, 0, &out), 0);
+    EXPECT_EQ(out.message_id, 0x20u);
+}
+
+struct UpdateContext {
+    pcie_router_t *router;
+    volatile int running;
+    uint64_t updates;
+};
+
+static void *update_routes(void *arg) {
+    UpdateContext *ctx = static_cast<UpdateContext *>(arg);
+    uint32_t step = 0;
+    while (ctx->running) {
+        pcie_router_set_route(ctx->router, 1, 0x42, (step++ & 1) ? 0x2 : 0x4);
+        __atomic_add_fetch(&ctx->updates, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+TEST_F(PCIeRouterTest, ConcurrentTableUpdates) {
+    for (uint32_t zone = 1; zone <= 3; zone++) {
+        ASSERT_EQ(pcie_router_add_port(&router, zone, 1024), (int)zone - 1);
+    }
+    ASSERT_EQ(pcie_router_set_route(&router, 1, 0x42, 0x2), 0);
+
+    UpdateContext ctx = {&router, 1, 0};
+    pthread_t updater;
+    ASSERT_EQ(pthread_create(&updater, NULL, update_routes, &ctx), 0);
+
+    // Every message reaches exactly one of the two alternating destinations
+    pcie_message_t msg = make_message(1, 0x42);
+    pcie_message_t out;
+    uint64_t forwarded = 0;
+    for (; forwarded < 20000 || __atomic_load_n(&ctx.updates, __ATOMIC_RELAXED) < 1000; forwarded++) {
+        ASSERT_EQ(pcie_router_forward(&router, &msg), 1);
+        while (pcie_router_dequeue(&router, 1, &out) == 0) {
+        }
+        while (pcie_router_dequeue(&router, 2, &out) == 0) {
+        }
+    }
+
+    ctx.running = 0;
+    pthread_join(updater, NULL);
+    EXPECT_GE(router.stats.table_updates, 1000u);
+    EXPECT_EQ(router.ports[1].enqueued + router.ports[2].enqueued, forwarded);
+}
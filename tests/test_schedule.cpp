@@ -0,0 +1,188 @@
+#include "gtest/gtest.h"
+#include "../translation/pcie_schedule.h"
+#include <string.h>
+#include <vector>
+
+// Collects the batches handed to the sink
+struct Capture {
+    std::vector<std::vector<uint32_t>> batches;
+    int fail = 0;
+    size_t accept = SIZE_MAX;   // Frames taken per batch before failing
+};
+
+static int capture_sink(const pcie_message_t *msgs, size_t count, void *context) {
+    Capture *capture = (Capture *)context;
+    if (capture->fail) {
+        return -1;
+    }
+    std::vector<uint32_t> ids;
+    for (size_t i = 0; i < count && i < capture->accept; i++) {
+        ids.push_back(msgs[i].message_id);
+    }
+    capture->batches.push_back(ids);
+    return (int)ids.size();
+}
+
+static pcie_message_t make_message(uint32_t message_id) {
+    pcie_message_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.message_id = message_id;
+    msg.bus_message.type = MSG_TYPE_CAN;
+    msg.bus_message.data.can.can_id = message_id;
+    return msg;
+}
+
+class ScheduleTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        // 1 ms ticks, at most 4 frames per tick, tick 0 starts at t = 1 s
+        ASSERT_EQ(pcie_sched_init(&sched, 1000, 4, EPOCH), 0);
+    }
+
+    // Start of a tick in nanoseconds
+    static uint64_t at(uint64_t tick) { return EPOCH + tick * 1000000ull; }
+
+    static constexpr uint64_t EPOCH = 1000000000ull;
+    pcie_sched_t sched;
+    Capture capture;
+};
+
+TEST_F(ScheduleTest, CyclicMessagesFollowPeriodAndOffset) {
+    ASSERT_EQ(pcie_sched_add(&sched, 0x100, 2000, 0, 0), 0);      // Even ticks
+    ASSERT_EQ(pcie_sched_add(&sched, 0x200, 2000, 1000, 0), 0);   // Odd ticks
+    ASSERT_EQ(pcie_sched_add(&sched, 0x300, 4000, 3000, 0), 0);   // Ticks 3, 7, ...
+    for (uint32_t id : {0x100u, 0x200u, 0x300u}) {
+        pcie_message_t msg = make_message(id);
+        ASSERT_EQ(pcie_sched_update(&sched, &msg), 0);
+    }
+
+    for (uint64_t tick = 0; tick < 8; tick++) {
+        // Anywhere inside the tick selects the same slot
+        EXPECT_GT(pcie_sched_poll(&sched, at(tick) + 400000, capture_sink, &capture), 0);
+    }
+
+    ASSERT_EQ(capture.batches.size(), 8u);
+    EXPECT_EQ(capture.batches[0], std::vector<uint32_t>({0x100}));
+    EXPECT_EQ(capture.batches[1], std::vector<uint32_t>({0x200}));
+    EXPECT_EQ(capture.batches[3], std::vector<uint32_t>({0x200, 0x300}));
+    EXPECT_EQ(capture.batches[7], std::vector<uint32_t>({0x200, 0x300}));
+    EXPECT_EQ(sched.stats.static_frames, 10u);
+    EXPECT_EQ(pcie_sched_next_tick_ns(&sched), at(8));
+}
+
+TEST_F(ScheduleTest, OnlyOneBatchPerTick) {
+    ASSERT_EQ(pcie_sched_add(&sched, 0x100, 1000, 0, 0), 0);
+    pcie_message_t msg = make_message(0x100);
+    ASSERT_EQ(pcie_sched_update(&sched, &msg), 0);
+
+    EXPECT_EQ(pcie_sched_poll(&sched, EPOCH - 1, capture_sink, &capture), 0);
+    EXPECT_EQ(pcie_sched_poll(&sched, at(5), capture_sink, &capture), 1);
+    EXPECT_EQ(pcie_sched_poll(&sched, at(5) + 999999, capture_sink, &capture), 0);
+    EXPECT_EQ(pcie_sched_poll(&sched, at(6), capture_sink, &capture), 1);
+    EXPECT_EQ(capture.batches.size(), 2u);
+}
+
+TEST_F(ScheduleTest, ScheduleOverBudgetIsRejected) {
+    for (uint32_t i = 0; i < 4; i++) {
+        ASSERT_EQ(pcie_sched_add(&sched, i, 2000, 0, 0), 0);
+    }
+    EXPECT_EQ(pcie_sched_static_load(&sched, 0), 4u);
+    EXPECT_EQ(pcie_sched_static_load(&sched, 1), 0u);
+
+    // Tick 0 is full, tick 1 has room, a period of 1 ms hits both
+    EXPECT_EQ(pcie_sched_add(&sched, 10, 2000, 0, 0), -1);
+    EXPECT_EQ(pcie_sched_add(&sched, 10, 1000, 0, 0), -1);
+    EXPECT_EQ(pcie_sched_add(&sched, 10, 2000, 1000, 0), 0);
+
+    // Invalid parameters and duplicates
+    EXPECT_EQ(pcie_sched_add(&sched, 11, 1500, 0, 0), -1);
+    EXPECT_EQ(pcie_sched_add(&sched, 11, 2000, 2000, 0), -1);
+    EXPECT_EQ(pcie_sched_add(&sched, 10, 4000, 1000, 0), -1);
+
+    // The hyperperiod is bounded
+    EXPECT_EQ(pcie_sched_add(&sched, 12, 4001000, 1000, 0), -1);
+    EXPECT_EQ(sched.entry_count, 5u);
+}
+
+TEST_F(ScheduleTest, SporadicTrafficUsesSlack) {
+    ASSERT_EQ(pcie_sched_add(&sched, 0x100, 2000, 0, 0), 0);
+    ASSERT_EQ(pcie_sched_add(&sched, 0x101, 2000, 0, 0), 0);
+    for (uint32_t id : {0x100u, 0x101u}) {
+        pcie_message_t msg = make_message(id);
+        ASSERT_EQ(pcie_sched_update(&sched, &msg), 0);
+    }
+    for (uint32_t i = 0; i < 5; i++) {
+        pcie_message_t msg = make_message(0x700 + i);
+        ASSERT_EQ(pcie_sched_submit(&sched, &msg), 0);
+    }
+
+    // Tick 0 has two static frames, so two sporadic ones fit the budget of four
+    EXPECT_EQ(pcie_sched_poll(&sched, at(0), capture_sink, &capture), 4);
+    EXPECT_EQ(capture.batches[0], std::vector<uint32_t>({0x100, 0x101, 0x700, 0x701}));
+    EXPECT_EQ(sched.stats.sporadic_deferred, 1u);
+
+    // Tick 1 has no static frames left
+    EXPECT_EQ(pcie_sched_poll(&sched, at(1), capture_sink, &capture), 3);
+    EXPECT_EQ(capture.batches[1], std::vector<uint32_t>({0x702, 0x703, 0x704}));
+    EXPECT_EQ(sched.stats.sporadic_frames, 5u);
+}
+
+TEST_F(ScheduleTest, MissedTicksAreNotReplayed) {
+    ASSERT_EQ(pcie_sched_add(&sched, 0x100, 1000, 0, 0), 0);
+    ASSERT_EQ(pcie_sched_add(&sched, 0x200, 1000, 0, 0), 0);
+    pcie_message_t msg = make_message(0x100);
+    ASSERT_EQ(pcie_sched_update(&sched, &msg), 0);
+
+    EXPECT_EQ(pcie_sched_poll(&sched, at(0), capture_sink, &capture), 1);
+    EXPECT_EQ(sched.stats.stale, 1u);   // 0x200 never published
+
+    EXPECT_EQ(pcie_sched_poll(&sched, at(10), capture_sink, &capture), 1);
+    EXPECT_EQ(sched.stats.missed_ticks, 9u);
+    EXPECT_EQ(sched.stats.ticks, 2u);
+    EXPECT_EQ(capture.batches.size(), 2u);
+}
+
+TEST_F(ScheduleTest, UnknownMessagesAndSinkErrors) {
+    pcie_message_t msg = make_message(0x123);
+    EXPECT_EQ(pcie_sched_update(&sched, &msg), -1);
+
+    for (int i = 0; i < PCIE_SCHED_SPORADIC_DEPTH; i++) {
+        ASSERT_EQ(pcie_sched_submit(&sched, &msg), 0);
+    }
+    EXPECT_EQ(pcie_sched_submit(&sched, &msg), PCIE_SCHED_FULL);
+    EXPECT_EQ(sched.stats.sporadic_dropped, 1u);
+
+    capture.fail = 1;
+    EXPECT_EQ(pcie_sched_poll(&sched, at(0), capture_sink, &capture), -1);
+    EXPECT_EQ(sched.stats.sink_errors, 1u);
+}
+
+TEST_F(ScheduleTest, PartialSendRequeuesSporadicFrames) {
+    ASSERT_EQ(pcie_sched_add(&sched, 0x100, 1000, 0, 0), 0);
+    ASSERT_EQ(pcie_sched_add(&sched, 0x101, 1000, 0, 0), 0);
+    pcie_message_t msg = make_message(0x100);
+    ASSERT_EQ(pcie_sched_update(&sched, &msg), 0);
+    msg = make_message(0x101);
+    ASSERT_EQ(pcie_sched_update(&sched, &msg), 0);
+    for (uint32_t id = 0x200; id < 0x202; id++) {
+        msg = make_message(id);
+        ASSERT_EQ(pcie_sched_submit(&sched, &msg), 0);
+    }
+
+    // The sink takes one cyclic frame, the other is dropped and both
+    // sporadic frames wait for the next tick
+    capture.accept = 1;
+    EXPECT_EQ(pcie_sched_poll(&sched, at(0), capture_sink, &capture), -1);
+    EXPECT_EQ(sched.stats.static_frames, 1u);
+    EXPECT_EQ(sched.stats.static_dropped, 1u);
+    EXPECT_EQ(sched.stats.sporadic_frames, 0u);
+
+    capture.accept = SIZE_MAX;
+    EXPECT_EQ(pcie_sched_poll(&sched, at(1), capture_sink, &capture), 4);
+    ASSERT_EQ(capture.batches.size(), 2u);
+    EXPECT_EQ(capture.batches[1], (std::vector<uint32_t>{0x100, 0x101, 0x200, 0x201}));
+    EXPECT_EQ(sched.stats.sporadic_frames, 2u);
+
+    // A NULL scheduler is rejected
+    EXPECT_EQ(pcie_sched_add(NULL, 0x300, 1000, 0, 0), -1);
+}
@@ -0,0 +1,219 @@
+#include "gtest/gtest.h"
+#include "../translation/pcie_signal_store.h"
+#include <string.h>
+#include <thread>
+
+static bus_message_t make_can(uint32_t can_id, uint8_t value) {
+    bus_message_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_TYPE_CAN;
+    msg.data.can.can_id = can_id;
+    msg.data.can.can_dlc = 8;
+    for (int i = 0; i < 8; i++) {
+        msg.data.can.data[i] = value;
+    }
+    return msg;
+}
+
+class SignalStoreTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_EQ(pcie_signal_store_init(&store, 4), 0);
+    }
+
+    void TearDown() override {
+        pcie_signal_store_destroy(&store);
+    }
+
+    pcie_signal_store_t store;
+    pcie_signal_t value;
+};
+
+TEST_F(SignalStoreTest, LatestValueWins) {
+    EXPECT_EQ(pcie_signal_store_get(&store, 1, MSG_TYPE_CAN, 0x123, &value), PCIE_SIGNAL_NONE);
+    EXPECT_EQ(value.update_ns, 0u);
+    EXPECT_EQ(value.status, PCIE_SIGNAL_NONE);
+
+    for (uint8_t i = 1; i <= 3; i++) {
+        bus_message_t msg = make_can(0x123, i);
+        ASSERT_EQ(pcie_signal_store_update(&store, &msg, 1, 7), 0);
+    }
+
+    ASSERT_EQ(pcie_signal_store_get(&store, 1, MSG_TYPE_CAN, 0x123, &value), 0);
+    EXPECT_EQ(value.message.data.can.can_id, 0x123u);
+    EXPECT_EQ(value.message.data.can.data[0], 3);
+    EXPECT_EQ(value.zone_id, 1u);
+    EXPECT_EQ(value.device_id, 7u);
+    EXPECT_EQ(value.updates, 3u);
+    EXPECT_GT(value.update_ns, 0u);
+    EXPECT_EQ(value.status, 0);
+    EXPECT_EQ(pcie_signal_store_version(&store), 3u);
+}
+
+TEST_F(SignalStoreTest, KeysAreIndependentPerZoneAndBus) {
+    bus_message_t can = make_can(0x10, 0xAA);
+    ASSERT_EQ(pcie_signal_store_update(&store, &can, 0, 1), 0);
+
+    bus_message_t lin;
+    memset(&lin, 0, sizeof(lin));
+    lin.type = MSG_TYPE_LIN;
+    lin.data.lin.lin_id = 0x10;
+    lin.data.lin.data[0] = 0xBB;
+    ASSERT_EQ(pcie_signal_store_update(&store, &lin, 0, 1), 0);
+
+    bus_message_t flexray;
+    memset(&flexray, 0, sizeof(flexray));
+    flexray.type = MSG_TYPE_FLEXRAY;
+    flexray.data.flexray.frame_id = 0x10;
+    flexray.data.flexray.data[63] = 0xCC;
+    ASSERT_EQ(pcie_signal_store_update(&store, &flexray, 3, 1), 0);
+
+    ASSERT_EQ(pcie_signal_store_get(&store, 0, MSG_TYPE_CAN, 0x10, &value), 0);
+    EXPECT_EQ(value.message.data.can.data[0], 0xAA);
+    ASSERT_EQ(pcie_signal_store_get(&store, 0, MSG_TYPE_LIN, 0x10, &value), 0);
+    EXPECT_EQ(value.message.data.lin.data[0], 0xBB);
+    ASSERT_EQ(pcie_signal_store_get(&store, 3, MSG_TYPE_FLEXRAY, 0x10, &value), 0);
+    EXPECT_EQ(value.message.data.flexray.data[63], 0xCC);
+
+    // Same ID in other zones or on other buses is untouched
+    EXPECT_EQ(pcie_signal_store_get(&store, 1, MSG_TYPE_CAN, 0x10, &value), PCIE_SIGNAL_NONE);
+    EXPECT_EQ(pcie_signal_store_get(&store, 0, MSG_TYPE_FLEXRAY, 0x10, &value), PCIE_SIGNAL_NONE);
+}
+
+TEST_F(SignalStoreTest, MessagesWithoutEntryAreIgnored) {
+    bus_message_t extended = make_can(0x18FF0001, 1);
+    EXPECT_EQ(pcie_signal_store_update(&store, &extended, 0, 1), PCIE_SIGNAL_IGNORED);
+
+    bus_message_t other_zone = make_can(0x100, 1);
+    EXPECT_EQ(pcie_signal_store_update(&store, &other_zone, 4, 1), PCIE_SIGNAL_IGNORED);
+
+    bus_message_t ethernet;
+    memset(&ethernet, 0, sizeof(ethernet));
+    ethernet.type = MSG_TYPE_ETHERNET;
+    ethernet.data.ethernet.ethertype = 0x88B5;
+    EXPECT_EQ(pcie_signal_store_update(&store, &ethernet, 0, 1), PCIE_SIGNAL_IGNORED);
+
+    EXPECT_EQ(store.stats.ignored, 3u);
+    EXPECT_EQ(store.stats.updates, 0u);
+    EXPECT_EQ(pcie_signal_store_version(&store), 0u);
+
+    // Lookups outside the table are errors
+    EXPECT_EQ(pcie_signal_store_get(&store, 0, MSG_TYPE_LIN, 64, &value), -1);
+    EXPECT_EQ(pcie_signal_store_get(&store, 4, MSG_TYPE_CAN, 0x100, &value), -1);
+    EXPECT_EQ(pcie_signal_store_get(&store, 0, MSG_TYPE_ETHERNET, 0x88B5, &value), -1);
+}
+
+TEST_F(SignalStoreTest, SnapshotReadsSeveralEntries) {
+    bus_message_t first = make_can(0x1, 11);
+    bus_message_t second = make_can(0x2, 22);
+    ASSERT_EQ(pcie_signal_store_update(&store, &first, 2, 1), 0);
+    ASSERT_EQ(pcie_signal_store_update(&store, &second, 2, 1), 0);
+
+    pcie_signal_key_t keys[3] = {
+        {2, MSG_TYPE_CAN, 0x1},
+        {2, MSG_TYPE_CAN, 0x2},
+        {2, MSG_TYPE_CAN, 0x3},
+    };
+    pcie_signal_t values[3];
+    ASSERT_EQ(pcie_signal_store_snapshot(&store, keys, 3, values), 0);
+    EXPECT_EQ(values[0].message.data.can.data[0], 11);
+    EXPECT_EQ(values[1].message.data.can.data[0], 22);
+    EXPECT_EQ(values[1].zone_id, 2u);
+    EXPECT_EQ(values[2].update_ns, 0u);
+    EXPECT_EQ(values[0].status, 0);
+    EXPECT_EQ(values[2].status, PCIE_SIGNAL_NONE);
+
+    keys[2].message_id = PCIE_SIGNAL_CAN_IDS;
+    EXPECT_EQ(pcie_signal_store_snapshot(&store, keys, 3, values), -1);
+}
+
+TEST_F(SignalStoreTest, SnapshotFallbackReportsEachEntry) {
+    bus_message_t first = make_can(0x1, 11);
+    bus_message_t second = make_can(0x2, 22);
+    ASSERT_EQ(pcie_signal_store_update(&store, &first, 2, 1), 0);
+    ASSERT_EQ(pcie_signal_store_update(&store, &second, 2, 1), 0);
+
+    // Leave a writer stuck in the middle of updating 0x2
+    pcie_signal_entry_t *stuck = NULL;
+    for (size_t i = 0; i < (size_t)store.zone_count * store.entries_per_zone; i++) {
+        pcie_signal_entry_t *entry = (pcie_signal_entry_t *)(store.entries + i * store.entry_size);
+        if (entry->seq != 0 && entry->message.data.can.can_id == 0x2) {
+            stuck = entry;
+        }
+    }
+    ASSERT_NE(stuck, nullptr);
+    store.sequence++;
+    stuck->seq++;
+
+    pcie_signal_key_t keys[3] = {
+        {2, MSG_TYPE_CAN, 0x1},
+        {2, MSG_TYPE_CAN, 0x2},
+        {2, MSG_TYPE_CAN, 0x3},
+    };
+    pcie_signal_t values[3];
+    EXPECT_EQ(pcie_signal_store_snapshot(&store, keys, 3, values), PCIE_SIGNAL_BUSY);
+    EXPECT_EQ(values[0].status, 0);
+    EXPECT_EQ(values[0].message.data.can.data[0], 11);
+    EXPECT_EQ(values[1].status, PCIE_SIGNAL_BUSY);
+    EXPECT_EQ(values[1].update_ns, 0u);
+    EXPECT_EQ(values[1].zone_id, 2u);
+    EXPECT_EQ(values[2].status, PCIE_SIGNAL_NONE);
+    EXPECT_EQ(pcie_signal_store_get(&store, 2, MSG_TYPE_CAN, 0x2, &value), PCIE_SIGNAL_BUSY);
+    EXPECT_EQ(value.status, PCIE_SIGNAL_BUSY);
+
+    // Readers recover once the writer commits
+    store.sequence++;
+    stuck->seq++;
+    EXPECT_EQ(pcie_signal_store_snapshot(&store, keys, 3, values), 0);
+    EXPECT_EQ(values[1].status, 0);
+    EXPECT_EQ(values[1].message.data.can.data[0], 22);
+}
+
+TEST_F(SignalStoreTest, ConcurrentReadersNeverSeeTornValues) {
+    const uint32_t rounds = 200000;
+    pcie_signal_key_t keys[2] = {
+        {0, MSG_TYPE_CAN, 0x100},
+        {0, MSG_TYPE_CAN, 0x200},
+    };
+
+    // Every round writes the same counter to both messages, first to 0x100
+    std::thread writer([this, rounds] {
+        for (uint32_t i = 1; i <= rounds; i++) {
+            bus_message_t msg = make_can(0x100, (uint8_t)i);
+            msg.timestamp = i;
+            pcie_signal_store_update(&store, &msg, 0, 1);
+            msg.data.can.can_id = 0x200;
+            pcie_signal_store_update(&store, &msg, 0, 1);
+        }
+    });
+
+    uint64_t last = 0;
+    uint64_t consistent = 0;
+    pcie_signal_t values[2];
+    while (last < rounds) {
+        int ret = pcie_signal_store_get(&store, 0, MSG_TYPE_CAN, 0x100, &value);
+        if (ret == 0) {
+            // All bytes come from the same update and values only move forward
+            for (int i = 1; i < 8; i++) {
+                ASSERT_EQ(value.message.data.can.data[i], value.message.data.can.data[0]);
+            }
+            ASSERT_EQ((uint8_t)value.message.timestamp, value.message.data.can.data[0]);
+            ASSERT_GE(value.message.timestamp, last);
+            last = value.message.timestamp;
+        } else {
+            ASSERT_TRUE(ret == PCIE_SIGNAL_NONE || ret == PCIE_SIGNAL_BUSY);
+            ASSERT_EQ(value.status, ret);
+        }
+
+        // A consistent snapshot sees either both or only the first write of a round
+        if (pcie_signal_store_snapshot(&store, keys, 2, values) == 0 && values[0].update_ns != 0) {
+            uint64_t a = values[0].message.timestamp;
+            uint64_t b = values[1].message.timestamp;
+            ASSERT_TRUE(a == b || a == b + 1) << a << " " << b;
+            consistent++;
+        }
+    }
+    writer.join();
+    EXPECT_GT(consistent, 0u);
+    EXPECT_EQ(store.stats.updates, 2u * rounds);
+}
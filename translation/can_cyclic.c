@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "pcie_common.h"
+#include "can_cyclic.h"
+
+#define CAN_CYCLIC_MASK (CAN_CYCLIC_CAPACITY - 1)
+
+// Find the entry of a CAN ID, optionally claiming a free one
+static can_cyclic_entry_t *lookup(can_cyclic_t *cache, uint32_t can_id, int create) {
+    uint32_t slot = pcie_hash_id(can_id) & CAN_CYCLIC_MASK;
+
+    for (uint32_t probe = 0; probe < CAN_CYCLIC_CAPACITY; probe++) {
+        can_cyclic_entry_t *entry = &cache->entries[(slot + probe) & CAN_CYCLIC_MASK];
+
+        if (entry->used && entry->can_id == can_id) {
+            return entry;
+        }
+
+        if (!entry->used) {
+            if (!create) {
+                return NULL;
+            }
+            memset(entry, 0, sizeof(*entry));
+            entry->used = 1;
+            entry->can_id = can_id;
+            entry->heartbeat_us = cache->default_heartbeat_us;
+            entry->cycle_us = cache->default_cycle_us;
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static inline int payload_changed(const can_cyclic_entry_t *entry, const can_message_t *can_msg) {
+    return !entry->valid ||
+           entry->can_dlc != can_msg->can_dlc ||
+           entry->flags != can_msg->flags ||
+           memcmp(entry->data, can_msg->data, can_msg->can_dlc) != 0;
+}
+
+// Whether an entry takes part in regeneration at all, regardless of time
+static inline int regen_candidate(const can_cyclic_entry_t *entry) {
+    return entry->used && entry->valid && entry->cycle_us != 0;
+}
+
+// Time after the last refresh at which the sender counts as silent
+static inline uint64_t stale_after_us(const can_cyclic_entry_t *entry) {
+    // Without suppression every frame is forwarded, so the regeneration
+    // period is also the sender's own cycle
+    uint32_t interval = entry->heartbeat_us != 0 ? entry->heartbeat_us : entry->cycle_us;
+    return (uint64_t)interval * CAN_CYCLIC_STALE_HEARTBEATS;
+}
+
+// Recount the regeneration candidates after a configuration change
+static void regen_rescan(can_cyclic_t *cache) {
+    cache->regen_entries = 0;
+    cache->regen_until_us = 0;
+    for (uint32_t index = 0; index < CAN_CYCLIC_CAPACITY; index++) {
+        const can_cyclic_entry_t *entry = &cache->entries[index];
+        if (!regen_candidate(entry)) {
+            continue;
+        }
+        uint64_t until = entry->last_update_us + stale_after_us(entry);
+        cache->regen_entries++;
+        if (until > cache->regen_until_us) {
+            cache->regen_until_us = until;
+        }
+    }
+}
+
+static inline void store_payload(can_cyclic_entry_t *entry, const can_message_t *can_msg) {
+    entry->can_dlc = can_msg->can_dlc;
+    entry->flags = can_msg->flags;
+    memcpy(entry->data, can_msg->data, sizeof(entry->data));
+    entry->valid = 1;
+}
+
+// Initialize an empty cache
+void can_cyclic_init(can_cyclic_t *cache, uint32_t default_heartbeat_us, uint32_t default_cycle_us) {
+    memset(cache, 0, sizeof(*cache));
+    cache->default_heartbeat_us = default_heartbeat_us;
+    cache->default_cycle_us = default_cycle_us;
+}
+
+// Configure heartbeat and regeneration period of a CAN ID
+int can_cyclic_configure(can_cyclic_t *cache, uint32_t can_id, uint32_t heartbeat_us, uint32_t cycle_us) {
+    if (cache == NULL) {
+        return -1;
+    }
+
+    can_cyclic_entry_t *entry = lookup(cache, can_id, 1);
+    if (entry == NULL) {
+        pcie_log("Cyclic", "Error: CAN ID cache is full.");
+        return -1;
+    }
+
+    entry->heartbeat_us = heartbeat_us;
+    entry->cycle_us = cycle_us;
+    regen_rescan(cache);
+    return 0;
+}
+
+// Sending side: decide whether a frame has to be forwarded
+int can_cyclic_should_forward(can_cyclic_t *cache, const can_message_t *can_msg, uint64_t now_us) {
+    if (cache == NULL || can_msg == NULL || can_msg->can_dlc > 8) {
+        // Never swallow frames we cannot classify
+        return 1;
+    }
+
+    can_cyclic_entry_t *entry = lookup(cache, can_msg->can_id, 1);
+    if (entry == NULL) {
+        cache->stats.untracked++;
+        return 1;
+    }
+
+    if (payload_changed(entry, can_msg)) {
+        store_payload(entry, can_msg);
+        entry->last_update_us = now_us;
+        entry->last_emit_us = now_us;
+        cache->stats.forwarded++;
+        return 1;
+    }
+
+    if (entry->heartbeat_us == 0) {
+        entry->last_emit_us = now_us;
+        cache->stats.forwarded++;
+        return 1;
+    }
+
+    if (now_us - entry->last_emit_us >= entry->heartbeat_us) {
+        entry->last_update_us = now_us;
+        entry->last_emit_us = now_us;
+        cache->stats.heartbeats++;
+        return 1;
+    }
+
+    cache->stats.suppressed++;
+    return 0;
+}
+
+// Receiving side: store a frame received from the backbone
+int can_cyclic_update(can_cyclic_t *cache, const can_message_t *can_msg, uint64_t now_us) {
+    if (cache == NULL || can_msg == NULL || can_msg->can_dlc > 8) {
+        return -1;
+    }
+
+    can_cyclic_entry_t *entry = lookup(cache, can_msg->can_id, 1);
+    if (entry == NULL) {
+        cache->stats.untracked++;
+        return -1;
+    }
+
+    // The received frame itself goes out on the local bus right away
+    int candidate = regen_candidate(entry);
+    store_payload(entry, can_msg);
+    entry->last_update_us = now_us;
+    entry->last_emit_us = now_us;
+
+    if (regen_candidate(entry)) {
+        uint64_t until = now_us + stale_after_us(entry);
+        cache->regen_entries += candidate ? 0 : 1;
+        if (until > cache->regen_until_us) {
+            cache->regen_until_us = until;
+        }
+    }
+    return 0;
+}
+
+// Whether an entry is regenerated at all at now_us
+static int regen_active(const can_cyclic_entry_t *entry, uint64_t now_us) {
+    if (!regen_candidate(entry)) {
+        return 0;
+    }
+
+    // Stop regenerating once the sender went silent
+    return now_us - entry->last_update_us <= stale_after_us(entry);
+}
+
+// Whether no entry can be due, without looking at the entries
+static inline int regen_idle(const can_cyclic_t *cache, uint64_t now_us) {
+    return cache->regen_entries == 0 || now_us > cache->regen_until_us;
+}
+
+// Receiving side: emit the next frame whose regeneration period expired
+int can_cyclic_poll_regen(can_cyclic_t *cache, uint64_t now_us, can_message_t *can_msg) {
+    if (cache == NULL || can_msg == NULL || regen_idle(cache, now_us)) {
+        return 0;
+    }
+
+    for (uint32_t n = 0; n < CAN_CYCLIC_CAPACITY; n++) {
+        uint32_t index = (cache->cursor + n) & CAN_CYCLIC_MASK;
+        can_cyclic_entry_t *entry = &cache->entries[index];
+
+        if (!regen_active(entry, now_us)) {
+            continue;
+        }
+
+        if (now_us - entry->last_emit_us >= entry->cycle_us) {
+            can_msg->can_id = entry->can_id;
+            can_msg->can_dlc = entry->can_dlc;
+            memcpy(can_msg->data, entry->data, sizeof(can_msg->data));
+            can_msg->flags = entry->flags;
+
+            entry->last_emit_us = now_us;
+            cache->cursor = (index + 1) & CAN_CYCLIC_MASK;
+            cache->stats.regenerated++;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Receiving side: time until the next regenerated frame is due
+uint64_t can_cyclic_next_regen_us(const can_cyclic_t *cache, uint64_t now_us) {
+    uint64_t next = CAN_CYCLIC_NO_REGEN;
+    if (cache == NULL || regen_idle(cache, now_us)) {
+        return next;
+    }
+
+    for (uint32_t index = 0; index < CAN_CYCLIC_CAPACITY; index++) {
+        const can_cyclic_entry_t *entry = &cache->entries[index];
+        if (!regen_active(entry, now_us)) {
+            continue;
+        }
+
+        uint64_t elapsed = now_us - entry->last_emit_us;
+        uint64_t wait = elapsed >= entry->cycle_us ? 0 : entry->cycle_us - elapsed;
+        if (wait < next) {
+            next = wait;
+        }
+    }
+    return next;
+}
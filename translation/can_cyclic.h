@@ -0,0 +1,88 @@
+#ifndef CAN_CYCLIC_H
+#define CAN_CYCLIC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pcie_translation.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Change-detection suppression for cyclic CAN traffic.
+//
+// The sending gateway keeps the last forwarded payload per CAN ID and only
+// forwards a frame when its payload changed or its heartbeat interval
+// expired. The receiving gateway can use the same cache to regenerate the
+// cyclic stream on its local bus from the last received value.
+
+// Number of CAN IDs tracked per cache (power of two)
+#define CAN_CYCLIC_CAPACITY 512
+
+// Regeneration stops if no refresh arrived within this many heartbeats, or
+// regeneration periods for IDs forwarded without suppression (heartbeat 0)
+#define CAN_CYCLIC_STALE_HEARTBEATS 3
+
+// can_cyclic_next_regen_us() result when no frame is being regenerated
+#define CAN_CYCLIC_NO_REGEN UINT64_MAX
+
+// Last-value cache entry for one CAN ID
+typedef struct {
+    uint32_t can_id;
+    uint8_t used;
+    uint8_t valid;           // A payload has been seen for this ID
+    uint8_t can_dlc;
+    uint8_t flags;
+    uint8_t data[8];
+    uint32_t heartbeat_us;   // Forward at least this often (0 = never suppress)
+    uint32_t cycle_us;       // Local regeneration period (0 = no regeneration)
+    uint64_t last_update_us; // Last payload change or heartbeat
+    uint64_t last_emit_us;   // Last forwarded or regenerated frame
+} can_cyclic_entry_t;
+
+// Counters for both directions
+typedef struct {
+    uint64_t forwarded;      // Frames forwarded because the payload changed
+    uint64_t heartbeats;     // Unchanged frames forwarded as heartbeat
+    uint64_t suppressed;     // Unchanged frames not forwarded
+    uint64_t untracked;      // Frames forwarded because the cache was full
+    uint64_t regenerated;    // Frames emitted locally from the cache
+} can_cyclic_stats_t;
+
+typedef struct {
+    can_cyclic_entry_t entries[CAN_CYCLIC_CAPACITY];
+    uint32_t default_heartbeat_us;  // Heartbeat for IDs without explicit configuration
+    uint32_t default_cycle_us;      // Regeneration period for IDs without explicit configuration
+    uint32_t cursor;                // Resume point for regeneration scans
+    uint32_t regen_entries;         // Entries with a payload and a regeneration period
+    uint64_t regen_until_us;        // No entry is regenerated after this time
+    can_cyclic_stats_t stats;
+} can_cyclic_t;
+
+// Initialize an empty cache. For IDs that are not configured explicitly a
+// default heartbeat of 0 disables suppression and a default cycle of 0
+// disables regeneration.
+void can_cyclic_init(can_cyclic_t *cache, uint32_t default_heartbeat_us, uint32_t default_cycle_us);
+
+// Configure heartbeat and regeneration period of a CAN ID
+int can_cyclic_configure(can_cyclic_t *cache, uint32_t can_id, uint32_t heartbeat_us, uint32_t cycle_us);
+
+// Sending side: returns 1 if the frame has to be forwarded, 0 if it is suppressed
+int can_cyclic_should_forward(can_cyclic_t *cache, const can_message_t *can_msg, uint64_t now_us);
+
+// Receiving side: store a frame received from the backbone
+int can_cyclic_update(can_cyclic_t *cache, const can_message_t *can_msg, uint64_t now_us);
+
+// Receiving side: returns 1 and fills can_msg if a regenerated frame is due, 0 otherwise
+int can_cyclic_poll_regen(can_cyclic_t *cache, uint64_t now_us, can_message_t *can_msg);
+
+// Receiving side: microseconds until can_cyclic_poll_regen() has the next
+// frame due (0 if one is due now), CAN_CYCLIC_NO_REGEN if none is tracked.
+// A receive loop bounds its wait by this so regenerated frames go out on time.
+uint64_t can_cyclic_next_regen_us(const can_cyclic_t *cache, uint64_t now_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAN_CYCLIC_H
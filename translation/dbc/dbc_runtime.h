@@ -0,0 +1,57 @@
+#ifndef DBC_RUNTIME_H
+#define DBC_RUNTIME_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Helpers shared by the decoders generated with dbcgen.py.
+//
+// A CAN payload is handled as one 64-bit word. Intel (little-endian)
+// signals are extracted from the payload read as little-endian word,
+// Motorola (big-endian) signals from its byte-swapped counterpart, so
+// every signal becomes a single shift and mask.
+
+static inline uint64_t dbc_load_le64(const uint8_t *data) {
+    return (uint64_t)data[0] |
+           ((uint64_t)data[1] << 8) |
+           ((uint64_t)data[2] << 16) |
+           ((uint64_t)data[3] << 24) |
+           ((uint64_t)data[4] << 32) |
+           ((uint64_t)data[5] << 40) |
+           ((uint64_t)data[6] << 48) |
+           ((uint64_t)data[7] << 56);
+}
+
+static inline void dbc_store_le64(uint8_t *data, uint64_t word) {
+    for (int i = 0; i < 8; i++) {
+        data[i] = (uint8_t)(word >> (8 * i));
+    }
+}
+
+static inline uint64_t dbc_bswap64(uint64_t word) {
+    return __builtin_bswap64(word);
+}
+
+// Sign-extend the lowest len bits of a raw value
+static inline int64_t dbc_sign_extend64(uint64_t raw, unsigned len) {
+    return (int64_t)(raw << (64 - len)) >> (64 - len);
+}
+
+static inline int32_t dbc_sign_extend32(uint32_t raw, unsigned len) {
+    return (int32_t)(raw << (32 - len)) >> (32 - len);
+}
+
+// Convert a physical value back to its rounded raw representation
+static inline uint64_t dbc_to_raw(float physical, float factor, float offset) {
+    float scaled = (physical - offset) / factor;
+    return (uint64_t)(int64_t)(scaled >= 0.0f ? scaled + 0.5f : scaled - 0.5f);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DBC_RUNTIME_H
@@ -0,0 +1,375 @@
+#!/usr/bin/env python3
+"""Generate C signal decoders/encoders from a DBC file.
+
+For every message in the DBC this emits
+  - a struct with the physical signal values,
+  - inline single-frame decode/encode functions with all bit positions,
+    masks and scaling folded into constants,
+  - a struct-of-arrays buffer and a batch decoder that sorts frames by
+    CAN ID and then extracts each signal in a tight loop over the raw
+    payload words, which the compiler can vectorize.
+
+Usage: dbcgen.py input.dbc -o outdir [--prefix name]
+Produces <outdir>/<prefix>_dbc.h and <outdir>/<prefix>_dbc.c.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+MESSAGE_RE = re.compile(r'^BO_\s+(\d+)\s+(\w+)\s*:\s*(\d+)\s+(\w+)')
+SIGNAL_RE = re.compile(
+    r'^SG_\s+(\w+)\s*(M|m\d+)?\s*:\s*(\d+)\|(\d+)@([01])([+-])\s*'
+    r'\(([^,]+),([^)]+)\)\s*\[([^|]*)\|([^\]]*)\]\s*"([^"]*)"')
+
+CAN_EFF_FLAG = 0x80000000
+CAN_EFF_MASK = 0x1FFFFFFF
+
+
+class Signal:
+    def __init__(self, name, start, length, little_endian, signed, factor, offset, unit):
+        self.name = name
+        self.length = length
+        self.signed = signed
+        self.factor = factor
+        self.offset = offset
+        self.unit = unit
+        self.little_endian = little_endian
+
+        if little_endian:
+            self.lsb = start
+        else:
+            # Motorola start bit is the MSB in sawtooth numbering; map it into
+            # the byte-swapped payload word
+            msb = (7 - start // 8) * 8 + start % 8
+            self.lsb = msb - length + 1
+
+        if self.lsb < 0 or self.lsb + length > 64 or length < 1:
+            raise ValueError(f'signal {name} does not fit into 64 bits')
+
+    @property
+    def word(self):
+        return 'le' if self.little_endian else 'be'
+
+    @property
+    def mask(self):
+        return (1 << self.length) - 1
+
+
+class Message:
+    def __init__(self, can_id, name, dlc):
+        self.can_id = can_id
+        self.name = name
+        self.dlc = dlc
+        self.signals = []
+
+    @property
+    def ident(self):
+        return snake_case(self.name)
+
+    def uses(self, word):
+        return any(s.word == word for s in self.signals)
+
+
+def snake_case(name):
+    name = re.sub(r'([a-z0-9])([A-Z])', r'\1_\2', name)
+    return re.sub(r'[^A-Za-z0-9]+', '_', name).lower().strip('_')
+
+
+def float_literal(value):
+    text = '%.9g' % value
+    if not any(c in text for c in '.en'):
+        text += '.0'
+    return text + 'f'
+
+
+def parse_dbc(path):
+    messages = []
+    current = None
+
+    with open(path, encoding='latin-1') as dbc:
+        for lineno, line in enumerate(dbc, 1):
+            line = line.strip()
+
+            match = MESSAGE_RE.match(line)
+            if match:
+                raw_id = int(match.group(1))
+                can_id = raw_id & CAN_EFF_MASK if raw_id & CAN_EFF_FLAG else raw_id
+                current = Message(can_id, match.group(2), int(match.group(3)))
+                messages.append(current)
+                continue
+
+            match = SIGNAL_RE.match(line)
+            if match and current is not None:
+                name, mux = match.group(1), match.group(2)
+                if mux and mux != 'M':
+                    print(f'{path}:{lineno}: skipping multiplexed signal {name}', file=sys.stderr)
+                    continue
+                try:
+                    current.signals.append(Signal(
+                        name,
+                        int(match.group(3)),
+                        int(match.group(4)),
+                        match.group(5) == '1',
+                        match.group(6) == '-',
+                        float(match.group(7)),
+                        float(match.group(8)),
+                        match.group(11)))
+                except ValueError as err:
+                    sys.exit(f'{path}:{lineno}: {err}')
+                continue
+
+            if line.startswith('BO_') or line.startswith('SG_'):
+                print(f'{path}:{lineno}: unrecognized line ignored', file=sys.stderr)
+
+    return [m for m in messages if m.signals]
+
+
+def extract_expr(sig, word):
+    """Raw extraction and scaling of one signal from a payload word."""
+    raw = f'(({word} >> {sig.lsb}) & 0x{sig.mask:X}ull)'
+
+    # 32-bit integer conversions keep the batch loops vectorizable
+    if not sig.signed and sig.length <= 31:
+        value = f'(float)(int32_t){raw}'
+    elif sig.signed and sig.length <= 32:
+        value = f'(float)dbc_sign_extend32((uint32_t){raw}, {sig.length})'
+    elif sig.signed:
+        value = f'(float)dbc_sign_extend64({raw}, {sig.length})'
+    else:
+        value = f'(float){raw}'
+
+    if sig.factor != 1.0:
+        value += f' * {float_literal(sig.factor)}'
+    if sig.offset > 0.0:
+        value += f' + {float_literal(sig.offset)}'
+    elif sig.offset < 0.0:
+        value += f' - {float_literal(-sig.offset)}'
+    return value
+
+
+def generate_header(prefix, messages, source):
+    guard = f'{prefix.upper()}_DBC_H'
+    out = [
+        f'// Generated by dbcgen.py from {source} - do not edit',
+        f'#ifndef {guard}',
+        f'#define {guard}',
+        '',
+        '#include <stdint.h>',
+        '#include <stddef.h>',
+        '#include "pcie_translation.h"',
+        '#include "dbc_runtime.h"',
+        '',
+    ]
+
+    for msg in messages:
+        name = f'{prefix}_{msg.ident}'
+        upper = name.upper()
+        out += [
+            f'// {msg.name} (0x{msg.can_id:X}, {msg.dlc} bytes)',
+            f'#define {upper}_ID 0x{msg.can_id:X}u',
+            f'#define {upper}_DLC {msg.dlc}',
+            '',
+            'typedef struct {',
+        ]
+        for sig in msg.signals:
+            unit = f'  // {sig.unit}' if sig.unit else ''
+            out.append(f'    float {sig.name};{unit}')
+        out += [
+            f'}} {name}_t;',
+            '',
+            '// Struct-of-arrays buffer for batch decoding',
+            'typedef struct {',
+            '    size_t capacity;',
+            '    size_t count;',
+            '    uint64_t *raw;          // Payload words in little-endian order',
+            '    uint32_t *frame_index;  // Position of the frame in the decoded batch',
+        ]
+        for sig in msg.signals:
+            out.append(f'    float *{sig.name};')
+        out += [
+            f'}} {name}_soa_t;',
+            '',
+            f'static inline void {name}_decode(const uint8_t *data, {name}_t *msg) {{',
+            '    uint64_t le = dbc_load_le64(data);',
+        ]
+        if msg.uses('be'):
+            out.append('    uint64_t be = dbc_bswap64(le);')
+        for sig in msg.signals:
+            out.append(f'    msg->{sig.name} = {extract_expr(sig, sig.word)};')
+        out += [
+            '}',
+            '',
+            f'static inline void {name}_encode(const {name}_t *msg, uint8_t *data) {{',
+            '    uint64_t le = 0;',
+            '    uint64_t be = 0;',
+        ]
+        for sig in msg.signals:
+            out.append(f'    {sig.word} |= (dbc_to_raw(msg->{sig.name}, {float_literal(sig.factor)}, '
+                       f'{float_literal(sig.offset)}) & 0x{sig.mask:X}ull) << {sig.lsb};')
+        out += [
+            '    dbc_store_le64(data, le | dbc_bswap64(be));',
+            '}',
+            '',
+        ]
+
+    out += [
+        '// Per-message buffers filled by one batch decode call',
+        'typedef struct {',
+    ]
+    for msg in messages:
+        out.append(f'    {prefix}_{msg.ident}_soa_t {msg.ident};')
+    out += [
+        '    size_t unknown;   // Frames with an ID not in the DBC',
+        '    size_t overflow;  // Frames dropped because a buffer was full',
+        f'}} {prefix}_batch_t;',
+        '',
+        '#ifdef __cplusplus',
+        'extern "C" {',
+        '#endif',
+        '',
+        '// Allocate buffers for up to capacity frames per message',
+        f'int {prefix}_batch_init({prefix}_batch_t *batch, size_t capacity);',
+        f'void {prefix}_batch_free({prefix}_batch_t *batch);',
+        '',
+        '// Decode an array of frames into the struct-of-arrays buffers,',
+        '// returns the number of decoded frames',
+        f'size_t {prefix}_decode_batch(const can_message_t *frames, size_t count, {prefix}_batch_t *batch);',
+        '',
+        '#ifdef __cplusplus',
+        '}',
+        '#endif',
+        '',
+        f'#endif // {guard}',
+        '',
+    ]
+    return '\n'.join(out)
+
+
+def generate_source(prefix, messages, source):
+    out = [
+        f'// Generated by dbcgen.py from {source} - do not edit',
+        '#include <stdlib.h>',
+        '#include <string.h>',
+        f'#include "{prefix}_dbc.h"',
+        '',
+    ]
+
+    # Signal extraction over contiguous payload words
+    for msg in messages:
+        name = f'{prefix}_{msg.ident}'
+        out += [
+            f'static void {name}_extract({name}_soa_t *soa) {{',
+            '    const uint64_t *raw = soa->raw;',
+            '    const size_t n = soa->count;',
+            '',
+        ]
+        for sig in msg.signals:
+            word = 'raw[i]' if sig.word == 'le' else 'dbc_bswap64(raw[i])'
+            out += [
+                f'    float *{sig.name} = soa->{sig.name};',
+                '    for (size_t i = 0; i < n; i++) {',
+                f'        {sig.name}[i] = {extract_expr(sig, word)};',
+                '    }',
+            ]
+        out += ['}', '']
+
+    out += [
+        f'int {prefix}_batch_init({prefix}_batch_t *batch, size_t capacity) {{',
+        '    memset(batch, 0, sizeof(*batch));',
+        '',
+    ]
+    for msg in messages:
+        soa = f'batch->{msg.ident}'
+        out += [
+            f'    {soa}.capacity = capacity;',
+            f'    {soa}.raw = (uint64_t *)malloc(capacity * sizeof(uint64_t));',
+            f'    {soa}.frame_index = (uint32_t *)malloc(capacity * sizeof(uint32_t));',
+        ]
+        checks = [f'!{soa}.raw', f'!{soa}.frame_index']
+        for sig in msg.signals:
+            out.append(f'    {soa}.{sig.name} = (float *)malloc(capacity * sizeof(float));')
+            checks.append(f'!{soa}.{sig.name}')
+        out += [
+            f'    if ({" || ".join(checks)}) {{',
+            f'        {prefix}_batch_free(batch);',
+            '        return -1;',
+            '    }',
+            '',
+        ]
+    out += ['    return 0;', '}', '']
+
+    out += [f'void {prefix}_batch_free({prefix}_batch_t *batch) {{']
+    for msg in messages:
+        soa = f'batch->{msg.ident}'
+        out += [f'    free({soa}.raw);', f'    free({soa}.frame_index);']
+        for sig in msg.signals:
+            out.append(f'    free({soa}.{sig.name});')
+    out += ['    memset(batch, 0, sizeof(*batch));', '}', '']
+
+    out += [
+        f'size_t {prefix}_decode_batch(const can_message_t *frames, size_t count, {prefix}_batch_t *batch) {{',
+        '    size_t decoded = 0;',
+        '',
+        '    batch->unknown = 0;',
+        '    batch->overflow = 0;',
+    ]
+    for msg in messages:
+        out.append(f'    batch->{msg.ident}.count = 0;')
+    out += [
+        '',
+        '    // Sort payload words into the per-message buffers',
+        '    for (size_t i = 0; i < count; i++) {',
+        '        switch (frames[i].can_id) {',
+    ]
+    for msg in messages:
+        soa = f'batch->{msg.ident}'
+        out += [
+            f'            case {prefix.upper()}_{msg.ident.upper()}_ID:',
+            f'                if ({soa}.count < {soa}.capacity) {{',
+            f'                    {soa}.raw[{soa}.count] = dbc_load_le64(frames[i].data);',
+            f'                    {soa}.frame_index[{soa}.count++] = (uint32_t)i;',
+            '                    decoded++;',
+            '                } else {',
+            '                    batch->overflow++;',
+            '                }',
+            '                break;',
+        ]
+    out += [
+        '            default:',
+        '                batch->unknown++;',
+        '                break;',
+        '        }',
+        '    }',
+        '',
+        '    // Extract every signal in one pass over its message buffer',
+    ]
+    for msg in messages:
+        out.append(f'    {prefix}_{msg.ident}_extract(&batch->{msg.ident});')
+    out += ['', '    return decoded;', '}', '']
+    return '\n'.join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate C signal decoders from a DBC file')
+    parser.add_argument('dbc', help='input DBC file')
+    parser.add_argument('-o', '--outdir', default='.', help='output directory')
+    parser.add_argument('--prefix', help='identifier prefix (default: DBC file name)')
+    args = parser.parse_args()
+
+    prefix = args.prefix or snake_case(os.path.splitext(os.path.basename(args.dbc))[0])
+    messages = parse_dbc(args.dbc)
+    if not messages:
+        sys.exit(f'{args.dbc}: no messages with signals found')
+
+    source = os.path.basename(args.dbc)
+    os.makedirs(args.outdir, exist_ok=True)
+    with open(os.path.join(args.outdir, f'{prefix}_dbc.h'), 'w') as header:
+        header.write(generate_header(prefix, messages, source))
+    with open(os.path.join(args.outdir, f'{prefix}_dbc.c'), 'w') as impl:
+        impl.write(generate_source(prefix, messages, source))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,686 @@
+#ifndef PCIE_ASYNC_HPP
+#define PCIE_ASYNC_HPP
+
+// C++20 coroutine layer for serving many channels from one thread.
+//
+// An EventLoop multiplexes PCIe flow control rings and SocketCAN sockets
+// with epoll. Sockets are waited on directly. Rings live in shared memory
+// and have no file descriptor of their own: a ring can name an eventfd its
+// peer signals after publishing or consuming (e.g. the MSI eventfd of a
+// VFIO device), otherwise the loop polls waiting rings on a timerfd.
+//
+// async_send()/async_receive() return lazily started Task<int> values with
+// the return codes of the C API. Tasks are started by co_await-ing them from
+// another task or by EventLoop::spawn(). Everything runs on the thread that
+// calls EventLoop::run(); only EventLoop::stop() may be called from others.
+// Objects passed by reference must outlive the task using them.
+
+#if __cplusplus < 202002L
+#error "pcie_async.hpp requires C++20 (-std=c++20)"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include "pcie_common.h"
+#include "pcie_client.h"
+#include "pcie_flow.h"
+#include "pcie_translation.h"
+
+namespace pcie::async {
+
+class EventLoop;
+
+template <typename T = void>
+class Task;
+
+namespace detail {
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+
+        // Symmetric transfer back to the awaiting task
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            std::coroutine_handle<> next = handle.promise().continuation;
+            return next ? next : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() noexcept { error = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : PromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object() noexcept;
+    void return_value(T result) { value = std::move(result); }
+
+    T result() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : PromiseBase {
+    Task<void> get_return_object() noexcept;
+    void return_void() const noexcept {}
+
+    void result() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+// Owner of a spawned task; frees itself when the task finishes
+struct Detached {
+    struct promise_type {
+        EventLoop *loop = nullptr;
+
+        struct FinalAwaiter {
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+            void await_resume() const noexcept {}
+        };
+
+        Detached get_return_object() noexcept {
+            return Detached{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        FinalAwaiter final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept {
+            pcie_log("Async", "Error: Unhandled exception in spawned task.");
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+} // namespace detail
+
+// Lazily started coroutine producing a T
+template <typename T>
+class [[nodiscard]] Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+    Task(Task &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, {});
+        }
+        return *this;
+    }
+
+    ~Task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        handle_.promise().continuation = caller;
+        return handle_;
+    }
+
+    T await_resume() { return handle_.promise().result(); }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+template <typename T>
+Task<T> detail::TaskPromise<T>::get_return_object() noexcept {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> detail::TaskPromise<void>::get_return_object() noexcept {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// Both directions of a PCIe link as seen by one side
+class RingEndpoint {
+public:
+    // wait_fd: eventfd signalled when the peer published or consumed (-1 = poll)
+    // notify_fd: eventfd written after every local send or receive (-1 = none)
+    RingEndpoint(pcie_flow_t *tx, pcie_flow_t *rx, int wait_fd = -1, int notify_fd = -1) noexcept
+        : tx_(tx), rx_(rx), wait_fd_(wait_fd), notify_fd_(notify_fd) {}
+
+    RingEndpoint(const RingEndpoint &) = delete;
+    RingEndpoint &operator=(const RingEndpoint &) = delete;
+
+    // Both rings of the PCIe client link (after pcie_client_init())
+    static RingEndpoint client(int wait_fd = -1, int notify_fd = -1) {
+        pcie_flow_t *tx = pcie_client_tx_flow();
+        pcie_flow_t *rx = pcie_client_rx_flow();
+        if (tx == nullptr || rx == nullptr) {
+            throw std::system_error(ENODEV, std::generic_category(), "Failed to open the PCIe client rings");
+        }
+        return RingEndpoint(tx, rx, wait_fd, notify_fd);
+    }
+
+    pcie_flow_t *tx() const noexcept { return tx_; }
+    pcie_flow_t *rx() const noexcept { return rx_; }
+
+    bool readable() const noexcept { return rx_ != nullptr && pcie_flow_readable(rx_); }
+    bool writable() const noexcept { return tx_ != nullptr && pcie_flow_credits(tx_) > 0; }
+
+    // Ring the peer's doorbell
+    void notify() const noexcept {
+        if (notify_fd_ >= 0) {
+            uint64_t one = 1;
+            ssize_t ret = write(notify_fd_, &one, sizeof(one));
+            (void)ret; // A saturated eventfd is already signalled
+        }
+    }
+
+private:
+    friend class EventLoop;
+
+    pcie_flow_t *tx_;
+    pcie_flow_t *rx_;
+    int wait_fd_;
+    int notify_fd_;
+    std::deque<std::coroutine_handle<>> readers_;
+    std::deque<std::coroutine_handle<>> writers_;
+    bool listed_ = false;
+};
+
+// Counters of one event loop
+struct LoopStats {
+    uint64_t iterations = 0;
+    uint64_t resumes = 0;       // Coroutines resumed by the loop
+    uint64_t epoll_waits = 0;
+    uint64_t timer_ticks = 0;   // Ring polling timer expirations
+    uint64_t doorbells = 0;     // Ring wait_fd wake-ups
+};
+
+class EventLoop {
+public:
+    explicit EventLoop(std::chrono::nanoseconds poll_interval = std::chrono::microseconds(50))
+        : poll_interval_(poll_interval) {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (epoll_fd_ < 0 || wake_fd_ < 0 || timer_fd_ < 0 ||
+            add_fd(wake_fd_, EPOLLIN) != 0 || add_fd(timer_fd_, EPOLLIN) != 0) {
+            int err = errno;
+            close_fds();
+            throw std::system_error(err, std::generic_category(), "Failed to create event loop");
+        }
+    }
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    ~EventLoop() {
+        // Tasks still suspended are destroyed together with their children
+        std::vector<void *> pending(tasks_.begin(), tasks_.end());
+        tasks_.clear();
+        for (void *frame : pending) {
+            std::coroutine_handle<>::from_address(frame).destroy();
+        }
+        close_fds();
+    }
+
+    // Start a task on this loop; it is freed when it finishes
+    void spawn(Task<void> task) {
+        detail::Detached detached = run_detached(std::move(task));
+        detached.handle.promise().loop = this;
+        tasks_.insert(detached.handle.address());
+        ready_.push_back(detached.handle);
+    }
+
+    // Run until stop() is called or every spawned task finished
+    void run() {
+        epoll_event events[64];
+
+        while (!stop_.load(std::memory_order_acquire) && !tasks_.empty()) {
+            stats_.iterations++;
+            run_ready();
+            poll_rings();
+            if (!ready_.empty()) {
+                continue;
+            }
+            if (tasks_.empty() || stop_.load(std::memory_order_acquire)) {
+                break;
+            }
+
+            update_timer();
+            stats_.epoll_waits++;
+            int count = epoll_wait(epoll_fd_, events, 64, -1);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                pcie_log("Async", "Error: epoll_wait failed.");
+                break;
+            }
+
+            for (int i = 0; i < count; i++) {
+                dispatch(static_cast<int>(events[i].data.fd), events[i].events);
+            }
+        }
+
+        // A later run() starts afresh
+        stop_.store(false, std::memory_order_relaxed);
+    }
+
+    // Make run() return; safe to call from any thread
+    void stop() noexcept {
+        stop_.store(true, std::memory_order_release);
+        uint64_t one = 1;
+        ssize_t ret = write(wake_fd_, &one, sizeof(one));
+        (void)ret;
+    }
+
+    // Resume a coroutine on the next loop iteration (loop thread only)
+    void post(std::coroutine_handle<> handle) { ready_.push_back(handle); }
+
+    const LoopStats &stats() const noexcept { return stats_; }
+    size_t active_tasks() const noexcept { return tasks_.size(); }
+
+    struct FdAwaiter {
+        EventLoop &loop;
+        int fd;
+        uint32_t events;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { loop.watch_fd(fd, events, handle); }
+        void await_resume() const noexcept {}
+    };
+
+    struct RingAwaiter {
+        EventLoop &loop;
+        RingEndpoint &ring;
+        bool write;
+
+        bool await_ready() const noexcept { return write ? ring.writable() : ring.readable(); }
+        void await_suspend(std::coroutine_handle<> handle) { loop.wait_ring(ring, write, handle); }
+        void await_resume() const noexcept {}
+    };
+
+    // Wait until a descriptor is readable or writable (one reader and one writer per fd)
+    FdAwaiter readable(int fd) noexcept { return FdAwaiter{*this, fd, EPOLLIN}; }
+    FdAwaiter writable(int fd) noexcept { return FdAwaiter{*this, fd, EPOLLOUT}; }
+
+    // Wait until a ring has a message or a credit
+    RingAwaiter ring_readable(RingEndpoint &ring) noexcept { return RingAwaiter{*this, ring, false}; }
+    RingAwaiter ring_writable(RingEndpoint &ring) noexcept { return RingAwaiter{*this, ring, true}; }
+
+private:
+    friend struct detail::Detached::promise_type::FinalAwaiter;
+
+    struct FdWaiters {
+        std::coroutine_handle<> reader;
+        std::coroutine_handle<> writer;
+        uint32_t events = 0;
+    };
+
+    static detail::Detached run_detached(Task<void> task) { co_await task; }
+
+    int add_fd(int fd, uint32_t events) noexcept {
+        epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = events;
+        event.data.fd = fd;
+        return epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    void close_fds() noexcept {
+        for (int *fd : {&epoll_fd_, &wake_fd_, &timer_fd_}) {
+            if (*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+    }
+
+    void resume(std::coroutine_handle<> handle) {
+        stats_.resumes++;
+        handle.resume();
+    }
+
+    void run_ready() {
+        while (!ready_.empty()) {
+            std::coroutine_handle<> handle = ready_.front();
+            ready_.pop_front();
+            resume(handle);
+        }
+    }
+
+    void watch_fd(int fd, uint32_t events, std::coroutine_handle<> handle) {
+        FdWaiters &waiters = fds_[fd];
+        if (events & EPOLLIN) {
+            waiters.reader = handle;
+        } else {
+            waiters.writer = handle;
+        }
+        if (update_interest(fd, waiters) != 0) {
+            // Let the task retry and see the error from its own system call
+            fds_.erase(fd);
+            ready_.push_back(handle);
+        }
+    }
+
+    int update_interest(int fd, FdWaiters &waiters) noexcept {
+        uint32_t events = (waiters.reader ? EPOLLIN : 0u) | (waiters.writer ? EPOLLOUT : 0u);
+        if (events == waiters.events) {
+            return 0;
+        }
+
+        epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = events;
+        event.data.fd = fd;
+        int op = waiters.events == 0 ? EPOLL_CTL_ADD : events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+        waiters.events = events;
+        return epoll_ctl(epoll_fd_, op, fd, &event);
+    }
+
+    void wait_ring(RingEndpoint &ring, bool write, std::coroutine_handle<> handle) {
+        (write ? ring.writers_ : ring.readers_).push_back(handle);
+        if (!ring.listed_) {
+            ring.listed_ = true;
+            rings_.push_back(&ring);
+            if (ring.wait_fd_ >= 0 && doorbells_[ring.wait_fd_]++ == 0) {
+                add_fd(ring.wait_fd_, EPOLLIN);
+            }
+        }
+    }
+
+    // Resume ring waiters whose condition holds, in FIFO order
+    void poll_rings() {
+        for (size_t i = 0; i < rings_.size(); i++) {
+            RingEndpoint *ring = rings_[i];
+
+            // Bounded by the waiters present now: a resumed task may wait again
+            for (size_t n = ring->readers_.size(); n > 0 && !ring->readers_.empty() && ring->readable(); n--) {
+                std::coroutine_handle<> handle = ring->readers_.front();
+                ring->readers_.pop_front();
+                resume(handle);
+            }
+            for (size_t n = ring->writers_.size(); n > 0 && !ring->writers_.empty() && ring->writable(); n--) {
+                std::coroutine_handle<> handle = ring->writers_.front();
+                ring->writers_.pop_front();
+                resume(handle);
+            }
+        }
+
+        // Forget rings nobody waits on any more
+        size_t kept = 0;
+        for (RingEndpoint *ring : rings_) {
+            if (ring->readers_.empty() && ring->writers_.empty()) {
+                ring->listed_ = false;
+                if (ring->wait_fd_ >= 0 && --doorbells_[ring->wait_fd_] == 0) {
+                    doorbells_.erase(ring->wait_fd_);
+                    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, ring->wait_fd_, nullptr);
+                }
+            } else {
+                rings_[kept++] = ring;
+            }
+        }
+        rings_.resize(kept);
+    }
+
+    // Poll on the timer only while a ring without doorbell has waiters
+    void update_timer() noexcept {
+        bool needed = false;
+        for (RingEndpoint *ring : rings_) {
+            if (ring->wait_fd_ < 0) {
+                needed = true;
+                break;
+            }
+        }
+        if (needed == timer_armed_) {
+            return;
+        }
+
+        itimerspec spec;
+        std::memset(&spec, 0, sizeof(spec));
+        if (needed) {
+            long long ns = poll_interval_.count() > 0 ? poll_interval_.count() : 1;
+            spec.it_interval.tv_sec = static_cast<time_t>(ns / 1000000000);
+            spec.it_interval.tv_nsec = static_cast<long>(ns % 1000000000);
+            spec.it_value = spec.it_interval;
+        }
+        timerfd_settime(timer_fd_, 0, &spec, nullptr);
+        timer_armed_ = needed;
+    }
+
+    static void drain(int fd) noexcept {
+        uint64_t value;
+        ssize_t ret = read(fd, &value, sizeof(value));
+        (void)ret;
+    }
+
+    void dispatch(int fd, uint32_t events) {
+        if (fd == wake_fd_) {
+            drain(fd);
+            return;
+        }
+        if (fd == timer_fd_) {
+            drain(fd);
+            stats_.timer_ticks++;
+            return;
+        }
+        if (doorbells_.count(fd) != 0) {
+            // poll_rings() on the next iteration checks the rings
+            drain(fd);
+            stats_.doorbells++;
+            return;
+        }
+
+        auto it = fds_.find(fd);
+        if (it == fds_.end()) {
+            return;
+        }
+
+        FdWaiters &waiters = it->second;
+        uint32_t failed = events & (EPOLLERR | EPOLLHUP);
+        if (waiters.reader && (events & (EPOLLIN | failed))) {
+            ready_.push_back(std::exchange(waiters.reader, {}));
+        }
+        if (waiters.writer && (events & (EPOLLOUT | failed))) {
+            ready_.push_back(std::exchange(waiters.writer, {}));
+        }
+        update_interest(fd, waiters);
+        if (waiters.events == 0) {
+            fds_.erase(it);
+        }
+    }
+
+    std::chrono::nanoseconds poll_interval_;
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;
+    int timer_fd_ = -1;
+    bool timer_armed_ = false;
+    std::atomic<bool> stop_{false};
+    std::deque<std::coroutine_handle<>> ready_;
+    std::unordered_set<void *> tasks_;         // Frames of spawned tasks
+    std::unordered_map<int, FdWaiters> fds_;
+    std::unordered_map<int, int> doorbells_;   // Ring wait_fd -> rings using it
+    std::vector<RingEndpoint *> rings_;        // Rings with waiters
+    LoopStats stats_;
+};
+
+inline void detail::Detached::promise_type::FinalAwaiter::await_suspend(
+    std::coroutine_handle<promise_type> handle) noexcept {
+    handle.promise().loop->tasks_.erase(handle.address());
+    handle.destroy();
+}
+
+// Receive the next message of a ring; returns 0 or -1
+inline Task<int> async_receive(EventLoop &loop, RingEndpoint &ring, void *buffer, size_t buffer_size, size_t *length) {
+    for (;;) {
+        int ret = pcie_flow_receive(ring.rx(), buffer, buffer_size, length);
+        if (ret != PCIE_FLOW_EMPTY) {
+            if (ret == 0) {
+                ring.notify();   // A credit went back to the peer
+            }
+            co_return ret;
+        }
+        co_await loop.ring_readable(ring);
+    }
+}
+
+// Publish a message once a credit is available; returns 0 or -1
+inline Task<int> async_send(EventLoop &loop, RingEndpoint &ring, const void *data, size_t length, uint32_t priority) {
+    while (!ring.writable()) {
+        co_await loop.ring_writable(ring);
+    }
+    int ret = pcie_flow_send(ring.tx(), data, length, priority);
+    if (ret == 0) {
+        ring.notify();
+    }
+    co_return ret;
+}
+
+// Non-blocking raw SocketCAN socket
+class CanSocket {
+public:
+    // Open and bind a CAN interface such as "can0" or "vcan0"
+    explicit CanSocket(const char *ifname) {
+        fd_ = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_RAW);
+        if (fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "Failed to open CAN socket");
+        }
+
+        struct ifreq ifr;
+        std::memset(&ifr, 0, sizeof(ifr));
+        std::strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+        struct sockaddr_can addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.can_family = AF_CAN;
+
+        if (ioctl(fd_, SIOCGIFINDEX, &ifr) < 0 ||
+            (addr.can_ifindex = ifr.ifr_ifindex,
+             bind(fd_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0)) {
+            int err = errno;
+            close(fd_);
+            throw std::system_error(err, std::generic_category(), "Failed to bind CAN socket");
+        }
+    }
+
+    // Adopt a descriptor that exchanges struct can_frame datagrams
+    explicit CanSocket(int fd) : fd_(fd) {
+        int flags = fcntl(fd_, F_GETFL);
+        if (flags < 0 || fcntl(fd_, F_SETFL, flags | O_NONBLOCK) < 0) {
+            int err = errno;
+            close(fd_);
+            throw std::system_error(err, std::generic_category(), "Failed to make CAN socket non-blocking");
+        }
+    }
+
+    CanSocket(CanSocket &&other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+    CanSocket(const CanSocket &) = delete;
+    CanSocket &operator=(const CanSocket &) = delete;
+
+    ~CanSocket() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    int fd() const noexcept { return fd_; }
+
+private:
+    int fd_ = -1;
+};
+
+// Write one CAN frame, waiting while the socket buffer is full; returns 0 or -1
+inline Task<int> async_send(EventLoop &loop, CanSocket &socket, const can_message_t &msg) {
+    struct can_frame frame;
+    std::memset(&frame, 0, sizeof(frame));
+    frame.can_id = msg.can_id;
+    frame.can_dlc = msg.can_dlc <= CAN_MAX_DLEN ? msg.can_dlc : CAN_MAX_DLEN;
+    std::memcpy(frame.data, msg.data, frame.can_dlc);
+
+    for (;;) {
+        ssize_t ret = write(socket.fd(), &frame, sizeof(frame));
+        if (ret == static_cast<ssize_t>(sizeof(frame))) {
+            co_return 0;
+        }
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+            co_await loop.writable(socket.fd());
+            continue;
+        }
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        pcie_log("Async", "Error: Failed to write CAN frame.");
+        co_return -1;
+    }
+}
+
+// Read the next CAN frame; returns 0 or -1
+inline Task<int> async_receive(EventLoop &loop, CanSocket &socket, can_message_t &msg) {
+    for (;;) {
+        struct can_frame frame;
+        ssize_t ret = read(socket.fd(), &frame, sizeof(frame));
+        if (ret == static_cast<ssize_t>(sizeof(frame))) {
+            std::memset(&msg, 0, sizeof(msg));
+            msg.can_id = frame.can_id;
+            msg.can_dlc = frame.can_dlc <= CAN_MAX_DLEN ? frame.can_dlc : CAN_MAX_DLEN;
+            std::memcpy(msg.data, frame.data, msg.can_dlc);
+            co_return 0;
+        }
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            co_await loop.readable(socket.fd());
+            continue;
+        }
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        pcie_log("Async", "Error: Failed to read CAN frame.");
+        co_return -1;
+    }
+}
+
+} // namespace pcie::async
+
+#endif // PCIE_ASYNC_HPP
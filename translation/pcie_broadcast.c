@@ -0,0 +1,376 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pcie_common.h"
+#include "pcie_broadcast.h"
+
+// Slots are padded to whole cache lines
+#define BROADCAST_SLOT_SIZE \
+    ((sizeof(pcie_broadcast_slot_t) + PCIE_BROADCAST_MAX_PAYLOAD + 63) & ~(size_t)63)
+
+// Attempts to resynchronize after being lapped before reporting empty
+#define BROADCAST_MAX_RESYNC 4
+
+// copy_slot() result when the publisher overwrote the slot
+#define BROADCAST_SLOT_LAPPED 2
+
+static inline pcie_broadcast_slot_t *slot_at(const pcie_broadcast_t *ring, uint64_t index) {
+    return (pcie_broadcast_slot_t *)(ring->region + sizeof(pcie_broadcast_ctrl_t) +
+                                     (size_t)(index & (ring->slot_count - 1)) * ring->slot_size);
+}
+
+static inline uint8_t *slot_payload(pcie_broadcast_slot_t *slot) {
+    return (uint8_t *)slot + sizeof(pcie_broadcast_slot_t);
+}
+
+static int set_name(pcie_broadcast_t *ring, const char *name) {
+    if (name == NULL || name[0] != '/' || strlen(name) >= sizeof(ring->name)) {
+        pcie_log("Broadcast", "Error: Ring name must start with '/' and fit 63 characters.");
+        return -1;
+    }
+    strcpy(ring->name, name);
+    return 0;
+}
+
+// Make subscribers of a segment that is being replaced attach again: they
+// report a size change once the slot count no longer matches. Returns the
+// generation the segment had reached.
+static uint64_t retire_segment(int fd, size_t size) {
+    if (size < sizeof(pcie_broadcast_ctrl_t)) {
+        return 0;
+    }
+    void *region = mmap(NULL, sizeof(pcie_broadcast_ctrl_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (region == MAP_FAILED) {
+        return 0;
+    }
+    pcie_broadcast_ctrl_t *ctrl = (pcie_broadcast_ctrl_t *)region;
+    uint64_t generation = pcie_load_acquire(&ctrl->generation);
+    __atomic_store_n(&ctrl->slot_count, 0, __ATOMIC_RELEASE);
+    munmap(region, sizeof(pcie_broadcast_ctrl_t));
+    return generation;
+}
+
+// Create (or take over) a ring
+int pcie_broadcast_create(pcie_broadcast_t *ring, const char *name, uint32_t slot_count) {
+    if (ring == NULL) {
+        pcie_log("Broadcast", "Error: Invalid arguments for ring creation.");
+        return -1;
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    if (set_name(ring, name) != 0) {
+        return -1;
+    }
+
+    if (slot_count == 0) {
+        slot_count = PCIE_BROADCAST_DEFAULT_SLOTS;
+    }
+    if (slot_count < 2 || (slot_count & (slot_count - 1)) != 0) {
+        pcie_log("Broadcast", "Error: Slot count must be a power of two.");
+        return -1;
+    }
+
+    ring->slot_count = slot_count;
+    ring->slot_size = (uint32_t)BROADCAST_SLOT_SIZE;
+    ring->region_size = sizeof(pcie_broadcast_ctrl_t) + (size_t)slot_count * ring->slot_size;
+    ring->publisher = 1;
+
+    ring->fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (ring->fd < 0) {
+        pcie_log("Broadcast", "Error: Failed to open shared memory.");
+        return -1;
+    }
+
+    // Shrinking a segment that subscribers still map would fault them with
+    // SIGBUS, so a ring of another size goes to a new segment under the same
+    // name; subscribers of the old one keep a valid mapping
+    struct stat st;
+    if (fstat(ring->fd, &st) != 0) {
+        pcie_log("Broadcast", "Error: Failed to size shared memory.");
+        pcie_broadcast_close(ring);
+        return -1;
+    }
+    uint64_t retired_generation = 0;
+    if (st.st_size != 0 && (size_t)st.st_size != ring->region_size) {
+        retired_generation = retire_segment(ring->fd, (size_t)st.st_size);
+        close(ring->fd);
+        shm_unlink(name);
+        ring->fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (ring->fd < 0) {
+            pcie_log("Broadcast", "Error: Failed to replace shared memory of another size.");
+            ring->publisher = 0;
+            return -1;
+        }
+        st.st_size = 0;
+    }
+    if (st.st_size == 0 && ftruncate(ring->fd, (off_t)ring->region_size) != 0) {
+        pcie_log("Broadcast", "Error: Failed to size shared memory.");
+        pcie_broadcast_close(ring);
+        return -1;
+    }
+
+    void *region = mmap(NULL, ring->region_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+    if (region == MAP_FAILED) {
+        pcie_log("Broadcast", "Error: Failed to map shared memory.");
+        pcie_broadcast_close(ring);
+        return -1;
+    }
+    ring->region = (uint8_t *)region;
+    ring->ctrl = (pcie_broadcast_ctrl_t *)region;
+
+    // Subscribers of a previous publisher see no valid ring while it is
+    // reformatted, then restart from the head of the new generation
+    pcie_broadcast_ctrl_t *ctrl = ring->ctrl;
+    if (retired_generation != 0) {
+        pcie_store_release(&ctrl->generation, retired_generation);
+    }
+    ring->generation = pcie_load_acquire(&ctrl->generation) + 1;
+    __atomic_store_n(&ctrl->magic, 0, __ATOMIC_RELEASE);
+    for (uint32_t i = 0; i < slot_count; i++) {
+        pcie_store_release(&slot_at(ring, i)->seq, 0);
+    }
+    ctrl->version = PCIE_BROADCAST_VERSION;
+    ctrl->slot_count = slot_count;
+    ctrl->slot_size = ring->slot_size;
+    ctrl->publisher_pid = (uint64_t)getpid();
+    pcie_store_release(&ctrl->head, 0);
+    pcie_store_release(&ctrl->generation, ring->generation);
+    __atomic_store_n(&ctrl->magic, PCIE_BROADCAST_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Map an existing ring read-only
+int pcie_broadcast_attach(pcie_broadcast_t *ring, const char *name) {
+    if (ring == NULL) {
+        pcie_log("Broadcast", "Error: Invalid arguments for attaching.");
+        return -1;
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    if (set_name(ring, name) != 0) {
+        return -1;
+    }
+
+    ring->fd = shm_open(name, O_RDONLY, 0);
+    if (ring->fd < 0) {
+        pcie_log("Broadcast", "Error: Ring does not exist.");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(ring->fd, &st) != 0 || (size_t)st.st_size < sizeof(pcie_broadcast_ctrl_t)) {
+        pcie_log("Broadcast", "Error: Ring is not formatted.");
+        pcie_broadcast_close(ring);
+        return -1;
+    }
+    ring->region_size = (size_t)st.st_size;
+
+    void *region = mmap(NULL, ring->region_size, PROT_READ, MAP_SHARED, ring->fd, 0);
+    if (region == MAP_FAILED) {
+        pcie_log("Broadcast", "Error: Failed to map shared memory.");
+        pcie_broadcast_close(ring);
+        return -1;
+    }
+    ring->region = (uint8_t *)region;
+    ring->ctrl = (pcie_broadcast_ctrl_t *)region;
+
+    const pcie_broadcast_ctrl_t *ctrl = ring->ctrl;
+    if (__atomic_load_n(&ctrl->magic, __ATOMIC_ACQUIRE) != PCIE_BROADCAST_MAGIC ||
+        ctrl->version != PCIE_BROADCAST_VERSION) {
+        pcie_log("Broadcast", "Error: Ring is not formatted.");
+        pcie_broadcast_close(ring);
+        return -1;
+    }
+
+    uint32_t slot_count = ctrl->slot_count;
+    if (slot_count < 2 || (slot_count & (slot_count - 1)) != 0 || ctrl->slot_size != BROADCAST_SLOT_SIZE ||
+        sizeof(pcie_broadcast_ctrl_t) + (size_t)slot_count * ctrl->slot_size > ring->region_size) {
+        pcie_log("Broadcast", "Error: Ring geometry does not fit the mapped region.");
+        pcie_broadcast_close(ring);
+        return -1;
+    }
+    ring->slot_count = slot_count;
+    ring->slot_size = ctrl->slot_size;
+    ring->generation = pcie_load_acquire(&ctrl->generation);
+    ring->index = pcie_load_acquire(&ctrl->head);
+    return 0;
+}
+
+// Unmap the ring; the publisher also removes its name
+void pcie_broadcast_close(pcie_broadcast_t *ring) {
+    if (ring == NULL) {
+        return;
+    }
+    if (ring->region != NULL) {
+        munmap(ring->region, ring->region_size);
+        ring->region = NULL;
+        ring->ctrl = NULL;
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+        ring->fd = -1;
+    }
+    if (ring->publisher && ring->name[0] != '\0') {
+        shm_unlink(ring->name);
+        ring->publisher = 0;
+    }
+}
+
+// Publish a bus message
+int pcie_broadcast_publish(pcie_broadcast_t *ring, const bus_message_t *msg, uint32_t zone_id, uint32_t device_id) {
+    if (ring == NULL || !ring->publisher || ring->ctrl == NULL || msg == NULL) {
+        pcie_log("Broadcast", "Error: Ring not initialized for publishing.");
+        return -1;
+    }
+
+    size_t payload_len = 0;
+    if (msg->type == MSG_TYPE_ETHERNET) {
+        payload_len = msg->data.ethernet.data_len;
+        if (payload_len > PCIE_BROADCAST_MAX_PAYLOAD ||
+            (payload_len > 0 && msg->data.ethernet.data == NULL)) {
+            ring->stats.too_large++;
+            pcie_log("Broadcast", "Error: Ethernet payload cannot be published.");
+            return -1;
+        }
+    }
+
+    // Mark the slot as being written, fill it, then commit it
+    uint64_t index = ring->index;
+    uint64_t seq = 2 * (index + 1);
+    pcie_broadcast_slot_t *slot = slot_at(ring, index);
+    pcie_store_release(&slot->seq, seq - 1);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->timestamp_ns = pcie_time_ns();
+    slot->zone_id = zone_id;
+    slot->device_id = device_id;
+    slot->payload_len = (uint32_t)payload_len;
+    slot->message = *msg;
+    if (msg->type == MSG_TYPE_ETHERNET) {
+        slot->message.data.ethernet.data = NULL;
+        memcpy(slot_payload(slot), msg->data.ethernet.data, payload_len);
+    }
+    pcie_store_release(&slot->seq, seq);
+
+    ring->index = index + 1;
+    pcie_store_release(&ring->ctrl->head, ring->index);
+    ring->stats.published++;
+    return 0;
+}
+
+// Receive one message from the link and publish it
+int pcie_broadcast_forward(pcie_broadcast_t *ring) {
+    bus_message_t msg;
+    uint32_t zone_id = 0;
+    uint32_t device_id = 0;
+
+    int ret = pcie_receive_bus_message(&msg, &zone_id, &device_id);
+    if (ret != 0) {
+        return ret;
+    }
+    return pcie_broadcast_publish(ring, &msg, zone_id, device_id);
+}
+
+// Records published but not yet read by this subscriber
+uint64_t pcie_broadcast_pending(const pcie_broadcast_t *ring) {
+    if (ring == NULL || ring->ctrl == NULL ||
+        __atomic_load_n(&ring->ctrl->magic, __ATOMIC_ACQUIRE) != PCIE_BROADCAST_MAGIC) {
+        return 0;
+    }
+    uint64_t head = pcie_load_acquire(&ring->ctrl->head);
+    return head > ring->index ? head - ring->index : 0;
+}
+
+// Copy the slot of record index; returns 0, PCIE_BROADCAST_EMPTY (not
+// published yet) or BROADCAST_SLOT_LAPPED
+static int copy_slot(pcie_broadcast_t *ring, uint64_t index, pcie_broadcast_record_t *record) {
+    uint64_t expected = 2 * (index + 1);
+    pcie_broadcast_slot_t *slot = slot_at(ring, index);
+    uint64_t seq = pcie_load_acquire(&slot->seq);
+
+    if (seq < expected) {
+        // Older record or still being written
+        return PCIE_BROADCAST_EMPTY;
+    }
+    if (seq > expected) {
+        return BROADCAST_SLOT_LAPPED;
+    }
+
+    record->sequence = index;
+    record->timestamp_ns = slot->timestamp_ns;
+    record->zone_id = slot->zone_id;
+    record->device_id = slot->device_id;
+    record->message = slot->message;
+    uint32_t payload_len = slot->payload_len;
+    if (record->message.type == MSG_TYPE_ETHERNET) {
+        // A torn length from a concurrent overwrite is caught by the check below
+        if (payload_len > PCIE_BROADCAST_MAX_PAYLOAD) {
+            payload_len = PCIE_BROADCAST_MAX_PAYLOAD;
+        }
+        memcpy(record->payload, slot_payload(slot), payload_len);
+        record->message.data.ethernet.data = record->payload;
+        record->message.data.ethernet.data_len = payload_len;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    // Only accept the copy if the publisher did not overwrite it meanwhile
+    return pcie_load_acquire(&slot->seq) == expected ? 0 : BROADCAST_SLOT_LAPPED;
+}
+
+// Lapped by the publisher: skip to the oldest intact record
+static void resync(pcie_broadcast_t *ring) {
+    uint64_t head = pcie_load_acquire(&ring->ctrl->head);
+    uint64_t oldest = head >= ring->slot_count ? head - ring->slot_count + 1 : 0;
+    ring->stats.lapped++;
+    if (oldest > ring->index) {
+        ring->stats.lost += oldest - ring->index;
+        ring->index = oldest;
+    }
+}
+
+// Read the next record
+int pcie_broadcast_read(pcie_broadcast_t *ring, pcie_broadcast_record_t *record) {
+    if (ring == NULL || ring->ctrl == NULL || ring->publisher || record == NULL) {
+        pcie_log("Broadcast", "Error: Ring not initialized for reading.");
+        return -1;
+    }
+
+    const pcie_broadcast_ctrl_t *ctrl = ring->ctrl;
+    if (__atomic_load_n(&ctrl->magic, __ATOMIC_ACQUIRE) != PCIE_BROADCAST_MAGIC) {
+        return PCIE_BROADCAST_EMPTY;
+    }
+    if (ctrl->slot_count != ring->slot_count) {
+        pcie_log("Broadcast", "Error: Ring was recreated with a different size, attach again.");
+        return -1;
+    }
+
+    // The publisher restarted and reformatted the ring: follow it from its
+    // first record. The head alone cannot tell, it is advanced only after a
+    // record is committed, so a subscriber may briefly be one record ahead.
+    uint64_t generation = pcie_load_acquire(&ctrl->generation);
+    if (generation != ring->generation) {
+        ring->generation = generation;
+        ring->index = 0;
+    }
+
+    for (int attempt = 0; attempt < BROADCAST_MAX_RESYNC; attempt++) {
+        int ret = copy_slot(ring, ring->index, record);
+        if (ret == PCIE_BROADCAST_EMPTY) {
+            return ret;
+        }
+        if (ret == BROADCAST_SLOT_LAPPED) {
+            resync(ring);
+            continue;
+        }
+        ring->index++;
+        ring->stats.received++;
+        return 0;
+    }
+    return PCIE_BROADCAST_EMPTY;
+}
@@ -0,0 +1,128 @@
+#ifndef PCIE_BROADCAST_H
+#define PCIE_BROADCAST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pcie_translation.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Shared-memory fan-out of received bus traffic to local consumer processes.
+//
+// One publisher (the process that owns the PCIe link) writes every decoded
+// bus message once into a POSIX shared-memory ring. Any number of
+// subscribers (ADAS, logging, diagnostics, ...) map the ring read-only and
+// follow it at their own pace with a private cursor; they never write to
+// the ring, so they share no locks or counters with each other or with the
+// publisher.
+//
+// The publisher never waits for subscribers. Slots carry a sequence counter
+// (see pcie_common.h) that also encodes the record index, so a subscriber
+// that falls more than a ring behind sees a newer sequence in its next slot,
+// skips ahead to the oldest intact record and counts the records it lost.
+
+// Default number of slots (power of two)
+#define PCIE_BROADCAST_DEFAULT_SLOTS 4096
+
+// Largest payload carried inline (standard Ethernet frame)
+#define PCIE_BROADCAST_MAX_PAYLOAD 1536
+
+// Marker written by the publisher once the ring is formatted ("PCBR")
+#define PCIE_BROADCAST_MAGIC 0x50434252u
+#define PCIE_BROADCAST_VERSION 1
+
+// Return code of pcie_broadcast_read() when no new record is available
+#define PCIE_BROADCAST_EMPTY 1
+
+// Control block at the start of the shared region
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint64_t publisher_pid;
+    uint64_t generation;         // Incremented every time a publisher formats the ring
+    uint8_t pad0[32];
+    uint64_t head;               // Records published (written by the publisher)
+    uint8_t pad1[56];
+} pcie_broadcast_ctrl_t;
+
+// Slot header, followed by payload_len bytes of Ethernet payload
+typedef struct {
+    uint64_t seq;                // 2*(index+1)-1 while written, 2*(index+1) once committed
+    uint64_t timestamp_ns;       // Publish time (monotonic clock)
+    uint32_t zone_id;
+    uint32_t device_id;
+    uint32_t payload_len;
+    uint32_t reserved;
+    bus_message_t message;       // Ethernet data pointer is not shared
+} pcie_broadcast_slot_t;
+
+// A record as delivered to a subscriber
+typedef struct {
+    uint64_t sequence;           // Publish index, gaps mean records were lost
+    uint64_t timestamp_ns;
+    uint32_t zone_id;
+    uint32_t device_id;
+    bus_message_t message;       // Ethernet data points into payload
+    uint8_t payload[PCIE_BROADCAST_MAX_PAYLOAD];
+} pcie_broadcast_record_t;
+
+typedef struct {
+    uint64_t published;          // Publisher: records written
+    uint64_t too_large;          // Publisher: records rejected for their payload size
+    uint64_t received;           // Subscriber: records read
+    uint64_t lapped;             // Subscriber: times the publisher overtook the cursor
+    uint64_t lost;               // Subscriber: records skipped after being lapped
+} pcie_broadcast_stats_t;
+
+// Local view of a ring, as publisher or subscriber
+typedef struct {
+    int fd;
+    uint8_t *region;
+    size_t region_size;
+    pcie_broadcast_ctrl_t *ctrl;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint64_t index;              // Next record to write (publisher) or read (subscriber)
+    uint64_t generation;         // Ring generation the index refers to
+    int publisher;
+    char name[64];
+    pcie_broadcast_stats_t stats;
+} pcie_broadcast_t;
+
+// Create (or take over) the shared-memory ring name, e.g. "/pcie_bus", with
+// slot_count slots (power of two, 0 selects the default). An existing ring
+// of another size is replaced by a new segment, never resized in place;
+// its subscribers get -1 from pcie_broadcast_read() and attach again.
+int pcie_broadcast_create(pcie_broadcast_t *ring, const char *name, uint32_t slot_count);
+
+// Map an existing ring read-only; the cursor starts at the newest record,
+// so only records published from now on are delivered
+int pcie_broadcast_attach(pcie_broadcast_t *ring, const char *name);
+
+// Unmap the ring; the publisher also removes its name
+void pcie_broadcast_close(pcie_broadcast_t *ring);
+
+// Publish a bus message; returns 0 or -1 (payload too large)
+int pcie_broadcast_publish(pcie_broadcast_t *ring, const bus_message_t *msg, uint32_t zone_id, uint32_t device_id);
+
+// Receive one message with pcie_receive_bus_message() and publish it;
+// returns 0, PCIE_FLOW_EMPTY or -1
+int pcie_broadcast_forward(pcie_broadcast_t *ring);
+
+// Records published but not yet read by this subscriber
+uint64_t pcie_broadcast_pending(const pcie_broadcast_t *ring);
+
+// Read the next record; returns 0, PCIE_BROADCAST_EMPTY or -1. A lapped
+// subscriber is moved to the oldest intact record first (see stats.lost),
+// after a publisher restart it continues with the first new record.
+int pcie_broadcast_read(pcie_broadcast_t *ring, pcie_broadcast_record_t *record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PCIE_BROADCAST_H
@@ -0,0 +1,589 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "pcie_common.h"
+#include "pcie_capture.h"
+
+#define RECORD_SIZE sizeof(pcie_capture_record_t)
+#define CHUNK_HEADER_SIZE sizeof(pcie_capture_chunk_header_t)
+
+// Write a whole buffer, retrying on short writes
+static int write_all(int fd, const void *data, size_t length) {
+    const uint8_t *ptr = (const uint8_t *)data;
+
+    while (length > 0) {
+        ssize_t n = write(fd, ptr, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        ptr += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+static inline pcie_capture_record_t *buffer_records(uint8_t *buffer) {
+    return (pcie_capture_record_t *)(buffer + CHUNK_HEADER_SIZE);
+}
+
+static int append_index(pcie_capture_writer_t *writer, const pcie_capture_index_entry_t *entry) {
+    if (writer->index_count == writer->index_capacity) {
+        uint64_t capacity = writer->index_capacity ? writer->index_capacity * 2 : 64;
+        pcie_capture_index_entry_t *index = (pcie_capture_index_entry_t *)realloc(
+            writer->index, capacity * sizeof(pcie_capture_index_entry_t));
+        if (index == NULL) {
+            return -1;
+        }
+        writer->index = index;
+        writer->index_capacity = capacity;
+    }
+
+    writer->index[writer->index_count++] = *entry;
+    return 0;
+}
+
+// Hand the fill buffer to the flush thread; called with the lock held
+static void seal_chunk(pcie_capture_writer_t *writer) {
+    uint8_t *buffer = writer->buffers[writer->fill_buffer];
+    pcie_capture_record_t *records = buffer_records(buffer);
+    pcie_capture_chunk_header_t *header = (pcie_capture_chunk_header_t *)buffer;
+
+    header->magic = PCIE_CAPTURE_CHUNK_MAGIC;
+    header->record_count = writer->fill_count;
+    header->first_ns = records[0].timestamp_ns;
+    header->last_ns = records[writer->fill_count - 1].timestamp_ns;
+    header->reserved = 0;
+
+    __atomic_store_n(&writer->full[writer->fill_buffer], 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&writer->cond);
+
+    writer->written += writer->fill_count;
+    writer->fill_buffer = (writer->fill_buffer + 1) % PCIE_CAPTURE_BUFFERS;
+    writer->fill_count = 0;
+}
+
+// Wait for a sealed buffer, sealing a partial chunk that got too old on the
+// way so a quiet bus does not keep its last records in memory; called and
+// returns with the lock held
+static void wait_for_chunk(pcie_capture_writer_t *writer) {
+    while (!writer->full[writer->flush_buffer] && !writer->stop) {
+        uint64_t now = pcie_time_ns();
+        if (writer->fill_count > 0 && now - writer->fill_started_ns >= PCIE_CAPTURE_FLUSH_INTERVAL_NS) {
+            seal_chunk(writer);
+            continue;
+        }
+
+        uint64_t deadline = (writer->fill_count > 0 ? writer->fill_started_ns : now) + PCIE_CAPTURE_FLUSH_INTERVAL_NS;
+        struct timespec ts;
+        ts.tv_sec = (time_t)(deadline / 1000000000ull);
+        ts.tv_nsec = (long)(deadline % 1000000000ull);
+        pthread_cond_timedwait(&writer->cond, &writer->lock, &ts);
+    }
+}
+
+// Background thread writing sealed chunks in order
+static void *flush_thread(void *arg) {
+    pcie_capture_writer_t *writer = (pcie_capture_writer_t *)arg;
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        wait_for_chunk(writer);
+        if (!writer->full[writer->flush_buffer]) {
+            break;
+        }
+        pthread_mutex_unlock(&writer->lock);
+
+        // The sealed buffer is owned by this thread until it is marked free
+        uint8_t *buffer = writer->buffers[writer->flush_buffer];
+        const pcie_capture_chunk_header_t *header = (const pcie_capture_chunk_header_t *)buffer;
+        size_t bytes = CHUNK_HEADER_SIZE + (size_t)header->record_count * RECORD_SIZE;
+
+        pcie_capture_index_entry_t entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.offset = writer->file_offset;
+        entry.first_ns = header->first_ns;
+        entry.last_ns = header->last_ns;
+        entry.record_count = header->record_count;
+
+        if (write_all(writer->fd, buffer, bytes) != 0 || append_index(writer, &entry) != 0) {
+            pcie_log("Capture", "Error: Failed to write capture chunk.");
+            __atomic_store_n(&writer->io_error, 1, __ATOMIC_RELEASE);
+        }
+        writer->file_offset += bytes;
+
+        pthread_mutex_lock(&writer->lock);
+        __atomic_store_n(&writer->full[writer->flush_buffer], 0, __ATOMIC_RELEASE);
+        writer->flush_buffer = (writer->flush_buffer + 1) % PCIE_CAPTURE_BUFFERS;
+        pthread_cond_broadcast(&writer->cond);
+    }
+    pthread_mutex_unlock(&writer->lock);
+
+    return NULL;
+}
+
+static void free_writer(pcie_capture_writer_t *writer) {
+    for (int i = 0; i < PCIE_CAPTURE_BUFFERS; i++) {
+        free(writer->buffers[i]);
+        writer->buffers[i] = NULL;
+    }
+    free(writer->index);
+    writer->index = NULL;
+    if (writer->fd >= 0) {
+        close(writer->fd);
+        writer->fd = -1;
+    }
+}
+
+// Create a capture file and start the flush thread
+int pcie_capture_writer_open(pcie_capture_writer_t *writer, const char *path, size_t chunk_records) {
+    if (writer == NULL || path == NULL) {
+        pcie_log("Capture", "Error: Invalid arguments for capture writer.");
+        return -1;
+    }
+
+    memset(writer, 0, sizeof(*writer));
+    writer->chunk_records = chunk_records ? chunk_records : PCIE_CAPTURE_DEFAULT_CHUNK_RECORDS;
+    writer->chunk_bytes = CHUNK_HEADER_SIZE + writer->chunk_records * RECORD_SIZE;
+
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        pcie_log("Capture", "Error: Failed to create capture file.");
+        fprintf(stderr, "Open failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    pcie_capture_file_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PCIE_CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = PCIE_CAPTURE_VERSION;
+    header.record_size = RECORD_SIZE;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    header.created_ns = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+
+    if (write_all(writer->fd, &header, sizeof(header)) != 0) {
+        pcie_log("Capture", "Error: Failed to write capture header.");
+        free_writer(writer);
+        return -1;
+    }
+    writer->file_offset = sizeof(header);
+
+    for (int i = 0; i < PCIE_CAPTURE_BUFFERS; i++) {
+        writer->buffers[i] = (uint8_t *)malloc(writer->chunk_bytes);
+        if (writer->buffers[i] == NULL) {
+            pcie_log("Capture", "Error: Failed to allocate capture buffers.");
+            free_writer(writer);
+            return -1;
+        }
+    }
+
+    // Timed waits of the flush thread use the clock of pcie_time_ns()
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&writer->thread, NULL, flush_thread, writer) != 0) {
+        pcie_log("Capture", "Error: Failed to start capture flush thread.");
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->cond);
+        free_writer(writer);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Append a record; never blocks on disk I/O. The lock is shared with the
+// flush thread only for bookkeeping, never while it writes.
+int pcie_capture_write(pcie_capture_writer_t *writer, const pcie_capture_record_t *record) {
+    if (writer == NULL || record == NULL || writer->fd < 0 ||
+        __atomic_load_n(&writer->io_error, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&writer->lock);
+
+    // All buffers are still queued for the disk, drop instead of stalling the gateway
+    if (writer->fill_count == 0 && writer->full[writer->fill_buffer]) {
+        writer->dropped++;
+        pthread_mutex_unlock(&writer->lock);
+        return PCIE_CAPTURE_DROPPED;
+    }
+
+    if (writer->fill_count == 0) {
+        writer->fill_started_ns = pcie_time_ns();
+    }
+    pcie_capture_record_t *records = buffer_records(writer->buffers[writer->fill_buffer]);
+    pcie_capture_record_t *slot = &records[writer->fill_count++];
+    memcpy(slot, record, sizeof(*slot));
+    if (slot->message.type == MSG_TYPE_ETHERNET) {
+        // The payload lives outside the record; keep the header consistent
+        // so a replay never sends a length without data
+        if (slot->message.data.ethernet.data_len > 0) {
+            writer->truncated++;
+        }
+        slot->message.data.ethernet.data = NULL;
+        slot->message.data.ethernet.data_len = 0;
+    }
+
+    if (writer->fill_count == writer->chunk_records ||
+        record->timestamp_ns - records[0].timestamp_ns >= PCIE_CAPTURE_FLUSH_INTERVAL_NS) {
+        seal_chunk(writer);
+    }
+
+    pthread_mutex_unlock(&writer->lock);
+    return 0;
+}
+
+// Hand the partial chunk to the flush thread and wait until everything is on disk
+int pcie_capture_writer_flush(pcie_capture_writer_t *writer) {
+    if (writer == NULL || writer->fd < 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    if (writer->fill_count > 0) {
+        seal_chunk(writer);
+    }
+    for (int i = 0; i < PCIE_CAPTURE_BUFFERS; i++) {
+        while (writer->full[i]) {
+            pthread_cond_wait(&writer->cond, &writer->lock);
+        }
+    }
+    pthread_mutex_unlock(&writer->lock);
+
+    return __atomic_load_n(&writer->io_error, __ATOMIC_ACQUIRE) ? -1 : 0;
+}
+
+// Flush, append the chunk index and close the file
+int pcie_capture_writer_close(pcie_capture_writer_t *writer) {
+    if (writer == NULL || writer->fd < 0) {
+        return -1;
+    }
+
+    int ret = pcie_capture_writer_flush(writer);
+
+    pthread_mutex_lock(&writer->lock);
+    writer->stop = 1;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->cond);
+
+    if (ret == 0) {
+        pcie_capture_trailer_t trailer;
+        memset(&trailer, 0, sizeof(trailer));
+        trailer.magic = PCIE_CAPTURE_INDEX_MAGIC;
+        trailer.index_offset = writer->file_offset;
+        trailer.chunk_count = writer->index_count;
+
+        if (write_all(writer->fd, writer->index, writer->index_count * sizeof(pcie_capture_index_entry_t)) != 0 ||
+            write_all(writer->fd, &trailer, sizeof(trailer)) != 0) {
+            pcie_log("Capture", "Error: Failed to write capture index.");
+            ret = -1;
+        }
+    }
+
+    free_writer(writer);
+    return ret;
+}
+
+// Walk the chunk headers of a file without index
+static int rebuild_index(pcie_capture_reader_t *reader) {
+    uint64_t capacity = 0;
+    uint64_t offset = sizeof(pcie_capture_file_header_t);
+
+    while (offset + CHUNK_HEADER_SIZE <= reader->size) {
+        const pcie_capture_chunk_header_t *header = (const pcie_capture_chunk_header_t *)(reader->map + offset);
+        uint64_t bytes = CHUNK_HEADER_SIZE + (uint64_t)header->record_count * RECORD_SIZE;
+
+        // Stop at the index or at a chunk cut short by a crash
+        if (header->magic != PCIE_CAPTURE_CHUNK_MAGIC || offset + bytes > reader->size) {
+            break;
+        }
+
+        if (reader->chunk_count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            pcie_capture_index_entry_t *index = (pcie_capture_index_entry_t *)realloc(
+                reader->rebuilt_index, capacity * sizeof(pcie_capture_index_entry_t));
+            if (index == NULL) {
+                return -1;
+            }
+            reader->rebuilt_index = index;
+        }
+
+        pcie_capture_index_entry_t *entry = &reader->rebuilt_index[reader->chunk_count++];
+        memset(entry, 0, sizeof(*entry));
+        entry->offset = offset;
+        entry->first_ns = header->first_ns;
+        entry->last_ns = header->last_ns;
+        entry->record_count = header->record_count;
+        offset += bytes;
+    }
+
+    reader->index = reader->rebuilt_index;
+    return 0;
+}
+
+// Check that every index entry points at an intact chunk before data_end
+static int validate_index(const pcie_capture_reader_t *reader, const pcie_capture_index_entry_t *index,
+                          uint64_t chunk_count, uint64_t data_end) {
+    for (uint64_t i = 0; i < chunk_count; i++) {
+        uint64_t offset = index[i].offset;
+        if (offset < sizeof(pcie_capture_file_header_t) || offset > data_end ||
+            data_end - offset < CHUNK_HEADER_SIZE ||
+            (data_end - offset - CHUNK_HEADER_SIZE) / RECORD_SIZE < index[i].record_count) {
+            return -1;
+        }
+
+        const pcie_capture_chunk_header_t *header = (const pcie_capture_chunk_header_t *)(reader->map + offset);
+        if (header->magic != PCIE_CAPTURE_CHUNK_MAGIC || header->record_count != index[i].record_count) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Map a capture file and load or rebuild its chunk index
+int pcie_capture_reader_open(pcie_capture_reader_t *reader, const char *path) {
+    if (reader == NULL || path == NULL) {
+        pcie_log("Capture", "Error: Invalid arguments for capture reader.");
+        return -1;
+    }
+
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = open(path, O_RDONLY);
+    if (reader->fd < 0) {
+        pcie_log("Capture", "Error: Failed to open capture file.");
+        fprintf(stderr, "Open failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(reader->fd, &st) != 0 || (size_t)st.st_size < sizeof(pcie_capture_file_header_t)) {
+        pcie_log("Capture", "Error: Capture file is truncated.");
+        close(reader->fd);
+        reader->fd = -1;
+        return -1;
+    }
+    reader->size = (size_t)st.st_size;
+
+    void *map = mmap(NULL, reader->size, PROT_READ, MAP_SHARED, reader->fd, 0);
+    if (map == MAP_FAILED) {
+        pcie_log("Capture", "Error: Failed to memory map capture file.");
+        close(reader->fd);
+        reader->fd = -1;
+        return -1;
+    }
+    reader->map = (const uint8_t *)map;
+    posix_madvise(map, reader->size, POSIX_MADV_SEQUENTIAL);
+
+    const pcie_capture_file_header_t *header = (const pcie_capture_file_header_t *)reader->map;
+    if (memcmp(header->magic, PCIE_CAPTURE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->record_size != RECORD_SIZE) {
+        pcie_log("Capture", "Error: Not a capture file of this version.");
+        pcie_capture_reader_close(reader);
+        return -1;
+    }
+
+    // Use the appended index if the file was closed cleanly
+    int indexed = 0;
+    if (reader->size >= sizeof(pcie_capture_file_header_t) + sizeof(pcie_capture_trailer_t)) {
+        const pcie_capture_trailer_t *trailer =
+            (const pcie_capture_trailer_t *)(reader->map + reader->size - sizeof(pcie_capture_trailer_t));
+        size_t index_space = reader->size - sizeof(pcie_capture_file_header_t) - sizeof(pcie_capture_trailer_t);
+        if (trailer->magic == PCIE_CAPTURE_INDEX_MAGIC &&
+            trailer->chunk_count <= index_space / sizeof(pcie_capture_index_entry_t) &&
+            trailer->index_offset >= sizeof(pcie_capture_file_header_t) &&
+            trailer->index_offset % sizeof(uint64_t) == 0 &&
+            trailer->index_offset + trailer->chunk_count * sizeof(pcie_capture_index_entry_t) +
+                sizeof(pcie_capture_trailer_t) == reader->size) {
+            const pcie_capture_index_entry_t *index =
+                (const pcie_capture_index_entry_t *)(reader->map + trailer->index_offset);
+
+            // Never trust the offsets of a damaged index, the chunks are rescanned instead
+            if (validate_index(reader, index, trailer->chunk_count, trailer->index_offset) == 0) {
+                reader->index = index;
+                reader->chunk_count = trailer->chunk_count;
+                indexed = 1;
+            } else {
+                pcie_log("Capture", "Capture index is corrupt.");
+            }
+        }
+    }
+
+    if (!indexed) {
+        pcie_log("Capture", "Capture index missing, rebuilding from chunk headers.");
+        if (rebuild_index(reader) != 0) {
+            pcie_capture_reader_close(reader);
+            return -1;
+        }
+    }
+
+    for (uint64_t i = 0; i < reader->chunk_count; i++) {
+        reader->record_count += reader->index[i].record_count;
+    }
+
+    return 0;
+}
+
+void pcie_capture_reader_close(pcie_capture_reader_t *reader) {
+    if (reader == NULL) {
+        return;
+    }
+
+    if (reader->map != NULL) {
+        munmap((void *)reader->map, reader->size);
+        reader->map = NULL;
+    }
+    if (reader->fd >= 0) {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+    free(reader->rebuilt_index);
+    reader->rebuilt_index = NULL;
+    reader->index = NULL;
+}
+
+static inline const pcie_capture_record_t *chunk_records(const pcie_capture_reader_t *reader, uint64_t chunk) {
+    return (const pcie_capture_record_t *)(reader->map + reader->index[chunk].offset + CHUNK_HEADER_SIZE);
+}
+
+// Position the cursor on the first record at or after a timestamp
+int pcie_capture_seek(pcie_capture_reader_t *reader, uint64_t timestamp_ns) {
+    if (reader == NULL || reader->map == NULL) {
+        return -1;
+    }
+
+    // First chunk that ends at or after the timestamp
+    uint64_t low = 0;
+    uint64_t high = reader->chunk_count;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (reader->index[mid].last_ns < timestamp_ns) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    reader->chunk = low;
+    reader->record = 0;
+    if (low == reader->chunk_count) {
+        return -1;
+    }
+
+    // First record in that chunk at or after the timestamp
+    const pcie_capture_record_t *records = chunk_records(reader, low);
+    uint32_t first = 0;
+    uint32_t last = reader->index[low].record_count;
+    while (first < last) {
+        uint32_t mid = first + (last - first) / 2;
+        if (records[mid].timestamp_ns < timestamp_ns) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+
+    reader->record = first;
+    return 0;
+}
+
+// Return the record at the cursor and advance, NULL at the end of the capture
+const pcie_capture_record_t *pcie_capture_next(pcie_capture_reader_t *reader) {
+    if (reader == NULL || reader->map == NULL) {
+        return NULL;
+    }
+
+    while (reader->chunk < reader->chunk_count) {
+        if (reader->record < reader->index[reader->chunk].record_count) {
+            return &chunk_records(reader, reader->chunk)[reader->record++];
+        }
+        reader->chunk++;
+        reader->record = 0;
+    }
+
+    return NULL;
+}
+
+// Default sink: put the record back on the PCIe link
+static int send_record(const pcie_capture_record_t *record, void *context) {
+    (void)context;
+    return pcie_send_bus_message(&record->message, record->zone_id, record->device_id, record->priority);
+}
+
+// Replay from the reader's current position
+int pcie_capture_replay(pcie_capture_reader_t *reader, const pcie_replay_config_t *config, pcie_replay_stats_t *stats) {
+    if (reader == NULL || config == NULL || stats == NULL) {
+        pcie_log("Capture", "Error: Invalid arguments for replay.");
+        return -1;
+    }
+
+    if (config->mode == PCIE_REPLAY_SCALED && config->speed <= 0.0) {
+        pcie_log("Capture", "Error: Replay speed must be positive.");
+        return -1;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    pcie_replay_sink_t sink = config->sink ? config->sink : send_record;
+
+    const pcie_capture_record_t *record = pcie_capture_next(reader);
+    if (record == NULL) {
+        return 0;
+    }
+
+    uint64_t capture_start = record->timestamp_ns;
+    uint64_t replay_start = pcie_time_ns();
+
+    for (; record != NULL; record = pcie_capture_next(reader)) {
+        if (config->running != NULL && !*config->running) {
+            break;
+        }
+
+        if (config->mode != PCIE_REPLAY_MAX_RATE) {
+            uint64_t offset = record->timestamp_ns - capture_start;
+            if (config->mode == PCIE_REPLAY_SCALED) {
+                offset = (uint64_t)((double)offset / config->speed);
+            }
+
+            // Absolute deadlines keep sleep overshoot from accumulating
+            uint64_t target = replay_start + offset;
+            struct timespec deadline;
+            deadline.tv_sec = (time_t)(target / 1000000000ull);
+            deadline.tv_nsec = (long)(target % 1000000000ull);
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+            }
+
+            uint64_t now = pcie_time_ns();
+            if (now > target && now - target > stats->max_late_ns) {
+                stats->max_late_ns = now - target;
+            }
+        }
+
+        if (sink(record, config->context) == 0) {
+            stats->replayed++;
+        } else {
+            stats->failed++;
+        }
+    }
+
+    stats->duration_ns = pcie_time_ns() - replay_start;
+    return 0;
+}
@@ -0,0 +1,172 @@
+#ifndef PCIE_CAPTURE_H
+#define PCIE_CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "pcie_translation.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Recording and replay of backbone traffic.
+//
+// File layout (append-only, all offsets 8-byte aligned):
+//   file header | chunk | chunk | ... | chunk index | trailer
+// Every chunk is a chunk header followed by fixed-size records in capture
+// order. The chunk index (first/last timestamp and offset per chunk) is
+// appended on close; if it is missing because the recorder did not shut
+// down cleanly, the reader rebuilds it by walking the chunk headers.
+
+#define PCIE_CAPTURE_MAGIC "PCIECAP1"
+#define PCIE_CAPTURE_VERSION 1
+#define PCIE_CAPTURE_CHUNK_MAGIC 0x4B4E4843u    // "CHNK"
+#define PCIE_CAPTURE_INDEX_MAGIC 0x58444E49u    // "INDX"
+
+// Records per chunk unless configured otherwise (~1 MiB chunks)
+#define PCIE_CAPTURE_DEFAULT_CHUNK_RECORDS 9362
+
+// Chunk buffers shared between the gateway loop and the flush thread
+#define PCIE_CAPTURE_BUFFERS 4
+
+// A partially filled chunk is handed to the flush thread after this long,
+// by the next record or, on a quiet bus, by the flush thread itself
+#define PCIE_CAPTURE_FLUSH_INTERVAL_NS 1000000000ull
+
+// Returned by pcie_capture_write when all chunk buffers are still being flushed
+#define PCIE_CAPTURE_DROPPED 1
+
+// Direction of the captured message relative to the gateway
+typedef enum {
+    PCIE_CAPTURE_TX,
+    PCIE_CAPTURE_RX
+} pcie_capture_direction_t;
+
+// One captured message
+typedef struct {
+    uint64_t timestamp_ns;        // Capture time (monotonic clock)
+    uint32_t zone_id;
+    uint32_t device_id;
+    uint32_t priority;
+    uint32_t direction;           // pcie_capture_direction_t
+    bus_message_t message;        // Ethernet payloads are not captured (data NULL, data_len 0)
+} pcie_capture_record_t;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t created_ns;          // Wall-clock creation time
+    uint8_t reserved[40];
+} pcie_capture_file_header_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t record_count;
+    uint64_t first_ns;
+    uint64_t last_ns;
+    uint64_t reserved;
+} pcie_capture_chunk_header_t;
+
+typedef struct {
+    uint64_t offset;              // File offset of the chunk header
+    uint64_t first_ns;
+    uint64_t last_ns;
+    uint32_t record_count;
+    uint32_t reserved;
+} pcie_capture_index_entry_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t index_offset;
+    uint64_t chunk_count;
+} pcie_capture_trailer_t;
+
+// Streaming writer with a background flush thread
+typedef struct {
+    int fd;
+    size_t chunk_records;
+    size_t chunk_bytes;
+    uint8_t *buffers[PCIE_CAPTURE_BUFFERS];
+    int full[PCIE_CAPTURE_BUFFERS];      // Sealed and waiting for the flush thread
+    uint32_t fill_buffer;                // Buffer the gateway loop appends to (under lock)
+    uint32_t flush_buffer;               // Next buffer the flush thread writes
+    uint32_t fill_count;                 // Records in the fill buffer (under lock)
+    uint64_t fill_started_ns;            // Arrival of the fill buffer's first record
+
+    pthread_t thread;
+    pthread_mutex_t lock;                // Never held across disk I/O
+    pthread_cond_t cond;                 // Waits on the monotonic clock
+    int stop;
+    int io_error;                        // Set by the flush thread (atomic)
+
+    uint64_t file_offset;
+    pcie_capture_index_entry_t *index;
+    uint64_t index_count;
+    uint64_t index_capacity;
+
+    uint64_t written;                    // Records handed to the flush thread
+    uint64_t dropped;                    // Records lost because no buffer was free
+    uint64_t truncated;                  // Ethernet records stored without their payload
+} pcie_capture_writer_t;
+
+// Memory-mapped reader
+typedef struct {
+    int fd;
+    const uint8_t *map;
+    size_t size;
+    const pcie_capture_index_entry_t *index;
+    pcie_capture_index_entry_t *rebuilt_index;
+    uint64_t chunk_count;
+    uint64_t record_count;
+    uint64_t chunk;                      // Cursor: current chunk
+    uint32_t record;                     // Cursor: record within the chunk
+} pcie_capture_reader_t;
+
+// Replay pacing
+typedef enum {
+    PCIE_REPLAY_ORIGINAL,   // Reproduce the captured inter-message timing
+    PCIE_REPLAY_SCALED,     // Captured timing divided by the speed factor
+    PCIE_REPLAY_MAX_RATE    // Send as fast as the sink accepts
+} pcie_replay_mode_t;
+
+// Destination of replayed records, returns 0 on success
+typedef int (*pcie_replay_sink_t)(const pcie_capture_record_t *record, void *context);
+
+typedef struct {
+    pcie_replay_mode_t mode;
+    double speed;                 // Only used by PCIE_REPLAY_SCALED
+    pcie_replay_sink_t sink;      // NULL sends via pcie_send_bus_message
+    void *context;
+    volatile int *running;        // Optional flag to abort the replay
+} pcie_replay_config_t;
+
+typedef struct {
+    uint64_t replayed;
+    uint64_t failed;
+    uint64_t max_late_ns;         // Worst lateness against the replay schedule
+    uint64_t duration_ns;
+} pcie_replay_stats_t;
+
+// Writer
+int pcie_capture_writer_open(pcie_capture_writer_t *writer, const char *path, size_t chunk_records);
+int pcie_capture_write(pcie_capture_writer_t *writer, const pcie_capture_record_t *record);
+int pcie_capture_writer_flush(pcie_capture_writer_t *writer);
+int pcie_capture_writer_close(pcie_capture_writer_t *writer);
+
+// Reader
+int pcie_capture_reader_open(pcie_capture_reader_t *reader, const char *path);
+void pcie_capture_reader_close(pcie_capture_reader_t *reader);
+int pcie_capture_seek(pcie_capture_reader_t *reader, uint64_t timestamp_ns);
+const pcie_capture_record_t *pcie_capture_next(pcie_capture_reader_t *reader);
+
+// Replay from the reader's current position
+int pcie_capture_replay(pcie_capture_reader_t *reader, const pcie_replay_config_t *config, pcie_replay_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PCIE_CAPTURE_H
@@ -0,0 +1,320 @@
+#ifndef PCIE_CHANNEL_HPP
+#define PCIE_CHANNEL_HPP
+
+// Header-only C++17 layer over pcie_client.h and pcie_translation.h.
+//
+// Client and Endpoint are RAII handles on the (process-wide) PCIe client:
+// the link is initialized by the first handle and cleaned up with the last.
+// Channel<Frame> sends and receives one bus type. Its wire layout is the
+// pcie_message_t used by pcie_send_bus_message(), so typed and untyped peers
+// interoperate, but the bus type, message ID and encoded size are resolved
+// at compile time and the encode path inlines into the caller.
+//
+// Construction failures throw pcie::Error; the data path never throws and
+// reports a Status instead.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "pcie_common.h"
+#include "pcie_client.h"
+#include "pcie_translation.h"
+
+namespace pcie {
+
+// Thrown when the PCIe client cannot be initialized
+class Error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Result of a data path operation
+enum class Status {
+    Ok,
+    Dropped,    // Discarded by the flow control overflow policy
+    Empty,      // No message arrived within the receive timeout
+    WrongType,  // A message of another bus type was consumed
+    Error
+};
+
+// Non-owning view of contiguous elements (std::span is C++20)
+template <typename T>
+class Span {
+public:
+    constexpr Span() noexcept : data_(nullptr), size_(0) {}
+    constexpr Span(T *data, std::size_t size) noexcept : data_(data), size_(size) {}
+
+    template <std::size_t N>
+    constexpr Span(T (&array)[N]) noexcept : data_(array), size_(N) {}
+
+    // Any container with contiguous data() and size(), e.g. std::vector or std::array
+    template <typename Container,
+              typename = std::enable_if_t<!std::is_array<Container>::value &&
+                                          std::is_convertible<decltype(std::declval<Container &>().data()), T *>::value>>
+    constexpr Span(Container &container) noexcept : data_(container.data()), size_(container.size()) {}
+
+    constexpr T *data() const noexcept { return data_; }
+    constexpr std::size_t size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+    constexpr T &operator[](std::size_t index) const noexcept { return data_[index]; }
+    constexpr T *begin() const noexcept { return data_; }
+    constexpr T *end() const noexcept { return data_ + size_; }
+
+    constexpr Span subspan(std::size_t offset, std::size_t count) const noexcept {
+        return Span(data_ + offset, count);
+    }
+
+private:
+    T *data_;
+    std::size_t size_;
+};
+
+// Map a C return code of the client or flow control API to a Status
+inline Status to_status(int ret, Status positive) noexcept {
+    return ret == 0 ? Status::Ok : ret > 0 ? positive : Status::Error;
+}
+
+// RAII reference on the PCIe client. Copies share the same link.
+class Client {
+public:
+    Client() { acquire(); }
+    Client(const Client &) { acquire(); }
+    Client &operator=(const Client &) = default;
+    ~Client() { release(); }
+
+    // Raw binary transfer with flow control
+    static Status send(Span<const std::uint8_t> bytes, std::uint32_t priority = 0) noexcept {
+        return to_status(pcie_client_send_buffer(bytes.data(), bytes.size(), priority), Status::Dropped);
+    }
+
+    static Status receive(Span<std::uint8_t> buffer, std::size_t &received) noexcept {
+        return to_status(pcie_client_receive_buffer(buffer.data(), buffer.size(), &received), Status::Empty);
+    }
+
+    static Status set_flow_policy(std::uint32_t priority_class, pcie_flow_policy_t policy,
+                                  std::uint32_t timeout_us = 0) noexcept {
+        return to_status(pcie_client_set_flow_policy(priority_class, policy, timeout_us), Status::Error);
+    }
+
+    static pcie_flow_stats_t tx_stats() noexcept {
+        pcie_flow_stats_t stats;
+        pcie_client_get_flow_stats(&stats, nullptr);
+        return stats;
+    }
+
+    static pcie_flow_stats_t rx_stats() noexcept {
+        pcie_flow_stats_t stats;
+        pcie_client_get_flow_stats(nullptr, &stats);
+        return stats;
+    }
+
+    // Number of live handles (for diagnostics and tests)
+    static int references() noexcept {
+        std::lock_guard<std::mutex> lock(mutex());
+        return count();
+    }
+
+private:
+    static std::mutex &mutex() noexcept {
+        static std::mutex lock;
+        return lock;
+    }
+
+    static int &count() noexcept {
+        static int references = 0;
+        return references;
+    }
+
+    static void acquire() {
+        std::lock_guard<std::mutex> lock(mutex());
+        if (count() == 0 && pcie_client_init() != 0) {
+            throw Error("Failed to initialize PCIe client");
+        }
+        count()++;
+    }
+
+    static void release() noexcept {
+        std::lock_guard<std::mutex> lock(mutex());
+        if (--count() == 0) {
+            pcie_client_cleanup();
+        }
+    }
+};
+
+// Local address written into every message header, keeps the link up
+class Endpoint {
+public:
+    Endpoint(std::uint32_t zone_id, std::uint32_t device_id, std::uint32_t priority = 0)
+        : zone_id_(zone_id), device_id_(device_id), priority_(priority) {}
+
+    std::uint32_t zone_id() const noexcept { return zone_id_; }
+    std::uint32_t device_id() const noexcept { return device_id_; }
+    std::uint32_t priority() const noexcept { return priority_; }
+    const Client &client() const noexcept { return client_; }
+
+private:
+    Client client_;
+    std::uint32_t zone_id_;
+    std::uint32_t device_id_;
+    std::uint32_t priority_;
+};
+
+// Compile-time description of a bus frame type
+template <typename Frame>
+struct BusTraits;
+
+template <>
+struct BusTraits<can_message_t> {
+    static constexpr bus_message_type_t type = MSG_TYPE_CAN;
+    static std::uint32_t message_id(const can_message_t &frame) noexcept { return frame.can_id; }
+    static can_message_t &payload(bus_message_t &msg) noexcept { return msg.data.can; }
+    static const can_message_t &payload(const bus_message_t &msg) noexcept { return msg.data.can; }
+};
+
+template <>
+struct BusTraits<lin_message_t> {
+    static constexpr bus_message_type_t type = MSG_TYPE_LIN;
+    static std::uint32_t message_id(const lin_message_t &frame) noexcept { return frame.lin_id; }
+    static lin_message_t &payload(bus_message_t &msg) noexcept { return msg.data.lin; }
+    static const lin_message_t &payload(const bus_message_t &msg) noexcept { return msg.data.lin; }
+};
+
+template <>
+struct BusTraits<flexray_message_t> {
+    static constexpr bus_message_type_t type = MSG_TYPE_FLEXRAY;
+    static std::uint32_t message_id(const flexray_message_t &frame) noexcept { return frame.frame_id; }
+    static flexray_message_t &payload(bus_message_t &msg) noexcept { return msg.data.flexray; }
+    static const flexray_message_t &payload(const bus_message_t &msg) noexcept { return msg.data.flexray; }
+};
+
+// Ethernet frames reference their payload through a pointer and cannot be
+// sent by value, so there is deliberately no BusTraits<ethernet_message_t>.
+
+// Header fields of a received message
+struct Source {
+    std::uint32_t zone_id;
+    std::uint32_t device_id;
+    std::uint32_t message_id;
+    std::uint64_t timestamp_us;
+};
+
+template <typename Frame>
+class Channel {
+    using Traits = BusTraits<Frame>;
+
+public:
+    static constexpr bus_message_type_t type = Traits::type;
+    static constexpr std::size_t encoded_size = sizeof(pcie_message_t);
+
+    static_assert(std::is_trivially_copyable<Frame>::value, "Frames are copied bytewise onto the wire");
+    static_assert(encoded_size <= PCIE_FLOW_PAYLOAD_SIZE, "Encoded frame must fit a flow control slot");
+
+    explicit Channel(const Endpoint &endpoint) : endpoint_(endpoint) {}
+
+    // Encode into the layout produced by pcie_send_bus_message()
+    static void encode(const Frame &frame, std::uint32_t zone_id, std::uint32_t device_id,
+                       std::uint32_t priority, std::uint64_t timestamp_us, pcie_message_t &msg) noexcept {
+        // Clear padding and the unused part of the union so no stack bytes leak onto the link
+        std::memset(&msg, 0, sizeof(msg));
+        msg.zone_id = zone_id;
+        msg.device_id = device_id;
+        msg.message_id = Traits::message_id(frame);
+        msg.priority = priority;
+        msg.payload_size = sizeof(bus_message_t);
+        msg.bus_message.type = type;
+        msg.bus_message.timestamp = timestamp_us;
+        Traits::payload(msg.bus_message) = frame;
+    }
+
+    // Decode a received message; false if it carries another bus type
+    static bool decode(const pcie_message_t &msg, Frame &frame, Source *source = nullptr) noexcept {
+        if (msg.bus_message.type != type) {
+            return false;
+        }
+        frame = Traits::payload(msg.bus_message);
+        if (source != nullptr) {
+            *source = Source{msg.zone_id, msg.device_id, msg.message_id, msg.bus_message.timestamp};
+        }
+        return true;
+    }
+
+    Status send(const Frame &frame) const noexcept {
+        pcie_message_t msg;
+        encode(frame, endpoint_.zone_id(), endpoint_.device_id(), endpoint_.priority(), now_us(), msg);
+        return to_status(pcie_client_send_buffer(&msg, encoded_size, endpoint_.priority()), Status::Dropped);
+    }
+
+    // Send frames in order until one fails; returns the number sent and the
+    // status of the last attempt. All frames share one timestamp.
+    std::size_t send(Span<const Frame> frames, Status *status = nullptr) const noexcept {
+        std::uint64_t timestamp = now_us();
+        Status result = Status::Ok;
+        std::size_t sent = 0;
+
+        for (; sent < frames.size(); sent++) {
+            pcie_message_t msg;
+            encode(frames[sent], endpoint_.zone_id(), endpoint_.device_id(), endpoint_.priority(), timestamp, msg);
+            result = to_status(pcie_client_send_buffer(&msg, encoded_size, endpoint_.priority()), Status::Dropped);
+            if (result != Status::Ok) {
+                break;
+            }
+        }
+
+        if (status != nullptr) {
+            *status = result;
+        }
+        return sent;
+    }
+
+    Status receive(Frame &frame, Source *source = nullptr) const noexcept {
+        pcie_message_t msg;
+        std::size_t received = 0;
+        Status result = to_status(pcie_client_receive_buffer(&msg, sizeof(msg), &received), Status::Empty);
+        if (result != Status::Ok) {
+            return result;
+        }
+        if (received != encoded_size) {
+            return Status::Error;
+        }
+        return decode(msg, frame, source) ? Status::Ok : Status::WrongType;
+    }
+
+    // Fill frames until the link runs empty or a receive fails; returns the
+    // number received and the status that ended the batch
+    std::size_t receive(Span<Frame> frames, Status *status = nullptr, Source *sources = nullptr) const noexcept {
+        Status result = Status::Ok;
+        std::size_t count = 0;
+
+        while (count < frames.size()) {
+            result = receive(frames[count], sources != nullptr ? &sources[count] : nullptr);
+            if (result != Status::Ok) {
+                break;
+            }
+            count++;
+        }
+
+        if (status != nullptr) {
+            *status = result;
+        }
+        return count;
+    }
+
+    const Endpoint &endpoint() const noexcept { return endpoint_; }
+
+private:
+    static std::uint64_t now_us() noexcept { return pcie_time_ns() / 1000; }
+
+    Endpoint endpoint_;
+};
+
+using CanChannel = Channel<can_message_t>;
+using LinChannel = Channel<lin_message_t>;
+using FlexRayChannel = Channel<flexray_message_t>;
+
+} // namespace pcie
+
+#endif // PCIE_CHANNEL_HPP
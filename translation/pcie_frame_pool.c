@@ -0,0 +1,472 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "pcie_common.h"
+#include "pcie_client.h"
+#include "pcie_trace.h"
+#include "pcie_frame_pool.h"
+
+// Blocks are padded to whole cache lines so neighbouring frames owned by
+// different threads never share one
+#define FRAME_ALIGN 64
+
+// Frames moved between a thread cache and a depot at once
+#define FRAME_BATCH (PCIE_FRAME_CACHE_SIZE / 2)
+
+// The payload must start right after the message header
+typedef char frame_layout_check[offsetof(pcie_frame_t, msg) + sizeof(pcie_message_t) == sizeof(pcie_frame_t) ? 1 : -1];
+
+// Leads every slot after the first of a fragmented frame
+typedef struct {
+    uint32_t magic;         // FRAME_FRAGMENT_MAGIC
+    uint32_t offset;        // Payload offset of the bytes that follow
+} frame_fragment_t;
+
+// Marker of a continuation slot ("PCFG")
+#define FRAME_FRAGMENT_MAGIC 0x50434647u
+
+// Payload bytes per continuation slot
+#define FRAME_NEXT_CHUNK (PCIE_FLOW_PAYLOAD_SIZE - sizeof(frame_fragment_t))
+
+static const size_t class_capacity[PCIE_FRAME_NUM_CLASSES] = {8, 64, 256, 1536, 9216};
+
+// Default frames per class: mostly small bus frames, few jumbo frames
+static const uint32_t default_counts[PCIE_FRAME_NUM_CLASSES] = {4096, 1024, 1024, 256, 64};
+
+int pcie_frame_class_for(size_t payload_size) {
+    for (int i = 0; i < PCIE_FRAME_NUM_CLASSES; i++) {
+        if (payload_size <= class_capacity[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+size_t pcie_frame_class_capacity(pcie_frame_class_t size_class) {
+    return (unsigned)size_class < PCIE_FRAME_NUM_CLASSES ? class_capacity[size_class] : 0;
+}
+
+int pcie_frame_pool_init(pcie_frame_pool_t *pool, const uint32_t *counts) {
+    if (pool == NULL) {
+        pcie_log("FramePool", "Error: Invalid pool pointer");
+        return -1;
+    }
+    if (counts == NULL) {
+        counts = default_counts;
+    }
+
+    memset(pool, 0, sizeof(*pool));
+    for (int i = 0; i < PCIE_FRAME_NUM_CLASSES; i++) {
+        pcie_frame_depot_t *depot = &pool->depots[i];
+        size_t block = (sizeof(pcie_frame_t) + class_capacity[i] + FRAME_ALIGN - 1) & ~(size_t)(FRAME_ALIGN - 1);
+
+        pthread_mutex_init(&depot->lock, NULL);
+        depot->block_size = (uint32_t)block;
+        depot->total = counts[i];
+        if (counts[i] == 0) {
+            continue;
+        }
+
+        // One allocation per class, touched now so the data path never page faults
+        depot->memory = (uint8_t *)aligned_alloc(FRAME_ALIGN, block * counts[i]);
+        if (depot->memory == NULL) {
+            pcie_log("FramePool", "Error: Failed to reserve frame memory");
+            pcie_frame_pool_destroy(pool);
+            return -1;
+        }
+        memset(depot->memory, 0, block * counts[i]);
+
+        // Thread the free list in address order
+        for (uint32_t n = counts[i]; n > 0; n--) {
+            pcie_frame_t *frame = (pcie_frame_t *)(depot->memory + (size_t)(n - 1) * block);
+            frame->pool = pool;
+            frame->size_class = (uint32_t)i;
+            frame->capacity = (uint32_t)class_capacity[i];
+            frame->next = depot->free;
+            depot->free = frame;
+        }
+        depot->free_count = counts[i];
+    }
+    return 0;
+}
+
+void pcie_frame_pool_destroy(pcie_frame_pool_t *pool) {
+    if (pool == NULL) {
+        return;
+    }
+    for (int i = 0; i < PCIE_FRAME_NUM_CLASSES; i++) {
+        pcie_frame_depot_t *depot = &pool->depots[i];
+        if (depot->block_size == 0) {
+            continue;   // Never initialized
+        }
+        if (depot->free_count != depot->total) {
+            pcie_log("FramePool", "Error: Destroying pool with frames still in use");
+        }
+        free(depot->memory);
+        pthread_mutex_destroy(&depot->lock);
+        depot->memory = NULL;
+        depot->free = NULL;
+        depot->free_count = 0;
+        depot->block_size = 0;
+    }
+}
+
+uint32_t pcie_frame_pool_available(pcie_frame_pool_t *pool, pcie_frame_class_t size_class) {
+    if (pool == NULL || (unsigned)size_class >= PCIE_FRAME_NUM_CLASSES) {
+        return 0;
+    }
+    pcie_frame_depot_t *depot = &pool->depots[size_class];
+    pthread_mutex_lock(&depot->lock);
+    uint32_t available = depot->free_count;
+    pthread_mutex_unlock(&depot->lock);
+    return available;
+}
+
+void pcie_frame_cache_init(pcie_frame_cache_t *cache, pcie_frame_pool_t *pool) {
+    memset(cache, 0, sizeof(*cache));
+    cache->pool = pool;
+}
+
+// Move up to FRAME_BATCH frames from the depot into the cache
+static void refill(pcie_frame_cache_t *cache, int size_class) {
+    pcie_frame_depot_t *depot = &cache->pool->depots[size_class];
+    uint32_t *count = &cache->count[size_class];
+
+    pthread_mutex_lock(&depot->lock);
+    while (*count < FRAME_BATCH && depot->free != NULL) {
+        pcie_frame_t *frame = depot->free;
+        depot->free = frame->next;
+        depot->free_count--;
+        cache->frames[size_class][(*count)++] = frame;
+    }
+    pthread_mutex_unlock(&depot->lock);
+    cache->stats.refills++;
+}
+
+// Return the oldest count cached frames of a class to the depot
+static void flush(pcie_frame_cache_t *cache, int size_class, uint32_t count) {
+    pcie_frame_depot_t *depot = &cache->pool->depots[size_class];
+    pcie_frame_t **frames = cache->frames[size_class];
+
+    pthread_mutex_lock(&depot->lock);
+    for (uint32_t i = 0; i < count; i++) {
+        frames[i]->next = depot->free;
+        depot->free = frames[i];
+    }
+    depot->free_count += count;
+    pthread_mutex_unlock(&depot->lock);
+
+    // Keep the most recently freed (cache-warm) frames
+    cache->count[size_class] -= count;
+    memmove(frames, frames + count, cache->count[size_class] * sizeof(pcie_frame_t *));
+    cache->stats.flushes++;
+}
+
+void pcie_frame_cache_flush(pcie_frame_cache_t *cache) {
+    if (cache == NULL || cache->pool == NULL) {
+        return;
+    }
+    for (int i = 0; i < PCIE_FRAME_NUM_CLASSES; i++) {
+        if (cache->count[i] > 0) {
+            flush(cache, i, cache->count[i]);
+        }
+    }
+}
+
+pcie_frame_t *pcie_frame_alloc(pcie_frame_cache_t *cache, size_t payload_size) {
+    if (cache == NULL || cache->pool == NULL) {
+        pcie_log("FramePool", "Error: Invalid frame cache");
+        return NULL;
+    }
+
+    int size_class = pcie_frame_class_for(payload_size);
+    if (size_class < 0) {
+        pcie_log("FramePool", "Error: Payload exceeds the largest frame class");
+        return NULL;
+    }
+
+    if (cache->count[size_class] > 0) {
+        cache->stats.hits++;
+    } else {
+        refill(cache, size_class);
+        if (cache->count[size_class] == 0) {
+            cache->stats.exhausted++;
+            return NULL;
+        }
+    }
+
+    pcie_frame_t *frame = cache->frames[size_class][--cache->count[size_class]];
+    frame->next = NULL;
+    frame->refs = 1;
+    frame->length = 0;
+    // Clear the header so no stale bytes from an earlier message reach the link
+    memset(&frame->msg, 0, sizeof(frame->msg));
+    cache->stats.allocs++;
+    return frame;
+}
+
+pcie_frame_t *pcie_frame_from_can(pcie_frame_cache_t *cache, const can_message_t *can_msg,
+                                  uint32_t zone_id, uint32_t device_id) {
+    pcie_frame_t *frame = pcie_frame_alloc(cache, 0);
+    if (frame == NULL) {
+        return NULL;
+    }
+    if (translate_can_to_pcie(can_msg, &frame->msg, zone_id, device_id) != 0) {
+        pcie_frame_release(cache, frame);
+        return NULL;
+    }
+    return frame;
+}
+
+int pcie_frame_to_can(const pcie_frame_t *frame, can_message_t *can_msg) {
+    if (frame == NULL) {
+        pcie_log("FramePool", "Error: Invalid frame pointer");
+        return -1;
+    }
+    return translate_pcie_to_can(&frame->msg, can_msg);
+}
+
+void pcie_frame_ref(pcie_frame_t *frame) {
+    __atomic_fetch_add(&frame->refs, 1, __ATOMIC_RELAXED);
+}
+
+void pcie_frame_release(pcie_frame_cache_t *cache, pcie_frame_t *frame) {
+    if (frame == NULL) {
+        return;
+    }
+    // Release ordering makes our writes visible to whoever reuses the frame
+    if (__atomic_sub_fetch(&frame->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    if (cache == NULL || cache->pool != frame->pool) {
+        pcie_log("FramePool", "Error: Frame released through a cache of another pool");
+        return;
+    }
+
+    int size_class = (int)frame->size_class;
+    if (cache->count[size_class] == PCIE_FRAME_CACHE_SIZE) {
+        flush(cache, size_class, FRAME_BATCH);
+    }
+    cache->frames[size_class][cache->count[size_class]++] = frame;
+}
+
+pcie_frame_t *pcie_frame_from_bus(pcie_frame_cache_t *cache, const bus_message_t *msg,
+                                  uint32_t zone_id, uint32_t device_id, uint32_t priority) {
+    if (msg == NULL) {
+        pcie_log("FramePool", "Error: Invalid message pointer");
+        return NULL;
+    }
+
+    uint32_t message_id;
+    if (pcie_bus_message_id(msg, &message_id) != 0) {
+        return NULL;
+    }
+
+    size_t payload = 0;
+    if (msg->type == MSG_TYPE_ETHERNET) {
+        if (msg->data.ethernet.data == NULL && msg->data.ethernet.data_len > 0) {
+            pcie_log("FramePool", "Error: Ethernet message without payload buffer");
+            return NULL;
+        }
+        payload = msg->data.ethernet.data_len;
+    }
+
+    pcie_frame_t *frame = pcie_frame_alloc(cache, payload);
+    if (frame == NULL) {
+        return NULL;
+    }
+
+    frame->msg.zone_id = zone_id;
+    frame->msg.device_id = device_id;
+    frame->msg.message_id = message_id;
+    frame->msg.priority = priority;
+    frame->msg.payload_size = sizeof(bus_message_t);
+    frame->msg.bus_message = *msg;
+
+    if (msg->type == MSG_TYPE_ETHERNET) {
+        // The frame owns its copy of the payload
+        memcpy(pcie_frame_payload(frame), msg->data.ethernet.data, payload);
+        frame->msg.bus_message.data.ethernet.data = pcie_frame_payload(frame);
+        frame->length = (uint32_t)payload;
+    }
+    return frame;
+}
+
+int pcie_send_frame(pcie_frame_t *frame) {
+    if (frame == NULL) {
+        pcie_log("FramePool", "Error: Invalid frame pointer for PCIe send");
+        return -1;
+    }
+    uint32_t priority = frame->msg.priority;
+    frame->msg.payload_size = (uint32_t)(sizeof(bus_message_t) + frame->length);
+
+    // Header and the start of the payload are contiguous and go out as they are
+    size_t offset = frame->length < PCIE_FRAME_FIRST_CHUNK ? frame->length : PCIE_FRAME_FIRST_CHUNK;
+    int ret = pcie_client_send_buffer(&frame->msg, sizeof(pcie_message_t) + offset, priority);
+
+    // The rest follows in continuation slots
+    uint8_t chunk[PCIE_FLOW_PAYLOAD_SIZE];
+    while (ret == 0 && offset < frame->length) {
+        size_t size = frame->length - offset;
+        if (size > FRAME_NEXT_CHUNK) {
+            size = FRAME_NEXT_CHUNK;
+        }
+        frame_fragment_t fragment;
+        fragment.magic = FRAME_FRAGMENT_MAGIC;
+        fragment.offset = (uint32_t)offset;
+        memcpy(chunk, &fragment, sizeof(fragment));
+        memcpy(chunk + sizeof(fragment), pcie_frame_payload(frame) + offset, size);
+        ret = pcie_client_send_buffer(chunk, sizeof(fragment) + size, priority);
+        offset += size;
+    }
+    return ret;
+}
+
+// Whether a received slot continues a fragmented frame
+static int is_fragment(const uint8_t *slot, size_t received) {
+    uint32_t magic;
+    if (received < sizeof(frame_fragment_t)) {
+        return 0;
+    }
+    memcpy(&magic, slot, sizeof(magic));
+    return magic == FRAME_FRAGMENT_MAGIC;
+}
+
+// Frame for the message starting in slot, holding the header and the first
+// chunk; its length is the payload the header announces
+static pcie_frame_t *frame_begin(pcie_frame_cache_t *cache, const uint8_t *slot, size_t received) {
+    if (received < sizeof(pcie_message_t) || is_fragment(slot, received)) {
+        pcie_log("FramePool", "Error: Received message has unexpected size");
+        return NULL;
+    }
+
+    // Size the frame from the header before the message is copied into it
+    uint32_t payload_size;
+    memcpy(&payload_size, slot + offsetof(pcie_message_t, payload_size), sizeof(payload_size));
+    size_t first = received - sizeof(pcie_message_t);
+    if (payload_size < sizeof(bus_message_t) || payload_size - sizeof(bus_message_t) < first) {
+        pcie_log("FramePool", "Error: Received message has inconsistent payload size");
+        return NULL;
+    }
+
+    size_t length = payload_size - sizeof(bus_message_t);
+    pcie_frame_t *rx = pcie_frame_alloc(cache, length);
+    if (rx == NULL) {
+        pcie_log("FramePool", "Error: No free frame for received message");
+        return NULL;
+    }
+    memcpy(&rx->msg, slot, received);
+    rx->length = (uint32_t)length;
+    return rx;
+}
+
+int pcie_receive_frame(pcie_frame_cache_t *cache, pcie_frame_t **frame) {
+    if (frame == NULL) {
+        pcie_log("FramePool", "Error: Invalid frame pointer for PCIe receive");
+        return -1;
+    }
+    *frame = NULL;
+
+    // Slots are read in place from the client's receive batch, so every
+    // byte is copied once, from the batch into the frame
+    for (;;) {
+        const void *data = NULL;
+        size_t received = 0;
+        int ret = pcie_client_peek_buffer(&data, &received);
+        if (ret != 0) {
+            return ret == PCIE_FLOW_EMPTY ? PCIE_FLOW_EMPTY : -1;
+        }
+        pcie_frame_t *rx = frame_begin(cache, (const uint8_t *)data, received);
+        pcie_client_consume_buffer();
+        if (rx == NULL) {
+            return -1;
+        }
+
+        // Collect the continuation slots in order
+        size_t filled = received - sizeof(pcie_message_t);
+        while (filled < rx->length) {
+            ret = pcie_client_peek_buffer(&data, &received);
+            if (ret != 0 || !is_fragment((const uint8_t *)data, received)) {
+                break;
+            }
+            frame_fragment_t fragment;
+            memcpy(&fragment, data, sizeof(fragment));
+            size_t size = received - sizeof(fragment);
+            if (fragment.offset != filled || size > rx->length - filled) {
+                break;
+            }
+            memcpy(pcie_frame_payload(rx) + filled, (const uint8_t *)data + sizeof(fragment), size);
+            pcie_client_consume_buffer();
+            filled += size;
+        }
+
+        if (filled == rx->length) {
+            if (rx->msg.bus_message.type == MSG_TYPE_ETHERNET) {
+                // The sender's pointer is meaningless here, point at our copy
+                rx->msg.bus_message.data.ethernet.data = pcie_frame_payload(rx);
+                rx->msg.bus_message.data.ethernet.data_len = rx->length;
+            }
+            PCIE_TRACE4(rx_dispatch, rx->msg.message_id, rx->msg.zone_id, rx->msg.device_id,
+                        rx->msg.bus_message.timestamp);
+            *frame = rx;
+            return 0;
+        }
+
+        // A slot was lost (dropped by the sender or overwritten). A slot
+        // that starts the next frame stays pending for the next round, a
+        // stray fragment is dropped.
+        pcie_log("FramePool", "Error: Incomplete fragmented frame discarded");
+        pcie_frame_release(cache, rx);
+        if (ret != 0) {
+            return -1;
+        }
+        if (is_fragment((const uint8_t *)data, received)) {
+            pcie_client_consume_buffer();
+            return -1;
+        }
+    }
+}
+
+int pcie_arena_init(pcie_arena_t *arena, size_t capacity) {
+    if (arena == NULL || capacity == 0) {
+        pcie_log("FramePool", "Error: Invalid arena parameters");
+        return -1;
+    }
+    arena->memory = (uint8_t *)aligned_alloc(FRAME_ALIGN, (capacity + FRAME_ALIGN - 1) & ~(size_t)(FRAME_ALIGN - 1));
+    if (arena->memory == NULL) {
+        pcie_log("FramePool", "Error: Failed to reserve arena memory");
+        return -1;
+    }
+    memset(arena->memory, 0, capacity);
+    arena->capacity = capacity;
+    arena->used = 0;
+    arena->high_water = 0;
+    return 0;
+}
+
+void pcie_arena_destroy(pcie_arena_t *arena) {
+    if (arena == NULL) {
+        return;
+    }
+    free(arena->memory);
+    arena->memory = NULL;
+    arena->capacity = 0;
+    arena->used = 0;
+}
+
+void *pcie_arena_alloc(pcie_arena_t *arena, size_t size) {
+    size_t offset = (arena->used + 15) & ~(size_t)15;
+    if (offset > arena->capacity || size > arena->capacity - offset) {
+        return NULL;
+    }
+    arena->used = offset + size;
+    if (arena->used > arena->high_water) {
+        arena->high_water = arena->used;
+    }
+    return arena->memory + offset;
+}
+
+void pcie_arena_reset(pcie_arena_t *arena) {
+    arena->used = 0;
+}
@@ -0,0 +1,173 @@
+#ifndef PCIE_FRAME_POOL_H
+#define PCIE_FRAME_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "pcie_flow.h"
+#include "pcie_translation.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Fixed-block frame pool and batch arena for the gateway data path.
+//
+// All memory is reserved by pcie_frame_pool_init(); allocating and freeing
+// a frame afterwards never calls malloc. Each size class has a central
+// depot (a mutex protected free list) and every thread keeps its own
+// pcie_frame_cache_t in front of it, so the common case touches only thread
+// local state and the depot lock is taken once per half cache.
+//
+// A frame holds a pcie_message_t immediately followed by its payload, so the
+// header and a variable-length payload go onto the link as one buffer. The
+// Ethernet data pointer of a pooled frame points into that payload: the
+// frame owns it and releasing the frame releases both.
+//
+// A flow control slot carries the header and the first
+// PCIE_FRAME_FIRST_CHUNK payload bytes. Larger frames continue in further
+// slots of the same ring, each led by a small fragment header, and the
+// receiver reassembles them into one pooled frame.
+
+// Size classes by payload capacity
+typedef enum {
+    PCIE_FRAME_CAN,        // 8 bytes (classic CAN, LIN)
+    PCIE_FRAME_CANFD,      // 64 bytes (CAN FD)
+    PCIE_FRAME_FLEXRAY,    // 256 bytes (FlexRay)
+    PCIE_FRAME_ETHERNET,   // 1536 bytes (standard Ethernet)
+    PCIE_FRAME_JUMBO,      // 9216 bytes (jumbo Ethernet)
+    PCIE_FRAME_NUM_CLASSES
+} pcie_frame_class_t;
+
+// Payload bytes that travel in the first slot together with the header
+#define PCIE_FRAME_FIRST_CHUNK (PCIE_FLOW_PAYLOAD_SIZE - sizeof(pcie_message_t))
+
+// Frames each thread caches per size class
+#define PCIE_FRAME_CACHE_SIZE 32
+
+struct pcie_frame_pool;
+
+typedef struct pcie_frame {
+    struct pcie_frame *next;        // Free list link
+    struct pcie_frame_pool *pool;   // Owning pool
+    uint32_t refs;                  // Reference count (atomic)
+    uint32_t size_class;
+    uint32_t capacity;              // Payload bytes after msg
+    uint32_t length;                // Payload bytes in use
+    pcie_message_t msg;             // Wire image, directly followed by the payload
+} pcie_frame_t;
+
+// Central free list of one size class
+typedef struct {
+    pthread_mutex_t lock;
+    pcie_frame_t *free;
+    uint32_t free_count;
+    uint32_t total;
+    uint32_t block_size;
+    uint8_t *memory;
+} pcie_frame_depot_t;
+
+typedef struct pcie_frame_pool {
+    pcie_frame_depot_t depots[PCIE_FRAME_NUM_CLASSES];
+} pcie_frame_pool_t;
+
+typedef struct {
+    uint64_t allocs;        // Frames handed out
+    uint64_t hits;          // Allocations served from the cache
+    uint64_t refills;       // Batches taken from a depot
+    uint64_t flushes;       // Batches returned to a depot
+    uint64_t exhausted;     // Allocations failed because the class ran out
+} pcie_frame_cache_stats_t;
+
+// Per-thread cache in front of the depots; owned by exactly one thread
+typedef struct {
+    pcie_frame_pool_t *pool;
+    pcie_frame_t *frames[PCIE_FRAME_NUM_CLASSES][PCIE_FRAME_CACHE_SIZE];
+    uint32_t count[PCIE_FRAME_NUM_CLASSES];
+    pcie_frame_cache_stats_t stats;
+} pcie_frame_cache_t;
+
+// Bump allocator for data that lives as long as one batch
+typedef struct {
+    uint8_t *memory;
+    size_t capacity;
+    size_t used;
+    size_t high_water;
+} pcie_arena_t;
+
+// Reserve counts[class] frames per size class (NULL selects the defaults)
+int pcie_frame_pool_init(pcie_frame_pool_t *pool, const uint32_t *counts);
+
+// Free the pool memory; all caches must have been flushed
+void pcie_frame_pool_destroy(pcie_frame_pool_t *pool);
+
+// Frames currently in the depot of a class (excludes thread caches)
+uint32_t pcie_frame_pool_available(pcie_frame_pool_t *pool, pcie_frame_class_t size_class);
+
+// Smallest size class with room for payload_size bytes, -1 if none
+int pcie_frame_class_for(size_t payload_size);
+
+// Payload capacity of a size class
+size_t pcie_frame_class_capacity(pcie_frame_class_t size_class);
+
+void pcie_frame_cache_init(pcie_frame_cache_t *cache, pcie_frame_pool_t *pool);
+
+// Return all cached frames to the depots (before the thread exits)
+void pcie_frame_cache_flush(pcie_frame_cache_t *cache);
+
+// Frame with room for payload_size bytes, cleared header and one reference.
+// Returns NULL if the size class is exhausted; there is no heap fallback.
+pcie_frame_t *pcie_frame_alloc(pcie_frame_cache_t *cache, size_t payload_size);
+
+// Add a reference, e.g. before handing a frame to a second destination
+void pcie_frame_ref(pcie_frame_t *frame);
+
+// Drop a reference; the last one returns the frame through the cache of the
+// calling thread, which need not be the thread that allocated it
+void pcie_frame_release(pcie_frame_cache_t *cache, pcie_frame_t *frame);
+
+// Payload bytes that follow the message header
+static inline uint8_t *pcie_frame_payload(pcie_frame_t *frame) {
+    return (uint8_t *)(frame + 1);
+}
+
+// Build a frame for a bus message. Ethernet payloads are copied into the
+// frame and data points at the copy.
+pcie_frame_t *pcie_frame_from_bus(pcie_frame_cache_t *cache, const bus_message_t *msg,
+                                  uint32_t zone_id, uint32_t device_id, uint32_t priority);
+
+// Translate a CAN message straight into a pooled frame (see
+// translate_can_to_pcie()); NULL if the frame could not be built
+pcie_frame_t *pcie_frame_from_can(pcie_frame_cache_t *cache, const can_message_t *can_msg,
+                                  uint32_t zone_id, uint32_t device_id);
+
+// CAN message carried by a frame; -1 if it holds another bus type
+int pcie_frame_to_can(const pcie_frame_t *frame, can_message_t *can_msg);
+
+// Send a frame, fragmented over as many slots as its payload needs. The
+// header's payload_size is set to cover the bus message and the payload.
+// Returns PCIE_FLOW_DROPPED if the flow control policy discarded a slot, in
+// which case the rest of the frame is not sent.
+int pcie_send_frame(pcie_frame_t *frame);
+
+// Receive the next message into a pooled frame of the class its payload
+// needs, reassembling fragmented frames. Returns 0 with *frame set,
+// PCIE_FLOW_EMPTY on timeout or -1 on error; incomplete frames are discarded.
+int pcie_receive_frame(pcie_frame_cache_t *cache, pcie_frame_t **frame);
+
+// Reserve capacity bytes for an arena
+int pcie_arena_init(pcie_arena_t *arena, size_t capacity);
+
+void pcie_arena_destroy(pcie_arena_t *arena);
+
+// 16-byte aligned block, NULL when the arena is full
+void *pcie_arena_alloc(pcie_arena_t *arena, size_t size);
+
+// Release everything allocated since init or the last reset
+void pcie_arena_reset(pcie_arena_t *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PCIE_FRAME_POOL_H
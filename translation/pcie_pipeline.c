@@ -0,0 +1,285 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include <time.h>
+#include "pcie_common.h"
+#include "pcie_pipeline.h"
+
+// Polls an idle stage yields the CPU before it starts to sleep
+#define PIPELINE_IDLE_SPINS 64
+
+// Default sleep of an idle stage, as the receiver's ring polling
+#define PIPELINE_IDLE_SLEEP_NS 50000
+
+static inline uint32_t queue_count(const pcie_pipeline_queue_t *queue) {
+    return (uint32_t)(pcie_load_acquire(&queue->head) - pcie_load_acquire(&queue->tail));
+}
+
+static inline uint32_t queue_free(const pcie_pipeline_queue_t *queue) {
+    return queue->capacity - queue_count(queue);
+}
+
+static inline int stage_done(const pcie_stage_t *stage) {
+    return __atomic_load_n(&stage->done, __ATOMIC_ACQUIRE);
+}
+
+// Pull count messages off the input queue (consumer side)
+static void queue_pop(pcie_pipeline_queue_t *queue, pcie_message_t *msgs, uint32_t count) {
+    uint64_t tail = queue->tail;
+    for (uint32_t i = 0; i < count; i++) {
+        msgs[i] = queue->slots[(tail + i) & (queue->capacity - 1)];
+    }
+    __atomic_store_n(&queue->tail, tail + count, __ATOMIC_RELEASE);
+}
+
+// Publish count messages on the output queue (producer side, space checked)
+static void queue_push(pcie_pipeline_queue_t *queue, const pcie_message_t *msgs, uint32_t count) {
+    uint64_t head = queue->head;
+    for (uint32_t i = 0; i < count; i++) {
+        queue->slots[(head + i) & (queue->capacity - 1)] = msgs[i];
+    }
+    __atomic_store_n(&queue->head, head + count, __ATOMIC_RELEASE);
+}
+
+static void stage_idle(pcie_stage_t *stage, uint32_t *spins) {
+    if ((*spins)++ < PIPELINE_IDLE_SPINS) {
+        sched_yield();
+        return;
+    }
+    struct timespec pause = {0, (long)stage->pipeline->idle_sleep_ns};
+    nanosleep(&pause, NULL);
+}
+
+static void *stage_main(void *arg) {
+    pcie_stage_t *stage = (pcie_stage_t *)arg;
+    pcie_pipeline_t *pipeline = stage->pipeline;
+    const pcie_stage_t *upstream = stage->in ? stage - 1 : NULL;
+    const pcie_stage_t *downstream = stage->out ? stage + 1 : NULL;
+    pcie_message_t in[PCIE_PIPELINE_BATCH];
+    pcie_message_t out[PCIE_PIPELINE_BATCH];
+    uint32_t spins = 0;
+
+    stage->rt_status = pcie_rt_apply(&stage->config.rt);
+    stage->stats.start_ns = pcie_time_ns();
+
+    for (;;) {
+        // A finished consumer would leave us blocked on a full queue forever
+        if (downstream != NULL && stage_done(downstream)) {
+            break;
+        }
+
+        uint32_t capacity = PCIE_PIPELINE_BATCH;
+        if (stage->out != NULL) {
+            uint32_t space = queue_free(stage->out);
+            if (space == 0) {
+                stage->stats.backpressure++;
+                stage_idle(stage, &spins);
+                continue;
+            }
+            if (space < capacity) {
+                capacity = space;
+            }
+        }
+
+        uint32_t count = 0;
+        if (upstream != NULL) {
+            // Check for completion before looking at the queue so nothing
+            // published just before the upstream stage exited is missed
+            int upstream_done = stage_done(upstream);
+            count = queue_count(stage->in);
+            if (count == 0) {
+                if (upstream_done) {
+                    break;
+                }
+                stage->stats.idle_polls++;
+                stage_idle(stage, &spins);
+                continue;
+            }
+            // One output slot per input, so a stage never has to hold back results
+            if (count > capacity) {
+                count = capacity;
+            }
+            queue_pop(stage->in, in, count);
+        } else if (!__atomic_load_n(&pipeline->running, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+
+        uint64_t start = pcie_time_ns();
+        int produced = stage->config.fn(stage->config.context, in, count, out, capacity);
+        uint64_t end = pcie_time_ns();
+        if (produced < 0) {
+            break;
+        }
+        if ((uint32_t)produced > capacity) {
+            pcie_log("Pipeline", "Error: Stage produced more messages than its capacity.");
+            produced = (int)capacity;
+        }
+
+        if (count == 0 && produced == 0) {
+            stage->stats.idle_polls++;
+            stage_idle(stage, &spins);
+            continue;
+        }
+
+        spins = 0;
+        stage->stats.calls++;
+        stage->stats.busy_ns += end - start;
+        stage->stats.in += count;
+        stage->stats.out += (uint64_t)produced;
+
+        if (stage->out != NULL && produced > 0) {
+            queue_push(stage->out, out, (uint32_t)produced);
+            uint32_t depth = queue_count(stage->out);
+            if (depth > stage->stats.queue_high_water) {
+                stage->stats.queue_high_water = depth;
+            }
+        }
+    }
+
+    stage->stats.end_ns = pcie_time_ns();
+    __atomic_store_n(&stage->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Initialize an empty pipeline
+void pcie_pipeline_init(pcie_pipeline_t *pipeline) {
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->idle_sleep_ns = PIPELINE_IDLE_SLEEP_NS;
+}
+
+// Append a stage
+int pcie_pipeline_add_stage(pcie_pipeline_t *pipeline, const pcie_stage_config_t *config) {
+    if (pipeline == NULL || config == NULL || config->fn == NULL) {
+        pcie_log("Pipeline", "Error: Invalid stage configuration.");
+        return -1;
+    }
+    if (pipeline->stage_count == PCIE_PIPELINE_MAX_STAGES || pipeline->running) {
+        pcie_log("Pipeline", "Error: Cannot add another stage.");
+        return -1;
+    }
+
+    uint32_t depth = config->queue_depth ? config->queue_depth : PCIE_PIPELINE_QUEUE_DEPTH;
+    if ((depth & (depth - 1)) != 0) {
+        pcie_log("Pipeline", "Error: Queue depth must be a power of two.");
+        return -1;
+    }
+
+    pcie_stage_t *stage = &pipeline->stages[pipeline->stage_count];
+    memset(stage, 0, sizeof(*stage));
+    stage->config = *config;
+    stage->config.queue_depth = depth;
+    stage->pipeline = pipeline;
+    return (int)pipeline->stage_count++;
+}
+
+static void free_queues(pcie_pipeline_t *pipeline) {
+    for (uint32_t i = 0; i < PCIE_PIPELINE_MAX_STAGES; i++) {
+        free(pipeline->queues[i].slots);
+        memset(&pipeline->queues[i], 0, sizeof(pipeline->queues[i]));
+    }
+}
+
+// Allocate the queues and start the stage threads
+int pcie_pipeline_start(pcie_pipeline_t *pipeline) {
+    if (pipeline == NULL || pipeline->stage_count == 0 || pipeline->running) {
+        pcie_log("Pipeline", "Error: Pipeline cannot be started.");
+        return -1;
+    }
+
+    // Queue i connects stage i to stage i + 1
+    for (uint32_t i = 0; i + 1 < pipeline->stage_count; i++) {
+        pcie_pipeline_queue_t *queue = &pipeline->queues[i];
+        uint32_t depth = pipeline->stages[i].config.queue_depth;
+        queue->slots = (pcie_message_t *)calloc(depth, sizeof(pcie_message_t));
+        if (queue->slots == NULL) {
+            pcie_log("Pipeline", "Error: Failed to allocate stage queue.");
+            free_queues(pipeline);
+            return -1;
+        }
+        queue->capacity = depth;
+        queue->head = 0;
+        queue->tail = 0;
+        pipeline->stages[i].out = queue;
+        pipeline->stages[i + 1].in = queue;
+    }
+
+    // Reset every stage before the first thread can look at its neighbours
+    for (uint32_t i = 0; i < pipeline->stage_count; i++) {
+        memset(&pipeline->stages[i].stats, 0, sizeof(pipeline->stages[i].stats));
+        pipeline->stages[i].done = 0;
+        pipeline->stages[i].rt_status = 0;
+    }
+
+    pipeline->running = 1;
+    for (uint32_t i = 0; i < pipeline->stage_count; i++) {
+        pcie_stage_t *stage = &pipeline->stages[i];
+        if (pthread_create(&stage->thread, NULL, stage_main, stage) != 0) {
+            pcie_log("Pipeline", "Error: Failed to start stage thread.");
+            // Stages already running drain and exit once the first one stops
+            pcie_pipeline_stop(pipeline);
+            return -1;
+        }
+        stage->started = 1;
+    }
+    return 0;
+}
+
+// Join all stage threads and free the queues
+void pcie_pipeline_wait(pcie_pipeline_t *pipeline) {
+    // Stages that never started count as finished so their neighbours exit
+    for (uint32_t i = 0; i < pipeline->stage_count; i++) {
+        if (!pipeline->stages[i].started) {
+            __atomic_store_n(&pipeline->stages[i].done, 1, __ATOMIC_RELEASE);
+        }
+    }
+    for (uint32_t i = 0; i < pipeline->stage_count; i++) {
+        pcie_stage_t *stage = &pipeline->stages[i];
+        if (stage->started) {
+            pthread_join(stage->thread, NULL);
+            stage->started = 0;
+        }
+    }
+    __atomic_store_n(&pipeline->running, 0, __ATOMIC_RELEASE);
+    free_queues(pipeline);
+    for (uint32_t i = 0; i < pipeline->stage_count; i++) {
+        pipeline->stages[i].in = NULL;
+        pipeline->stages[i].out = NULL;
+    }
+}
+
+// Stop the first stage and drain the rest
+void pcie_pipeline_stop(pcie_pipeline_t *pipeline) {
+    __atomic_store_n(&pipeline->running, 0, __ATOMIC_RELEASE);
+    pcie_pipeline_wait(pipeline);
+}
+
+// Fraction of its lifetime a stage spent doing work
+double pcie_pipeline_utilization(const pcie_pipeline_t *pipeline, uint32_t stage) {
+    if (stage >= pipeline->stage_count) {
+        return 0.0;
+    }
+    const pcie_stage_stats_t *stats = &pipeline->stages[stage].stats;
+    if (stats->start_ns == 0) {
+        return 0.0;
+    }
+    uint64_t end = stats->end_ns ? stats->end_ns : pcie_time_ns();
+    return end > stats->start_ns ? (double)stats->busy_ns / (double)(end - stats->start_ns) : 0.0;
+}
+
+// Print one line per stage
+void pcie_pipeline_report(const pcie_pipeline_t *pipeline) {
+    pcie_log("Pipeline", "Stage utilization:");
+    for (uint32_t i = 0; i < pipeline->stage_count; i++) {
+        const pcie_stage_t *stage = &pipeline->stages[i];
+        printf("%-12s in %10llu  out %10llu  busy %5.1f%%  stalled %8llu  queue max %5u%s\n",
+               stage->config.name ? stage->config.name : "stage",
+               (unsigned long long)stage->stats.in, (unsigned long long)stage->stats.out,
+               100.0 * pcie_pipeline_utilization(pipeline, i),
+               (unsigned long long)stage->stats.backpressure, stage->stats.queue_high_water,
+               stage->rt_status != 0 ? "  (rt profile not applied)" : "");
+    }
+}
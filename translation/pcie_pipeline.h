@@ -0,0 +1,118 @@
+#ifndef PCIE_PIPELINE_H
+#define PCIE_PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "pcie_rt.h"
+#include "pcie_translation.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Multi-stage gateway pipeline, e.g. ingest -> filter/translate ->
+// batch/encode -> transmit.
+//
+// Every stage runs on its own thread with its own real-time profile (CPU
+// pinning, scheduling class) and is connected to the next stage by a
+// bounded single-producer/single-consumer queue. A stage only takes as many
+// messages from its input as fit into its output queue, so a slow stage
+// stalls the ones before it instead of dropping frames. With one thread per
+// stage and FIFO queues, messages leave the pipeline in the order they
+// entered it.
+
+#define PCIE_PIPELINE_MAX_STAGES 8
+
+// Messages handed to a stage function per call at most
+#define PCIE_PIPELINE_BATCH 32
+
+// Default queue depth after a stage (power of two)
+#define PCIE_PIPELINE_QUEUE_DEPTH 1024
+
+// Stage function. Gets count input messages (none for the first stage) and
+// may write up to capacity output messages (ignored for the last stage).
+// Returns the number of messages written, or -1 when the stage is finished,
+// e.g. its source is exhausted. All inputs count as consumed.
+typedef int (*pcie_stage_fn_t)(void *context, const pcie_message_t *in, size_t count,
+                               pcie_message_t *out, size_t capacity);
+
+typedef struct {
+    const char *name;
+    pcie_stage_fn_t fn;
+    void *context;
+    pcie_rt_config_t rt;        // Applied by the stage thread on start (see pcie_rt_config_default)
+    uint32_t queue_depth;       // Output queue depth, 0 selects the default
+} pcie_stage_config_t;
+
+typedef struct {
+    uint64_t in;                // Messages taken from the input queue
+    uint64_t out;               // Messages produced
+    uint64_t calls;             // Stage function calls that did work
+    uint64_t busy_ns;           // Time spent in those calls
+    uint64_t idle_polls;        // Polls without input
+    uint64_t backpressure;      // Polls blocked by a full output queue
+    uint32_t queue_high_water;  // Deepest output queue seen
+    uint64_t start_ns;
+    uint64_t end_ns;            // 0 while running
+} pcie_stage_stats_t;
+
+// Bounded SPSC queue between two stages
+typedef struct {
+    uint64_t head;              // Next slot to fill (producing stage)
+    uint8_t pad_head[56];
+    uint64_t tail;              // Next slot to drain (consuming stage)
+    uint8_t pad_tail[56];
+    pcie_message_t *slots;
+    uint32_t capacity;          // Power of two
+} pcie_pipeline_queue_t;
+
+struct pcie_pipeline;
+
+typedef struct {
+    pcie_stage_config_t config;
+    pcie_pipeline_queue_t *in;  // NULL for the first stage
+    pcie_pipeline_queue_t *out; // NULL for the last stage
+    struct pcie_pipeline *pipeline;
+    pthread_t thread;
+    int started;
+    int done;                   // Set (atomically) when the thread exits
+    int rt_status;              // Result of pcie_rt_apply() in the stage thread
+    pcie_stage_stats_t stats;
+} pcie_stage_t;
+
+typedef struct pcie_pipeline {
+    pcie_stage_t stages[PCIE_PIPELINE_MAX_STAGES];
+    pcie_pipeline_queue_t queues[PCIE_PIPELINE_MAX_STAGES];
+    uint32_t stage_count;
+    int running;                // Cleared by stop to end the first stage
+    uint32_t idle_sleep_ns;     // Sleep of an idle stage after spinning
+} pcie_pipeline_t;
+
+// Initialize an empty pipeline
+void pcie_pipeline_init(pcie_pipeline_t *pipeline);
+
+// Append a stage; returns its index or -1
+int pcie_pipeline_add_stage(pcie_pipeline_t *pipeline, const pcie_stage_config_t *config);
+
+// Allocate the queues and start one thread per stage
+int pcie_pipeline_start(pcie_pipeline_t *pipeline);
+
+// Stop the first stage, let the others drain their queues, join all threads
+// and free the queues
+void pcie_pipeline_stop(pcie_pipeline_t *pipeline);
+
+// Wait until every stage finished on its own (first stage returned -1)
+void pcie_pipeline_wait(pcie_pipeline_t *pipeline);
+
+// Fraction of its lifetime a stage spent doing work (0.0 - 1.0)
+double pcie_pipeline_utilization(const pcie_pipeline_t *pipeline, uint32_t stage);
+
+// Print one line per stage
+void pcie_pipeline_report(const pcie_pipeline_t *pipeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PCIE_PIPELINE_H
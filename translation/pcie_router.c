@@ -0,0 +1,401 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include "pcie_common.h"
+#include "pcie_router.h"
+
+#define MIN_TABLE_CAPACITY 16
+
+// Mix source zone and message ID so neighbouring IDs spread over the table
+static inline uint32_t hash_route(uint32_t src_zone, uint32_t message_id) {
+    return pcie_hash_id((src_zone * 0x9E3779B1u) ^ message_id);
+}
+
+static pcie_router_table_t *table_alloc(uint32_t capacity) {
+    // Header and entries in one allocation
+    pcie_router_table_t *table = (pcie_router_table_t *)calloc(1, sizeof(pcie_router_table_t) +
+                                                               capacity * sizeof(pcie_route_t));
+    if (table == NULL) {
+        return NULL;
+    }
+    table->capacity = capacity;
+    table->entries = (pcie_route_t *)(table + 1);
+    return table;
+}
+
+// Insert into a table that is not yet published
+static void table_insert(pcie_router_table_t *table, const pcie_route_t *route) {
+    uint32_t mask = table->capacity - 1;
+    uint32_t slot = hash_route(route->src_zone, route->message_id) & mask;
+
+    for (;; slot = (slot + 1) & mask) {
+        pcie_route_t *entry = &table->entries[slot];
+        if (entry->port_mask == 0) {
+            *entry = *route;
+            table->count++;
+            return;
+        }
+        if (entry->src_zone == route->src_zone && entry->message_id == route->message_id) {
+            entry->port_mask = route->port_mask;
+            return;
+        }
+    }
+}
+
+static uint64_t table_find(const pcie_router_table_t *table, uint32_t src_zone, uint32_t message_id) {
+    uint32_t mask = table->capacity - 1;
+    uint32_t slot = hash_route(src_zone, message_id) & mask;
+
+    for (;; slot = (slot + 1) & mask) {
+        const pcie_route_t *entry = &table->entries[slot];
+        if (entry->port_mask == 0) {
+            return 0;
+        }
+        if (entry->src_zone == src_zone && entry->message_id == message_id) {
+            return entry->port_mask;
+        }
+    }
+}
+
+// Exact route first, then the default route of the source zone
+static inline uint64_t table_route(const pcie_router_table_t *table, uint32_t src_zone, uint32_t message_id) {
+    uint64_t ports = table_find(table, src_zone, message_id);
+    if (ports == 0 && message_id != PCIE_ROUTER_ANY_MESSAGE) {
+        ports = table_find(table, src_zone, PCIE_ROUTER_ANY_MESSAGE);
+    }
+    return ports;
+}
+
+// Smallest power of two keeping the load factor at or below one half
+static uint32_t table_capacity_for(size_t count) {
+    uint32_t capacity = MIN_TABLE_CAPACITY;
+    while (capacity < 2 * count + 1) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+// Publish a new table and free the old one once the forwarding thread can
+// no longer be reading it. Called with the update lock held.
+static void table_publish(pcie_router_t *router, pcie_router_table_t *table) {
+    pcie_router_table_t *old = __atomic_exchange_n(&router->table, table, __ATOMIC_SEQ_CST);
+
+    // A lookup that started before the swap may still use the old table:
+    // wait until the forwarding thread leaves that read section
+    uint64_t seq = __atomic_load_n(&router->reader_seq, __ATOMIC_SEQ_CST);
+    if (seq & 1) {
+        while (__atomic_load_n(&router->reader_seq, __ATOMIC_ACQUIRE) == seq) {
+            sched_yield();
+        }
+    }
+
+    router->stats.table_updates++;
+    free(old);
+}
+
+static inline void read_begin(pcie_router_t *router) {
+    __atomic_add_fetch(&router->reader_seq, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline void read_end(pcie_router_t *router) {
+    __atomic_add_fetch(&router->reader_seq, 1, __ATOMIC_RELEASE);
+}
+
+// Initialize a router with no ports and an empty routing table
+int pcie_router_init(pcie_router_t *router) {
+    if (router == NULL) {
+        pcie_log("Router", "Error: Invalid router pointer");
+        return -1;
+    }
+
+    memset(router, 0, sizeof(*router));
+    router->table = table_alloc(MIN_TABLE_CAPACITY);
+    if (router->table == NULL) {
+        pcie_log("Router", "Error: Failed to allocate routing table");
+        return -1;
+    }
+    pthread_mutex_init(&router->update_lock, NULL);
+    return 0;
+}
+
+// Free the routing table and all port queues
+void pcie_router_destroy(pcie_router_t *router) {
+    if (router == NULL) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < router->port_count; i++) {
+        free(router->ports[i].slots);
+    }
+    free(router->table);
+    pthread_mutex_destroy(&router->update_lock);
+    memset(router, 0, sizeof(*router));
+}
+
+// Add a destination port for a zone
+int pcie_router_add_port(pcie_router_t *router, uint32_t zone_id, uint32_t queue_depth) {
+    if (router == NULL) {
+        return -1;
+    }
+    if (queue_depth == 0) {
+        queue_depth = PCIE_ROUTER_QUEUE_DEPTH;
+    }
+    if ((queue_depth & (queue_depth - 1)) != 0) {
+        pcie_log("Router", "Error: Queue depth must be a power of two");
+        return -1;
+    }
+
+    pthread_mutex_lock(&router->update_lock);
+
+    uint32_t index = router->port_count;
+    if (index >= PCIE_ROUTER_MAX_PORTS || pcie_router_port_for_zone(router, zone_id) >= 0) {
+        pthread_mutex_unlock(&router->update_lock);
+        pcie_log("Router", "Error: No free port or zone already attached");
+        return -1;
+    }
+
+    pcie_router_port_t *port = &router->ports[index];
+    port->slots = (pcie_message_t *)malloc(queue_depth * sizeof(pcie_message_t));
+    if (port->slots == NULL) {
+        pthread_mutex_unlock(&router->update_lock);
+        pcie_log("Router", "Error: Failed to allocate port queue");
+        return -1;
+    }
+    port->capacity = queue_depth;
+    port->zone_id = zone_id;
+
+    // The forwarding thread may pick up the new port immediately
+    __atomic_store_n(&router->port_count, index + 1, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&router->update_lock);
+    return (int)index;
+}
+
+// Find the port of a zone
+int pcie_router_port_for_zone(const pcie_router_t *router, uint32_t zone_id) {
+    uint32_t count = __atomic_load_n(&router->port_count, __ATOMIC_ACQUIRE);
+    for (uint32_t i = 0; i < count; i++) {
+        if (router->ports[i].zone_id == zone_id) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Add, replace or remove a single route
+int pcie_router_set_route(pcie_router_t *router, uint32_t src_zone, uint32_t message_id, uint64_t port_mask) {
+    if (router == NULL) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&router->update_lock);
+
+    // Only updaters replace the table and they hold the lock
+    const pcie_router_table_t *current = router->table;
+    pcie_router_table_t *table = table_alloc(table_capacity_for(current->count + 1));
+    if (table == NULL) {
+        pthread_mutex_unlock(&router->update_lock);
+        pcie_log("Router", "Error: Failed to allocate routing table");
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < current->capacity; i++) {
+        const pcie_route_t *entry = &current->entries[i];
+        if (entry->port_mask != 0 &&
+            !(entry->src_zone == src_zone && entry->message_id == message_id)) {
+            table_insert(table, entry);
+        }
+    }
+
+    if (port_mask != 0) {
+        pcie_route_t route = {src_zone, message_id, port_mask};
+        table_insert(table, &route);
+    }
+
+    table_publish(router, table);
+    pthread_mutex_unlock(&router->update_lock);
+    return 0;
+}
+
+// Replace the whole routing table in one step
+int pcie_router_load_routes(pcie_router_t *router, const pcie_route_t *routes, size_t count) {
+    if (router == NULL || (routes == NULL && count > 0)) {
+        return -1;
+    }
+
+    pcie_router_table_t *table = table_alloc(table_capacity_for(count));
+    if (table == NULL) {
+        pcie_log("Router", "Error: Failed to allocate routing table");
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (routes[i].port_mask != 0) {
+            table_insert(table, &routes[i]);
+        }
+    }
+
+    pthread_mutex_lock(&router->update_lock);
+    table_publish(router, table);
+    pthread_mutex_unlock(&router->update_lock);
+    return 0;
+}
+
+// Destination ports of a message
+uint64_t pcie_router_lookup(pcie_router_t *router, uint32_t src_zone, uint32_t message_id) {
+    pthread_mutex_lock(&router->update_lock);
+    uint64_t ports = table_route(router->table, src_zone, message_id);
+    pthread_mutex_unlock(&router->update_lock);
+    return ports;
+}
+
+// Copy a message into a port queue, 0 if the queue is full
+static inline int port_enqueue(pcie_router_port_t *port, const pcie_message_t *msg) {
+    uint64_t head = port->head;
+    if (head - __atomic_load_n(&port->tail, __ATOMIC_ACQUIRE) >= port->capacity) {
+        port->dropped++;
+        return 0;
+    }
+
+    memcpy(&port->slots[head & (port->capacity - 1)], msg, sizeof(pcie_message_t));
+    __atomic_store_n(&port->head, head + 1, __ATOMIC_RELEASE);
+    port->enqueued++;
+    return 1;
+}
+
+// Fan a message out to its destination ports
+static inline int fan_out(pcie_router_t *router, const pcie_message_t *msg, uint64_t ports, uint32_t port_count) {
+    int queued = 0;
+
+    while (ports != 0) {
+        uint32_t index = (uint32_t)__builtin_ctzll(ports);
+        ports &= ports - 1;
+
+        pcie_router_port_t *port = &router->ports[index];
+        // Never reflect a message back into the zone it came from
+        if (index >= port_count || port->zone_id == msg->zone_id) {
+            continue;
+        }
+
+        if (port_enqueue(port, msg)) {
+            queued++;
+        } else {
+            router->stats.queue_full++;
+        }
+    }
+
+    router->stats.deliveries += queued;
+    return queued;
+}
+
+// Forward a single message
+int pcie_router_forward(pcie_router_t *router, const pcie_message_t *msg) {
+    return msg == NULL ? -1 : pcie_router_forward_batch(router, msg, 1);
+}
+
+// Forward a batch under a single table read
+int pcie_router_forward_batch(pcie_router_t *router, const pcie_message_t *msgs, size_t count) {
+    if (router == NULL || msgs == NULL) {
+        return -1;
+    }
+
+    uint32_t port_count = __atomic_load_n(&router->port_count, __ATOMIC_ACQUIRE);
+    int queued = 0;
+
+    read_begin(router);
+    const pcie_router_table_t *table = __atomic_load_n(&router->table, __ATOMIC_SEQ_CST);
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t ports = table_route(table, msgs[i].zone_id, msgs[i].message_id);
+        if (ports == 0) {
+            router->stats.unrouted++;
+            continue;
+        }
+        queued += fan_out(router, &msgs[i], ports, port_count);
+    }
+
+    read_end(router);
+
+    router->stats.received += count;
+    return queued;
+}
+
+// Drain every zone endpoint once, one batch each so no zone starves the others
+int pcie_router_receive(pcie_router_t *router, pcie_flow_t *endpoints, size_t endpoint_count) {
+    if (router == NULL || (endpoint_count > 0 && endpoints == NULL)) {
+        return -1;
+    }
+
+    pcie_message_t msgs[PCIE_ROUTER_RX_BATCH];
+    size_t lengths[PCIE_ROUTER_RX_BATCH];
+    int received = 0;
+
+    for (size_t e = 0; e < endpoint_count; e++) {
+        int count = pcie_flow_receive_batch(&endpoints[e], msgs, sizeof(pcie_message_t), PCIE_ROUTER_RX_BATCH, lengths);
+        if (count <= 0) {
+            continue;
+        }
+
+        // Only whole messages can be routed
+        size_t valid = 0;
+        for (int i = 0; i < count; i++) {
+            if (lengths[i] != sizeof(pcie_message_t)) {
+                router->stats.malformed++;
+                continue;
+            }
+            if (valid != (size_t)i) {
+                msgs[valid] = msgs[i];
+            }
+            valid++;
+        }
+        if (valid > 0) {
+            pcie_router_forward_batch(router, msgs, valid);
+        }
+        received += count;
+    }
+    return received;
+}
+
+// Take the oldest message of a port queue
+int pcie_router_dequeue(pcie_router_t *router, int port, pcie_message_t *msg) {
+    if (router == NULL || msg == NULL || port < 0 || port >= PCIE_ROUTER_MAX_PORTS) {
+        return -1;
+    }
+
+    pcie_router_port_t *queue = &router->ports[port];
+    uint64_t tail = queue->tail;
+    if (tail == __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) {
+        return PCIE_ROUTER_EMPTY;
+    }
+
+    memcpy(msg, &queue->slots[tail & (queue->capacity - 1)], sizeof(pcie_message_t));
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Pass queued messages to a sink without copying them out first
+size_t pcie_router_drain(pcie_router_t *router, int port, pcie_router_sink_t sink, void *context, size_t max) {
+    if (router == NULL || sink == NULL || port < 0 || port >= PCIE_ROUTER_MAX_PORTS) {
+        return 0;
+    }
+
+    pcie_router_port_t *queue = &router->ports[port];
+    uint64_t tail = queue->tail;
+    uint64_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    size_t drained = 0;
+
+    while (tail != head && drained < max) {
+        if (sink(&queue->slots[tail & (queue->capacity - 1)], context) != 0) {
+            break;
+        }
+        tail++;
+        drained++;
+    }
+
+    // Release all drained slots to the forwarding thread at once
+    __atomic_store_n(&queue->tail, tail, __ATOMIC_RELEASE);
+    return drained;
+}
@@ -0,0 +1,132 @@
+#ifndef PCIE_ROUTER_H
+#define PCIE_ROUTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "pcie_flow.h"
+#include "pcie_translation.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Zone-to-zone router for the central compute node.
+//
+// Messages received from any zone endpoint are looked up in a routing table
+// keyed by (source zone, message_id) and copied into the TX queue of every
+// destination port. The table is immutable once published: updates build a
+// new copy and swap the pointer, so the forwarding path never takes a lock.
+// Each port queue is single-producer (the forwarding thread) and
+// single-consumer (the port's TX thread).
+
+// Maximum number of ports, one bit each in a route's port mask
+#define PCIE_ROUTER_MAX_PORTS 64
+
+// Default TX queue depth per port (power of two)
+#define PCIE_ROUTER_QUEUE_DEPTH 1024
+
+// Most messages taken from one zone endpoint per pcie_router_receive() call
+#define PCIE_ROUTER_RX_BATCH 32
+
+// Wildcard message ID: default route for a source zone
+#define PCIE_ROUTER_ANY_MESSAGE 0xFFFFFFFFu
+
+// Return code of pcie_router_dequeue() when the port queue is empty
+#define PCIE_ROUTER_EMPTY 1
+
+// One routing table entry; a port mask of 0 removes the route
+typedef struct {
+    uint32_t src_zone;
+    uint32_t message_id;
+    uint64_t port_mask;
+} pcie_route_t;
+
+// Immutable open-addressing table, replaced as a whole on every update
+typedef struct {
+    uint32_t capacity;        // Power of two
+    uint32_t count;
+    pcie_route_t *entries;    // Empty slots have a port mask of 0
+} pcie_router_table_t;
+
+// TX queue of one destination zone
+typedef struct {
+    uint64_t head;            // Next slot to fill (forwarding thread)
+    uint8_t pad_head[56];
+    uint64_t tail;            // Next slot to drain (port TX thread)
+    uint8_t pad_tail[56];
+    pcie_message_t *slots;
+    uint32_t capacity;        // Power of two
+    uint32_t zone_id;
+    uint64_t enqueued;
+    uint64_t dropped;         // Messages lost because the queue was full
+} pcie_router_port_t;
+
+typedef struct {
+    uint64_t received;        // Messages passed to the router
+    uint64_t malformed;       // Endpoint messages that are not a pcie_message_t
+    uint64_t unrouted;        // Messages without a matching route
+    uint64_t deliveries;      // Copies queued on destination ports
+    uint64_t queue_full;      // Copies dropped on full port queues
+    uint64_t table_updates;   // Published routing tables
+} pcie_router_stats_t;
+
+typedef struct {
+    pcie_router_table_t *table;   // Current routing table
+    uint64_t reader_seq;          // Odd while the forwarding thread reads the table
+    pthread_mutex_t update_lock;  // Serializes table updates (control path only)
+    pcie_router_port_t ports[PCIE_ROUTER_MAX_PORTS];
+    uint32_t port_count;
+    pcie_router_stats_t stats;
+} pcie_router_t;
+
+// Sink used to drain a port queue, returns 0 on success
+typedef int (*pcie_router_sink_t)(const pcie_message_t *msg, void *context);
+
+// Initialize a router with no ports and an empty routing table
+int pcie_router_init(pcie_router_t *router);
+
+// Free the routing table and all port queues
+void pcie_router_destroy(pcie_router_t *router);
+
+// Add a destination port for a zone; returns the port index or -1.
+// A queue depth of 0 selects PCIE_ROUTER_QUEUE_DEPTH.
+int pcie_router_add_port(pcie_router_t *router, uint32_t zone_id, uint32_t queue_depth);
+
+// Find the port of a zone, -1 if there is none
+int pcie_router_port_for_zone(const pcie_router_t *router, uint32_t zone_id);
+
+// Add, replace or (with a port mask of 0) remove a single route
+int pcie_router_set_route(pcie_router_t *router, uint32_t src_zone, uint32_t message_id, uint64_t port_mask);
+
+// Replace the whole routing table in one step
+int pcie_router_load_routes(pcie_router_t *router, const pcie_route_t *routes, size_t count);
+
+// Destination ports of a message, 0 if unrouted
+uint64_t pcie_router_lookup(pcie_router_t *router, uint32_t src_zone, uint32_t message_id);
+
+// Forwarding path, called from a single thread. Copies the message to every
+// destination port except the source zone's own; returns the number of
+// copies queued or -1 on invalid arguments.
+int pcie_router_forward(pcie_router_t *router, const pcie_message_t *msg);
+
+// Forward a batch under a single table read; returns the number of copies queued
+int pcie_router_forward_batch(pcie_router_t *router, const pcie_message_t *msgs, size_t count);
+
+// Receive side of the forwarding thread: take up to PCIE_ROUTER_RX_BATCH
+// messages from the ring of every zone endpoint and forward them. Returns
+// the number of messages received (0 if all rings were empty) or -1.
+int pcie_router_receive(pcie_router_t *router, pcie_flow_t *endpoints, size_t endpoint_count);
+
+// Port TX thread: take the oldest message, PCIE_ROUTER_EMPTY if none
+int pcie_router_dequeue(pcie_router_t *router, int port, pcie_message_t *msg);
+
+// Port TX thread: pass up to max queued messages to the sink; returns the
+// number drained. A failing sink leaves its message at the head of the queue.
+size_t pcie_router_drain(pcie_router_t *router, int port, pcie_router_sink_t sink, void *context, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PCIE_ROUTER_H
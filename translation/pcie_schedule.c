@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "pcie_common.h"
+#include "pcie_client.h"
+#include "pcie_schedule.h"
+
+#define SCHED_INDEX_SIZE (2 * PCIE_SCHED_MAX_ENTRIES)
+#define SCHED_SPORADIC_MASK (PCIE_SCHED_SPORADIC_DEPTH - 1)
+
+// Index slot holding a message ID, or the free slot where it would go
+static uint32_t index_slot(const pcie_sched_t *sched, uint32_t message_id) {
+    uint32_t slot = pcie_hash_id(message_id) & (SCHED_INDEX_SIZE - 1);
+
+    // The index is at most half full, so a free slot always ends the probe
+    while (sched->index[slot] != 0 && sched->entries[sched->index[slot] - 1].message_id != message_id) {
+        slot = (slot + 1) & (SCHED_INDEX_SIZE - 1);
+    }
+    return slot;
+}
+
+static uint64_t gcd(uint64_t a, uint64_t b) {
+    while (b != 0) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Initialize an empty schedule
+int pcie_sched_init(pcie_sched_t *sched, uint32_t tick_us, uint32_t frames_per_tick, uint64_t epoch_ns) {
+    if (sched == NULL || tick_us == 0 || frames_per_tick == 0 || frames_per_tick > PCIE_SCHED_MAX_BATCH) {
+        pcie_log("Scheduler", "Error: Invalid scheduler parameters");
+        return -1;
+    }
+
+    memset(sched, 0, sizeof(*sched));
+    sched->tick_ns = (uint64_t)tick_us * 1000;
+    sched->epoch_ns = epoch_ns;
+    sched->frames_per_tick = frames_per_tick;
+    sched->hyperperiod = 1;
+    return 0;
+}
+
+// Add a cyclic message to the static schedule
+int pcie_sched_add(pcie_sched_t *sched, uint32_t message_id, uint32_t period_us, uint32_t offset_us, uint32_t priority) {
+    if (sched == NULL) {
+        pcie_log("Scheduler", "Error: Invalid scheduler pointer");
+        return -1;
+    }
+
+    uint64_t tick_us = sched->tick_ns / 1000;
+    if (period_us == 0 || period_us % tick_us != 0 || offset_us % tick_us != 0 || offset_us >= period_us) {
+        pcie_log("Scheduler", "Error: Period and offset must be multiples of the tick, offset below period");
+        return -1;
+    }
+    if (sched->entry_count == PCIE_SCHED_MAX_ENTRIES) {
+        pcie_log("Scheduler", "Error: Schedule table full");
+        return -1;
+    }
+
+    uint32_t slot = index_slot(sched, message_id);
+    if (sched->index[slot] != 0) {
+        pcie_log("Scheduler", "Error: Message already scheduled");
+        return -1;
+    }
+
+    uint32_t period = (uint32_t)(period_us / tick_us);
+    uint32_t offset = (uint32_t)(offset_us / tick_us);
+    uint64_t hyperperiod = (uint64_t)sched->hyperperiod / gcd(sched->hyperperiod, period) * period;
+    if (hyperperiod > PCIE_SCHED_MAX_HYPERPERIOD) {
+        pcie_log("Scheduler", "Error: Hyperperiod of the schedule too long");
+        return -1;
+    }
+
+    // Repeat the current load pattern over the longer hyperperiod
+    for (uint32_t k = sched->hyperperiod; k < hyperperiod; k++) {
+        sched->load[k] = sched->load[k % sched->hyperperiod];
+    }
+
+    // Check every tick the message occupies before committing anything
+    for (uint32_t k = offset; k < hyperperiod; k += period) {
+        if (sched->load[k] + 1u > sched->frames_per_tick) {
+            pcie_log("Scheduler", "Error: Schedule exceeds the frame budget of a tick");
+            return -1;
+        }
+    }
+    for (uint32_t k = offset; k < hyperperiod; k += period) {
+        sched->load[k]++;
+    }
+    sched->hyperperiod = (uint32_t)hyperperiod;
+
+    pcie_sched_entry_t *entry = &sched->entries[sched->entry_count];
+    memset(entry, 0, sizeof(*entry));
+    entry->message_id = message_id;
+    entry->period = period;
+    entry->offset = offset;
+    entry->priority = priority;
+    sched->index[slot] = (uint16_t)++sched->entry_count;
+    return 0;
+}
+
+// Publish the latest value of a scheduled message
+int pcie_sched_update(pcie_sched_t *sched, const pcie_message_t *msg) {
+    if (sched == NULL || msg == NULL) {
+        pcie_log("Scheduler", "Error: Invalid pointers for schedule update");
+        return -1;
+    }
+
+    uint32_t slot = index_slot(sched, msg->message_id);
+    if (sched->index[slot] == 0) {
+        pcie_log("Scheduler", "Error: Message is not in the schedule");
+        return -1;
+    }
+
+    pcie_sched_entry_t *entry = &sched->entries[sched->index[slot] - 1];
+    entry->msg = *msg;
+    entry->msg.priority = entry->priority;
+    entry->valid = 1;
+    return 0;
+}
+
+// Queue a sporadic message for the slack of the next ticks
+int pcie_sched_submit(pcie_sched_t *sched, const pcie_message_t *msg) {
+    if (sched == NULL || msg == NULL) {
+        pcie_log("Scheduler", "Error: Invalid pointers for sporadic submit");
+        return -1;
+    }
+    if (sched->sporadic_head - sched->sporadic_tail == PCIE_SCHED_SPORADIC_DEPTH) {
+        sched->stats.sporadic_dropped++;
+        return PCIE_SCHED_FULL;
+    }
+    sched->sporadic[sched->sporadic_head++ & SCHED_SPORADIC_MASK] = *msg;
+    return 0;
+}
+
+// Static frames due in a tick
+uint32_t pcie_sched_static_load(const pcie_sched_t *sched, uint64_t tick) {
+    return sched->load[tick % sched->hyperperiod];
+}
+
+// Absolute time of the next tick to process
+uint64_t pcie_sched_next_tick_ns(const pcie_sched_t *sched) {
+    return sched->epoch_ns + sched->next_tick * sched->tick_ns;
+}
+
+// Emit the batch of the latest due tick
+int pcie_sched_poll(pcie_sched_t *sched, uint64_t now_ns, pcie_sched_sink_t sink, void *context) {
+    if (sched == NULL || sink == NULL) {
+        pcie_log("Scheduler", "Error: Invalid pointers for schedule poll");
+        return -1;
+    }
+    if (now_ns < sched->epoch_ns) {
+        return 0;
+    }
+
+    uint64_t tick = (now_ns - sched->epoch_ns) / sched->tick_ns;
+    if (!sched->started) {
+        sched->started = 1;
+        sched->next_tick = tick;
+    }
+    if (tick < sched->next_tick) {
+        return 0;
+    }
+    sched->stats.missed_ticks += tick - sched->next_tick;
+    sched->next_tick = tick + 1;
+    sched->stats.ticks++;
+
+    // Static segment: every message due in this tick, in table order
+    size_t count = 0;
+    for (uint32_t i = 0; i < sched->entry_count; i++) {
+        pcie_sched_entry_t *entry = &sched->entries[i];
+        if (tick % entry->period != entry->offset) {
+            continue;
+        }
+        if (!entry->valid) {
+            sched->stats.stale++;
+            continue;
+        }
+        sched->batch[count++] = entry->msg;
+        entry->emitted++;
+    }
+    size_t static_count = count;
+
+    // Sporadic traffic fills whatever budget the static segment left
+    while (count < sched->frames_per_tick && sched->sporadic_tail != sched->sporadic_head) {
+        sched->batch[count++] = sched->sporadic[sched->sporadic_tail++ & SCHED_SPORADIC_MASK];
+    }
+    if (sched->sporadic_tail != sched->sporadic_head) {
+        sched->stats.sporadic_deferred++;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+    int sent = sink(sched->batch, count, context);
+    if (sent < 0) {
+        sent = 0;
+    }
+    if ((size_t)sent < count) {
+        // Sporadic frames the sink did not take go back to the front of the
+        // queue; their slots are untouched since nothing was submitted in
+        // between. Unsent cyclic values are superseded by the next period.
+        size_t sent_static = (size_t)sent < static_count ? (size_t)sent : static_count;
+        size_t sent_sporadic = (size_t)sent - sent_static;
+        sched->sporadic_tail -= (uint32_t)(count - static_count - sent_sporadic);
+        sched->stats.static_frames += sent_static;
+        sched->stats.sporadic_frames += sent_sporadic;
+        sched->stats.static_dropped += static_count - sent_static;
+        sched->stats.sink_errors++;
+        return -1;
+    }
+
+    sched->stats.static_frames += static_count;
+    sched->stats.sporadic_frames += count - static_count;
+    return (int)count;
+}
+
+// Send a batch over the PCIe client, stopping at the first failure
+int pcie_sched_client_sink(const pcie_message_t *msgs, size_t count, void *context) {
+    (void)context;
+    size_t sent = 0;
+    while (sent < count) {
+        // Frames discarded by the overflow policy are counted by the flow layer
+        if (pcie_client_send_buffer(&msgs[sent], sizeof(pcie_message_t), msgs[sent].priority) < 0) {
+            break;
+        }
+        sent++;
+    }
+    return (int)sent;
+}
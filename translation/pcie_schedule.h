@@ -0,0 +1,127 @@
+#ifndef PCIE_SCHEDULE_H
+#define PCIE_SCHEDULE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pcie_translation.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Time-triggered transmission scheduler for cyclic traffic.
+//
+// Time is divided into ticks counted from a common epoch, so gateways whose
+// clocks are synchronized tick together. A static schedule, like a FlexRay
+// static segment or a TSN gate control list, assigns each cyclic message a
+// period and an offset in ticks. Producers only update the latest value of
+// a message; at every tick the scheduler emits all messages due in that tick
+// as one batch, in table order, followed by queued sporadic messages up to
+// the per-tick frame budget. A schedule that could exceed the budget in any
+// tick of the hyperperiod is rejected when it is built, so the remaining
+// slack is always available to sporadic traffic.
+//
+// A scheduler is owned by one gateway thread; it does no locking.
+
+// Scheduled messages per scheduler
+#define PCIE_SCHED_MAX_ENTRIES 256
+
+// Upper bound of the per-tick frame budget
+#define PCIE_SCHED_MAX_BATCH 64
+
+// Longest hyperperiod (least common multiple of all periods) in ticks
+#define PCIE_SCHED_MAX_HYPERPERIOD 4096
+
+// Sporadic messages waiting for slack (power of two)
+#define PCIE_SCHED_SPORADIC_DEPTH 256
+
+// Return code of pcie_sched_submit() when the sporadic queue is full
+#define PCIE_SCHED_FULL 1
+
+// One cyclic message of the static schedule
+typedef struct {
+    uint32_t message_id;
+    uint32_t period;          // In ticks
+    uint32_t offset;          // In ticks, below the period
+    uint32_t priority;
+    uint8_t valid;            // A value has been published
+    pcie_message_t msg;       // Latest value, re-sent every period
+    uint64_t emitted;
+} pcie_sched_entry_t;
+
+typedef struct {
+    uint64_t ticks;           // Ticks processed
+    uint64_t missed_ticks;    // Ticks skipped because poll ran late
+    uint64_t static_frames;   // Cyclic frames emitted
+    uint64_t stale;           // Due slots skipped because no value was published yet
+    uint64_t sporadic_frames; // Sporadic frames emitted in slack
+    uint64_t sporadic_deferred;  // Ticks that ended with sporadic frames still queued
+    uint64_t sporadic_dropped;   // Submissions rejected on a full queue
+    uint64_t static_dropped;  // Cyclic frames the sink failed to send
+    uint64_t sink_errors;     // Batches the sink failed to send completely
+} pcie_sched_stats_t;
+
+typedef struct {
+    uint64_t tick_ns;
+    uint64_t epoch_ns;        // Start of tick 0
+    uint32_t frames_per_tick; // Link budget per tick, static and sporadic
+    uint64_t next_tick;       // Next tick index to process
+    int started;              // The first poll has fixed next_tick
+
+    pcie_sched_entry_t entries[PCIE_SCHED_MAX_ENTRIES];
+    uint32_t entry_count;
+    uint16_t index[2 * PCIE_SCHED_MAX_ENTRIES];   // Message ID hash -> entry + 1
+
+    uint32_t hyperperiod;     // In ticks
+    uint8_t load[PCIE_SCHED_MAX_HYPERPERIOD];     // Static frames per tick of the hyperperiod
+
+    pcie_message_t sporadic[PCIE_SCHED_SPORADIC_DEPTH];
+    uint32_t sporadic_head;
+    uint32_t sporadic_tail;
+
+    pcie_message_t batch[PCIE_SCHED_MAX_BATCH];
+    pcie_sched_stats_t stats;
+} pcie_sched_t;
+
+// Receives the batch of one tick; returns the number of frames it sent from
+// the start of the batch, count on success. Fewer (or -1) means the
+// remaining frames were not sent.
+typedef int (*pcie_sched_sink_t)(const pcie_message_t *msgs, size_t count, void *context);
+
+// Initialize an empty schedule with ticks of tick_us starting at epoch_ns
+int pcie_sched_init(pcie_sched_t *sched, uint32_t tick_us, uint32_t frames_per_tick, uint64_t epoch_ns);
+
+// Add a cyclic message; period and offset must be multiples of the tick.
+// Fails if the message is already scheduled, the hyperperiod gets too long
+// or any tick would exceed the frame budget.
+int pcie_sched_add(pcie_sched_t *sched, uint32_t message_id, uint32_t period_us, uint32_t offset_us, uint32_t priority);
+
+// Publish the latest value of a scheduled message (looked up by message_id)
+int pcie_sched_update(pcie_sched_t *sched, const pcie_message_t *msg);
+
+// Queue a sporadic message for the slack of the next ticks
+int pcie_sched_submit(pcie_sched_t *sched, const pcie_message_t *msg);
+
+// Static frames due in a tick
+uint32_t pcie_sched_static_load(const pcie_sched_t *sched, uint64_t tick);
+
+// Absolute time of the next tick to process
+uint64_t pcie_sched_next_tick_ns(const pcie_sched_t *sched);
+
+// Process the latest tick that started at or before now_ns and hand its
+// batch to the sink. Ticks missed in between are counted, not replayed, so a
+// late gateway does not burst stale cyclic values. Returns the number of
+// frames emitted, 0 if no tick was due, or -1 if the sink failed. Sporadic
+// frames the sink did not send are queued again for the next tick; cyclic
+// frames are counted as dropped, the next period carries their value.
+int pcie_sched_poll(pcie_sched_t *sched, uint64_t now_ns, pcie_sched_sink_t sink, void *context);
+
+// Sink sending the frames of a batch with pcie_client_send_buffer() until
+// one fails; frames discarded by the overflow policy count as sent
+int pcie_sched_client_sink(const pcie_message_t *msgs, size_t count, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PCIE_SCHEDULE_H
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "pcie_common.h"
+#include "pcie_signal_store.h"
+
+// Entries are padded to whole cache lines
+#define SIGNAL_ENTRY_SIZE (((sizeof(pcie_signal_entry_t) + 63) & ~(size_t)63))
+
+// How long a reader retries before reporting PCIE_SIGNAL_BUSY. An update
+// takes well under a microsecond, so a reader only runs out of time if the
+// same entry (or, for snapshots, the store) is rewritten constantly.
+#define SIGNAL_RETRY_NS 10000
+
+// First entry of each bus type within a zone
+#define SIGNAL_CAN_BASE 0
+#define SIGNAL_LIN_BASE (SIGNAL_CAN_BASE + PCIE_SIGNAL_CAN_IDS)
+#define SIGNAL_FLEXRAY_BASE (SIGNAL_LIN_BASE + PCIE_SIGNAL_LIN_IDS)
+#define SIGNAL_ENTRIES_PER_ZONE (SIGNAL_FLEXRAY_BASE + PCIE_SIGNAL_FLEXRAY_IDS)
+
+// Entry of a key, NULL if the key has no entry
+static pcie_signal_entry_t *entry_for(const pcie_signal_store_t *store, uint32_t zone_id,
+                                      bus_message_type_t type, uint32_t message_id) {
+    uint32_t base;
+    uint32_t ids;
+
+    switch (type) {
+        case MSG_TYPE_CAN:
+            base = SIGNAL_CAN_BASE;
+            ids = PCIE_SIGNAL_CAN_IDS;
+            break;
+        case MSG_TYPE_LIN:
+            base = SIGNAL_LIN_BASE;
+            ids = PCIE_SIGNAL_LIN_IDS;
+            break;
+        case MSG_TYPE_FLEXRAY:
+            base = SIGNAL_FLEXRAY_BASE;
+            ids = PCIE_SIGNAL_FLEXRAY_IDS;
+            break;
+        default:
+            return NULL;
+    }
+    if (zone_id >= store->zone_count || message_id >= ids) {
+        return NULL;
+    }
+
+    size_t index = (size_t)zone_id * store->entries_per_zone + base + message_id;
+    return (pcie_signal_entry_t *)(store->entries + index * store->entry_size);
+}
+
+// Allocate an empty table
+int pcie_signal_store_init(pcie_signal_store_t *store, uint32_t zone_count) {
+    if (store == NULL || zone_count == 0) {
+        pcie_log("SignalStore", "Error: Invalid arguments for store initialization.");
+        return -1;
+    }
+    memset(store, 0, sizeof(*store));
+
+    size_t size = (size_t)zone_count * SIGNAL_ENTRIES_PER_ZONE * SIGNAL_ENTRY_SIZE;
+    store->entries = (uint8_t *)aligned_alloc(64, size);
+    if (store->entries == NULL) {
+        pcie_log("SignalStore", "Error: Failed to allocate the signal table.");
+        return -1;
+    }
+    memset(store->entries, 0, size);
+    store->entry_size = SIGNAL_ENTRY_SIZE;
+    store->zone_count = zone_count;
+    store->entries_per_zone = SIGNAL_ENTRIES_PER_ZONE;
+    return 0;
+}
+
+void pcie_signal_store_destroy(pcie_signal_store_t *store) {
+    if (store == NULL) {
+        return;
+    }
+    free(store->entries);
+    store->entries = NULL;
+    store->zone_count = 0;
+}
+
+// Overwrite the entry of a message
+int pcie_signal_store_update(pcie_signal_store_t *store, const bus_message_t *msg, uint32_t zone_id, uint32_t device_id) {
+    if (store == NULL || store->entries == NULL || msg == NULL) {
+        pcie_log("SignalStore", "Error: Store not initialized for updates.");
+        return -1;
+    }
+
+    uint32_t message_id;
+    if (pcie_bus_message_id(msg, &message_id) != 0) {
+        return -1;
+    }
+    pcie_signal_entry_t *entry = entry_for(store, zone_id, msg->type, message_id);
+    if (entry == NULL) {
+        store->stats.ignored++;
+        return PCIE_SIGNAL_IGNORED;
+    }
+
+    // The writer owns both counters, readers only compare them. Mark the
+    // store and the entry as being written, fill the entry, then commit.
+    // The clock is read first to keep the window readers wait on short.
+    uint64_t now = pcie_time_ns();
+    uint64_t sequence = store->sequence;
+    uint64_t seq = entry->seq;
+    pcie_store_release(&store->sequence, sequence + 1);
+    pcie_store_release(&entry->seq, seq + 1);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    entry->update_ns = now;
+    entry->updates++;
+    entry->device_id = device_id;
+    entry->message = *msg;
+    pcie_store_release(&entry->seq, seq + 2);
+    pcie_store_release(&store->sequence, sequence + 2);
+
+    store->stats.updates++;
+    return 0;
+}
+
+// Receive one message from the link and store it
+int pcie_signal_store_receive(pcie_signal_store_t *store) {
+    bus_message_t msg;
+    uint32_t zone_id = 0;
+    uint32_t device_id = 0;
+
+    int ret = pcie_receive_bus_message(&msg, &zone_id, &device_id);
+    if (ret != 0) {
+        return ret;
+    }
+    return pcie_signal_store_update(store, &msg, zone_id, device_id);
+}
+
+// Number of updates so far
+uint64_t pcie_signal_store_version(const pcie_signal_store_t *store) {
+    if (store == NULL) {
+        return 0;
+    }
+    return pcie_load_acquire(&store->sequence) / 2;
+}
+
+static void copy_entry(const pcie_signal_entry_t *entry, uint32_t zone_id, pcie_signal_t *value) {
+    value->update_ns = entry->update_ns;
+    value->updates = entry->updates;
+    value->zone_id = zone_id;
+    value->device_id = entry->device_id;
+    value->status = value->update_ns != 0 ? 0 : PCIE_SIGNAL_NONE;
+    value->message = entry->message;
+}
+
+// Value without data: never updated, or the writer did not let go
+static int empty_value(uint32_t zone_id, int status, pcie_signal_t *value) {
+    memset(value, 0, sizeof(*value));
+    value->zone_id = zone_id;
+    value->status = status;
+    return status;
+}
+
+// Pause before another attempt; returns 0 once the reader ran out of time.
+// The clock is only read once a first attempt failed.
+static int retry_wait(uint64_t *deadline_ns) {
+    uint64_t now = pcie_time_ns();
+    if (*deadline_ns == 0) {
+        *deadline_ns = now + SIGNAL_RETRY_NS;
+    } else if (now >= *deadline_ns) {
+        return 0;
+    }
+    pcie_cpu_relax();
+    return 1;
+}
+
+// Copy one entry; returns 0, PCIE_SIGNAL_NONE or PCIE_SIGNAL_BUSY
+static int read_entry(const pcie_signal_entry_t *entry, uint32_t zone_id, pcie_signal_t *value) {
+    uint64_t deadline = 0;
+    do {
+        uint64_t seq = pcie_load_acquire(&entry->seq);
+        if (seq == 0) {
+            return empty_value(zone_id, PCIE_SIGNAL_NONE, value);
+        }
+        if ((seq & 1) == 0) {
+            copy_entry(entry, zone_id, value);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+            // Only accept the copy if the writer did not touch it meanwhile
+            if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == seq) {
+                return 0;
+            }
+        }
+    } while (retry_wait(&deadline));
+    return empty_value(zone_id, PCIE_SIGNAL_BUSY, value);
+}
+
+// Latest value of one entry
+int pcie_signal_store_get(const pcie_signal_store_t *store, uint32_t zone_id, bus_message_type_t type,
+                          uint32_t message_id, pcie_signal_t *value) {
+    if (store == NULL || store->entries == NULL || value == NULL) {
+        pcie_log("SignalStore", "Error: Store not initialized for reading.");
+        return -1;
+    }
+
+    const pcie_signal_entry_t *entry = entry_for(store, zone_id, type, message_id);
+    if (entry == NULL) {
+        pcie_log("SignalStore", "Error: Key has no entry in the signal table.");
+        return -1;
+    }
+    return read_entry(entry, zone_id, value);
+}
+
+// Read several entries as of one point in time
+int pcie_signal_store_snapshot(const pcie_signal_store_t *store, const pcie_signal_key_t *keys, size_t count,
+                               pcie_signal_t *values) {
+    if (store == NULL || store->entries == NULL || (count > 0 && (keys == NULL || values == NULL))) {
+        pcie_log("SignalStore", "Error: Store not initialized for reading.");
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (entry_for(store, keys[i].zone_id, keys[i].type, keys[i].message_id) == NULL) {
+            pcie_log("SignalStore", "Error: Key has no entry in the signal table.");
+            return -1;
+        }
+    }
+
+    // No update may start or finish while the entries are copied
+    uint64_t deadline = 0;
+    do {
+        uint64_t sequence = pcie_load_acquire(&store->sequence);
+        if (sequence & 1) {
+            continue;
+        }
+        for (size_t i = 0; i < count; i++) {
+            const pcie_signal_entry_t *entry = entry_for(store, keys[i].zone_id, keys[i].type, keys[i].message_id);
+            copy_entry(entry, keys[i].zone_id, &values[i]);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&store->sequence, __ATOMIC_RELAXED) == sequence) {
+            return 0;
+        }
+    } while (retry_wait(&deadline));
+
+    // The writer never paused: fall back to individually consistent
+    // entries, each with its own status
+    for (size_t i = 0; i < count; i++) {
+        const pcie_signal_entry_t *entry = entry_for(store, keys[i].zone_id, keys[i].type, keys[i].message_id);
+        read_entry(entry, keys[i].zone_id, &values[i]);
+    }
+    return PCIE_SIGNAL_BUSY;
+}
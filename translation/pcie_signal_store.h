@@ -0,0 +1,120 @@
+#ifndef PCIE_SIGNAL_STORE_H
+#define PCIE_SIGNAL_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pcie_translation.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Last-value store of the bus messages received on the central node.
+//
+// Consumers that only need the current value of a message look it up here
+// instead of following the receive stream themselves. The RX path is the
+// only writer: every CAN, LIN and FlexRay message it receives overwrites the
+// entry for (zone_id, bus type, message_id) in a dense table, so lookups are
+// a single index computation. Ethernet frames and extended CAN IDs have no
+// entry and are ignored.
+//
+// Readers never write to the table and never delay the writer: each entry
+// carries a sequence counter (see pcie_common.h) and a read retries while
+// the entry changes under it. A store-wide counter of the same kind lets a
+// reader take a snapshot of several entries from the same point in time.
+
+// Message IDs with an entry, per bus type
+#define PCIE_SIGNAL_CAN_IDS 2048         // 11-bit identifiers
+#define PCIE_SIGNAL_LIN_IDS 64           // 6-bit identifiers
+#define PCIE_SIGNAL_FLEXRAY_IDS 2048     // Static and dynamic slots
+
+// Return code of the read functions for an entry that was never updated
+#define PCIE_SIGNAL_NONE 1
+
+// Return code of the read functions when the writer kept changing the data
+// for longer than readers retry (a few microseconds)
+#define PCIE_SIGNAL_BUSY 2
+
+// Return code of pcie_signal_store_update() for messages without an entry
+// (distinct from PCIE_FLOW_EMPTY, see pcie_signal_store_receive())
+#define PCIE_SIGNAL_IGNORED 3
+
+// Key of one entry
+typedef struct {
+    uint32_t zone_id;
+    bus_message_type_t type;
+    uint32_t message_id;
+} pcie_signal_key_t;
+
+// One table entry; the table stride is rounded up to whole cache lines
+typedef struct {
+    uint64_t seq;                // Odd while written, even once committed, 0 = never written
+    uint64_t update_ns;          // Time of the last update (monotonic clock)
+    uint64_t updates;            // Updates since the store was created
+    uint32_t device_id;
+    uint32_t reserved;
+    bus_message_t message;
+} pcie_signal_entry_t;
+
+// Value of an entry as delivered to a reader
+typedef struct {
+    uint64_t update_ns;          // 0 if the entry was never updated
+    uint64_t updates;
+    uint32_t zone_id;
+    uint32_t device_id;
+    int status;                  // 0, PCIE_SIGNAL_NONE or PCIE_SIGNAL_BUSY (no value read)
+    bus_message_t message;
+} pcie_signal_t;
+
+typedef struct {
+    uint64_t updates;            // Messages stored
+    uint64_t ignored;            // Messages without an entry (Ethernet, ID out of range)
+} pcie_signal_store_stats_t;
+
+typedef struct {
+    // Written by the writer only
+    uint64_t sequence;           // Store-wide counter: 2 * updates, odd during an update
+    pcie_signal_store_stats_t stats;
+    uint8_t pad[40];
+    // Read-only after init, on a line of their own
+    uint8_t *entries;
+    size_t entry_size;
+    uint32_t zone_count;
+    uint32_t entries_per_zone;
+} pcie_signal_store_t;
+
+// Allocate an empty table for zones 0 .. zone_count-1
+int pcie_signal_store_init(pcie_signal_store_t *store, uint32_t zone_count);
+
+void pcie_signal_store_destroy(pcie_signal_store_t *store);
+
+// Overwrite the entry of a message (single writer, the RX path). Returns 0,
+// PCIE_SIGNAL_IGNORED for messages without an entry or -1.
+int pcie_signal_store_update(pcie_signal_store_t *store, const bus_message_t *msg, uint32_t zone_id, uint32_t device_id);
+
+// Receive one message with pcie_receive_bus_message() and store it;
+// returns 0, PCIE_SIGNAL_IGNORED, PCIE_FLOW_EMPTY or -1
+int pcie_signal_store_receive(pcie_signal_store_t *store);
+
+// Number of updates so far; readers that poll can skip work while it is unchanged
+uint64_t pcie_signal_store_version(const pcie_signal_store_t *store);
+
+// Latest value of one entry. Returns 0, PCIE_SIGNAL_NONE, PCIE_SIGNAL_BUSY
+// or -1 for a key outside the table.
+int pcie_signal_store_get(const pcie_signal_store_t *store, uint32_t zone_id, bus_message_type_t type,
+                          uint32_t message_id, pcie_signal_t *value);
+
+// Read count entries as of one point in time: no update happened between
+// the first and the last copy. Entries that were never updated have an
+// update_ns of 0 and status PCIE_SIGNAL_NONE. Returns 0, -1 for a key
+// outside the table, or PCIE_SIGNAL_BUSY if the writer never paused long
+// enough. The entries are then read one by one and may be from different
+// updates; check each status, an entry with PCIE_SIGNAL_BUSY has no value.
+int pcie_signal_store_snapshot(const pcie_signal_store_t *store, const pcie_signal_key_t *keys, size_t count,
+                               pcie_signal_t *values);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PCIE_SIGNAL_STORE_H
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include "pcie_common.h"
 #include "pcie_client.h"
+#include "pcie_trace.h"
 #include "pcie_translation.h"
 
 // Get current timestamp in microseconds
@@ -20,6 +21,7 @@ int translate_can_to_pcie(const can_message_t *can_msg, pcie_message_t *pcie_msg
         pcie_log("Translator", "Error: Invalid pointers for CAN to PCIe translation");
         return -1;
     }
+    PCIE_TRACE2(can_to_pcie_entry, can_msg->can_id, zone_id);
 
     // Fill in PCIe message header
     pcie_msg->zone_id = zone_id;
@@ -35,6 +37,7 @@ int translate_can_to_pcie(const can_message_t *can_msg, pcie_message_t *pcie_msg
     // Copy the CAN message data
     memcpy(&(pcie_msg->bus_message.data.can), can_msg, sizeof(can_message_t));
 
+    PCIE_TRACE4(can_to_pcie_return, pcie_msg->message_id, zone_id, pcie_msg->bus_message.timestamp, 0);
     return 0;
 }
 
@@ -44,19 +47,43 @@ int translate_pcie_to_can(const pcie_message_t *pcie_msg, can_message_t *can_msg
         pcie_log("Translator", "Error: Invalid pointers for PCIe to CAN translation");
         return -1;
     }
+    PCIE_TRACE3(pcie_to_can_entry, pcie_msg->message_id, pcie_msg->zone_id, pcie_msg->bus_message.timestamp);
 
     // Check if the message type is CAN
     if (pcie_msg->bus_message.type != MSG_TYPE_CAN) {
         pcie_log("Translator", "Error: PCIe message is not a CAN message");
+        PCIE_TRACE3(pcie_to_can_return, pcie_msg->message_id, pcie_msg->zone_id, -1);
         return -1;
     }
 
     // Copy the CAN message data from the PCIe message
     memcpy(can_msg, &(pcie_msg->bus_message.data.can), sizeof(can_message_t));
 
+    PCIE_TRACE3(pcie_to_can_return, pcie_msg->message_id, pcie_msg->zone_id, 0);
     return 0;
 }
 
+// Routing message ID of a bus message
+int pcie_bus_message_id(const bus_message_t *msg, uint32_t *message_id) {
+    switch (msg->type) {
+        case MSG_TYPE_CAN:
+            *message_id = msg->data.can.can_id;
+            return 0;
+        case MSG_TYPE_LIN:
+            *message_id = msg->data.lin.lin_id;
+            return 0;
+        case MSG_TYPE_FLEXRAY:
+            *message_id = msg->data.flexray.frame_id;
+            return 0;
+        case MSG_TYPE_ETHERNET:
+            *message_id = msg->data.ethernet.ethertype;
+            return 0;
+        default:
+            pcie_log("Translator", "Error: Unknown bus message type");
+            return -1;
+    }
+}
+
 // Send a bus message over PCIe
 int pcie_send_bus_message(const bus_message_t *msg, uint32_t zone_id, uint32_t device_id, uint32_t priority) {
     if (msg == NULL) {
@@ -72,35 +99,21 @@ int pcie_send_bus_message(const bus_message_t *msg, uint32_t zone_id, uint32_t d
     pcie_msg.payload_size = sizeof(bus_message_t);
     
     // Set the message ID based on the bus message type
-    switch (msg->type) {
-        case MSG_TYPE_CAN:
-            pcie_msg.message_id = msg->data.can.can_id;
-            break;
-        case MSG_TYPE_LIN:
-            pcie_msg.message_id = msg->data.lin.lin_id;
-            break;
-        case MSG_TYPE_FLEXRAY:
-            pcie_msg.message_id = msg->data.flexray.frame_id;
-            break;
-        case MSG_TYPE_ETHERNET:
-            pcie_msg.message_id = msg->data.ethernet.ethertype;
-            break;
-        default:
-            pcie_log("Translator", "Error: Unknown bus message type");
-            return -1;
+    if (pcie_bus_message_id(msg, &pcie_msg.message_id) != 0) {
+        return -1;
     }
     
-    // Copy the bus message
+    // Copy the bus message and stamp it with the send time unless the
+    // caller provided one (e.g. a replayed capture)
     memcpy(&(pcie_msg.bus_message), msg, sizeof(bus_message_t));
+    if (pcie_msg.bus_message.timestamp == 0) {
+        pcie_msg.bus_message.timestamp = get_timestamp_us();
+    }
     
-    // Serialize the PCIe message to a buffer
-    char buffer[1024];
-    size_t msg_size = sizeof(pcie_message_t);
-    memcpy(buffer, &pcie_msg, msg_size);
-    
-    // Send the serialized message via PCIe
-    pcie_log("Translator", "Sending bus message over PCIe");
-    return pcie_client_send(buffer);
+    // Send the message via PCIe, subject to flow control. Per-message
+    // logging is left to the tracepoints, printf is too slow for this path.
+    PCIE_TRACE4(send_enqueue, pcie_msg.message_id, zone_id, priority, pcie_msg.bus_message.timestamp);
+    return pcie_client_send_buffer(&pcie_msg, sizeof(pcie_message_t), priority);
 }
 
 // Receive a bus message from PCIe
@@ -110,26 +123,32 @@ int pcie_receive_bus_message(bus_message_t *msg, uint32_t *zone_id, uint32_t *de
         return -1;
     }
     
-    // Buffer for receiving PCIe message
-    char buffer[1024];
-    
-    // Receive raw PCIe message
-    if (pcie_client_receive(buffer, sizeof(buffer)) != 0) {
+    // Look at the raw PCIe message where the client staged it
+    const void *data = NULL;
+    size_t received = 0;
+    int ret = pcie_client_peek_buffer(&data, &received);
+    if (ret == PCIE_FLOW_EMPTY) {
+        return PCIE_FLOW_EMPTY;
+    }
+    if (ret != 0) {
         pcie_log("Translator", "Error: Failed to receive PCIe message");
         return -1;
     }
+    pcie_client_consume_buffer();
     
-    // Deserialize the PCIe message
-    pcie_message_t pcie_msg;
-    memcpy(&pcie_msg, buffer, sizeof(pcie_message_t));
-    
-    // Extract the zone and device IDs
-    *zone_id = pcie_msg.zone_id;
-    *device_id = pcie_msg.device_id;
+    if (received != sizeof(pcie_message_t)) {
+        pcie_log("Translator", "Error: Received message has unexpected size");
+        return -1;
+    }
     
-    // Extract the bus message
-    memcpy(msg, &(pcie_msg.bus_message), sizeof(bus_message_t));
+    // Extract the header fields and copy only the bus message out
+    const uint8_t *raw = (const uint8_t *)data;
+    uint32_t message_id;
+    memcpy(zone_id, raw + offsetof(pcie_message_t, zone_id), sizeof(*zone_id));
+    memcpy(device_id, raw + offsetof(pcie_message_t, device_id), sizeof(*device_id));
+    memcpy(&message_id, raw + offsetof(pcie_message_t, message_id), sizeof(message_id));
+    memcpy(msg, raw + offsetof(pcie_message_t, bus_message), sizeof(bus_message_t));
     
-    pcie_log("Translator", "Received bus message from PCIe");
+    PCIE_TRACE4(rx_dispatch, message_id, *zone_id, *device_id, msg->timestamp);
     return 0;
 }
\ No newline at end of file
@@ -4,6 +4,10 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 // Message types for different bus protocols
 typedef enum {
     MSG_TYPE_CAN,     // Controller Area Network
@@ -76,10 +80,21 @@ int translate_can_to_pcie(const can_message_t *can_msg, pcie_message_t *pcie_msg
 // Translate a PCIe message to CAN message format
 int translate_pcie_to_can(const pcie_message_t *pcie_msg, can_message_t *can_msg);
 
-// Send a bus message over PCIe
+// Routing message ID of a bus message (CAN ID, LIN ID, FlexRay frame ID or Ethertype)
+// Returns -1 for an unknown bus type
+int pcie_bus_message_id(const bus_message_t *msg, uint32_t *message_id);
+
+// Send a bus message over PCIe. A timestamp of 0 is replaced by the send
+// time (CLOCK_MONOTONIC, microseconds), so receivers can take the message age.
+// Returns PCIE_FLOW_DROPPED if the flow control policy of the priority class discarded it
 int pcie_send_bus_message(const bus_message_t *msg, uint32_t zone_id, uint32_t device_id, uint32_t priority);
 
 // Receive a bus message from PCIe
+// Returns PCIE_FLOW_EMPTY if no message arrived within the receive timeout
 int pcie_receive_bus_message(bus_message_t *msg, uint32_t *zone_id, uint32_t *device_id);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // PCIE_TRANSLATION_H
\ No newline at end of file